@@ -0,0 +1,177 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Runs the decluttering overlap pass over a frame's worth of label boxes,
+ * with the screen-space grid against testing every box that already
+ * passed. Checks that both pass exactly the same labels, including boxes
+ * off the edges of the viewport and degenerate (NaN) boxes.
+ */
+
+#include "Benchmark"
+#include <osgEarthAnnotation/ScreenSpaceGrid>
+#include <osg/Math>
+#include <osg/Viewport>
+#include <limits>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+
+namespace
+{
+    /** Label boxes in window space, in front-to-back order, with parents. */
+    struct Frame
+    {
+        std::vector<osg::BoundingBox> boxes;
+        std::vector<const osg::Node*> parents;
+    };
+
+    void createFrame( unsigned numLabels, const osg::Viewport* vp, std::vector< osg::ref_ptr<osg::Node> >& nodes, Frame& frame )
+    {
+        unsigned x = 12345u;
+        for( unsigned i = 0; i < numLabels; ++i )
+        {
+            x = x * 1664525u + 1013904223u;
+            double px = vp->x() - 100.0 + (double)(x >> 8) / (double)(1u<<24) * (vp->width() + 200.0);
+            x = x * 1664525u + 1013904223u;
+            double py = vp->y() - 50.0 + (double)(x >> 8) / (double)(1u<<24) * (vp->height() + 100.0);
+            x = x * 1664525u + 1013904223u;
+            double w = 40.0 + (x >> 25);
+            double h = 12.0 + ((x >> 20) & 15);
+
+            osg::BoundingBox box( px, py, 0.0, px + w, py + h, 0.0 );
+
+            // now and then a projection goes bad:
+            if ( i % 997 == 500 )
+                box.xMin() = std::numeric_limits<float>::quiet_NaN();
+
+            // an icon and its text share a parent:
+            if ( i % 2 == 0 )
+                nodes.push_back( new osg::Node() );
+
+            frame.boxes.push_back( box );
+            frame.parents.push_back( nodes.back().get() );
+        }
+    }
+
+    /** The test the grid replaced. */
+    bool overlapsLinear( const osg::BoundingBox& box, const osg::Node* parent, const std::vector<RenderLeafBox>& used )
+    {
+        for( unsigned i = 0; i < used.size(); ++i )
+        {
+            bool isClear =
+                box.xMin() > used[i].second.xMax() ||
+                box.xMax() < used[i].second.xMin() ||
+                box.yMin() > used[i].second.yMax() ||
+                box.yMax() < used[i].second.yMin();
+
+            if ( !isClear && parent != used[i].first )
+                return true;
+        }
+        return false;
+    }
+
+    void declutterLinear( const Frame& frame, std::vector<RenderLeafBox>& used, std::vector<bool>& passed )
+    {
+        used.clear();
+        passed.assign( frame.boxes.size(), false );
+        for( unsigned i = 0; i < frame.boxes.size(); ++i )
+        {
+            if ( !overlapsLinear(frame.boxes[i], frame.parents[i], used) )
+            {
+                used.push_back( std::make_pair(frame.parents[i], frame.boxes[i]) );
+                passed[i] = true;
+            }
+        }
+    }
+
+    void declutterGrid( const Frame& frame, const osg::Viewport* vp, ScreenSpaceGrid& grid, std::vector<RenderLeafBox>& used, std::vector<bool>& passed )
+    {
+        used.clear();
+        grid.reset( vp );
+        passed.assign( frame.boxes.size(), false );
+        for( unsigned i = 0; i < frame.boxes.size(); ++i )
+        {
+            if ( !grid.overlaps(frame.boxes[i], frame.parents[i], used) )
+            {
+                grid.insert( used.size(), frame.boxes[i] );
+                used.push_back( std::make_pair(frame.parents[i], frame.boxes[i]) );
+                passed[i] = true;
+            }
+        }
+    }
+}
+
+
+int
+declutter( osg::ArgumentParser& args )
+{
+    unsigned numLabels = 10000;
+    args.read( "--labels", numLabels );
+    unsigned numFrames = 10;
+    args.read( "--frames", numFrames );
+
+    osg::ref_ptr<osg::Viewport> vp = new osg::Viewport( 0, 0, 1920, 1080 );
+
+    std::vector< osg::ref_ptr<osg::Node> > nodes;
+    Frame frame;
+    createFrame( numLabels, vp.get(), nodes, frame );
+
+    std::vector<RenderLeafBox> used;
+    std::vector<bool>          linearPassed, gridPassed;
+
+    Benchmark::Stopwatch t;
+    for( unsigned f = 0; f < numFrames; ++f )
+        declutterLinear( frame, used, linearPassed );
+    double linearTime = t.seconds();
+    Benchmark::report( "overlap test, every passed box", linearTime, numFrames * numLabels, "labels" );
+
+    ScreenSpaceGrid grid;
+    t.reset();
+    for( unsigned f = 0; f < numFrames; ++f )
+        declutterGrid( frame, vp.get(), grid, used, gridPassed );
+    double gridTime = t.seconds();
+    Benchmark::report( "overlap test, screen-space grid", gridTime, numFrames * numLabels, "labels" );
+    Benchmark::speedup( "grid vs. every passed box", linearTime, gridTime );
+
+    unsigned numPassed = 0;
+    for( unsigned i = 0; i < gridPassed.size(); ++i )
+        if ( gridPassed[i] ) ++numPassed;
+    std::cout << "  labels passed: " << numPassed << " of " << numLabels << std::endl;
+
+    BENCH_CHECK( gridPassed == linearPassed );
+    BENCH_CHECK( numPassed > 0 && numPassed < numLabels );
+    if ( numLabels >= 2000 )
+    {
+        BENCH_CHECK( gridTime < linearTime );
+    }
+
+    // a viewport that doesn't start at the origin, and one too big for the grid:
+    osg::ref_ptr<osg::Viewport> offset = new osg::Viewport( 300, 200, 800, 600 );
+    declutterLinear( frame, used, linearPassed );
+    declutterGrid( frame, offset.get(), grid, used, gridPassed );
+    BENCH_CHECK( gridPassed == linearPassed );
+
+    osg::ref_ptr<osg::Viewport> huge = new osg::Viewport( 0, 0, 16384, 16384 );
+    declutterGrid( frame, huge.get(), grid, used, gridPassed );
+    BENCH_CHECK( gridPassed == linearPassed );
+
+    return 0;
+}
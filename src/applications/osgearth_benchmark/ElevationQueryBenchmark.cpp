@@ -0,0 +1,225 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Runs batched elevation queries against a synthetic elevation layer whose
+ * tiles take a fixed time to "read", fetching the missing tiles with one
+ * thread and with the query's task service. Checks the sampled heights
+ * against the analytic surface, and that a batch containing points that
+ * cannot be transformed still answers the points that can.
+ */
+
+#include "Benchmark"
+#include <osgEarth/ElevationQuery>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osgEarth/TileSource>
+#include <OpenThreads/Thread>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace
+{
+    const int    TILE_SIZE  = 32;
+    const int    DELAY_MS   = 5;
+    const double TOLERANCE  = 0.01;
+    const double NO_VALUE   = -12345.0;
+
+    /** Linear, so bilinear sampling reproduces it exactly. */
+    double surface( double lon, double lat )
+    {
+        return 100.0 + 2.0*lon + 3.0*lat;
+    }
+
+    /** Serves the surface, pretending each tile costs a disk or network read. */
+    class SurfaceTileSource : public TileSource
+    {
+    public:
+        SurfaceTileSource( const TileSourceOptions& options ) : TileSource( options ) { }
+
+        Status initialize( const osgDB::Options* dbOptions )
+        {
+            setProfile( Registry::instance()->getGlobalGeodeticProfile() );
+            return STATUS_OK;
+        }
+
+        osg::Image* createImage( const TileKey& key, ProgressCallback* progress )
+        {
+            return 0L;
+        }
+
+        osg::HeightField* createHeightField( const TileKey& key, ProgressCallback* progress )
+        {
+            OpenThreads::Thread::microSleep( DELAY_MS * 1000 );
+
+            const GeoExtent& ex = key.getExtent();
+            osg::HeightField* hf = new osg::HeightField();
+            hf->allocate( TILE_SIZE, TILE_SIZE );
+            double dx = ex.width()  / (double)(TILE_SIZE-1);
+            double dy = ex.height() / (double)(TILE_SIZE-1);
+            for( int c = 0; c < TILE_SIZE; ++c )
+                for( int r = 0; r < TILE_SIZE; ++r )
+                    hf->setHeight( c, r, (float)surface(ex.xMin() + dx*(double)c, ex.yMin() + dy*(double)r) );
+            return hf;
+        }
+
+        CachePolicy getCachePolicyHint() const
+        {
+            return CachePolicy::NO_CACHE;
+        }
+    };
+
+    /** A grid of points spread over a lon/lat box, several per tile. */
+    void makeGrid( double lon0, double lat0, double size, unsigned n, std::vector<osg::Vec3d>& out )
+    {
+        for( unsigned i = 0; i < n; ++i )
+            for( unsigned j = 0; j < n; ++j )
+                out.push_back( osg::Vec3d(lon0 + size*((double)i+0.5)/(double)n, lat0 + size*((double)j+0.5)/(double)n, NO_VALUE) );
+    }
+
+    /** Number of points whose height matches the surface at (lon, lat). */
+    unsigned countCorrect( const std::vector<osg::Vec3d>& points, const std::vector<osg::Vec3d>& lonLat )
+    {
+        unsigned n = 0;
+        for( unsigned i = 0; i < points.size(); ++i )
+            if ( fabs(points[i].z() - surface(lonLat[i].x(), lonLat[i].y())) <= TOLERANCE )
+                ++n;
+        return n;
+    }
+}
+
+
+int
+elevationQuery( osg::ArgumentParser& args )
+{
+    unsigned level = 8;
+    args.read( "--level", level );
+    unsigned gridSize = 64;
+    args.read( "--grid", gridSize );
+
+    TileSourceOptions sourceOptions;
+    sourceOptions.tileSize() = TILE_SIZE;
+
+    ElevationLayerOptions layerOptions( "surface", sourceOptions );
+    layerOptions.maxDataLevel() = level;
+
+    osg::ref_ptr<Map> map = new Map();
+    map->addElevationLayer( new ElevationLayer(layerOptions, new SurfaceTileSource(sourceOptions)) );
+
+    const SpatialReference* wgs84 = Registry::instance()->getGlobalGeodeticProfile()->getSRS();
+
+    // the same number of tiles in each run, in different places so that no
+    // run finds the tiles another one read.
+    double size = 16.0 * 180.0 / (double)(1 << level);
+    std::vector<osg::Vec3d> serialPoints, parallelPoints;
+    makeGrid( 10.0, 10.0, size, gridSize, serialPoints );
+    makeGrid( 40.0, 10.0, size, gridSize, parallelPoints );
+
+    std::vector<osg::Vec3d> serialLonLat( serialPoints ), parallelLonLat( parallelPoints );
+
+    ElevationQuery serialQuery( map.get() );
+    serialQuery.setNumFetchThreads( 1 );
+    Benchmark::Stopwatch t;
+    serialQuery.getElevations( serialPoints, wgs84, true );
+    double serialTime = t.seconds();
+    const ElevationQuery::BatchStats& serialStats = serialQuery.getLastBatchStats();
+    Benchmark::report( "batch, 1 fetch thread", serialTime, serialPoints.size(), "points" );
+    BENCH_CHECK( serialStats._numTilesFetched == serialStats._numTiles );
+    BENCH_CHECK( countCorrect(serialPoints, serialLonLat) == serialPoints.size() );
+
+    unsigned numThreads = osg::maximum( 4, OpenThreads::GetNumberOfProcessors() );
+    ElevationQuery parallelQuery( map.get() );
+    parallelQuery.setNumFetchThreads( numThreads );
+    t.reset();
+    parallelQuery.getElevations( parallelPoints, wgs84, true );
+    double parallelTime = t.seconds();
+    const ElevationQuery::BatchStats& parallelStats = parallelQuery.getLastBatchStats();
+    Benchmark::report( "batch, task service fetch", parallelTime, parallelPoints.size(), "points" );
+    Benchmark::speedup( "parallel fetch speedup", serialTime, parallelTime );
+    std::cout << "  tiles per batch: " << parallelStats._numTiles << std::endl;
+    BENCH_CHECK( parallelStats._numTilesFetched == parallelStats._numTiles );
+    BENCH_CHECK( countCorrect(parallelPoints, parallelLonLat) == parallelPoints.size() );
+
+    // the tiles are sleeping, not computing, so the fetch threads must overlap them.
+    BENCH_CHECK( parallelStats._fetchTime * 2.0 < serialStats._fetchTime );
+
+    // a second batch over the same points reads nothing.
+    for( unsigned i = 0; i < parallelPoints.size(); ++i )
+        parallelPoints[i].z() = NO_VALUE;
+    parallelQuery.getElevations( parallelPoints, wgs84, true );
+    BENCH_CHECK( parallelQuery.getLastBatchStats()._numTilesFetched == 0 );
+    BENCH_CHECK( countCorrect(parallelPoints, parallelLonLat) == parallelPoints.size() );
+
+    // points in UTM, with a few that have no geographic equivalent mixed in.
+    // Those may come back unchanged, but must not cost the others their heights.
+    osg::ref_ptr<const SpatialReference> utm = wgs84->createUTMFromLonLat( Angular(15.0), Angular(45.0) );
+    BENCH_CHECK( utm.valid() );
+    if ( utm.valid() )
+    {
+        std::vector<osg::Vec3d> lonLat, utmPoints;
+        makeGrid( 14.0, 44.0, 2.0, 16, lonLat );
+        for( unsigned i = 0; i < lonLat.size(); ++i )
+        {
+            osg::Vec3d p;
+            wgs84->transform( lonLat[i], utm.get(), p );
+            p.z() = NO_VALUE;
+            utmPoints.push_back( p );
+        }
+
+        std::vector<osg::Vec3d> mixed;
+        std::vector<bool>       good;
+        for( unsigned i = 0; i < utmPoints.size(); ++i )
+        {
+            mixed.push_back( utmPoints[i] );
+            good.push_back( true );
+            if ( i % 16 == 0 )
+            {
+                mixed.push_back( osg::Vec3d(std::numeric_limits<double>::infinity(), 1e300, NO_VALUE) );
+                good.push_back( false );
+            }
+        }
+
+        ElevationQuery query( map.get() );
+        query.getElevations( mixed, utm.get(), true );
+
+        unsigned correct = 0, k = 0, unanswered = 0;
+        for( unsigned i = 0; i < mixed.size(); ++i )
+        {
+            if ( good[i] )
+            {
+                if ( fabs(mixed[i].z() - surface(lonLat[k].x(), lonLat[k].y())) <= TOLERANCE )
+                    ++correct;
+                ++k;
+            }
+            else if ( mixed[i].z() == NO_VALUE )
+            {
+                ++unanswered;
+            }
+        }
+        std::cout << "  untransformable points left unanswered: " << unanswered << std::endl;
+        BENCH_CHECK( correct == utmPoints.size() );
+        BENCH_CHECK( unanswered == mixed.size() - utmPoints.size() );
+    }
+
+    return Benchmark::failures();
+}
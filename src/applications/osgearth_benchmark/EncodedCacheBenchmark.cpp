@@ -0,0 +1,316 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Caches PNG tiles and heightfields in a packed cache, storing the bytes the
+ * tiles were fetched as (and the lossless heightfield packing) against
+ * serializing the decoded objects. Checks that the records read back
+ * exactly, that encoded bytes stay off images no cache asked for, that they
+ * are gone after the write, and that a bin that can't store them is never
+ * handed any.
+ */
+
+#include "Benchmark"
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/StringUtils>
+#include <osgEarthDrivers/cache_packed/PackedCacheOptions>
+#include <osgDB/FileUtils>
+#include <osgDB/Registry>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    /** Smooth color ramps with a little noise, like imagery. */
+    osg::Image* createTile( unsigned seed, int size )
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage( size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+        unsigned x = seed * 2654435761u + 1u;
+        for( int t = 0; t < size; ++t )
+        {
+            for( int s = 0; s < size; ++s )
+            {
+                x = x * 1664525u + 1013904223u;
+                unsigned char* p = image->data( s, t );
+                p[0] = (unsigned char)( (s + seed) & 0xFF );
+                p[1] = (unsigned char)( (t * 2 + seed) & 0xFF );
+                p[2] = (unsigned char)( ((s + t) / 2 + (x >> 29)) & 0xFF );
+                p[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    /** Terrain-like samples, in half meters. */
+    osg::HeightField* createHeightField( unsigned seed, unsigned size )
+    {
+        osg::HeightField* hf = new osg::HeightField();
+        hf->allocate( size, size );
+        for( unsigned r = 0; r < size; ++r )
+        {
+            for( unsigned c = 0; c < size; ++c )
+            {
+                double h = 800.0 * sin( 0.05 * (c + seed) ) * cos( 0.07 * (r + seed) ) + 3.0 * r;
+                hf->setHeight( c, r, (float)(floor(h * 2.0 + 0.5) * 0.5) );
+            }
+        }
+        return hf;
+    }
+
+    bool samePixels( const osg::Image* a, const osg::Image* b )
+    {
+        return
+            a && b &&
+            a->s() == b->s() && a->t() == b->t() &&
+            a->getPixelFormat() == b->getPixelFormat() &&
+            a->getImageSizeInBytes() == b->getImageSizeInBytes() &&
+            memcmp( a->data(), b->data(), a->getImageSizeInBytes() ) == 0;
+    }
+
+    bool sameHeights( const osg::HeightField* a, const osg::HeightField* b )
+    {
+        if ( !a || !b || a->getNumColumns() != b->getNumColumns() || a->getNumRows() != b->getNumRows() )
+            return false;
+        for( unsigned r = 0; r < a->getNumRows(); ++r )
+            for( unsigned c = 0; c < a->getNumColumns(); ++c )
+                if ( a->getHeight(c, r) != b->getHeight(c, r) )
+                    return false;
+        return true;
+    }
+
+    void removeFolder( const std::string& path )
+    {
+        osgDB::DirectoryContents dc = osgDB::getDirectoryContents( path );
+        for( osgDB::DirectoryContents::iterator i = dc.begin(); i != dc.end(); ++i )
+        {
+            if ( *i != "." && *i != ".." )
+                ::remove( osgDB::concatPaths(path, *i).c_str() );
+        }
+    }
+
+    Cache* openCache( const std::string& path )
+    {
+        removeFolder( path );
+        PackedCacheOptions options;
+        options.rootPath() = path;
+        return CacheFactory::create( options );
+    }
+
+    /** A bin like the memory cache's: it keeps objects and can't store encoded bytes. */
+    class ObjectBin : public CacheBin
+    {
+    public:
+        ObjectBin() : CacheBin( "objects" ), _writes( 0 ), _encodedWrites( 0 ) { }
+
+        ReadResult readObject( const std::string& key, double maxAge ) { return ReadResult(); }
+        ReadResult readImage( const std::string& key, double maxAge )  { return ReadResult(); }
+        ReadResult readString( const std::string& key, double maxAge ) { return ReadResult(); }
+        bool isCached( const std::string& key, double maxAge )         { return false; }
+        bool purge()                                                   { return true; }
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            ++_writes;
+            return true;
+        }
+
+        bool writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta )
+        {
+            ++_encodedWrites;
+            return false;
+        }
+
+        unsigned _writes, _encodedWrites;
+    };
+}
+
+
+int
+encodedCache( osg::ArgumentParser& args )
+{
+    unsigned n = 64;
+    args.read( "--tiles", n );
+
+    osgDB::ReaderWriter* png = osgDB::Registry::instance()->getReaderWriterForExtension( "png" );
+    BENCH_CHECK( png != 0L );
+    if ( !png )
+        return -1;
+
+    // the tiles as a server would deliver them:
+    std::vector<std::string> fetched( n );
+    std::vector< osg::ref_ptr<osg::Image> > originals( n );
+    for( unsigned i = 0; i < n; ++i )
+    {
+        originals[i] = createTile( i, 256 );
+        std::stringstream buf;
+        png->writeImage( *originals[i].get(), buf );
+        fetched[i] = buf.str();
+    }
+
+    // what a reader does with the bytes, with and without a cache waiting for them:
+    osg::ref_ptr<osgDB::Options> plain  = new osgDB::Options();
+    osg::ref_ptr<osgDB::Options> wanted = new osgDB::Options();
+    EncodedRecord::setWanted( wanted.get(), true );
+    BENCH_CHECK( !EncodedRecord::isWanted(plain.get()) );
+    BENCH_CHECK( EncodedRecord::isWanted(wanted.get()) );
+
+    std::vector< osg::ref_ptr<osg::Image> > decoded( n );
+    unsigned long long retained = 0;
+    for( unsigned i = 0; i < n; ++i )
+    {
+        std::istringstream in( fetched[i] );
+        decoded[i] = png->readImage( in ).takeImage();
+        if ( EncodedRecord::isWanted(plain.get()) )
+            ImageUtils::setEncodedData( decoded[i].get(), fetched[i] );
+        if ( ImageUtils::getEncodedData(decoded[i].get()).valid() )
+            retained += fetched[i].size();
+    }
+    std::cout << "  encoded bytes kept with no cache waiting: " << retained << std::endl;
+    BENCH_CHECK( retained == 0 );
+
+    osg::ref_ptr<Cache> cache = openCache( "osgearth_benchmark_packed" );
+    BENCH_CHECK( cache.valid() && cache->isOK() && cache->acceptsEncoded() );
+    if ( !cache.valid() || !cache->isOK() )
+        return -1;
+
+    CacheBin* bin = cache->addBin( "bench" );
+    BENCH_CHECK( bin && bin->acceptsEncoded() );
+
+    // old: serialize the decoded pixels.
+    Benchmark::Stopwatch t;
+    bool serializedOK = true;
+    for( unsigned i = 0; i < n; ++i )
+        serializedOK = bin->write( Stringify() << "serialized_" << i, decoded[i].get() ) && serializedOK;
+    double serializeTime = t.seconds();
+    Benchmark::report( "image write, serialized", serializeTime, n, "tiles" );
+    BENCH_CHECK( serializedOK );
+
+    // new: store the bytes as fetched, then drop them the way ImageLayer does.
+    for( unsigned i = 0; i < n; ++i )
+        ImageUtils::setEncodedData( decoded[i].get(), fetched[i] );
+
+    t.reset();
+    bool encodedOK = true;
+    for( unsigned i = 0; i < n; ++i )
+    {
+        encodedOK = bin->writeImage( Stringify() << "encoded_" << i, decoded[i].get() ) && encodedOK;
+        ImageUtils::clearEncodedData( decoded[i].get() );
+    }
+    double encodedTime = t.seconds();
+    Benchmark::report( "image write, as fetched", encodedTime, n, "tiles" );
+    Benchmark::speedup( "as fetched vs. serialized", serializeTime, encodedTime );
+    BENCH_CHECK( encodedOK );
+
+    retained = 0;
+    for( unsigned i = 0; i < n; ++i )
+        if ( decoded[i]->getUserData() ) retained += fetched[i].size();
+    BENCH_CHECK( retained == 0 );
+
+    // both read back exactly:
+    t.reset();
+    bool readSerialized = true;
+    for( unsigned i = 0; i < n; ++i )
+    {
+        ReadResult r = bin->readImage( Stringify() << "serialized_" << i );
+        readSerialized = readSerialized && r.succeeded() && samePixels( r.getImage(), originals[i].get() );
+    }
+    Benchmark::report( "image read, serialized", t.seconds(), n, "tiles" );
+    BENCH_CHECK( readSerialized );
+
+    t.reset();
+    bool readEncoded = true;
+    for( unsigned i = 0; i < n; ++i )
+    {
+        ReadResult r = bin->readImage( Stringify() << "encoded_" << i );
+        readEncoded = readEncoded && r.succeeded() && samePixels( r.getImage(), originals[i].get() );
+    }
+    Benchmark::report( "image read, as fetched", t.seconds(), n, "tiles" );
+    BENCH_CHECK( readEncoded );
+
+    // an edited image no longer matches its bytes, so it must be serialized:
+    osg::ref_ptr<osg::Image> edited = createTile( 0, 256 );
+    ImageUtils::setEncodedData( edited.get(), fetched[0] );
+    edited->data()[0] ^= 0xFF;
+    edited->dirty();
+    BENCH_CHECK( !ImageUtils::getEncodedData(edited.get()).valid() );
+
+    // heightfields: lossless packing vs. serialization.
+    std::vector< osg::ref_ptr<osg::HeightField> > hfs( n );
+    for( unsigned i = 0; i < n; ++i )
+        hfs[i] = createHeightField( i, 257 );
+
+    t.reset();
+    for( unsigned i = 0; i < n; ++i )
+        bin->write( Stringify() << "hf_serialized_" << i, hfs[i].get() );
+    double hfSerializeTime = t.seconds();
+    Benchmark::report( "heightfield write, serialized", hfSerializeTime, n, "tiles" );
+
+    t.reset();
+    unsigned long long packedBytes = 0;
+    bool hfEncodedOK = true;
+    for( unsigned i = 0; i < n; ++i )
+    {
+        std::string encoded;
+        HeightFieldUtils::encodeHeightField( hfs[i].get(), encoded );
+        packedBytes += encoded.size();
+        hfEncodedOK = bin->writeEncoded( Stringify() << "hf_encoded_" << i, EncodedRecord::HEIGHTFIELD, encoded ) && hfEncodedOK;
+    }
+    double hfEncodeTime = t.seconds();
+    Benchmark::report( "heightfield write, packed", hfEncodeTime, n, "tiles" );
+    Benchmark::speedup( "packed vs. serialized", hfSerializeTime, hfEncodeTime );
+    BENCH_CHECK( hfEncodedOK );
+
+    unsigned long long rawBytes = (unsigned long long)n * 257 * 257 * sizeof(float);
+    std::cout << "  heightfield bytes packed/raw: " << packedBytes << "/" << rawBytes << std::endl;
+    BENCH_CHECK( packedBytes * 2 < rawBytes );
+
+    bool hfReadOK = true;
+    for( unsigned i = 0; i < n; ++i )
+    {
+        ReadResult r = bin->readObject( Stringify() << "hf_encoded_" << i );
+        hfReadOK = hfReadOK && r.succeeded() && sameHeights( r.get<osg::HeightField>(), hfs[i].get() );
+    }
+    BENCH_CHECK( hfReadOK );
+
+    // a bin that can't store encoded data is never handed any.
+    osg::ref_ptr<ObjectBin> objects = new ObjectBin();
+    for( unsigned i = 0; i < n; ++i )
+        ImageUtils::setEncodedData( decoded[i].get(), fetched[i] );
+    for( unsigned i = 0; i < n; ++i )
+    {
+        objects->writeImage( Stringify() << i, decoded[i].get() );
+        ImageUtils::clearEncodedData( decoded[i].get() );
+    }
+    BENCH_CHECK( objects->_encodedWrites == 0 );
+    BENCH_CHECK( objects->_writes == n );
+
+    cache = 0L;
+    removeFolder( "osgearth_benchmark_packed" );
+    return 0;
+}
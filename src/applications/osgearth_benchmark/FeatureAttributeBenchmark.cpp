@@ -0,0 +1,206 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Builds a large set of features the way the OGR reader does, with one
+ * attribute schema shared by all of them, against a name->value table per
+ * feature. Times setting attributes, reading them by name and by slot, and
+ * evaluating an expression per feature and over the whole list. Checks the
+ * values, that features gaining the same attribute keep sharing a schema,
+ * and that the table from getAttrs() owns its strings.
+ */
+
+#include "Benchmark"
+#include <osgEarthFeatures/Feature>
+#include <osgEarth/StringUtils>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace
+{
+    const unsigned NUM_FIELDS = 16;
+    const unsigned NUM_VALUES = 50;
+
+    // field i is a string, a double or an int, by i % 3.
+    std::string fieldName( unsigned i )
+    {
+        return Stringify() << "field_" << i;
+    }
+
+    std::string stringFor( unsigned f, unsigned field )
+    {
+        return Stringify() << "value_" << ((f + field) % NUM_VALUES);
+    }
+
+    double doubleFor( unsigned f, unsigned field ) { return (double)f * 0.5 + field; }
+    int    intFor   ( unsigned f, unsigned field ) { return (int)(f % 1000) + (int)field; }
+
+    /** The per-feature table a feature used to keep. */
+    void fillTable( unsigned f, const std::vector<std::string>& names, AttributeTable& table )
+    {
+        for( unsigned i = 0; i < NUM_FIELDS; ++i )
+        {
+            AttributeValue& a = table[names[i]];
+            switch( i % 3 )
+            {
+            case 0: a.first = ATTRTYPE_STRING; a.second.stringValue = stringFor(f, i); break;
+            case 1: a.first = ATTRTYPE_DOUBLE; a.second.doubleValue = doubleFor(f, i); break;
+            case 2: a.first = ATTRTYPE_INT;    a.second.intValue    = intFor(f, i);    break;
+            }
+            a.second.set = true;
+        }
+    }
+
+    Feature* createFeature( unsigned f, const AttributeSchema* schema )
+    {
+        Feature* feature = new Feature( 0L, 0L, Style(), f );
+        feature->setSchema( schema );
+        for( unsigned i = 0; i < NUM_FIELDS; ++i )
+        {
+            switch( i % 3 )
+            {
+            case 0: feature->setAt( i, stringFor(f, i) ); break;
+            case 1: feature->setAt( i, doubleFor(f, i) ); break;
+            case 2: feature->setAt( i, intFor(f, i) );    break;
+            }
+        }
+        return feature;
+    }
+}
+
+
+int
+featureAttributes( osg::ArgumentParser& args )
+{
+    unsigned n = 100000;
+    args.read( "--features", n );
+
+    std::vector<std::string> names;
+    for( unsigned i = 0; i < NUM_FIELDS; ++i )
+        names.push_back( fieldName(i) );
+
+    // build:
+    Benchmark::Stopwatch t;
+    std::vector<AttributeTable> tables( n );
+    for( unsigned f = 0; f < n; ++f )
+        fillTable( f, names, tables[f] );
+    double tableBuild = t.seconds();
+    Benchmark::report( "build, table per feature", tableBuild, n, "features" );
+
+    osg::ref_ptr<AttributeSchema> schema = new AttributeSchema( names );
+    t.reset();
+    FeatureList features;
+    for( unsigned f = 0; f < n; ++f )
+        features.push_back( createFeature(f, schema.get()) );
+    double schemaBuild = t.seconds();
+    Benchmark::report( "build, shared schema", schemaBuild, n, "features" );
+
+    // read by name (field_4 is a double, field_6 a string):
+    const std::string dname = fieldName( 4 ), sname = fieldName( 6 );
+
+    t.reset();
+    double tableSum = 0.0;
+    unsigned tableMatches = 0;
+    for( unsigned f = 0; f < n; ++f )
+    {
+        AttributeTable::const_iterator d = tables[f].find( dname );
+        AttributeTable::const_iterator s = tables[f].find( sname );
+        tableSum += d->second.getDouble();
+        if ( s->second.getString() == stringFor(f, 6) ) ++tableMatches;
+    }
+    double tableRead = t.seconds();
+    Benchmark::report( "read by name, table per feature", tableRead, 2 * n, "reads" );
+
+    t.reset();
+    double nameSum = 0.0;
+    unsigned nameMatches = 0;
+    unsigned f = 0;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++f )
+    {
+        nameSum += (*i)->getDouble( dname );
+        if ( (*i)->getString(sname) == stringFor(f, 6) ) ++nameMatches;
+    }
+    Benchmark::report( "read by name, shared schema", t.seconds(), 2 * n, "reads" );
+
+    int dslot = schema->indexOf( dname ), sslot = schema->indexOf( sname );
+    t.reset();
+    double slotSum = 0.0;
+    unsigned slotMatches = 0;
+    f = 0;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++f )
+    {
+        slotSum += (*i)->getAttr( dslot )->getDouble();
+        if ( (*i)->getAttr(sslot)->getString() == stringFor(f, 6) ) ++slotMatches;
+    }
+    double slotRead = t.seconds();
+    Benchmark::report( "read by slot, shared schema", slotRead, 2 * n, "reads" );
+    Benchmark::speedup( "slot vs. table lookup", tableRead, slotRead );
+
+    BENCH_CHECK( tableSum == nameSum && nameSum == slotSum );
+    BENCH_CHECK( tableMatches == n && nameMatches == n && slotMatches == n );
+
+    // expressions: one feature at a time vs. the whole list.
+    NumericExpression expr( "[field_4] * 2 + [field_5]" );
+
+    t.reset();
+    std::vector<double> each;
+    each.reserve( n );
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+        each.push_back( (*i)->eval(expr) );
+    double evalEach = t.seconds();
+    Benchmark::report( "eval, per feature", evalEach, n, "features" );
+
+    t.reset();
+    std::vector<double> all;
+    Feature::evalAll( expr, features, all );
+    double evalList = t.seconds();
+    Benchmark::report( "eval, evalAll", evalList, n, "features" );
+    Benchmark::speedup( "evalAll vs. per feature", evalEach, evalList );
+
+    bool evalOK = all.size() == n && each == all;
+    for( unsigned k = 0; k < n && evalOK; k += 997 )
+        evalOK = all[k] == doubleFor(k, 4) * 2.0 + intFor(k, 5);
+    BENCH_CHECK( evalOK );
+
+    // features that gain the same attribute keep sharing a schema:
+    Feature* first  = features.front().get();
+    Feature* second = (++features.begin())->get();
+    first->set( "extra", 1 );
+    second->set( "extra", 2 );
+    BENCH_CHECK( first->getSchema() == second->getSchema() );
+    BENCH_CHECK( first->getInt("extra") == 1 && second->getInt("extra") == 2 );
+    BENCH_CHECK( first->getString(sname) == stringFor(0, 6) );
+
+    // a table from getAttrs() outlives the feature and its schema:
+    AttributeTable copy;
+    {
+        osg::ref_ptr<AttributeSchema> temp = new AttributeSchema( names );
+        osg::ref_ptr<Feature> feature = createFeature( 7, temp.get() );
+        feature->set( "name", std::string("a string only this feature has") );
+        copy = feature->getAttrs();
+    }
+    BENCH_CHECK( copy.size() == NUM_FIELDS + 1 );
+    BENCH_CHECK( copy["name"].getString() == "a string only this feature has" );
+    BENCH_CHECK( copy[sname].getString() == stringFor(7, 6) );
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Builds a feature tile of a dense synthetic city (a grid of extruded
+ * building footprints) on a geocentric map, compiling the tile serially and
+ * in chunks on the graph's compile threads. Times the tile build, and checks
+ * that the chunked build merges back into as many geodes as the serial one,
+ * with the same vertices in the same place, and that it comes out the same
+ * every time.
+ */
+
+#include "Benchmark"
+#include <osgEarthFeatures/FeatureListSource>
+#include <osgEarthFeatures/FeatureModelGraph>
+#include <osgEarthFeatures/FeatureModelSource>
+#include <osgEarthFeatures/Session>
+#include <osgEarthSymbology/ExtrusionSymbol>
+#include <osgEarthSymbology/PolygonSymbol>
+#include <osgEarthSymbology/StyleSheet>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Transform>
+#include <OpenThreads/Thread>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace
+{
+    const double LON0    = 10.0;
+    const double LAT0    = 50.0;
+    const double SPACING = 0.0003;  // degrees between footprints
+    const double SIZE    = 0.0002;  // footprint width in degrees
+
+    FeatureListSource* createCity( unsigned n )
+    {
+        const SpatialReference* wgs84 = Registry::instance()->getGlobalGeodeticProfile()->getSRS();
+        FeatureListSource* source = new FeatureListSource();
+
+        for( unsigned i = 0; i < n; ++i )
+        {
+            for( unsigned j = 0; j < n; ++j )
+            {
+                double x = LON0 + SPACING * (double)i;
+                double y = LAT0 + SPACING * (double)j;
+
+                Polygon* footprint = new Polygon();
+                footprint->push_back( osg::Vec3d(x,      y,      0) );
+                footprint->push_back( osg::Vec3d(x+SIZE, y,      0) );
+                footprint->push_back( osg::Vec3d(x+SIZE, y+SIZE, 0) );
+                footprint->push_back( osg::Vec3d(x,      y+SIZE, 0) );
+
+                Feature* feature = new Feature( footprint, wgs84, Style(), i*n + j );
+                feature->set( "height", (double)(10 + (i*7 + j*13) % 50) );
+                source->insertFeature( feature );
+            }
+        }
+        return source;
+    }
+
+    StyleSheet* createStyles()
+    {
+        Style style( "default" );
+        style.getOrCreate<ExtrusionSymbol>()->heightExpression() = NumericExpression( "[height]" );
+        style.getOrCreate<PolygonSymbol>()->fill()->color() = Color( 0.8f, 0.7f, 0.6f, 1.0f );
+
+        StyleSheet* sheet = new StyleSheet();
+        sheet->addStyle( style );
+        return sheet;
+    }
+
+    /** What a built tile contains, in world coordinates. */
+    struct TileContents : public osg::NodeVisitor
+    {
+        TileContents() : osg::NodeVisitor( TRAVERSE_ALL_CHILDREN ),
+            geodes( 0 ), drawables( 0 ), vertices( 0 ), checksum( 0.0 ) { }
+
+        void apply( osg::Geode& geode )
+        {
+            ++geodes;
+            osg::Matrixd local2world = osg::computeLocalToWorld( getNodePath() );
+            for( unsigned d = 0; d < geode.getNumDrawables(); ++d )
+            {
+                osg::Geometry* geom = geode.getDrawable(d)->asGeometry();
+                osg::Vec3Array* verts = geom ? dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) : 0L;
+                if ( !verts )
+                    continue;
+
+                ++drawables;
+                for( osg::Vec3Array::const_iterator v = verts->begin(); v != verts->end(); ++v )
+                {
+                    osg::Vec3d world = osg::Vec3d(*v) * local2world;
+                    center += world;
+                    ++vertices;
+                    checksum += (double)vertices * (world.x() + 2.0*world.y() + 3.0*world.z());
+                }
+            }
+        }
+
+        unsigned      geodes;
+        unsigned      drawables;
+        unsigned long vertices;
+        osg::Vec3d    center;   // sum, until finish()
+        double        checksum; // order-sensitive
+
+        void finish() { if ( vertices > 0 ) center /= (double)vertices; }
+    };
+
+    /** Builds the (single, unpaged) tile and reports what's in it. */
+    double buildTile( Map* map, FeatureListSource* source, StyleSheet* styles, unsigned threads, unsigned chunkSize, TileContents& out )
+    {
+        FeatureModelSourceOptions options;
+        options.styles() = styles;
+        if ( threads > 0 )
+        {
+            options.compileThreads()   = threads;
+            options.compileChunkSize() = chunkSize;
+        }
+
+        osg::ref_ptr<Session> session = new Session( map, styles, source );
+        osg::ref_ptr<FeatureNodeFactory> factory = new GeomFeatureNodeFactory();
+
+        Benchmark::Stopwatch t;
+        osg::ref_ptr<FeatureModelGraph> graph = new FeatureModelGraph( session.get(), options, factory.get() );
+        double seconds = t.seconds();
+
+        graph->accept( out );
+        out.finish();
+        return seconds;
+    }
+}
+
+
+int
+featureTile( osg::ArgumentParser& args )
+{
+    unsigned n = 100;
+    args.read( "--grid", n );
+    unsigned chunkSize = 500;
+    args.read( "--chunk", chunkSize );
+    unsigned threads = osg::maximum( 2, OpenThreads::GetNumberOfProcessors() );
+    args.read( "--threads", threads );
+
+    // a geocentric map, so each compiled chunk is localized to its own center.
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<StyleSheet> styles = createStyles();
+    osg::ref_ptr<FeatureListSource> city = createCity( n );
+    unsigned buildings = n * n;
+
+    // warm up (shader generation, state set cache) on a small city.
+    {
+        osg::ref_ptr<FeatureListSource> small = createCity( 4 );
+        TileContents ignore;
+        buildTile( map.get(), small.get(), styles.get(), 0, 0, ignore );
+    }
+
+    TileContents serial;
+    double serialTime = buildTile( map.get(), city.get(), styles.get(), 0, 0, serial );
+    Benchmark::report( "tile build, serial", serialTime, buildings, "buildings" );
+
+    TileContents parallel;
+    double parallelTime = buildTile( map.get(), city.get(), styles.get(), threads, chunkSize, parallel );
+    Benchmark::report( "tile build, chunked on compile threads", parallelTime, buildings, "buildings" );
+    Benchmark::speedup( "chunked vs. serial tile build", serialTime, parallelTime );
+
+    std::cout << "  chunks: " << (buildings + chunkSize - 1) / chunkSize << ", threads: " << threads
+        << ", geodes: " << serial.geodes << " / " << parallel.geodes
+        << ", drawables: " << serial.drawables << " / " << parallel.drawables << std::endl;
+
+    BENCH_CHECK( serial.vertices > 0 );
+    BENCH_CHECK( parallel.vertices == serial.vertices );
+
+    // the chunks merge back into one set of geodes, not sibling copies of it.
+    BENCH_CHECK( parallel.geodes == serial.geodes );
+    BENCH_CHECK( parallel.drawables <= serial.drawables );
+
+    // merging shifts vertices between local frames; they must not move in the world.
+    BENCH_CHECK( (parallel.center - serial.center).length() < 0.01 );
+
+    // the output does not depend on which chunk finishes first.
+    TileContents again;
+    buildTile( map.get(), city.get(), styles.get(), threads, chunkSize, again );
+    BENCH_CHECK( again.vertices == parallel.vertices );
+    BENCH_CHECK( again.geodes == parallel.geodes && again.drawables == parallel.drawables );
+    BENCH_CHECK( again.checksum == parallel.checksum );
+
+    if ( OpenThreads::GetNumberOfProcessors() >= 4 && threads >= 4 )
+    {
+        BENCH_CHECK( parallelTime < serialTime );
+    }
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Times GDAL heightfield creation at low and high LODs on a synthetic
+ * global DEM, against the per-pixel RasterIO sampling it replaced, and
+ * checks the heights against the analytic surface.
+ */
+
+#include "Benchmark"
+#include <osgEarth/Registry>
+#include <osgEarth/TileSource>
+#include <osgEarthDrivers/gdal/GDALOptions>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+#include <cstdio>
+#include <sstream>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    const double AMPLITUDE = 1000.0;
+
+    double surface( double lon, double lat )
+    {
+        return AMPLITUDE * sin(osg::DegreesToRadians(lon)) * cos(osg::DegreesToRadians(lat));
+    }
+
+    bool createDEM( const std::string& path, int width, int height )
+    {
+        GDAL_SCOPED_LOCK;
+        GDALAllRegister();
+
+        GDALDriver* driver = GetGDALDriverManager()->GetDriverByName( "GTiff" );
+        if ( !driver )
+            return false;
+
+        GDALDataset* ds = driver->Create( path.c_str(), width, height, 1, GDT_Float32, 0L );
+        if ( !ds )
+            return false;
+
+        double xform[6] = { -180.0, 360.0/(double)width, 0.0, 90.0, 0.0, -180.0/(double)height };
+        ds->SetGeoTransform( xform );
+
+        OGRSpatialReference srs;
+        srs.SetWellKnownGeogCS( "WGS84" );
+        char* wkt = 0L;
+        srs.exportToWkt( &wkt );
+        ds->SetProjection( wkt );
+        CPLFree( wkt );
+
+        GDALRasterBand* band = ds->GetRasterBand( 1 );
+        std::vector<float> row( width );
+        for( int r = 0; r < height; ++r )
+        {
+            double lat = 90.0 - ((double)r + 0.5) * 180.0/(double)height;
+            for( int c = 0; c < width; ++c )
+                row[c] = (float)surface( -180.0 + ((double)c + 0.5) * 360.0/(double)width, lat );
+            band->RasterIO( GF_Write, 0, r, width, 1, &row[0], width, 1, GDT_Float32, 0, 0 );
+        }
+
+        GDALClose( ds );
+        return true;
+    }
+
+    /**
+     * The sampling the driver used before: four 1x1 RasterIO calls per
+     * bilinear sample.
+     */
+    osg::HeightField* sampleByPixel( GDALRasterBand* band, const double* inv, const GeoExtent& ex, int tileSize )
+    {
+        osg::HeightField* hf = new osg::HeightField();
+        hf->allocate( tileSize, tileSize );
+
+        double dx = ex.width()  / (double)(tileSize-1);
+        double dy = ex.height() / (double)(tileSize-1);
+        int xsize = band->GetXSize(), ysize = band->GetYSize();
+
+        for( int c = 0; c < tileSize; ++c )
+        {
+            for( int r = 0; r < tileSize; ++r )
+            {
+                double col, row;
+                GDALApplyGeoTransform( const_cast<double*>(inv), ex.xMin() + dx*(double)c, ex.yMin() + dy*(double)r, &col, &row );
+                col = osg::clampBetween( col - 0.5, 0.0, (double)xsize-1 );
+                row = osg::clampBetween( row - 0.5, 0.0, (double)ysize-1 );
+
+                int c0 = (int)floor(col), r0 = (int)floor(row);
+                int c1 = osg::minimum(c0+1, xsize-1), r1 = osg::minimum(r0+1, ysize-1);
+                float v00, v01, v10, v11;
+                band->RasterIO( GF_Read, c0, r0, 1, 1, &v00, 1, 1, GDT_Float32, 0, 0 );
+                band->RasterIO( GF_Read, c1, r0, 1, 1, &v10, 1, 1, GDT_Float32, 0, 0 );
+                band->RasterIO( GF_Read, c0, r1, 1, 1, &v01, 1, 1, GDT_Float32, 0, 0 );
+                band->RasterIO( GF_Read, c1, r1, 1, 1, &v11, 1, 1, GDT_Float32, 0, 0 );
+
+                double fc = col - (double)c0, fr = row - (double)r0;
+                double top = v00 + (v10-v00)*fc;
+                double bot = v01 + (v11-v01)*fc;
+                hf->setHeight( c, r, (float)(top + (bot-top)*fr) );
+            }
+        }
+        return hf;
+    }
+
+    /** Largest difference between a heightfield and the analytic surface. */
+    double maxError( const osg::HeightField* hf, const GeoExtent& ex )
+    {
+        int n = hf->getNumColumns();
+        double dx = ex.width()  / (double)(n-1);
+        double dy = ex.height() / (double)(hf->getNumRows()-1);
+        double err = 0.0;
+        for( unsigned c = 0; c < hf->getNumColumns(); ++c )
+            for( unsigned r = 0; r < hf->getNumRows(); ++r )
+                err = osg::maximum( err, fabs(hf->getHeight(c, r) - surface(ex.xMin() + dx*(double)c, ex.yMin() + dy*(double)r)) );
+        return err;
+    }
+}
+
+
+int
+gdalHeightField( osg::ArgumentParser& args )
+{
+    int size = 8192;
+    args.read( "--dem-size", size );
+    int tileSize = 32;
+    args.read( "--tile-size", tileSize );
+    unsigned maxLevel = 8;
+    args.read( "--max-level", maxLevel );
+
+    std::string path = "osgearth_benchmark_dem.tif";
+    if ( !createDEM(path, size, size/2) )
+    {
+        std::cout << "  Cannot create " << path << "; skipping" << std::endl;
+        BENCH_CHECK( false );
+        return 1;
+    }
+
+    GDALOptions options;
+    options.url()           = path;
+    options.interpolation() = INTERP_BILINEAR;
+    options.tileSize()      = tileSize;
+
+    osg::ref_ptr<TileSource> source = TileSourceFactory::create( options );
+    BENCH_CHECK( source.valid() && source->startup(0L) == TileSource::STATUS_OK );
+
+    GDALDataset* ds = (GDALDataset*)GDALOpen( path.c_str(), GA_ReadOnly );
+    BENCH_CHECK( ds != 0L );
+
+    if ( source.valid() && source->isOK() && ds )
+    {
+        double xform[6], inv[6];
+        ds->GetGeoTransform( xform );
+        GDALInvGeoTransform( xform, inv );
+        GDALRasterBand* band = ds->GetRasterBand( 1 );
+
+        // one pixel of the DEM, plus the bilinear error of a smooth surface:
+        double pixelTolerance = AMPLITUDE * osg::DegreesToRadians(360.0/(double)size) * 2.0;
+
+        for( unsigned lod = 0; lod <= maxLevel; lod += 2 )
+        {
+            unsigned tw, th;
+            source->getProfile()->getNumTiles( lod, tw, th );
+
+            // a diagonal of up to 8 tiles at this LOD:
+            unsigned n = osg::minimum( 8u, osg::minimum(tw, th) );
+            std::vector<TileKey> keys;
+            for( unsigned i = 0; i < n; ++i )
+                keys.push_back( TileKey(lod, (i*tw)/n, (i*th)/n, source->getProfile()) );
+
+            double before = 0.0, after = 0.0, errBefore = 0.0, errAfter = 0.0;
+            for( unsigned k = 0; k < keys.size(); ++k )
+            {
+                Benchmark::Stopwatch t;
+                osg::ref_ptr<osg::HeightField> hf = source->createHeightField( keys[k], 0L, 0L );
+                after += t.seconds();
+
+                t.reset();
+                osg::ref_ptr<osg::HeightField> ref = sampleByPixel( band, inv, keys[k].getExtent(), tileSize );
+                before += t.seconds();
+
+                BENCH_CHECK( hf.valid() );
+                if ( hf.valid() )
+                    errAfter = osg::maximum( errAfter, maxError(hf.get(), keys[k].getExtent()) );
+                errBefore = osg::maximum( errBefore, maxError(ref.get(), keys[k].getExtent()) );
+            }
+
+            std::stringstream buf;
+            buf << "LOD " << lod;
+            Benchmark::report( buf.str() + " per-pixel reads (before)", before, keys.size(), "tiles" );
+            Benchmark::report( buf.str() + " windowed reads (after)",   after,  keys.size(), "tiles" );
+            Benchmark::speedup( buf.str() + " speedup", before, after );
+
+            std::cout << "  " << buf.str() << " max error: before " << errBefore << " m, after " << errAfter << " m" << std::endl;
+
+            // full-resolution windows must be as accurate as the per-pixel reads; the
+            // decimated low-LOD windows may be off by about one decimated cell.
+            double cellDegrees = osg::maximum( keys[0].getExtent().width() / (double)tileSize, 360.0/(double)size );
+            double tolerance   = AMPLITUDE * osg::DegreesToRadians(cellDegrees) * 2.0;
+            BENCH_CHECK( errAfter <= errBefore + pixelTolerance || errAfter <= tolerance );
+        }
+    }
+
+    if ( ds )
+        GDALClose( ds );
+    source = 0L;
+    remove( path.c_str() );
+
+    return Benchmark::failures();
+}
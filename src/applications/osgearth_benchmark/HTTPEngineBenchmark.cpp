@@ -0,0 +1,337 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Runs the HTTP engine against a loopback HTTP/1.1 server that answers
+ * every request with its own path after a fixed delay. Times blocking
+ * requests against multiplexed ones, and checks the responses, keep-alive
+ * connection reuse, completion callbacks, and re-entrant calls made from
+ * a callback on the engine thread.
+ */
+
+#include "Benchmark"
+#include <osgEarth/HTTPClient>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#  include <winsock2.h>
+   typedef SOCKET socket_t;
+   typedef int    socklen_t;
+#  define CLOSE_SOCKET closesocket
+#  define SHUT_RDWR    SD_BOTH
+#else
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <arpa/inet.h>
+#  include <unistd.h>
+   typedef int socket_t;
+#  define INVALID_SOCKET (-1)
+#  define CLOSE_SOCKET   ::close
+#endif
+
+using namespace osgEarth;
+
+namespace
+{
+    const int      DELAY_MS     = 25;
+    const unsigned NUM_REQUESTS = 32;
+
+    /** One keep-alive connection; answers requests until the client hangs up. */
+    class Connection : public OpenThreads::Thread
+    {
+    public:
+        Connection( socket_t s, int delayMs, unsigned& requests, Threading::Mutex& mutex ) :
+            _socket( s ), _delayMs( delayMs ), _requests( requests ), _mutex( mutex ) { }
+
+        void run()
+        {
+            std::string buf;
+            char chunk[1024];
+            for( ;; )
+            {
+                std::string::size_type end;
+                while( (end = buf.find("\r\n\r\n")) == std::string::npos )
+                {
+                    int n = ::recv( _socket, chunk, sizeof(chunk), 0 );
+                    if ( n <= 0 )
+                        return;
+                    buf.append( chunk, n );
+                }
+
+                // "GET /path HTTP/1.1"
+                std::string::size_type p0 = buf.find( ' ' );
+                std::string::size_type p1 = buf.find( ' ', p0+1 );
+                std::string path = buf.substr( p0+1, p1-p0-1 );
+                buf.erase( 0, end+4 );
+
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    ++_requests;
+                }
+
+                OpenThreads::Thread::microSleep( _delayMs * 1000 );
+
+                std::stringstream out;
+                out << "HTTP/1.1 200 OK\r\n"
+                    << "Content-Type: text/plain\r\n"
+                    << "Content-Length: " << path.size() << "\r\n"
+                    << "\r\n"
+                    << path;
+                std::string response = out.str();
+                if ( ::send( _socket, response.c_str(), (int)response.size(), 0 ) != (int)response.size() )
+                    return;
+            }
+        }
+
+        void shutdown() { ::shutdown( _socket, SHUT_RDWR ); }
+
+        ~Connection() { CLOSE_SOCKET( _socket ); }
+
+    private:
+        socket_t          _socket;
+        int               _delayMs;
+        unsigned&         _requests;
+        Threading::Mutex& _mutex;
+    };
+
+    /** Minimal HTTP/1.1 server on 127.0.0.1, one thread per connection. */
+    class LoopbackServer : public OpenThreads::Thread
+    {
+    public:
+        LoopbackServer( int delayMs ) :
+            _delayMs( delayMs ), _port( 0 ), _accepted( 0 ), _requests( 0 ), _done( false )
+        {
+            _listen = ::socket( AF_INET, SOCK_STREAM, 0 );
+
+            sockaddr_in addr;
+            ::memset( &addr, 0, sizeof(addr) );
+            addr.sin_family      = AF_INET;
+            addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+            addr.sin_port        = 0;
+
+            if ( _listen != INVALID_SOCKET &&
+                 ::bind( _listen, (sockaddr*)&addr, sizeof(addr) ) == 0 &&
+                 ::listen( _listen, 64 ) == 0 )
+            {
+                socklen_t len = sizeof(addr);
+                ::getsockname( _listen, (sockaddr*)&addr, &len );
+                _port = ntohs( addr.sin_port );
+            }
+        }
+
+        ~LoopbackServer()
+        {
+            stop();
+        }
+
+        bool valid() const { return _port != 0; }
+
+        std::string url( const std::string& path ) const
+        {
+            std::stringstream buf;
+            buf << "http://127.0.0.1:" << _port << path;
+            return buf.str();
+        }
+
+        unsigned getNumAccepted() { Threading::ScopedMutexLock lock( _mutex ); return _accepted; }
+        unsigned getNumRequests() { Threading::ScopedMutexLock lock( _mutex ); return _requests; }
+
+        void run()
+        {
+            while( !_done )
+            {
+                socket_t s = ::accept( _listen, 0L, 0L );
+                if ( s == INVALID_SOCKET )
+                    break;
+
+                Threading::ScopedMutexLock lock( _mutex );
+                ++_accepted;
+                Connection* c = new Connection( s, _delayMs, _requests, _mutex );
+                _connections.push_back( c );
+                c->start();
+            }
+        }
+
+        void stop()
+        {
+            if ( _listen == INVALID_SOCKET )
+                return;
+
+            _done = true;
+            ::shutdown( _listen, SHUT_RDWR );
+            CLOSE_SOCKET( _listen );
+            _listen = INVALID_SOCKET;
+            if ( isRunning() )
+                join();
+
+            // the HTTP engine keeps its connections open; hang up on them.
+            for( unsigned i = 0; i < _connections.size(); ++i )
+            {
+                _connections[i]->shutdown();
+                _connections[i]->join();
+                delete _connections[i];
+            }
+            _connections.clear();
+        }
+
+    private:
+        socket_t                 _listen;
+        int                      _delayMs;
+        int                      _port;
+        unsigned                 _accepted;
+        unsigned                 _requests;
+        volatile bool            _done;
+        Threading::Mutex         _mutex;
+        std::vector<Connection*> _connections;
+    };
+
+    /** Counts successful completions. */
+    struct CountingCallback : public HTTPCallback
+    {
+        CountingCallback() : _count( 0 ) { }
+
+        void onComplete( const HTTPRequest& request, const HTTPResponse& response )
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( response.isOK() )
+                ++_count;
+        }
+
+        unsigned         _count;
+        Threading::Mutex _mutex;
+    };
+
+    /** Makes blocking calls from the engine thread, which must not deadlock. */
+    struct ReentrantCallback : public HTTPCallback
+    {
+        ReentrantCallback( const std::string& url ) :
+            _url( url ), _syncOK( false ), _nestedCancelled( false ) { }
+
+        void onComplete( const HTTPRequest& request, const HTTPResponse& response )
+        {
+            _syncOK = HTTPClient::get( _url ).isOK();
+
+            osg::ref_ptr<HTTPFuture> nested = HTTPClient::getAsync( HTTPRequest(_url) );
+            _nestedCancelled = nested->get().isCancelled();
+
+            _done.set();
+        }
+
+        std::string      _url;
+        bool             _syncOK;
+        bool             _nestedCancelled;
+        Threading::Event _done;
+    };
+}
+
+
+int
+httpEngine( osg::ArgumentParser& args )
+{
+    // a proxy configured in the environment must not intercept loopback traffic.
+#ifdef _WIN32
+    _putenv( "NO_PROXY=127.0.0.1" );
+#else
+    ::setenv( "NO_PROXY", "127.0.0.1", 1 );
+#endif
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup( MAKEWORD(2,2), &wsaData );
+#endif
+
+    LoopbackServer server( DELAY_MS );
+    BENCH_CHECK( server.valid() );
+    if ( !server.valid() )
+        return -1;
+    server.start();
+
+    // blocking, one request at a time on this thread's connection:
+    HTTPClient::setUseAsyncEngine( false );
+    bool syncOK = true;
+    Benchmark::Stopwatch t;
+    for( unsigned i = 0; i < NUM_REQUESTS; ++i )
+    {
+        std::stringstream path;
+        path << "/sync/" << i;
+        HTTPResponse response = HTTPClient::get( server.url(path.str()) );
+        syncOK = syncOK && response.isOK() && response.getPartAsString(0) == path.str();
+    }
+    double syncTime = t.seconds();
+    Benchmark::report( "blocking get", syncTime, NUM_REQUESTS, "requests" );
+    BENCH_CHECK( syncOK );
+
+    // multiplexed on the engine:
+    unsigned acceptedBefore = server.getNumAccepted();
+    osg::ref_ptr<CountingCallback> counter = new CountingCallback();
+    std::vector< osg::ref_ptr<HTTPFuture> > futures;
+    t.reset();
+    for( unsigned i = 0; i < NUM_REQUESTS; ++i )
+    {
+        std::stringstream path;
+        path << "/async/" << i;
+        futures.push_back( HTTPClient::getAsync(HTTPRequest(server.url(path.str())), 0L, 0L, counter.get()) );
+    }
+
+    bool asyncOK = true;
+    for( unsigned i = 0; i < NUM_REQUESTS; ++i )
+    {
+        std::stringstream path;
+        path << "/async/" << i;
+        const HTTPResponse& response = futures[i]->get();
+        asyncOK = asyncOK && response.isOK() && response.getPartAsString(0) == path.str();
+    }
+    double asyncTime = t.seconds();
+    Benchmark::report( "getAsync", asyncTime, NUM_REQUESTS, "requests" );
+    Benchmark::speedup( "getAsync speedup", syncTime, asyncTime );
+
+    BENCH_CHECK( asyncOK );
+    BENCH_CHECK( counter->_count == NUM_REQUESTS );
+    BENCH_CHECK( asyncTime * 2.0 < syncTime );
+
+    // the engine caps concurrent transfers per host and reuses their connections:
+    unsigned opened = server.getNumAccepted() - acceptedBefore;
+    std::cout << "  engine connections opened: " << opened << std::endl;
+    BENCH_CHECK( opened <= HTTPClient::getMaxConnectionsPerHost() );
+
+    // blocking calls from a callback run on the engine thread itself:
+    HTTPClient::setUseAsyncEngine( true );
+    osg::ref_ptr<ReentrantCallback> reentrant = new ReentrantCallback( server.url("/nested") );
+    HTTPClient::getAsync( HTTPRequest(server.url("/outer")), 0L, 0L, reentrant.get() );
+    // a deadlocked engine never completes the outer request; give up after 10s.
+    for( unsigned i = 0; i < 1000 && !reentrant->_done.isSet(); ++i )
+        OpenThreads::Thread::microSleep( 10000 );
+    BENCH_CHECK( reentrant->_done.isSet() );
+    BENCH_CHECK( reentrant->_syncOK );
+    BENCH_CHECK( reentrant->_nestedCancelled );
+
+    // the engine routes blocking calls from other threads:
+    HTTPResponse routed = HTTPClient::get( server.url("/routed") );
+    BENCH_CHECK( routed.isOK() && routed.getPartAsString(0) == "/routed" );
+    HTTPClient::setUseAsyncEngine( false );
+
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,202 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Assembles geodetic tiles from the spherical mercator tiles that intersect
+ * them, the way an image layer does when its profile differs from the map's:
+ * once by building the mosaic and reprojecting it, and once by sampling the
+ * source tiles directly. Compares throughput and the image memory each path
+ * allocates, and checks that both produce the same pixels.
+ */
+
+#include "Benchmark"
+#include <osgEarth/ImageMosaic>
+#include <osgEarth/Registry>
+#include <osgEarth/TileKey>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace
+{
+    const int SIZE = 256;
+
+    /** A tile whose pixels vary smoothly inside it and differ from its neighbors'. */
+    osg::Image* createTile( const TileKey& key )
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage( SIZE, SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+        image->setInternalTextureFormat( GL_RGBA8 );
+        for( int t = 0; t < SIZE; ++t )
+        {
+            for( int s = 0; s < SIZE; ++s )
+            {
+                unsigned char* p = image->data( s, t );
+                p[0] = (unsigned char)s;
+                p[1] = (unsigned char)t;
+                p[2] = (unsigned char)((key.getTileX()*37 + key.getTileY()*11) & 0xff);
+                p[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    struct Job
+    {
+        TileKey               _key;
+        std::vector<TileKey>  _sources;
+    };
+
+    /** Largest channel difference where both images have data; counts those pixels. */
+    int maxDifference( const osg::Image* a, const osg::Image* b, unsigned& out_compared )
+    {
+        int diff = 0;
+        out_compared = 0;
+        for( int t = 0; t < a->t(); ++t )
+        {
+            for( int s = 0; s < a->s(); ++s )
+            {
+                const unsigned char* pa = a->data( s, t );
+                const unsigned char* pb = b->data( s, t );
+                if ( pa[3] != 255 || pb[3] != 255 )
+                    continue;
+                ++out_compared;
+                for( int k = 0; k < 4; ++k )
+                    diff = osg::maximum( diff, std::abs((int)pa[k] - (int)pb[k]) );
+            }
+        }
+        return diff;
+    }
+}
+
+
+int
+imageMosaic( osg::ArgumentParser& args )
+{
+    unsigned lod = 5;
+    args.read( "--lod", lod );
+    unsigned n = 4;
+    args.read( "--tiles", n );
+
+    const Profile* geodetic = Registry::instance()->getGlobalGeodeticProfile();
+    const Profile* mercator = Registry::instance()->getSphericalMercatorProfile();
+
+    // a block of geodetic tiles at mid latitudes, each with the mercator
+    // tiles (one level down, so about the same resolution) that cover it.
+    std::map< TileKey, osg::ref_ptr<osg::Image> > sources;
+    std::vector<Job> jobs;
+    TileKey origin = geodetic->createTileKey( 0.0, 30.0, lod );
+    for( unsigned i = 0; i < n; ++i )
+    {
+        for( unsigned j = 0; j < n; ++j )
+        {
+            Job job;
+            job._key = TileKey( lod, origin.getTileX()+i, origin.getTileY()+j, geodetic );
+
+            std::vector<TileKey> keys;
+            mercator->getIntersectingTiles( job._key.getExtent(), keys );
+            for( unsigned k = 0; k < keys.size(); ++k )
+            {
+                if ( sources.find(keys[k]) == sources.end() )
+                    sources[keys[k]] = createTile( keys[k] );
+                job._sources.push_back( keys[k] );
+            }
+            jobs.push_back( job );
+        }
+    }
+
+    unsigned numSources = 0;
+    for( unsigned i = 0; i < jobs.size(); ++i )
+        numSources += jobs[i]._sources.size();
+    std::cout << "  " << jobs.size() << " output tiles from " << numSources << " source tiles" << std::endl;
+
+    // mosaic, then reproject:
+    std::vector< osg::ref_ptr<osg::Image> > before;
+    unsigned mosaicBytes = 0, beforeHighWater = 0;
+    Benchmark::Stopwatch t;
+    for( unsigned i = 0; i < jobs.size(); ++i )
+    {
+        ImageMosaic mosaic;
+        for( unsigned k = 0; k < jobs[i]._sources.size(); ++k )
+            mosaic.getImages().push_back( TileImage(sources[jobs[i]._sources[k]].get(), jobs[i]._sources[k]) );
+
+        double xmin, ymin, xmax, ymax;
+        mosaic.getExtents( xmin, ymin, xmax, ymax );
+        GeoImage mosaiced( mosaic.createImage(), GeoExtent(mercator->getSRS(), xmin, ymin, xmax, ymax) );
+        GeoImage result = mosaiced.reproject( geodetic->getSRS(), &jobs[i]._key.getExtent(), SIZE, SIZE, true );
+        before.push_back( result.getImage() );
+
+        unsigned bytes = mosaiced.getImage()->getImageSizeInBytes();
+        mosaicBytes    += bytes;
+        beforeHighWater = osg::maximum( beforeHighWater, bytes + result.getImage()->getImageSizeInBytes() );
+    }
+    double beforeTime = t.seconds();
+
+    // sample the source tiles directly:
+    std::vector< osg::ref_ptr<osg::Image> > after;
+    unsigned afterHighWater = 0;
+    t.reset();
+    for( unsigned i = 0; i < jobs.size(); ++i )
+    {
+        ImageMosaic mosaic;
+        for( unsigned k = 0; k < jobs[i]._sources.size(); ++k )
+            mosaic.getImages().push_back( TileImage(sources[jobs[i]._sources[k]].get(), jobs[i]._sources[k]) );
+
+        osg::ref_ptr<osg::Image> result = mosaic.createImage( mercator->getSRS(), jobs[i]._key.getExtent(), SIZE, SIZE, true );
+        after.push_back( result.get() );
+        if ( result.valid() )
+            afterHighWater = osg::maximum( afterHighWater, result->getImageSizeInBytes() );
+    }
+    double afterTime = t.seconds();
+
+    Benchmark::report( "mosaic + reproject (before)", beforeTime, jobs.size(), "tiles" );
+    Benchmark::report( "direct sampling (after)",     afterTime,  jobs.size(), "tiles" );
+    Benchmark::speedup( "speedup", beforeTime, afterTime );
+    std::cout
+        << "  image memory per output tile: before " << beforeHighWater/1024 << " KB peak ("
+        << mosaicBytes/jobs.size()/1024 << " KB mosaic on average), after " << afterHighWater/1024 << " KB" << std::endl;
+
+    BENCH_CHECK( afterHighWater == SIZE*SIZE*4 );
+    BENCH_CHECK( afterHighWater * 2 <= beforeHighWater );
+
+    bool allValid = true;
+    int  diff = 0;
+    unsigned compared = 0;
+    for( unsigned i = 0; i < jobs.size(); ++i )
+    {
+        allValid = allValid && before[i].valid() && after[i].valid();
+        if ( before[i].valid() && after[i].valid() )
+        {
+            unsigned c;
+            diff = osg::maximum( diff, maxDifference(before[i].get(), after[i].get(), c) );
+            compared += c;
+        }
+    }
+    std::cout << "  max pixel difference: " << diff << " over " << compared << " pixels" << std::endl;
+    BENCH_CHECK( allValid );
+    BENCH_CHECK( compared > 0 );
+
+    // both paths use the same transform grid and interpolation.
+    BENCH_CHECK( diff <= 1 );
+
+    return Benchmark::failures();
+}
@@ -0,0 +1,333 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Warps a stream of tiles into geodetic extents with ImageReprojector, from
+ * spherical mercator (against the per-pixel transform loop that handled
+ * mercator before) and from UTM (against the GDAL warp path). The source is
+ * a gradient whose value is its own pixel coordinate, so every output pixel
+ * can be checked against an exact per-pixel transform.
+ */
+
+#include "Benchmark"
+#include <osgEarth/ImageReprojector>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/TileKey>
+#include <gdal_priv.h>
+#include <gdalwarper.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace
+{
+    const int SIZE = 256;
+
+    /** RGBA gradient: red is the column and green the row. */
+    osg::Image* createGradient()
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage( SIZE, SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+        for( int t = 0; t < SIZE; ++t )
+        {
+            for( int s = 0; s < SIZE; ++s )
+            {
+                unsigned char* p = image->data( s, t );
+                p[0] = (unsigned char)s;
+                p[1] = (unsigned char)t;
+                p[2] = 128;
+                p[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    /** Largest difference between the warped gradient and its exact value. */
+    double maxError( const osg::Image* image, const GeoExtent& srcExtent, const GeoExtent& destExtent, unsigned& out_covered )
+    {
+        const SpatialReference* destSRS = destExtent.getSRS();
+        const SpatialReference* srcSRS  = srcExtent.getSRS();
+        double dx = destExtent.width()  / (double)image->s();
+        double dy = destExtent.height() / (double)image->t();
+        double err = 0.0;
+        out_covered = 0;
+
+        for( int t = 0; t < image->t(); ++t )
+        {
+            for( int s = 0; s < image->s(); ++s )
+            {
+                osg::Vec3d p;
+                destSRS->transform( osg::Vec3d(destExtent.xMin() + dx*((double)s+0.5), destExtent.yMin() + dy*((double)t+0.5), 0.0), srcSRS, p );
+
+                const unsigned char* pixel = image->data( s, t );
+                if ( !srcExtent.contains(p.x(), p.y()) )
+                    continue;
+
+                // edge pixels clamp; don't hold them to the gradient.
+                double px = (p.x() - srcExtent.xMin()) / srcExtent.width()  * (double)SIZE - 0.5;
+                double py = (p.y() - srcExtent.yMin()) / srcExtent.height() * (double)SIZE - 0.5;
+                if ( px < 0.0 || py < 0.0 || px > (double)(SIZE-1) || py > (double)(SIZE-1) )
+                    continue;
+
+                ++out_covered;
+                err = osg::maximum( err, fabs((double)pixel[0] - px) );
+                err = osg::maximum( err, fabs((double)pixel[1] - py) );
+            }
+        }
+        return err;
+    }
+
+    /**
+     * The mercator path before: every destination pixel transformed
+     * with transformExtentPoints, sampled through PixelReader.
+     */
+    osg::Image* reprojectPerPixel( const osg::Image* image, const GeoExtent& srcExtent, const GeoExtent& destExtent )
+    {
+        unsigned width = image->s(), height = image->t();
+        osg::Image* result = new osg::Image();
+        result->allocateImage( width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+        memset( result->data(), 0, result->getImageSizeInBytes() );
+
+        double dx = destExtent.width()  / (double)width;
+        double dy = destExtent.height() / (double)height;
+        std::vector<double> xs( width*height ), ys( width*height );
+        destExtent.getSRS()->transformExtentPoints(
+            srcExtent.getSRS(),
+            destExtent.xMin() + .5*dx, destExtent.yMin() + .5*dy,
+            destExtent.xMax() - .5*dx, destExtent.yMax() - .5*dy,
+            &xs[0], &ys[0], width, height );
+
+        ImageUtils::PixelReader read( image );
+        ImageUtils::PixelWriter write( result );
+        double xfac = (image->s() - 1) / srcExtent.width();
+        double yfac = (image->t() - 1) / srcExtent.height();
+        unsigned pixel = 0;
+        for( unsigned c = 0; c < width; ++c )
+        {
+            for( unsigned r = 0; r < height; ++r, ++pixel )
+            {
+                if ( !srcExtent.contains(xs[pixel], ys[pixel]) )
+                    continue;
+                float px = (xs[pixel] - srcExtent.xMin()) * xfac;
+                float py = (ys[pixel] - srcExtent.yMin()) * yfac;
+                int c0 = (int)floor(px), r0 = (int)floor(py);
+                int c1 = osg::minimum(c0+1, image->s()-1), r1 = osg::minimum(r0+1, image->t()-1);
+                float fx = px - (float)c0, fy = py - (float)r0;
+                osg::Vec4 bottom = read(c0, r0) * (1.0f-fx) + read(c1, r0) * fx;
+                osg::Vec4 top    = read(c0, r1) * (1.0f-fx) + read(c1, r1) * fx;
+                write( bottom * (1.0f-fy) + top * fy, c, r );
+            }
+        }
+        return result;
+    }
+
+    GDALDataset* createMemDS( int width, int height, const GeoExtent& extent )
+    {
+        GDALDriver* driver = GetGDALDriverManager()->GetDriverByName( "MEM" );
+        GDALDataset* ds = driver->Create( "", width, height, 4, GDT_Byte, 0L );
+        double xform[6] = {
+            extent.xMin(), extent.width()/(double)width, 0.0,
+            extent.yMax(), 0.0, -extent.height()/(double)height };
+        ds->SetGeoTransform( xform );
+        ds->SetProjection( extent.getSRS()->getWKT().c_str() );
+        return ds;
+    }
+
+    /** The GDAL path before: clone, flip, MEM datasets, GDALReprojectImage. */
+    osg::Image* reprojectGDAL( const osg::Image* image, const GeoExtent& srcExtent, const GeoExtent& destExtent )
+    {
+        GDAL_SCOPED_LOCK;
+
+        osg::ref_ptr<osg::Image> flipped = new osg::Image( *image, osg::CopyOp::DEEP_COPY_ALL );
+        flipped->flipVertical();
+
+        GDALDataset* srcDS = createMemDS( image->s(), image->t(), srcExtent );
+        srcDS->RasterIO( GF_Write, 0, 0, image->s(), image->t(), flipped->data(), image->s(), image->t(), GDT_Byte, 4, 0L, 4, 4*image->s(), 1 );
+
+        GDALDataset* destDS = createMemDS( image->s(), image->t(), destExtent );
+        GDALReprojectImage( srcDS, 0L, destDS, 0L, GRA_Bilinear, 0, 0, 0, 0, 0 );
+
+        osg::Image* result = new osg::Image();
+        result->allocateImage( image->s(), image->t(), 1, GL_RGBA, GL_UNSIGNED_BYTE );
+        destDS->RasterIO( GF_Read, 0, 0, result->s(), result->t(), result->data(), result->s(), result->t(), GDT_Byte, 4, 0L, 4, 4*result->s(), 1 );
+        result->flipVertical();
+
+        delete srcDS;
+        delete destDS;
+        return result;
+    }
+
+    /** Mean difference of the red and green channels where both images have data. */
+    double meanDifference( const osg::Image* a, const osg::Image* b )
+    {
+        double sum = 0.0;
+        unsigned n = 0;
+        for( int t = 0; t < a->t(); ++t )
+        {
+            for( int s = 0; s < a->s(); ++s )
+            {
+                const unsigned char* pa = a->data( s, t );
+                const unsigned char* pb = b->data( s, t );
+                if ( pa[3] == 255 && pb[3] == 255 )
+                {
+                    sum += fabs((double)pa[0] - (double)pb[0]) + fabs((double)pa[1] - (double)pb[1]);
+                    n += 2;
+                }
+            }
+        }
+        return n > 0 ? sum / (double)n : 0.0;
+    }
+
+    struct Tile
+    {
+        GeoExtent _src;
+        GeoExtent _dest;
+    };
+
+    /** Geodetic tiles over a box, each with the MBR of its extent in the source SRS. */
+    void makeTiles( const SpatialReference* srcSRS, double lon0, double lat0, unsigned lod, unsigned n, std::vector<Tile>& out )
+    {
+        const Profile* geodetic = Registry::instance()->getGlobalGeodeticProfile();
+        TileKey origin = geodetic->createTileKey( lon0, lat0, lod );
+        for( unsigned i = 0; i < n; ++i )
+        {
+            for( unsigned j = 0; j < n; ++j )
+            {
+                TileKey key( lod, origin.getTileX()+i, origin.getTileY()+j, geodetic );
+                Tile tile;
+                tile._dest = key.getExtent();
+                tile._src  = tile._dest.transform( srcSRS );
+                out.push_back( tile );
+            }
+        }
+    }
+
+    /** Warps every tile; returns the largest gradient error. */
+    double warpAll( const osg::Image* source, const std::vector<Tile>& tiles, double& out_seconds, bool check )
+    {
+        double err = 0.0;
+        Benchmark::Stopwatch t;
+        std::vector< osg::ref_ptr<osg::Image> > results;
+        for( unsigned i = 0; i < tiles.size(); ++i )
+            results.push_back( ImageReprojector::reproject(source, tiles[i]._src, tiles[i]._dest) );
+        out_seconds = t.seconds();
+
+        for( unsigned i = 0; check && i < tiles.size(); ++i )
+        {
+            unsigned covered = 0;
+            BENCH_CHECK( results[i].valid() );
+            if ( results[i].valid() )
+                err = osg::maximum( err, maxError(results[i].get(), tiles[i]._src, tiles[i]._dest, covered) );
+            BENCH_CHECK( covered > 0 );
+        }
+        return err;
+    }
+}
+
+
+int
+imageReprojector( osg::ArgumentParser& args )
+{
+    unsigned lod = 6;
+    args.read( "--lod", lod );
+    unsigned n = 4;
+    args.read( "--tiles", n );
+
+    GDALAllRegister();
+
+    osg::ref_ptr<osg::Image> source = createGradient();
+    const SpatialReference* wgs84 = Registry::instance()->getGlobalGeodeticProfile()->getSRS();
+
+    // an eighth of a source pixel of grid error, plus rounding to bytes.
+    const double TOLERANCE = 0.75;
+
+    // spherical mercator -> geodetic
+    {
+        const SpatialReference* merc = Registry::instance()->getSphericalMercatorProfile()->getSRS();
+        std::vector<Tile> tiles;
+        makeTiles( merc, 10.0, 40.0, lod, n, tiles );
+
+        double cold, warm, before = 0.0;
+        double err = warpAll( source.get(), tiles, cold, true );
+        warpAll( source.get(), tiles, warm, false );
+
+        Benchmark::Stopwatch t;
+        for( unsigned i = 0; i < tiles.size(); ++i )
+        {
+            osg::ref_ptr<osg::Image> ref = reprojectPerPixel( source.get(), tiles[i]._src, tiles[i]._dest );
+        }
+        before = t.seconds();
+
+        Benchmark::report( "mercator: per-pixel transform (before)", before, tiles.size(), "tiles" );
+        Benchmark::report( "mercator: ImageReprojector, new grids", cold, tiles.size(), "tiles" );
+        Benchmark::report( "mercator: ImageReprojector, cached grids", warm, tiles.size(), "tiles" );
+        Benchmark::speedup( "mercator speedup", before, cold );
+        std::cout << "  mercator max gradient error: " << err << std::endl;
+        BENCH_CHECK( err <= TOLERANCE );
+
+        // separable, so the grid is exact and has no control point mesh.
+        osg::ref_ptr<TransformGrid> grid = ImageReprojector::getGrid( tiles[0]._src, SIZE, SIZE, tiles[0]._dest, SIZE, SIZE );
+        BENCH_CHECK( grid.valid() && grid->getStep() == 0 );
+        BENCH_CHECK( grid.get() == ImageReprojector::getGrid(tiles[0]._src, SIZE, SIZE, tiles[0]._dest, SIZE, SIZE).get() );
+    }
+
+    // UTM -> geodetic
+    {
+        osg::ref_ptr<const SpatialReference> utm = wgs84->createUTMFromLonLat( Angular(15.0), Angular(45.0) );
+        BENCH_CHECK( utm.valid() );
+        if ( !utm.valid() )
+            return Benchmark::failures();
+
+        std::vector<Tile> tiles;
+        makeTiles( utm.get(), 14.0, 44.0, lod, n, tiles );
+
+        double cold, warm;
+        double err = warpAll( source.get(), tiles, cold, true );
+        warpAll( source.get(), tiles, warm, false );
+
+        double diff = 0.0;
+        Benchmark::Stopwatch t;
+        std::vector< osg::ref_ptr<osg::Image> > gdal;
+        for( unsigned i = 0; i < tiles.size(); ++i )
+            gdal.push_back( reprojectGDAL(source.get(), tiles[i]._src, tiles[i]._dest) );
+        double before = t.seconds();
+
+        for( unsigned i = 0; i < tiles.size(); ++i )
+        {
+            osg::ref_ptr<osg::Image> ours = ImageReprojector::reproject( source.get(), tiles[i]._src, tiles[i]._dest );
+            diff = osg::maximum( diff, meanDifference(ours.get(), gdal[i].get()) );
+        }
+
+        Benchmark::report( "UTM: GDAL warp (before)", before, tiles.size(), "tiles" );
+        Benchmark::report( "UTM: ImageReprojector, new grids", cold, tiles.size(), "tiles" );
+        Benchmark::report( "UTM: ImageReprojector, cached grids", warm, tiles.size(), "tiles" );
+        Benchmark::speedup( "UTM speedup", before, cold );
+        std::cout << "  UTM max gradient error: " << err << ", mean difference from GDAL: " << diff << std::endl;
+        BENCH_CHECK( err <= TOLERANCE );
+        BENCH_CHECK( diff <= 1.0 );
+
+        osg::ref_ptr<TransformGrid> grid = ImageReprojector::getGrid( tiles[0]._src, SIZE, SIZE, tiles[0]._dest, SIZE, SIZE );
+        BENCH_CHECK( grid.valid() && grid->getStep() > 0 );
+    }
+
+    return Benchmark::failures();
+}
@@ -0,0 +1,298 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Reads a synthetic shapefile with many attributes through the OGR feature
+ * source, with and without read-ahead and with and without an attribute
+ * projection, while the consumer does some work on each feature (standing
+ * in for the filters). Reports time to first feature and throughput, and
+ * checks that every configuration reads the same features and values, that
+ * a projection leaves out the other attributes, and how Query::combineWith
+ * merges projections.
+ */
+
+#include "Benchmark"
+#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthFeatures/FeatureSource>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <ogr_api.h>
+#include <ogr_srs_api.h>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    const unsigned NUM_EXTRA_FIELDS = 18;
+
+    std::string extraField( unsigned i )
+    {
+        return Stringify() << "field_" << (i < 10 ? "0" : "") << i;
+    }
+
+    double heightFor( unsigned f ) { return (double)(10 + f % 90); }
+
+    std::string nameFor( unsigned f ) { return Stringify() << "building " << f; }
+
+    bool createShapefile( const std::string& path, unsigned n )
+    {
+        GDAL_SCOPED_LOCK;
+        OGRRegisterAll();
+
+        OGRSFDriverH driver = OGRGetDriverByName( "ESRI Shapefile" );
+        if ( !driver )
+            return false;
+
+        OGRDataSourceH ds = OGR_Dr_CreateDataSource( driver, path.c_str(), 0L );
+        if ( !ds )
+            return false;
+
+        OGRSpatialReferenceH srs = OSRNewSpatialReference( 0L );
+        OSRSetWellKnownGeogCS( srs, "WGS84" );
+        OGRLayerH layer = OGR_DS_CreateLayer( ds, "buildings", srs, wkbPolygon, 0L );
+        OSRDestroySpatialReference( srs );
+        if ( !layer )
+        {
+            OGR_DS_Destroy( ds );
+            return false;
+        }
+
+        OGRFieldDefnH fd = OGR_Fld_Create( "height", OFTReal );
+        OGR_L_CreateField( layer, fd, TRUE );
+        OGR_Fld_Destroy( fd );
+
+        fd = OGR_Fld_Create( "name", OFTString );
+        OGR_Fld_SetWidth( fd, 32 );
+        OGR_L_CreateField( layer, fd, TRUE );
+        OGR_Fld_Destroy( fd );
+
+        for( unsigned i = 0; i < NUM_EXTRA_FIELDS; ++i )
+        {
+            fd = OGR_Fld_Create( extraField(i).c_str(), i % 2 == 0 ? OFTString : OFTReal );
+            if ( i % 2 == 0 )
+                OGR_Fld_SetWidth( fd, 24 );
+            OGR_L_CreateField( layer, fd, TRUE );
+            OGR_Fld_Destroy( fd );
+        }
+
+        OGRFeatureDefnH defn = OGR_L_GetLayerDefn( layer );
+        unsigned side = (unsigned)ceil( sqrt((double)n) );
+        for( unsigned f = 0; f < n; ++f )
+        {
+            double x = 10.0 + 0.001 * (double)(f % side);
+            double y = 50.0 + 0.001 * (double)(f / side);
+
+            OGRGeometryH ring = OGR_G_CreateGeometry( wkbLinearRing );
+            OGR_G_AddPoint_2D( ring, x,          y );
+            OGR_G_AddPoint_2D( ring, x + 0.0008, y );
+            OGR_G_AddPoint_2D( ring, x + 0.0008, y + 0.0008 );
+            OGR_G_AddPoint_2D( ring, x,          y + 0.0008 );
+            OGR_G_AddPoint_2D( ring, x,          y );
+            OGRGeometryH poly = OGR_G_CreateGeometry( wkbPolygon );
+            OGR_G_AddGeometryDirectly( poly, ring );
+
+            OGRFeatureH feature = OGR_F_Create( defn );
+            OGR_F_SetGeometryDirectly( feature, poly );
+            OGR_F_SetFieldDouble( feature, 0, heightFor(f) );
+            OGR_F_SetFieldString( feature, 1, nameFor(f).c_str() );
+            for( unsigned i = 0; i < NUM_EXTRA_FIELDS; ++i )
+            {
+                if ( i % 2 == 0 )
+                    OGR_F_SetFieldString( feature, 2+i, (Stringify() << "value " << i << "/" << f).c_str() );
+                else
+                    OGR_F_SetFieldDouble( feature, 2+i, (double)(f * i) );
+            }
+            OGR_L_CreateFeature( layer, feature );
+            OGR_F_Destroy( feature );
+        }
+
+        OGR_DS_Destroy( ds );
+        return true;
+    }
+
+    void removeShapefile( const std::string& base )
+    {
+        const char* ext[] = { ".shp", ".shx", ".dbf", ".prj" };
+        for( unsigned i = 0; i < 4; ++i )
+            remove( (base + ext[i]).c_str() );
+    }
+
+    /** Stands in for the filters that process each feature. */
+    double consume( const Feature* feature )
+    {
+        double sum = 0.0;
+        const Geometry* geom = feature->getGeometry();
+        if ( geom )
+        {
+            for( unsigned k = 0; k < 32; ++k )
+                for( Geometry::const_iterator p = geom->begin(); p != geom->end(); ++p )
+                    sum += sin( p->x() * (double)k ) * cos( p->y() );
+        }
+        return sum;
+    }
+
+    struct ReadResult
+    {
+        ReadResult() : firstFeature( 0.0 ), total( 0.0 ), valuesOK( true ), extraFields( 0 ) { }
+
+        double                 firstFeature;  // seconds
+        double                 total;         // seconds
+        std::vector<FeatureID> ids;
+        bool                   valuesOK;
+        unsigned               extraFields;   // attributes present beyond height and name
+    };
+
+    bool read( const std::string& path, unsigned prefetchThreads, const Query& query, ReadResult& out )
+    {
+        OGRFeatureOptions options;
+        options.url()             = URI( path );
+        options.prefetchThreads() = prefetchThreads;
+
+        osg::ref_ptr<FeatureSource> source = FeatureSourceFactory::create( options );
+        if ( !source.valid() )
+            return false;
+        source->initialize();
+        if ( !source->getFeatureProfile() )
+            return false;
+
+        Benchmark::Stopwatch t;
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor( query );
+        if ( !cursor.valid() )
+            return false;
+
+        double sink = 0.0;
+        while( cursor->hasMore() )
+        {
+            osg::ref_ptr<Feature> feature = cursor->nextFeature();
+            if ( out.ids.empty() )
+                out.firstFeature = t.seconds();
+
+            FeatureID id = feature->getFID();
+            out.ids.push_back( id );
+            out.valuesOK = out.valuesOK &&
+                feature->getDouble("height") == heightFor((unsigned)id) &&
+                feature->getString("name") == nameFor((unsigned)id);
+
+            for( unsigned i = 0; i < NUM_EXTRA_FIELDS; ++i )
+                if ( feature->getAttr(extraField(i)) )
+                    ++out.extraFields;
+
+            sink += consume( feature.get() );
+        }
+        out.total = t.seconds();
+
+        // keep the work from being optimized away.
+        if ( sink == 12345.0 )
+            std::cout << "";
+
+        return true;
+    }
+
+    void report( const std::string& what, const ReadResult& r )
+    {
+        std::cout << "  " << what << ": first feature after " << r.firstFeature * 1000.0 << " ms" << std::endl;
+        Benchmark::report( what + ", read + consume", r.total, r.ids.size(), "features" );
+    }
+
+    bool hasAttributes( const Query& q, const std::string& list )
+    {
+        StringVector expected;
+        StringTokenizer( list, expected, " ", "", false, true );
+        return q.attributes() == expected;
+    }
+}
+
+
+int
+ogrCursor( osg::ArgumentParser& args )
+{
+    // projections merge as a union, and an empty list ("all") wins:
+    Query a, b, none;
+    a.attributes().push_back( "height" );
+    b.attributes().push_back( "name" );
+    b.attributes().push_back( "height" );
+    BENCH_CHECK( hasAttributes(a.combineWith(b), "height name") );
+    BENCH_CHECK( hasAttributes(a.combineWith(a), "height") );
+    BENCH_CHECK( a.combineWith(none).attributes().empty() );
+    BENCH_CHECK( none.combineWith(b).attributes().empty() );
+
+    // read-ahead is opt-in:
+    BENCH_CHECK( *OGRFeatureOptions().prefetchThreads() == 0 );
+
+    unsigned n = 50000;
+    args.read( "--features", n );
+
+    std::string base = "osgearth_benchmark_buildings";
+    std::string path = base + ".shp";
+    removeShapefile( base );
+    if ( !createShapefile(path, n) )
+    {
+        std::cout << "  Cannot create " << path << "; skipping" << std::endl;
+        return 0;
+    }
+
+    Query all;
+    Query projected;
+    projected.attributes().push_back( "height" );
+    projected.attributes().push_back( "name" );
+
+    ReadResult onDemand, readAhead, onDemandProjected, readAheadProjected;
+    bool ok =
+        read( path, 0, all,       onDemand ) &&
+        read( path, 2, all,       readAhead ) &&
+        read( path, 0, projected, onDemandProjected ) &&
+        read( path, 2, projected, readAheadProjected );
+    BENCH_CHECK( ok );
+
+    if ( ok )
+    {
+        report( "on demand, all attributes",   onDemand );
+        report( "read-ahead, all attributes",  readAhead );
+        report( "on demand, 2 attributes",     onDemandProjected );
+        report( "read-ahead, 2 attributes",    readAheadProjected );
+        Benchmark::speedup( "read-ahead vs. on demand", onDemand.total, readAhead.total );
+        Benchmark::speedup( "projection vs. all attributes", onDemand.total, onDemandProjected.total );
+        Benchmark::speedup( "read-ahead + projection vs. neither", onDemand.total, readAheadProjected.total );
+
+        // everyone reads the same features, in the same order, with the same values:
+        BENCH_CHECK( onDemand.ids.size() == n );
+        BENCH_CHECK( readAhead.ids == onDemand.ids );
+        BENCH_CHECK( onDemandProjected.ids == onDemand.ids );
+        BENCH_CHECK( readAheadProjected.ids == onDemand.ids );
+        BENCH_CHECK( onDemand.valuesOK && readAhead.valuesOK && onDemandProjected.valuesOK && readAheadProjected.valuesOK );
+
+        // all attributes means all of them; a projection leaves the others out.
+        BENCH_CHECK( onDemand.extraFields == n * NUM_EXTRA_FIELDS );
+        BENCH_CHECK( readAhead.extraFields == n * NUM_EXTRA_FIELDS );
+#if GDAL_VERSION_NUM >= 1800
+        BENCH_CHECK( onDemandProjected.extraFields == 0 );
+        BENCH_CHECK( readAheadProjected.extraFields == 0 );
+#endif
+    }
+
+    removeShapefile( base );
+    return 0;
+}
@@ -0,0 +1,231 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Exercises the ScriptEngine batching layer with a pure C++ mock engine
+ * whose "scripts" are numeric expressions over feature attributes. Times
+ * one run() per feature with and without a compiled-script cache against a
+ * batch run() that enters the engine and compiles once, and checks that
+ * all three agree, that the default batch run() preserves order, and how
+ * often each path compiles and enters the engine.
+ */
+
+#include "Benchmark"
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <map>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace
+{
+    /**
+     * Compiling parses the expression; entering the engine takes a lock, the
+     * way the V8 engine takes a v8::Locker. Uses the default batch run().
+     */
+    class MockEngine : public ScriptEngine
+    {
+    public:
+        MockEngine( bool cacheCompiled ) : _cacheCompiled( cacheCompiled ), _compiles( 0 ), _entries( 0 ) { }
+
+        bool supported( std::string lang ) { return lang == "mock"; }
+        bool supported( Script* script )   { return script && supported(script->getLanguage()); }
+
+        ScriptResult run( Script* script, Feature const* feature, FilterContext const* context )
+        {
+            if ( !script )
+                return ScriptResult( EMPTY_STRING, false, "Script is null." );
+            return run( script->getCode(), feature, context );
+        }
+
+        ScriptResult run( const std::string& code, Feature const* feature, FilterContext const* context )
+        {
+            Threading::ScopedMutexLock lock( _engineMutex );
+            ++_entries;
+            return runCompiled( compile(code), feature );
+        }
+
+        ScriptResult call( const std::string& function, Feature const* feature, FilterContext const* context )
+        {
+            return ScriptResult( EMPTY_STRING, false, "Not supported." );
+        }
+
+        unsigned _compiles;
+        unsigned _entries;
+
+    protected:
+        NumericExpression& compile( const std::string& code )
+        {
+            if ( !_cacheCompiled )
+            {
+                ++_compiles;
+                _scratch = NumericExpression( code );
+                return _scratch;
+            }
+
+            std::map<std::string, NumericExpression>::iterator i = _compiled.find( code );
+            if ( i == _compiled.end() )
+            {
+                ++_compiles;
+                i = _compiled.insert( std::make_pair(code, NumericExpression(code)) ).first;
+            }
+            return i->second;
+        }
+
+        ScriptResult runCompiled( NumericExpression& expr, Feature const* feature )
+        {
+            if ( !feature )
+                return ScriptResult( EMPTY_STRING, false, "No feature." );
+            return ScriptResult( Stringify() << feature->eval(expr) );
+        }
+
+        bool                                     _cacheCompiled;
+        NumericExpression                        _scratch;
+        std::map<std::string, NumericExpression> _compiled;
+        Threading::Mutex                         _engineMutex;
+    };
+
+    /** Overrides the batch run() to enter the engine and compile once. */
+    class BatchingMockEngine : public MockEngine
+    {
+    public:
+        BatchingMockEngine() : MockEngine( true ) { }
+
+        using MockEngine::run;
+
+        bool run( const std::string& code, const FeatureList& features, std::vector<ScriptResult>& out_results, FilterContext const* context )
+        {
+            Threading::ScopedMutexLock lock( _engineMutex );
+            ++_entries;
+
+            NumericExpression& expr = compile( code );
+            out_results.clear();
+            out_results.reserve( features.size() );
+            for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+                out_results.push_back( runCompiled(expr, i->get()) );
+            return true;
+        }
+    };
+
+    const std::string CODE = "[height] * 3 + [levels]";
+
+    // integral values, so the results format exactly.
+    double expected( unsigned f ) { return (double)(f % 100) * 3.0 + (double)(f % 7); }
+
+    bool checkResults( std::vector<ScriptResult>& results, unsigned n )
+    {
+        if ( results.size() != n )
+            return false;
+        for( unsigned f = 0; f < n; f += 101 )
+            if ( !results[f].success() || results[f].asDouble() != expected(f) )
+                return false;
+        return true;
+    }
+
+    bool sameResults( std::vector<ScriptResult>& a, std::vector<ScriptResult>& b )
+    {
+        if ( a.size() != b.size() )
+            return false;
+        for( unsigned i = 0; i < a.size(); ++i )
+            if ( a[i].asString() != b[i].asString() )
+                return false;
+        return true;
+    }
+}
+
+
+int
+scriptBatch( osg::ArgumentParser& args )
+{
+    unsigned n = 50000;
+    args.read( "--features", n );
+
+    FeatureList features;
+    for( unsigned f = 0; f < n; ++f )
+    {
+        Feature* feature = new Feature( 0L, 0L, Style(), f );
+        feature->set( "height", (double)(f % 100) );
+        feature->set( "levels", (int)(f % 7) );
+        features.push_back( feature );
+    }
+
+    // what scripted expressions used to do: compile on every run.
+    osg::ref_ptr<MockEngine> uncached = new MockEngine( false );
+    std::vector<ScriptResult> uncachedResults;
+    Benchmark::Stopwatch t;
+    bool uncachedOK = static_cast<ScriptEngine*>(uncached.get())->run( CODE, features, uncachedResults );
+    double uncachedTime = t.seconds();
+    Benchmark::report( "run per feature, compile every run", uncachedTime, n, "features" );
+
+    osg::ref_ptr<MockEngine> cached = new MockEngine( true );
+    std::vector<ScriptResult> cachedResults;
+    t.reset();
+    bool cachedOK = static_cast<ScriptEngine*>(cached.get())->run( CODE, features, cachedResults );
+    double cachedTime = t.seconds();
+    Benchmark::report( "run per feature, compiled cache", cachedTime, n, "features" );
+
+    osg::ref_ptr<BatchingMockEngine> batching = new BatchingMockEngine();
+    std::vector<ScriptResult> batchResults;
+    t.reset();
+    bool batchOK = static_cast<ScriptEngine*>(batching.get())->run( CODE, features, batchResults );
+    double batchTime = t.seconds();
+    Benchmark::report( "batch run", batchTime, n, "features" );
+
+    Benchmark::speedup( "compiled cache vs. compile every run", uncachedTime, cachedTime );
+    Benchmark::speedup( "batch vs. compile every run", uncachedTime, batchTime );
+
+    BENCH_CHECK( uncachedOK && cachedOK && batchOK );
+    BENCH_CHECK( checkResults(uncachedResults, n) );
+    BENCH_CHECK( sameResults(uncachedResults, cachedResults) );
+    BENCH_CHECK( sameResults(uncachedResults, batchResults) );
+
+    BENCH_CHECK( uncached->_compiles == n && uncached->_entries == n );
+    BENCH_CHECK( cached->_compiles == 1 && cached->_entries == n );
+    BENCH_CHECK( batching->_compiles == 1 && batching->_entries == 1 );
+    BENCH_CHECK( batchTime < uncachedTime );
+
+    // the default batch run() reports failures per feature, in order:
+    FeatureList mixed;
+    mixed.push_back( features.front() );
+    mixed.push_back( 0L );
+    mixed.push_back( features.back() );
+    std::vector<ScriptResult> mixedResults;
+    BENCH_CHECK( static_cast<ScriptEngine*>(cached.get())->run(CODE, mixed, mixedResults) );
+    BENCH_CHECK( mixedResults.size() == 3 );
+    BENCH_CHECK( mixedResults[0].success() && mixedResults[0].asDouble() == expected(0) );
+    BENCH_CHECK( !mixedResults[1].success() );
+    BENCH_CHECK( mixedResults[2].success() && mixedResults[2].asDouble() == expected(n-1) );
+
+    // a null script fails the whole batch, with one result per feature:
+    std::vector<ScriptResult> nullResults;
+    BENCH_CHECK( !static_cast<ScriptEngine*>(cached.get())->run((Script*)0L, mixed, nullResults) );
+    BENCH_CHECK( nullResults.size() == 3 && !nullResults[0].success() );
+
+    // an empty batch succeeds with no results:
+    std::vector<ScriptResult> emptyResults( 1 );
+    BENCH_CHECK( static_cast<ScriptEngine*>(cached.get())->run(CODE, FeatureList(), emptyResults) );
+    BENCH_CHECK( emptyResults.empty() );
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Stresses the sqlite3 cache with many more threads than it has pooled
+ * connections, mixing reads and writes over a key space big enough to keep
+ * eviction busy, and verifies every hit. Also checks that eviction honors
+ * hits whose access times are still waiting to be written.
+ */
+
+#include "Benchmark"
+#include <osgEarth/Cache>
+#include <osgEarth/CacheBin>
+#include <osgEarth/StringUtils>
+#include <osgEarthDrivers/cache_sqlite3/Sqlite3CacheOptions>
+#include <OpenThreads/Thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    /** Pixels that depend on the key and don't compress. */
+    osg::Image* createPayload( unsigned key, int size )
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage( size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+        unsigned x = key * 2654435761u + 1u;
+        unsigned char* p = image->data();
+        for( unsigned i = 0; i < image->getImageSizeInBytes(); ++i )
+        {
+            x = x * 1664525u + 1013904223u;
+            p[i] = (unsigned char)(x >> 24);
+        }
+        return image;
+    }
+
+    bool samePixels( const osg::Image* a, const osg::Image* b )
+    {
+        return
+            a && b &&
+            a->getImageSizeInBytes() == b->getImageSizeInBytes() &&
+            memcmp( a->data(), b->data(), a->getImageSizeInBytes() ) == 0;
+    }
+
+    void removeDatabase( const std::string& path )
+    {
+        ::remove( path.c_str() );
+        ::remove( (path + "-wal").c_str() );
+        ::remove( (path + "-shm").c_str() );
+        ::remove( (path + "-journal").c_str() );
+    }
+
+    Cache* openCache( const std::string& path, unsigned maxSizeMB, unsigned maxConnections )
+    {
+        removeDatabase( path );
+        Sqlite3CacheOptions options;
+        options.path()                = path;
+        options.maxSize()             = maxSizeMB;
+        options.maxConnections()      = maxConnections;
+        options.accessTimeBatchSize() = 1000;
+        return CacheFactory::create( options );
+    }
+
+    /** One client: a fixed mix of reads and writes over the shared key space. */
+    class Client : public OpenThreads::Thread
+    {
+    public:
+        Client( CacheBin* bin, unsigned seed, unsigned ops, unsigned keys, int size ) :
+            _bin( bin ), _seed( seed ), _ops( ops ), _keys( keys ), _size( size ),
+            _reads( 0 ), _hits( 0 ), _corrupt( 0 ), _writes( 0 ), _failedWrites( 0 ) { }
+
+        void run()
+        {
+            unsigned x = _seed;
+            for( unsigned i = 0; i < _ops; ++i )
+            {
+                x = x * 1664525u + 1013904223u;
+                unsigned key = (x >> 8) % _keys;
+                std::string name = Stringify() << "key_" << key;
+
+                // 3 reads to every write:
+                if ( (x >> 4) % 4 != 0 )
+                {
+                    ++_reads;
+                    ReadResult r = _bin->readImage( name );
+                    if ( r.succeeded() )
+                    {
+                        ++_hits;
+                        osg::ref_ptr<osg::Image> expected = createPayload( key, _size );
+                        if ( !samePixels(r.getImage(), expected.get()) )
+                            ++_corrupt;
+                    }
+                }
+                else
+                {
+                    ++_writes;
+                    osg::ref_ptr<osg::Image> image = createPayload( key, _size );
+                    if ( !_bin->write(name, image.get()) )
+                        ++_failedWrites;
+                }
+            }
+        }
+
+        CacheBin* _bin;
+        unsigned  _seed, _ops, _keys;
+        int       _size;
+        unsigned  _reads, _hits, _corrupt, _writes, _failedWrites;
+    };
+
+    /** Runs some clients to completion; false if they don't finish in time. */
+    bool runClients( std::vector<Client*>& clients, double timeout )
+    {
+        for( unsigned i = 0; i < clients.size(); ++i )
+            clients[i]->start();
+
+        Benchmark::Stopwatch t;
+        for( unsigned i = 0; i < clients.size(); ++i )
+        {
+            while( clients[i]->isRunning() )
+            {
+                if ( t.seconds() > timeout )
+                    return false;
+                OpenThreads::Thread::microSleep( 10000 );
+            }
+        }
+        return true;
+    }
+}
+
+
+int
+sqlite3Cache( osg::ArgumentParser& args )
+{
+    unsigned numThreads = 16;
+    args.read( "--threads", numThreads );
+    unsigned maxConnections = 4;
+    args.read( "--connections", maxConnections );
+    unsigned ops = 400;
+    args.read( "--ops", ops );
+
+    const std::string path = "osgearth_benchmark_cache.db";
+
+    // eviction must see hits that are still batched in memory. Write the
+    // "hot" records first, so that on a tie in access time they'd go first.
+    {
+        osg::ref_ptr<Cache> cache = openCache( path, 1, maxConnections );
+        BENCH_CHECK( cache.valid() && cache->isOK() );
+        CacheBin* bin = cache.valid() ? cache->addBin( "lru" ) : 0L;
+        BENCH_CHECK( bin != 0L );
+        if ( bin )
+        {
+            const unsigned numHot = 8, numOld = 48, numNew = 24;
+            bool writesOK = true;
+            for( unsigned i = 0; i < numOld; ++i )
+            {
+                osg::ref_ptr<osg::Image> image = createPayload( i, 64 );
+                writesOK = bin->write( Stringify() << "old_" << i, image.get() ) && writesOK;
+            }
+
+            // access times have a resolution of one second.
+            OpenThreads::Thread::microSleep( 1100000 );
+
+            for( unsigned i = 0; i < numHot; ++i )
+                BENCH_CHECK( bin->readImage(Stringify() << "old_" << i).succeeded() );
+
+            for( unsigned i = 0; i < numNew; ++i )
+            {
+                osg::ref_ptr<osg::Image> image = createPayload( 1000+i, 64 );
+                writesOK = bin->write( Stringify() << "new_" << i, image.get() ) && writesOK;
+            }
+            BENCH_CHECK( writesOK );
+
+            unsigned hotKept = 0, coldKept = 0;
+            for( unsigned i = 0; i < numOld; ++i )
+            {
+                bool cached = bin->isCached( Stringify() << "old_" << i );
+                if ( i < numHot && cached ) ++hotKept;
+                if ( i >= numHot && cached ) ++coldKept;
+            }
+            std::cout << "  eviction kept " << hotKept << " of " << numHot << " recently read records and "
+                << coldKept << " of " << (numOld-numHot) << " others" << std::endl;
+            BENCH_CHECK( hotKept == numHot );
+            BENCH_CHECK( coldKept < numOld - numHot );
+        }
+    }
+    removeDatabase( path );
+
+    // mixed read/write load, one thread and then many:
+    const unsigned numKeys = 256;
+    const int      size    = 32;  // 4 KB records; 1 MB of keys against a 1 MB limit
+    double rate[2] = { 0.0, 0.0 };
+    unsigned threadCounts[2] = { 1, numThreads };
+
+    for( unsigned run = 0; run < 2; ++run )
+    {
+        osg::ref_ptr<Cache> cache = openCache( path, 1, maxConnections );
+        CacheBin* bin = cache.valid() ? cache->addBin( "stress" ) : 0L;
+        BENCH_CHECK( bin != 0L );
+        if ( !bin )
+            break;
+
+        std::vector<Client*> clients;
+        for( unsigned i = 0; i < threadCounts[run]; ++i )
+            clients.push_back( new Client(bin, 17u*i + 1u, ops * numThreads / threadCounts[run], numKeys, size) );
+
+        Benchmark::Stopwatch t;
+        if ( !runClients(clients, 300.0) )
+        {
+            // threads stuck waiting on each other; there's no way to stop them.
+            std::cout << "  FAILED: clients did not finish (deadlock?)" << std::endl;
+            std::exit( 1 );
+        }
+        double seconds = t.seconds();
+
+        unsigned reads = 0, hits = 0, corrupt = 0, writes = 0, failedWrites = 0;
+        for( unsigned i = 0; i < clients.size(); ++i )
+        {
+            reads        += clients[i]->_reads;
+            hits         += clients[i]->_hits;
+            corrupt      += clients[i]->_corrupt;
+            writes       += clients[i]->_writes;
+            failedWrites += clients[i]->_failedWrites;
+            delete clients[i];
+        }
+
+        std::string label = Stringify() << threadCounts[run] << " thread(s), " << maxConnections << " connections";
+        Benchmark::report( label, seconds, reads + writes, "ops" );
+        std::cout << "  " << reads << " reads (" << hits << " hits), " << writes << " writes" << std::endl;
+        rate[run] = seconds > 0.0 ? (double)(reads + writes) / seconds : 0.0;
+
+        BENCH_CHECK( hits > 0 );
+        BENCH_CHECK( corrupt == 0 );
+        BENCH_CHECK( failedWrites == 0 );
+
+        cache = 0L;
+        removeDatabase( path );
+    }
+
+    if ( rate[0] > 0.0 )
+        Benchmark::speedup( "throughput, many threads vs. one", 1.0/rate[0], 1.0/rate[1] );
+
+    return Benchmark::failures();
+}
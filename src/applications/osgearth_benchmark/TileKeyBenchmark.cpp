@@ -0,0 +1,177 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Times TileKey construction (child and neighbor keys) and lookup in the
+ * ordered and hashed containers the engine keys on tiles, against string
+ * keys like the ones a TileKey used to format for itself. Checks that
+ * packed IDs are unique, hashes agree with equality, and child extents
+ * tile their parent.
+ */
+
+#include "Benchmark"
+#include <osgEarth/Registry>
+#include <osgEarth/TileKey>
+#include <osgEarth/StringUtils>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+#  include <unordered_map>
+#  define HAVE_UNORDERED_MAP
+#endif
+
+using namespace osgEarth;
+
+namespace
+{
+    const unsigned MAX_LOD = 8;
+
+    // every key in the pyramid under the profile's root keys, through MAX_LOD.
+    void collectKeys( const TileKey& key, std::vector<TileKey>& out )
+    {
+        out.push_back( key );
+        if ( key.getLOD() < MAX_LOD )
+        {
+            for( unsigned q = 0; q < 4; ++q )
+                collectKeys( key.createChildKey(q), out );
+        }
+    }
+
+    // the string a key used to build in its constructor.
+    std::string oldKeyString( unsigned lod, unsigned x, unsigned y )
+    {
+        return Stringify() << lod << "_" << x << "_" << y;
+    }
+
+    bool near( double a, double b )
+    {
+        return fabs(a - b) <= 1e-9 * (1.0 + fabs(a) + fabs(b));
+    }
+}
+
+
+int
+tileKey( osg::ArgumentParser& args )
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    std::vector<TileKey> roots;
+    profile->getRootKeys( roots );
+
+    // construction: walking the pyramid the way the engine does.
+    std::vector<TileKey> keys;
+    Benchmark::Stopwatch t;
+    for( unsigned i = 0; i < roots.size(); ++i )
+        collectKeys( roots[i], keys );
+    double buildTime = t.seconds();
+    Benchmark::report( "createChildKey", buildTime, keys.size(), "keys" );
+
+    t.reset();
+    unsigned neighbors = 0;
+    for( unsigned i = 0; i < keys.size(); ++i )
+    {
+        TileKey n = keys[i].createNeighborKey( 1, -1 );
+        if ( n.valid() )
+            ++neighbors;
+    }
+    Benchmark::report( "createNeighborKey", t.seconds(), keys.size(), "keys" );
+    BENCH_CHECK( neighbors == keys.size() );
+
+    t.reset();
+    std::vector<std::string> strings;
+    strings.reserve( keys.size() );
+    for( unsigned i = 0; i < keys.size(); ++i )
+        strings.push_back( oldKeyString(keys[i].getLOD(), keys[i].getTileX(), keys[i].getTileY()) );
+    double stringTime = t.seconds();
+    Benchmark::report( "string formatting (old per-key cost)", stringTime, keys.size(), "keys" );
+
+    // correctness: unique packed IDs, hashes consistent with ==, and
+    // children that exactly tile their parent.
+    std::set<unsigned long long> ids;
+    for( unsigned i = 0; i < keys.size(); ++i )
+        ids.insert( keys[i].getPackedID() );
+    BENCH_CHECK( ids.size() == keys.size() );
+
+    bool hashOK = true, extentOK = true;
+    for( unsigned i = 0; i < keys.size(); i += 97 )
+    {
+        TileKey copy( keys[i].getLOD(), keys[i].getTileX(), keys[i].getTileY(), profile );
+        hashOK = hashOK && copy == keys[i] && copy.hash() == keys[i].hash();
+
+        if ( keys[i].getLOD() < MAX_LOD )
+        {
+            GeoExtent e  = keys[i].getExtent();
+            GeoExtent nw = keys[i].createChildKey(0).getExtent();
+            GeoExtent se = keys[i].createChildKey(3).getExtent();
+            extentOK = extentOK &&
+                near(nw.xMin(), e.xMin()) && near(nw.yMax(), e.yMax()) &&
+                near(se.xMax(), e.xMax()) && near(se.yMin(), e.yMin()) &&
+                near(nw.xMax(), se.xMin()) && near(nw.yMin(), se.yMax());
+        }
+    }
+    BENCH_CHECK( hashOK );
+    BENCH_CHECK( extentOK );
+
+    // lookup: the same keys in the containers the engine uses.
+    std::map<TileKey, unsigned>     keyMap;
+    std::map<std::string, unsigned> stringMap;
+    for( unsigned i = 0; i < keys.size(); ++i )
+    {
+        keyMap[keys[i]]      = i;
+        stringMap[strings[i]] = i;
+    }
+
+    unsigned found = 0;
+    t.reset();
+    for( unsigned i = 0; i < keys.size(); ++i )
+        if ( keyMap.find(keys[i]) != keyMap.end() ) ++found;
+    double keyLookup = t.seconds();
+    Benchmark::report( "std::map<TileKey> lookup", keyLookup, keys.size(), "lookups" );
+    BENCH_CHECK( found == keys.size() );
+
+    found = 0;
+    t.reset();
+    for( unsigned i = 0; i < keys.size(); ++i )
+        if ( stringMap.find(strings[i]) != stringMap.end() ) ++found;
+    double stringLookup = t.seconds();
+    Benchmark::report( "std::map<string> lookup", stringLookup, keys.size(), "lookups" );
+    BENCH_CHECK( found == keys.size() );
+    Benchmark::speedup( "TileKey vs. string lookup", stringLookup, keyLookup );
+
+#ifdef HAVE_UNORDERED_MAP
+    std::unordered_map<TileKey, unsigned> hashMap;
+    for( unsigned i = 0; i < keys.size(); ++i )
+        hashMap[keys[i]] = i;
+
+    found = 0;
+    t.reset();
+    for( unsigned i = 0; i < keys.size(); ++i )
+        if ( hashMap.find(keys[i]) != hashMap.end() ) ++found;
+    double hashLookup = t.seconds();
+    Benchmark::report( "std::unordered_map<TileKey> lookup", hashLookup, keys.size(), "lookups" );
+    BENCH_CHECK( found == keys.size() );
+    BENCH_CHECK( hashMap.size() == keys.size() );
+    Benchmark::speedup( "hashed vs. ordered TileKey lookup", keyLookup, hashLookup );
+#endif
+
+    return 0;
+}
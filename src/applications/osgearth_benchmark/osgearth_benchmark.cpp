@@ -0,0 +1,124 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * Benchmarks and self-checks for osgEarth subsystems. Each suite times
+ * the current code path (and, where there is one, the path it replaced)
+ * and checks the results; the exit status is nonzero if any check fails.
+ */
+
+#include "Benchmark"
+#include <osgEarth/Registry>
+#include <cstring>
+
+using namespace osgEarth;
+
+int declutter( osg::ArgumentParser& args );
+int elevationQuery( osg::ArgumentParser& args );
+int encodedCache( osg::ArgumentParser& args );
+int featureAttributes( osg::ArgumentParser& args );
+int featureTile( osg::ArgumentParser& args );
+int gdalHeightField( osg::ArgumentParser& args );
+int httpEngine( osg::ArgumentParser& args );
+int imageMosaic( osg::ArgumentParser& args );
+int imageReprojector( osg::ArgumentParser& args );
+int ogrCursor( osg::ArgumentParser& args );
+int scriptBatch( osg::ArgumentParser& args );
+int sqlite3Cache( osg::ArgumentParser& args );
+int tileKey( osg::ArgumentParser& args );
+
+namespace
+{
+    struct Suite
+    {
+        const char* name;
+        int (*run)( osg::ArgumentParser& );
+        const char* description;
+    };
+
+    Suite s_suites[] =
+    {
+        { "declutter",          declutter,         "Declutter overlap pass: screen-space grid vs. testing every passed box" },
+        { "elevation_query",    elevationQuery,    "Batched elevation queries: serial vs. task-service tile fetches" },
+        { "encoded_cache",      encodedCache,      "Cache writes as fetched/packed vs. serialized, and encoded-byte lifetime" },
+        { "feature_attributes", featureAttributes, "Feature attributes: shared schema slots vs. a table per feature" },
+        { "feature_tile",       featureTile,       "Dense-city feature tile build: serial vs. chunked parallel compile" },
+        { "gdal_heightfield",   gdalHeightField,   "GDAL heightfield sampling: windowed reads vs. per-pixel reads" },
+        { "http_engine",        httpEngine,        "HTTP engine against a loopback server: blocking vs. multiplexed requests" },
+        { "image_mosaic",       imageMosaic,       "Cross-profile tile assembly: mosaic + reproject vs. direct sampling" },
+        { "image_reprojector",  imageReprojector,  "Image reprojection: transform grids vs. GDAL warp and per-pixel transforms" },
+        { "ogr_cursor",         ogrCursor,         "OGR cursor: read-ahead and attribute projection vs. on-demand full reads" },
+        { "script_batch",       scriptBatch,       "ScriptEngine batching on a mock engine: per-feature runs vs. one batch" },
+        { "sqlite3_cache",      sqlite3Cache,      "Sqlite3 cache under mixed concurrent reads and writes, and LRU eviction" },
+        { "tilekey",            tileKey,           "TileKey construction and container lookup vs. string keys" }
+    };
+
+    const unsigned s_numSuites = sizeof(s_suites) / sizeof(s_suites[0]);
+
+    int usage()
+    {
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_benchmark suite|all [options]" << std::endl
+            << std::endl
+            << "Suites:" << std::endl;
+
+        for( unsigned i = 0; i < s_numSuites; ++i )
+            std::cout << "    " << s_suites[i].name << " ; " << s_suites[i].description << std::endl;
+
+        std::cout << std::endl;
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( argc < 2 || args.read("--help") )
+        return usage();
+
+    std::string which = argv[1];
+    bool all = which == "all";
+
+    unsigned numRun = 0;
+    for( unsigned i = 0; i < s_numSuites; ++i )
+    {
+        if ( all || which == s_suites[i].name )
+        {
+            std::cout << s_suites[i].name << ":" << std::endl;
+            s_suites[i].run( args );
+            ++numRun;
+        }
+    }
+
+    if ( numRun == 0 )
+        return usage();
+
+    if ( Benchmark::failures() > 0 )
+    {
+        std::cout << Benchmark::failures() << " check(s) FAILED" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
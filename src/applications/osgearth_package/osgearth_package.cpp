@@ -30,6 +30,7 @@
 #include <osgEarth/HTTPClient>
 #include <osgEarthUtil/TMSPackager>
 #include <osgEarthDrivers/tms/TMSOptions>
+#include <osgEarthDrivers/mbtiles/MBTilesOptions>
 
 #include <iostream>
 #include <sstream>
@@ -65,6 +66,8 @@ usage( const std::string& msg = "" )
         << "            [--overwrite]                   : overwrite existing tiles\n"
         << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--threads <num>]               : number of threads to fetch and encode tiles with (default=1)\n"
+        << "            [--mbtiles]                     : write image layers to MBTiles databases instead of TMS folders\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -156,6 +159,15 @@ makeTMS( osg::ArgumentParser& args )
     // whether to keep 'empty' tiles
     bool keepEmpties = args.read("--keep-empties");    
 
+    // number of packaging threads
+    unsigned numThreads = 1;
+    args.read( "--threads", numThreads );
+
+    // whether to write image layers to MBTiles instead of TMS
+    bool mbtiles = args.read("--mbtiles");
+    if ( mbtiles && !TMSPackager::supportsMBTiles() )
+        return usage( "MBTiles output requires osgEarth built with SQLite3" );
+
     // load up the map
     osg::ref_ptr<MapNode> mapNode = MapNode::load( args );
     if ( !mapNode.valid() )
@@ -174,6 +186,7 @@ makeTMS( osg::ArgumentParser& args )
     packager.setVerbose( verbose );
     packager.setOverwrite( overwrite );
     packager.setKeepEmptyImageTiles( keepEmpties );
+    packager.setNumThreads( numThreads );
 
     if ( maxLevel != ~0 )
         packager.setMaxLevel( maxLevel );
@@ -221,19 +234,37 @@ makeTMS( osg::ArgumentParser& args )
             }
 
             std::string layerRoot = osgDB::concatPaths( rootFolder, layerFolder );
-            TMSPackager::Result r = packager.package( layer, layerRoot, extension );
+            if ( mbtiles )
+                layerRoot += ".mbtiles";
+
+            TMSPackager::Result r = mbtiles ?
+                packager.packageMBTiles( layer, layerRoot, extension ) :
+                packager.package( layer, layerRoot, extension );
+
             if ( r.ok )
             {
                 // save to the output map if requested:
                 if ( outMap.valid() )
                 {
-                    // new TMS driver info:
-                    TMSOptions tms;
-                    tms.url() = URI(
-                        osgDB::concatPaths(layerFolder, "tms.xml"),
-                        outEarthFile );
-
-                    ImageLayerOptions layerOptions( layer->getName(), tms );
+                    TileSourceOptions driver;
+                    if ( mbtiles )
+                    {
+                        // new MBTiles driver info:
+                        MBTilesOptions mbt;
+                        mbt.filename() = layerRoot;
+                        driver = mbt;
+                    }
+                    else
+                    {
+                        // new TMS driver info:
+                        TMSOptions tms;
+                        tms.url() = URI(
+                            osgDB::concatPaths(layerFolder, "tms.xml"),
+                            outEarthFile );
+                        driver = tms;
+                    }
+
+                    ImageLayerOptions layerOptions( layer->getName(), driver );
                     layerOptions.mergeConfig( layer->getInitialOptions().getConfig(true) );
                     layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
 
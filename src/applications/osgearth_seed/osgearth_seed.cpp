@@ -80,6 +80,9 @@ usage( const std::string& msg )
         << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to seed (in map coordinates; default=entire map)" << std::endl
         << "        [--cache-path path]             ; Overrides the cache path in the .earth file" << std::endl
         << "        [--cache-type type]             ; Overrides the cache type in the .earth file" << std::endl
+        << "        [--threads n]                   ; Number of seeding threads (default=1)" << std::endl
+        << "        [--checkpoint file]             ; Saves progress to file, and resumes from it if present" << std::endl
+        << "        [--checkpoint-interval s]       ; Seconds between checkpoints (default=30)" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
         << std::endl;
@@ -127,6 +130,17 @@ seed( osg::ArgumentParser& args )
     std::string cacheType;
     while (args.read("--cache-type", cacheType));
 
+    //Read the number of seeding threads
+    unsigned int numThreads = 1;
+    while (args.read("--threads", numThreads));
+
+    //Read the checkpoint file and interval
+    std::string checkpointFile;
+    while (args.read("--checkpoint", checkpointFile));
+
+    double checkpointInterval = 30.0;
+    while (args.read("--checkpoint-interval", checkpointInterval));
+
     bool verbose = args.read("--verbose");
 
     //Read in the earth file.
@@ -141,6 +155,9 @@ seed( osg::ArgumentParser& args )
     CacheSeed seeder;
     seeder.setMinLevel( minLevel );
     seeder.setMaxLevel( maxLevel );
+    seeder.setNumThreads( numThreads );
+    seeder.setCheckpointFile( checkpointFile );
+    seeder.setCheckpointInterval( checkpointInterval );
 
     for (unsigned int i = 0; i < bounds.size(); i++)
     {
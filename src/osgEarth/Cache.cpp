@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/Cache>
+#include <osgEarth/HeightFieldUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/ThreadingUtils>
 
@@ -24,6 +25,7 @@
 #include <osgDB/FileUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Threading;
@@ -106,3 +108,96 @@ CacheDriver::getCacheOptions( const osgDB::ReaderWriter::Options* rwopt ) const
 {
     return *static_cast<const CacheOptions*>( rwopt->getPluginData( CACHE_OPTIONS_TAG ) );
 }
+
+//------------------------------------------------------------------------
+
+#undef  LC
+#define LC "[EncodedRecord] "
+
+namespace
+{
+    // Tag that starts an encoded record: "#oe:<format>\n". No serialized osgb
+    // stream can start with this since those begin with a binary magic number.
+    const std::string ENCODED_RECORD_TAG = "#oe:";
+
+    // Limit on the length of the tag line, so we don't scan a whole record
+    // looking for a newline.
+    const std::string::size_type MAX_TAG_LENGTH = 32;
+}
+
+const std::string EncodedRecord::HEIGHTFIELD = "oehf";
+
+void
+EncodedRecord::setWanted( osgDB::Options* options, bool wanted )
+{
+    if ( !options )
+        return;
+
+    if ( wanted )
+        options->setPluginData( "osgEarth::EncodedRecord::wanted", (void*)1 );
+    else
+        options->removePluginData( "osgEarth::EncodedRecord::wanted" );
+}
+
+bool
+EncodedRecord::isWanted( const osgDB::Options* options )
+{
+    return options && options->getPluginData( "osgEarth::EncodedRecord::wanted" ) != 0L;
+}
+
+std::string
+EncodedRecord::wrap( const std::string& format, const std::string& bytes )
+{
+    std::string record;
+    record.reserve( ENCODED_RECORD_TAG.length() + format.length() + 1 + bytes.length() );
+    record.append( ENCODED_RECORD_TAG );
+    record.append( format );
+    record.push_back( '\n' );
+    record.append( bytes );
+    return record;
+}
+
+bool
+EncodedRecord::isEncoded( const std::string& record )
+{
+    return record.compare( 0, ENCODED_RECORD_TAG.length(), ENCODED_RECORD_TAG ) == 0;
+}
+
+osg::Object*
+EncodedRecord::decode( const std::string& record, const osgDB::Options* options )
+{
+    if ( !isEncoded(record) )
+        return 0L;
+
+    std::string::size_type eol = record.find( '\n', ENCODED_RECORD_TAG.length() );
+    if ( eol == std::string::npos || eol > MAX_TAG_LENGTH )
+    {
+        OE_WARN << LC << "Malformed record tag" << std::endl;
+        return 0L;
+    }
+
+    std::string format = record.substr( ENCODED_RECORD_TAG.length(), eol - ENCODED_RECORD_TAG.length() );
+    std::string::size_type offset = eol + 1;
+
+    if ( format == HEIGHTFIELD )
+    {
+        return HeightFieldUtils::decodeHeightField( record.data() + offset, record.length() - offset );
+    }
+
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension( format );
+    if ( !rw )
+    {
+        OE_WARN << LC << "No plugin available to decode format \"" << format << "\"" << std::endl;
+        return 0L;
+    }
+
+    std::istringstream in( record.substr(offset) );
+    osgDB::ReaderWriter::ReadResult rr = rw->readImage( in, options );
+    if ( !rr.validImage() )
+    {
+        OE_WARN << LC << "Failed to decode \"" << format << "\" record" << std::endl;
+        return 0L;
+    }
+
+    return rr.takeImage();
+}
@@ -19,8 +19,17 @@
 
 #include <osgEarth/CacheSeed>
 #include <osgEarth/MapFrame>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Atomic>
 #include <OpenThreads/ScopedLock>
+#include <OpenThreads/Thread>
+#include <osg/Timer>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <deque>
 #include <limits.h>
+#include <stdio.h>
 
 #define LC "[CacheSeed] "
 
@@ -28,13 +37,141 @@ using namespace osgEarth;
 using namespace OpenThreads;
 
 CacheSeed::CacheSeed():
-_minLevel (0),
-_maxLevel (12),
-_total    (0),
-_completed(0)
+_minLevel          (0),
+_maxLevel          (12),
+_total             (0),
+_completed         (0),
+_bytes             (0.0),
+_startTime         (0.0),
+_numThreads        (1),
+_checkpointInterval(30.0)
 {
 }
 
+//------------------------------------------------------------------------
+
+/**
+ * Work-stealing queue of tiles to seed. Each worker pushes and pops at the
+ * back of its own deque (depth-first, for cache locality), and steals from
+ * the front of the others' deques (breadth-first, for big chunks of work)
+ * when its own runs dry.
+ */
+class CacheSeed::WorkQueue
+{
+public:
+    WorkQueue( unsigned numWorkers ) :
+      _deques   ( numWorkers ),
+      _mutexes  ( new OpenThreads::Mutex[numWorkers] ),
+      _current  ( numWorkers ),
+      _busy     ( numWorkers, 0 ),
+      _canceled ( false ) { }
+
+    ~WorkQueue() { delete [] _mutexes; }
+
+    void push( unsigned worker, const WorkItem& item )
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutexes[worker] );
+        _deques[worker].push_back( item );
+        ++_pending;
+    }
+
+    bool pop( unsigned worker, WorkItem& out )
+    {
+        Threading::ScopedReadLock shared( _snapshotMutex );
+        unsigned n = _deques.size();
+        for( unsigned i = 0; i < n; ++i )
+        {
+            unsigned victim = (worker + i) % n;
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutexes[victim] );
+            std::deque<WorkItem>& d = _deques[victim];
+            if ( !d.empty() )
+            {
+                if ( victim == worker ) {
+                    out = d.back();
+                    d.pop_back();
+                }
+                else {
+                    out = d.front();
+                    d.pop_front();
+                }
+                _current[worker] = out;
+                _busy[worker] = 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // finishes the worker's current item, queueing its children.
+    void complete( unsigned worker, const std::vector<WorkItem>& children )
+    {
+        Threading::ScopedReadLock shared( _snapshotMutex );
+        for( std::vector<WorkItem>::const_iterator i = children.begin(); i != children.end(); ++i )
+            push( worker, *i );
+        _busy[worker] = 0;
+        --_pending;
+    }
+
+    // all the work that remains: queued items, plus the items in progress.
+    void snapshot( std::vector<WorkItem>& out )
+    {
+        Threading::ScopedWriteLock exclusive( _snapshotMutex );
+        for( unsigned w = 0; w < _deques.size(); ++w )
+        {
+            if ( _busy[w] )
+                out.push_back( _current[w] );
+            out.insert( out.end(), _deques[w].begin(), _deques[w].end() );
+        }
+    }
+
+    bool isFinished() const { return (unsigned)_pending == 0; }
+
+    void cancel() { _canceled = true; }
+    bool isCanceled() const { return _canceled; }
+
+private:
+    std::vector< std::deque<WorkItem> > _deques;
+    OpenThreads::Mutex*                 _mutexes;
+    std::vector<WorkItem>               _current;
+    std::vector<char>                   _busy;      // not vector<bool>: workers write their own flags concurrently
+    OpenThreads::Atomic                 _pending;
+    Threading::ReadWriteMutex           _snapshotMutex;
+    volatile bool                       _canceled;
+};
+
+/**
+ * Seeding thread.
+ */
+class CacheSeed::Worker : public OpenThreads::Thread
+{
+public:
+    Worker( CacheSeed* seeder, const MapFrame& mapf, WorkQueue& queue, unsigned index ) :
+      _seeder( seeder ),
+      _mapf  ( mapf, "CacheSeed::Worker" ),
+      _queue ( queue ),
+      _index ( index ) { }
+
+    void run()
+    {
+        WorkItem item;
+        while( !_queue.isCanceled() && !_queue.isFinished() )
+        {
+            if ( _queue.pop(_index, item) )
+                _seeder->processItem( _mapf, item, _queue, _index );
+            else
+                OpenThreads::Thread::microSleep( 1000 );
+        }
+    }
+
+private:
+    CacheSeed* _seeder;
+    MapFrame   _mapf;
+    WorkQueue& _queue;
+    unsigned   _index;
+};
+
+//------------------------------------------------------------------------
+
 void CacheSeed::seed( Map* map )
 {
     if ( !map->getCache() )
@@ -53,6 +190,7 @@ void CacheSeed::seed( Map* map )
     }
 
     bool hasCaches = false;
+    std::vector<int> seedLayers; // image layer indices, or -1 for elevation
     int src_min_level = INT_MAX;
     unsigned int src_max_level = 0;
 
@@ -63,6 +201,7 @@ void CacheSeed::seed( Map* map )
     {
         ImageLayer* layer = i->get();
         TileSource* src   = layer->getTileSource();
+        int         index = i - mapf.imageLayers().begin();
 
         const ImageLayerOptions& opt = layer->getImageLayerOptions();
 
@@ -85,6 +224,7 @@ void CacheSeed::seed( Map* map )
         else
         {
             hasCaches = true;
+            seedLayers.push_back( index );
 
             if (opt.minLevel().isSet() && (int)opt.minLevel().get() < src_min_level)
                 src_min_level = opt.minLevel().get();
@@ -93,6 +233,7 @@ void CacheSeed::seed( Map* map )
         }
     }
 
+    bool hasElevation = false;
     for( ElevationLayerVector::const_iterator i = mapf.elevationLayers().begin(); i != mapf.elevationLayers().end(); i++ )
     {
         ElevationLayer* layer = i->get();
@@ -117,6 +258,9 @@ void CacheSeed::seed( Map* map )
         }
         else
         {
+            if ( !hasElevation )
+                seedLayers.push_back( -1 );
+            hasElevation = true;
             hasCaches = true;
 
             if (opt.minLevel().isSet() && (int)opt.minLevel().get() < src_min_level)
@@ -256,14 +400,79 @@ void CacheSeed::seed( Map* map )
 
     //Adjust the # of tiles again to be bigger than computed to avoid giving false hope
     _total *= 2;
+
+    // each layer walks its own tile pyramid
+    _total *= seedLayers.size();
     osg::Timer_t endTime = osg::Timer::instance()->tick();
     //OE_NOTICE << "Counted tiles in " << osg::Timer::instance()->delta_s(startTime, endTime) << " s" << std::endl;
 
     OE_INFO << "Processing ~" << _total << " tiles" << std::endl;
 
-    for (unsigned int i = 0; i < keys.size(); ++i)
+    // initial work: the root keys for each layer, or whatever was left
+    // over from an interrupted run.
+    std::string signature = getCheckpointSignature( mapf, seedLayers );
+    std::vector<WorkItem> items;
+    if ( !readCheckpoint(map->getProfile(), signature, items) )
+    {
+        for( std::vector<int>::const_iterator layer = seedLayers.begin(); layer != seedLayers.end(); ++layer )
+            for( std::vector<TileKey>::const_iterator key = keys.begin(); key != keys.end(); ++key )
+                items.push_back( WorkItem(*key, *layer) );
+    }
+
+    WorkQueue queue( _numThreads );
+    for( unsigned i = 0; i < items.size(); ++i )
+    {
+        queue.push( i % _numThreads, items[i] );
+    }
+
+    _completed = 0;
+    _bytes     = 0.0;
+    _startTime = osg::Timer::instance()->time_s();
+
+    OE_INFO << LC << "Seeding with " << _numThreads << " thread(s)" << std::endl;
+
+    std::vector<Worker*> workers;
+    for( unsigned i = 0; i < _numThreads; ++i )
+    {
+        workers.push_back( new Worker(this, mapf, queue, i) );
+        workers.back()->start();
+    }
+
+    // wait for the workers to finish, saving a checkpoint now and then.
+    double lastCheckpoint = _startTime;
+    while( !queue.isFinished() && !queue.isCanceled() )
+    {
+        OpenThreads::Thread::microSleep( 100000 );
+
+        double now = osg::Timer::instance()->time_s();
+        if ( !_checkpointFile.empty() && now - lastCheckpoint >= _checkpointInterval )
+        {
+            std::vector<WorkItem> remaining;
+            queue.snapshot( remaining );
+            writeCheckpoint( signature, remaining );
+            lastCheckpoint = now;
+        }
+    }
+
+    for( std::vector<Worker*>::iterator i = workers.begin(); i != workers.end(); ++i )
+    {
+        (*i)->join();
+        delete *i;
+    }
+
+    if ( !_checkpointFile.empty() )
     {
-        processKey( mapf, keys[i] );
+        if ( queue.isFinished() )
+        {
+            ::remove( _checkpointFile.c_str() );
+        }
+        else
+        {
+            std::vector<WorkItem> remaining;
+            queue.snapshot( remaining );
+            writeCheckpoint( signature, remaining );
+            OE_NOTICE << LC << "Seeding interrupted; progress saved to " << _checkpointFile << std::endl;
+        }
     }
 
     _total = _completed;
@@ -271,99 +480,222 @@ void CacheSeed::seed( Map* map )
     if ( _progress.valid()) _progress->reportProgress(_completed, _total, 0, 1, "Finished");
 }
 
-void CacheSeed::incrementCompleted( unsigned int total ) const
+void CacheSeed::incrementCompleted( unsigned int total, unsigned int bytes )
 {    
-    CacheSeed* nonconst_this = const_cast<CacheSeed*>(this);
-    nonconst_this->_completed += total;
+    _completed += total;
+    _bytes     += (double)bytes;
+}
+
+double
+CacheSeed::getTilesPerSecond() const
+{
+    double elapsed = osg::Timer::instance()->time_s() - _startTime;
+    return elapsed > 0.0 ? (double)_completed / elapsed : 0.0;
+}
+
+double
+CacheSeed::getBytesPerSecond() const
+{
+    double elapsed = osg::Timer::instance()->time_s() - _startTime;
+    return elapsed > 0.0 ? _bytes / elapsed : 0.0;
 }
 
 void
-CacheSeed::processKey(const MapFrame& mapf, const TileKey& key ) const
+CacheSeed::processItem(const MapFrame& mapf, const WorkItem& item, WorkQueue& queue, unsigned int worker )
 {
-    unsigned int x, y, lod;
-    key.getTileXY(x, y);
-    lod = key.getLevelOfDetail();
+    const TileKey& key = item._key;
+    unsigned int lod = key.getLevelOfDetail();
 
     bool gotData = true;
 
     if ( _minLevel <= lod && _maxLevel >= lod )
     {
-        gotData = cacheTile( mapf, key );
-        if (gotData)
+        unsigned int bytes = 0;
+        gotData = cacheTile( mapf, item, bytes );
+
+        if ( gotData )
         {
-        incrementCompleted( 1 );
-        }
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _progressMutex );
+            incrementCompleted( 1, bytes );
 
-        if ( _progress.valid() && _progress->isCanceled() )
-            return; // Task has been cancelled by user
+            if ( _progress.valid() )
+            {
+                std::stringstream buf;
+                buf << "Cached tile: " << key.str()
+                    << " (" << (int)getTilesPerSecond() << " tiles/s, "
+                    << (int)(getBytesPerSecond()/1024.0) << " KB/s decoded)";
 
-        if ( _progress.valid() && gotData && _progress->reportProgress(_completed, _total, std::string("Cached tile: ") + key.str()) )
-            return; // Canceled
+                if ( _progress->reportProgress(_completed, _total, buf.str()) )
+                    queue.cancel();
+            }
+        }
     }
 
-    if ( gotData && lod <= _maxLevel )
+    if ( _progress.valid() && _progress->isCanceled() )
+        queue.cancel(); // Task has been cancelled by user
+
+    std::vector<WorkItem> children;
+
+    if ( gotData && lod < _maxLevel )
     {
         TileKey k0 = key.createChildKey(0);
         TileKey k1 = key.createChildKey(1);
         TileKey k2 = key.createChildKey(2);
         TileKey k3 = key.createChildKey(3); 
 
-        bool intersectsKey = false;
-        if (_extents.empty()) intersectsKey = true;
-        else
-        {
-            for (unsigned int i = 0; i < _extents.size(); ++i)
-            {
-                if (_extents[i].intersects( k0.getExtent() ) ||
-                    _extents[i].intersects( k1.getExtent() ) ||
-                    _extents[i].intersects( k2.getExtent() ) ||
-                    _extents[i].intersects( k3.getExtent() ))
-                {
-                    intersectsKey = true;
-                }
-
-            }
-        }
-
         //Check to see if the bounds intersects ANY of the tile's children.  If it does, then process all of the children
         //for this level
-        if (intersectsKey)
+        if ( intersectsExtents(k0) || intersectsExtents(k1) || intersectsExtents(k2) || intersectsExtents(k3) )
         {
-            processKey(mapf, k0);
-            processKey(mapf, k1);
-            processKey(mapf, k2);
-            processKey(mapf, k3);
+            children.push_back( WorkItem(k0, item._layer) );
+            children.push_back( WorkItem(k1, item._layer) );
+            children.push_back( WorkItem(k2, item._layer) );
+            children.push_back( WorkItem(k3, item._layer) );
         }
     }
+
+    queue.complete( worker, children );
+}
+
+bool
+CacheSeed::intersectsExtents( const TileKey& key ) const
+{
+    if ( _extents.empty() )
+        return true;
+
+    for (unsigned int i = 0; i < _extents.size(); ++i)
+    {
+        if ( _extents[i].intersects(key.getExtent()) )
+            return true;
+    }
+    return false;
 }
 
 bool
-CacheSeed::cacheTile(const MapFrame& mapf, const TileKey& key ) const
+CacheSeed::cacheTile(const MapFrame& mapf, const WorkItem& item, unsigned int& out_bytes ) const
 {
     bool gotData = false;
+    const TileKey& key = item._key;
 
-    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); i++ )
+    if ( item._layer >= 0 )
     {
-        ImageLayer* layer = i->get();
-        if ( layer->isKeyValid( key ) )
+        if ( item._layer < (int)mapf.imageLayers().size() )
         {
-            GeoImage image = layer->createImage( key );
-            if ( image.valid() )
-                gotData = true;
+            ImageLayer* layer = mapf.imageLayers()[item._layer].get();
+            if ( layer->isKeyValid( key ) )
+            {
+                GeoImage image = layer->createImage( key );
+                if ( image.valid() )
+                {
+                    gotData = true;
+                    out_bytes = image.getImage()->getTotalSizeInBytes();
+                }
+            }
         }
     }
 
-    if ( mapf.elevationLayers().size() > 0 )
+    else if ( mapf.elevationLayers().size() > 0 )
     {
         osg::ref_ptr<osg::HeightField> hf;
         mapf.getHeightField( key, false, hf );
         if ( hf.valid() )
+        {
             gotData = true;
+            out_bytes = hf->getNumColumns() * hf->getNumRows() * sizeof(float);
+        }
     }
 
     return gotData;
 }
 
+std::string
+CacheSeed::getCheckpointSignature( const MapFrame& mapf, const std::vector<int>& seedLayers ) const
+{
+    // Everything that decides which tiles a seed visits. Resuming a checkpoint
+    // written for a different operation would skip or misattribute tiles.
+    std::stringstream buf;
+    buf << std::setprecision(12)
+        << "profile=" << mapf.getProfile()->getHorizSignature()
+        << " layers=";
+
+    for( std::vector<int>::const_iterator i = seedLayers.begin(); i != seedLayers.end(); ++i )
+    {
+        if ( *i >= 0 )
+            buf << *i << ":" << mapf.imageLayers()[*i]->getName() << ",";
+        else
+            buf << "elevation,";
+    }
+
+    buf << " extents=";
+    for( std::vector<GeoExtent>::const_iterator e = _extents.begin(); e != _extents.end(); ++e )
+    {
+        buf << e->getSRS()->getHorizInitString() << ":"
+            << e->xMin() << "," << e->yMin() << "," << e->xMax() << "," << e->yMax() << ";";
+    }
+
+    std::string str;
+    str = buf.str();
+    return str;
+}
+
+bool
+CacheSeed::readCheckpoint( const Profile* profile, const std::string& signature, std::vector<WorkItem>& out_items ) const
+{
+    if ( _checkpointFile.empty() )
+        return false;
+
+    std::ifstream in( _checkpointFile.c_str() );
+    if ( !in.is_open() )
+        return false;
+
+    std::string magic, line, fileSignature;
+    unsigned minLevel = 0, maxLevel = 0;
+    in >> magic >> minLevel >> maxLevel;
+    std::getline( in, line );
+    std::getline( in, fileSignature );
+    if ( magic != "osgearth_seed_checkpoint" || minLevel != _minLevel || maxLevel != _maxLevel || fileSignature != signature )
+    {
+        OE_WARN << LC << "Checkpoint file " << _checkpointFile << " does not match this seed operation; ignoring it" << std::endl;
+        return false;
+    }
+
+    int layer;
+    unsigned lod, x, y;
+    while( in >> layer >> lod >> x >> y )
+    {
+        out_items.push_back( WorkItem(TileKey(lod, x, y, profile), layer) );
+    }
+
+    OE_NOTICE << LC << "Resuming from checkpoint " << _checkpointFile << " (" << out_items.size() << " tiles pending)" << std::endl;
+    return true;
+}
+
+void
+CacheSeed::writeCheckpoint( const std::string& signature, const std::vector<WorkItem>& items ) const
+{
+    // write to a temporary file and swap it in, so that an interruption
+    // never leaves a partial checkpoint behind.
+    std::string temp = _checkpointFile + ".tmp";
+    {
+        std::ofstream out( temp.c_str() );
+        if ( !out.is_open() )
+        {
+            OE_WARN << LC << "Failed to write checkpoint file " << temp << std::endl;
+            return;
+        }
+
+        out << "osgearth_seed_checkpoint " << _minLevel << " " << _maxLevel << std::endl;
+        out << signature << std::endl;
+        for( std::vector<WorkItem>::const_iterator i = items.begin(); i != items.end(); ++i )
+        {
+            out << i->_layer << " " << i->_key.getLevelOfDetail() << " " << i->_key.getTileX() << " " << i->_key.getTileY() << std::endl;
+        }
+    }
+
+    ::remove( _checkpointFile.c_str() );
+    ::rename( temp.c_str(), _checkpointFile.c_str() );
+}
+
 void
 CacheSeed::addExtent( const GeoExtent& value)
 {
@@ -19,7 +19,10 @@
 #include <osgEarth/ElevationLayer>
 #include <osgEarth/VerticalDatum>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/TaskService>
 #include <osg/Version>
+#include <OpenThreads/Thread>
+#include <float.h>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -208,7 +211,7 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
         }
 
         // Make it from the source:
-        result = source->createHeightField( key, _preCacheOp.get(), progress );
+        result = readHeightFieldFromTileSource( key, progress );
 
         // If the result is good, we how have a heightfield but it's vertical values
         // are still relative to the tile source's vertical datum. Convert them.
@@ -264,6 +267,37 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
 }
 
 
+osg::HeightField*
+ElevationLayer::readHeightFieldFromTileSource(const TileKey&    key,
+                                              ProgressCallback* progress)
+{
+    TileSource* source = getTileSource();
+
+    osg::ref_ptr<osg::Object> shared;
+    if ( _tileFlights.join(key, shared) )
+    {
+        osg::ref_ptr<osg::HeightField> hf = source->createHeightField( key, _preCacheOp.get(), progress );
+
+        // if others are sharing this heightfield, keep a copy of our own since
+        // the caller will modify it.
+        if ( _tileFlights.land(key, hf.get()) > 0 && hf.valid() )
+            hf = new osg::HeightField( *hf.get() );
+
+        return hf.release();
+    }
+
+    osg::HeightField* hf = dynamic_cast<osg::HeightField*>( shared.get() );
+    if ( hf )
+        return new osg::HeightField( *hf );
+
+    // the shared read failed. If it was blacklisted, so be it; otherwise it was
+    // probably canceled, so try it ourselves.
+    if ( source->getBlacklist()->contains(key.getTileId()) )
+        return 0L;
+
+    return source->createHeightField( key, _preCacheOp.get(), progress );
+}
+
 osg::HeightField*
 ElevationLayer::assembleHeightFieldFromTileSource(const TileKey&    key,
                                                   ProgressCallback* progress)
@@ -434,7 +468,19 @@ ElevationLayer::createHeightField(const TileKey&    key,
          !fromCache    &&
          getCachePolicy().isCacheWriteable() )
     {
-        cacheBin->write( key.str(), result );
+        // store heightfields in their compact lossless encoding when the bin supports it.
+        bool written = false;
+        if ( cacheBin->acceptsEncoded() )
+        {
+            std::string encoded;
+            HeightFieldUtils::encodeHeightField( result, encoded );
+            written = !encoded.empty() && cacheBin->writeEncoded( key.str(), EncodedRecord::HEIGHTFIELD, encoded );
+        }
+
+        if ( !written )
+        {
+            cacheBin->write( key.str(), result );
+        }
     }
 
     if ( result )
@@ -459,6 +505,313 @@ ElevationLayer::createHeightField(const TileKey&    key,
 //------------------------------------------------------------------------
 
 
+
+namespace
+{
+    /**
+     * Fetches one layer's heightfield for a tile, falling back on lower LODs
+     * if requested.
+     */
+    struct LayerFetch
+    {
+        LayerFetch() : _layer(0L), _fallback(false), _progress(0L), _isFallback(false) { }
+
+        void run()
+        {
+            _result = _layer->createHeightField( _key, _progress );
+
+            // if "fallback" is set, try to fall back on lower LODs.
+            if ( !_result.valid() && _fallback )
+            {
+                _resultKey = _key.createParentKey();
+
+                while ( _resultKey.valid() && !_result.valid() )
+                {
+                    _result = _layer->createHeightField( _resultKey, _progress );
+                    if ( !_result.valid() )
+                        _resultKey = _resultKey.createParentKey();
+                }
+
+                _isFallback = _result.valid();
+            }
+        }
+
+        ElevationLayer*   _layer;
+        TileKey           _key;
+        bool              _fallback;
+        ProgressCallback* _progress;
+        GeoHeightField    _result;
+        TileKey           _resultKey;
+        bool              _isFallback;
+    };
+
+    /**
+     * The layer fetches for one tile. Whoever calls runAll() -- the
+     * compositing thread or a worker on the fetch service -- takes fetches
+     * off the list until none are left, so the compositing thread never
+     * waits on a fetch that hasn't started, even when every worker is busy.
+     */
+    struct LayerFetchBatch : public osg::Referenced
+    {
+        LayerFetchBatch() : _next(0), _finished(0) { }
+
+        void runAll()
+        {
+            for(;;)
+            {
+                unsigned i;
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    if ( _next >= _fetches.size() )
+                        return;
+                    i = _next++;
+                }
+
+                _fetches[i].run();
+
+                Threading::ScopedMutexLock lock( _mutex );
+                if ( ++_finished == _fetches.size() )
+                    _done.set();
+            }
+        }
+
+        std::vector<LayerFetch> _fetches;
+        Threading::Mutex        _mutex;
+        unsigned                _next;
+        unsigned                _finished;
+        Threading::Event        _done;
+    };
+
+    /** Task that helps run a LayerFetchBatch on the shared fetch service. */
+    struct LayerFetchWorker
+    {
+        void execute() { _batch->runAll(); }
+        osg::ref_ptr<LayerFetchBatch> _batch;
+    };
+
+    Threading::Mutex          s_fetchServiceMutex;
+    osg::ref_ptr<TaskService> s_fetchService;
+
+    /** Task service shared by all layer stacks for concurrent layer fetches. */
+    TaskService* getFetchService()
+    {
+        Threading::ScopedMutexLock lock( s_fetchServiceMutex );
+        if ( !s_fetchService.valid() )
+        {
+            s_fetchService = new TaskService(
+                "ElevationLayer fetch",
+                std::max( 2, OpenThreads::GetNumberOfProcessors() ) );
+        }
+        return s_fetchService.get();
+    }
+
+    /**
+     * One source heightfield, with everything needed to sample it set up
+     * once per output tile instead of once per post.
+     */
+    struct CompositeSource
+    {
+        CompositeSource( const GeoHeightField& geoHF, const SpatialReference* keySRS ) :
+            _geoHF( &geoHF )
+        {
+            const osg::HeightField* hf = geoHF.getHeightField();
+            const GeoExtent&        ex = geoHF.getExtent();
+
+            _heights   = &hf->getHeightList().front();
+            _cols      = hf->getNumColumns();
+            _rows      = hf->getNumRows();
+            _xMin      = ex.xMin();
+            _yMin      = ex.yMin();
+            _xInterval = ex.width()  / (double)(_cols-1);
+            _yInterval = ex.height() / (double)(_rows-1);
+
+            const SpatialReference* srs = ex.getSRS();
+            _sameSRS    = !keySRS || keySRS->isEquivalentTo( srs );
+            _sameVDatum = srs->isVertEquivalentTo( keySRS );
+        }
+
+        inline float height( int c, int r ) const { return _heights[r*_cols + c]; }
+
+        const GeoHeightField* _geoHF;
+        const float*          _heights;
+        unsigned              _cols, _rows;
+        double                _xMin, _yMin, _xInterval, _yInterval;
+        bool                  _sameSRS;
+        bool                  _sameVDatum;
+    };
+
+    /**
+     * Bilinear sample at a local coordinate. Performs exactly the same arithmetic
+     * as HeightFieldUtils::getHeightAtLocation( ..., INTERP_BILINEAR ) so that the
+     * composited result does not change; it just skips the per-call overhead.
+     */
+    inline float sampleBilinear( const CompositeSource& s, double x, double y )
+    {
+        double c = osg::clampBetween( (x - s._xMin) / s._xInterval, 0.0, (double)(s._cols-1) );
+        double r = osg::clampBetween( (y - s._yMin) / s._yInterval, 0.0, (double)(s._rows-1) );
+
+        int rowMin = osg::maximum((int)floor(r), 0);
+        int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(s._rows-1)), 0);
+        int colMin = osg::maximum((int)floor(c), 0);
+        int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(s._cols-1)), 0);
+
+        if (rowMin > rowMax) rowMin = rowMax;
+        if (colMin > colMax) colMin = colMax;
+
+        float urHeight = s.height(colMax, rowMax);
+        float llHeight = s.height(colMin, rowMin);
+        float ulHeight = s.height(colMin, rowMax);
+        float lrHeight = s.height(colMax, rowMin);
+
+        if (urHeight == NO_DATA_VALUE || llHeight == NO_DATA_VALUE || ulHeight == NO_DATA_VALUE || lrHeight == NO_DATA_VALUE)
+            return NO_DATA_VALUE;
+
+        if ((colMax == colMin) && (rowMax == rowMin))
+            return s.height((int)c, (int)r);
+        else if (colMax == colMin)
+            return ((double)rowMax - r) * llHeight + (r - (double)rowMin) * ulHeight;
+        else if (rowMax == rowMin)
+            return ((double)colMax - c) * llHeight + (c - (double)colMin) * lrHeight;
+
+        float r1 = ((double)colMax - c) * llHeight + (c - (double)colMin) * lrHeight;
+        float r2 = ((double)colMax - c) * ulHeight + (c - (double)colMin) * urHeight;
+        return ((double)rowMax - r) * r1 + (r - (double)rowMin) * r2;
+    }
+
+    /**
+     * Samples one row of output posts from a source, writing NO_DATA_VALUE
+     * wherever the source has no coverage. The row's coordinates are transformed
+     * into the source SRS in a single call.
+     */
+    void sampleRow(const CompositeSource&  s,
+                   const SpatialReference* keySRS,
+                   double                  minx,
+                   double                  dx,
+                   double                  y,
+                   unsigned                width,
+                   ElevationInterpolation  interpolation,
+                   std::vector<osg::Vec3d>& scratch,
+                   float*                  out )
+    {
+        scratch.resize( width );
+        for( unsigned c = 0; c < width; ++c )
+            scratch[c].set( minx + dx*(double)c, y, 0.0 );
+
+        // Vertical datum conversions need a geographic coordinate per post, and
+        // a failed row transform needs per-post handling; leave those to 
+        // GeoHeightField.
+        if ( !s._sameVDatum || (!s._sameSRS && !keySRS->transform(scratch, s._geoHF->getExtent().getSRS())) )
+        {
+            for( unsigned c = 0; c < width; ++c )
+            {
+                float elevation;
+                out[c] = s._geoHF->getElevation(keySRS, minx + dx*(double)c, y, interpolation, keySRS, elevation) ?
+                    elevation : NO_DATA_VALUE;
+            }
+            return;
+        }
+
+        const GeoExtent& extent = s._geoHF->getExtent();
+
+        if ( interpolation == INTERP_BILINEAR )
+        {
+            for( unsigned c = 0; c < width; ++c )
+            {
+                const osg::Vec3d& p = scratch[c];
+                out[c] = extent.contains(p.x(), p.y()) ? sampleBilinear(s, p.x(), p.y()) : NO_DATA_VALUE;
+            }
+        }
+        else
+        {
+            for( unsigned c = 0; c < width; ++c )
+            {
+                const osg::Vec3d& p = scratch[c];
+                out[c] = extent.contains(p.x(), p.y()) ?
+                    HeightFieldUtils::getHeightAtLocation(
+                        s._geoHF->getHeightField(), p.x(), p.y(), s._xMin, s._yMin, s._xInterval, s._yInterval, interpolation ) :
+                    NO_DATA_VALUE;
+            }
+        }
+    }
+
+    // Policy kernels. Each combines one row of samples from every source, in
+    // priority order (highest priority first), ignoring NO_DATA_VALUE samples.
+
+    void combineFirstValid( const std::vector<float*>& rows, unsigned width, float* out )
+    {
+        for( unsigned c = 0; c < width; ++c )
+        {
+            float elevation = NO_DATA_VALUE;
+            for( unsigned i = 0; i < rows.size(); ++i )
+            {
+                if ( rows[i][c] != NO_DATA_VALUE )
+                {
+                    elevation = rows[i][c];
+                    break;
+                }
+            }
+            out[c] = elevation;
+        }
+    }
+
+    void combineHighest( const std::vector<float*>& rows, unsigned width, float* out )
+    {
+        for( unsigned c = 0; c < width; ++c )
+        {
+            float elevation = -FLT_MAX;
+            bool  valid     = false;
+            for( unsigned i = 0; i < rows.size(); ++i )
+            {
+                float h = rows[i][c];
+                if ( h != NO_DATA_VALUE )
+                {
+                    valid = true;
+                    if ( elevation < h ) elevation = h;
+                }
+            }
+            out[c] = valid ? elevation : NO_DATA_VALUE;
+        }
+    }
+
+    void combineLowest( const std::vector<float*>& rows, unsigned width, float* out )
+    {
+        for( unsigned c = 0; c < width; ++c )
+        {
+            float elevation = FLT_MAX;
+            bool  valid     = false;
+            for( unsigned i = 0; i < rows.size(); ++i )
+            {
+                float h = rows[i][c];
+                if ( h != NO_DATA_VALUE )
+                {
+                    valid = true;
+                    if ( elevation > h ) elevation = h;
+                }
+            }
+            out[c] = valid ? elevation : NO_DATA_VALUE;
+        }
+    }
+
+    void combineAverage( const std::vector<float*>& rows, unsigned width, float* out )
+    {
+        for( unsigned c = 0; c < width; ++c )
+        {
+            float    elevation = 0.0f;
+            unsigned count     = 0;
+            for( unsigned i = 0; i < rows.size(); ++i )
+            {
+                float h = rows[i][c];
+                if ( h != NO_DATA_VALUE )
+                {
+                    elevation += h;
+                    ++count;
+                }
+            }
+            out[c] = count > 0 ? elevation / (float)count : NO_DATA_VALUE;
+        }
+    }
+}
+
 bool
 ElevationLayerVector::createHeightField(const TileKey&                  key,
                                         bool                            fallback,
@@ -498,39 +851,56 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
 
     unsigned defElevSize = 8;
 
+    osg::ref_ptr<LayerFetchBatch> batch = new LayerFetchBatch();
+    std::vector<LayerFetch>& fetches = batch->_fetches;
     for( ElevationLayerVector::const_iterator i = this->begin(); i != this->end(); i++ )
     {
         ElevationLayer* layer = i->get();
         if ( layer->getVisible() )
         {
-            GeoHeightField geoHF = layer->createHeightField( keyToUse, progress );
+            fetches.push_back( LayerFetch() );
+            LayerFetch& fetch = fetches.back();
+            fetch._layer    = layer;
+            fetch._key      = keyToUse;
+            fetch._fallback = fallback;
+            fetch._progress = progress;
+        }
+    }
 
-            // if "fallback" is set, try to fall back on lower LODs.
-            if ( !geoHF.valid() && fallback )
-            {
-                TileKey hf_key = keyToUse.createParentKey();
+    // with more than one layer, let the shared fetch service help with
+    // all but the one this thread starts on.
+    if ( fetches.size() > 1 )
+    {
+        TaskService* service = getFetchService();
+        for( unsigned i = 1; i < fetches.size(); ++i )
+        {
+            ParallelTask<LayerFetchWorker>* task = new ParallelTask<LayerFetchWorker>();
+            task->_batch = batch.get();
+            service->add( task );
+        }
+    }
 
-                while ( hf_key.valid() && !geoHF.valid() )
-                {
-                    geoHF = layer->createHeightField( hf_key, progress );
-                    if ( !geoHF.valid() )
-                        hf_key = hf_key.createParentKey();
-                }
+    if ( fetches.size() > 0 )
+    {
+        batch->runAll();
+        batch->_done.wait();
+    }
 
-                if ( geoHF.valid() )
-                {
-                    if ( hf_key.getLevelOfDetail() < lowestLOD )
-                        lowestLOD = hf_key.getLevelOfDetail();
+    for( unsigned i = 0; i < fetches.size(); ++i )
+    {
+        LayerFetch& fetch = fetches[i];
+        if ( fetch._result.valid() )
+        {
+            if ( fetch._isFallback )
+            {
+                if ( fetch._resultKey.getLevelOfDetail() < lowestLOD )
+                    lowestLOD = fetch._resultKey.getLevelOfDetail();
 
-                    //This HeightField is fallback data, so increment the count.
-                    numFallbacks++;
-                }
+                //This HeightField is fallback data, so increment the count.
+                numFallbacks++;
             }
 
-            if ( geoHF.valid() )
-            {
-                heightFields.push_back( geoHF );
-            }
+            heightFields.push_back( fetch._result );
         }
     }
 
@@ -595,67 +965,45 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
 
         const SpatialReference* keySRS = keyToUse.getProfile()->getSRS();
 
-        //Create the new heightfield by sampling all of them.
-        for (unsigned int c = 0; c < width; ++c)
+        //Set up the sources in priority order; the last layer is the highest priority.
+        std::vector<CompositeSource> sources;
+        sources.reserve( heightFields.size() );
+        for( GeoHeightFieldVector::reverse_iterator itr = heightFields.rbegin(); itr != heightFields.rend(); ++itr )
         {
-            double x = minx + (dx * (double)c);
-            for (unsigned r = 0; r < height; ++r)
-            {
-                double y = miny + (dy * (double)r);
+            sources.push_back( CompositeSource(*itr, keySRS) );
+        }
 
-                //Collect elevations from all of the layers. Iterate BACKWARDS because the last layer
-                // is the highest priority.
-                std::vector<float> elevations;
-                for( GeoHeightFieldVector::reverse_iterator itr = heightFields.rbegin(); itr != heightFields.rend(); ++itr )
-                {
-                    const GeoHeightField& geoHF = *itr;
+        //One row of samples per source.
+        std::vector<float> rowBuffer( width * sources.size() );
+        std::vector<float*> rows( sources.size() );
+        for( unsigned i = 0; i < sources.size(); ++i )
+            rows[i] = &rowBuffer[i * width];
 
-                    float elevation = 0.0f;
-                    if ( geoHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) )
-                    {
-                        if (elevation != NO_DATA_VALUE)
-                        {
-                            elevations.push_back(elevation);
-                        }
-                    }
-                }
+        std::vector<osg::Vec3d> scratch;
+        std::vector<float> outRow( width );
 
-                float elevation = NO_DATA_VALUE;
+        //Create the new heightfield by sampling all of them, a row at a time.
+        for (unsigned r = 0; r < height; ++r)
+        {
+            double y = miny + (dy * (double)r);
 
-                //The list of elevations only contains valid values
-                if (elevations.size() > 0)
-                {
-                    if (samplePolicy == SAMPLE_FIRST_VALID)
-                    {
-                        elevation = elevations[0];
-                    }
-                    else if (samplePolicy == SAMPLE_HIGHEST)
-                    {
-                        elevation = -FLT_MAX;
-                        for (unsigned int i = 0; i < elevations.size(); ++i)
-                        {
-                            if (elevation < elevations[i]) elevation = elevations[i];
-                        }
-                    }
-                    else if (samplePolicy == SAMPLE_LOWEST)
-                    {
-                        elevation = FLT_MAX;
-                        for (unsigned i = 0; i < elevations.size(); ++i)
-                        {
-                            if (elevation > elevations[i]) elevation = elevations[i];
-                        }
-                    }
-                    else if (samplePolicy == SAMPLE_AVERAGE)
-                    {
-                        elevation = 0.0;
-                        for (unsigned i = 0; i < elevations.size(); ++i)
-                        {
-                            elevation += elevations[i];
-                        }
-                        elevation /= (float)elevations.size();
-                    }
-                }
-                out_result->setHeight(c, r, elevation);
+            for( unsigned i = 0; i < sources.size(); ++i )
+            {
+                sampleRow( sources[i], keySRS, minx, dx, y, width, interpolation, scratch, rows[i] );
+            }
+
+            if (samplePolicy == SAMPLE_HIGHEST)
+                combineHighest( rows, width, &outRow[0] );
+            else if (samplePolicy == SAMPLE_LOWEST)
+                combineLowest( rows, width, &outRow[0] );
+            else if (samplePolicy == SAMPLE_AVERAGE)
+                combineAverage( rows, width, &outRow[0] );
+            else
+                combineFirstValid( rows, width, &outRow[0] );
+
+            for (unsigned int c = 0; c < width; ++c)
+            {
+                out_result->setHeight(c, r, outRow[c]);
             }
         }
     }
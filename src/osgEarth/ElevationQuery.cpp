@@ -1,8 +1,12 @@
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/Locators>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
+#include <map>
+#include <limits.h>
 
 #define LC "[ElevationQuery] "
 
@@ -10,13 +14,15 @@ using namespace osgEarth;
 using namespace OpenThreads;
 
 ElevationQuery::ElevationQuery( const Map* map ) :
-_mapf( map, Map::TERRAIN_LAYERS )
+_mapf     ( map, Map::TERRAIN_LAYERS ),
+_tileCache( 50, 1 )
 {
     postCTOR();
 }
 
 ElevationQuery::ElevationQuery( const MapFrame& mapFrame ) :
-_mapf( mapFrame )
+_mapf     ( mapFrame ),
+_tileCache( 50, 1 )
 {
     postCTOR();
 }
@@ -30,10 +36,18 @@ ElevationQuery::postCTOR()
     _maxLevelOverride = -1;
     _queries          = 0.0;
     _totalTime        = 0.0;
+    _numFetchThreads  = std::max( 1, OpenThreads::GetNumberOfProcessors() );
 
-    // Limit the size of the cache we'll use to cache heightfields. This is an
-    // LRU cache.
-    _tileCache.setMaxSize( 50 );
+    // The heightfield cache (see ctors) is an LRU cache limited to 50 tiles.
+    // ElevationQuery is not shared across threads, so it uses a single shard.
+}
+
+void
+ElevationQuery::setNumFetchThreads( unsigned value )
+{
+    _numFetchThreads = value > 0 ? value : 1;
+    if ( _fetchService.valid() )
+        _fetchService->setNumThreads( _numFetchThreads );
 }
 
 void
@@ -145,13 +159,13 @@ ElevationQuery::getMaxLevel( double x, double y, const SpatialReference* srs, co
 void
 ElevationQuery::setMaxTilesToCache( int value )
 {
-    _tileCache.setMaxSize( value );
+    _tileCache.setMaxCost( value );
 }
 
 int
 ElevationQuery::getMaxTilesToCache() const
 {
-    return _tileCache.getMaxSize();
+    return _tileCache.getMaxCost();
 }
         
 void
@@ -183,14 +197,16 @@ ElevationQuery::getElevations(std::vector<osg::Vec3d>& points,
                               double                   desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<double> elevations;
+    std::vector<bool>   valid;
+    getElevationsImpl( points, pointsSRS, elevations, valid, desiredResolution );
+
+    for( unsigned i = 0; i < points.size(); ++i )
     {
-        double elevation;
-        double z = (*i).z();
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
-        if ( getElevationImpl( p, elevation, desiredResolution ) )
+        if ( valid[i] )
         {
-            (*i).z() = ignoreZ ? elevation : elevation + z;
+            points[i].z() = ignoreZ ? elevations[i] : elevations[i] + points[i].z();
         }
     }
     return true;
@@ -203,21 +219,238 @@ ElevationQuery::getElevations(const std::vector<osg::Vec3d>& points,
                               double                         desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::const_iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<double> elevations;
+    std::vector<bool>   valid;
+    getElevationsImpl( points, pointsSRS, elevations, valid, desiredResolution );
+
+    for( unsigned i = 0; i < points.size(); ++i )
+    {
+        out_elevations.push_back( valid[i] ? elevations[i] : 0.0 );
+    }
+    return true;
+}
+
+namespace
+{
+    typedef std::map< TileKey, std::vector<unsigned> > Buckets;
+
+    /** Fetches the heightfield for one key; runs on the query's task service. */
+    struct FetchTile
+    {
+        void init( const MapFrame* mapf, const TileKey& key, osg::ref_ptr<osg::HeightField>* out )
+        {
+            _mapf = mapf;
+            _key  = key;
+            _out  = out;
+        }
+
+        void execute()
+        {
+            _mapf->getHeightField( _key, true, *_out, 0L );
+        }
+
+        const MapFrame*                 _mapf;
+        TileKey                         _key;
+        osg::ref_ptr<osg::HeightField>* _out;
+    };
+}
+
+void
+ElevationQuery::getElevationsImpl(const std::vector<osg::Vec3d>& points,
+                                  const SpatialReference*        pointsSRS,
+                                  std::vector<double>&           out_elevations,
+                                  std::vector<bool>&             out_valid,
+                                  double                         desiredResolution )
+{
+    osg::Timer* timer = osg::Timer::instance();
+    osg::Timer_t start = timer->tick();
+
+    _batchStats = BatchStats();
+    _batchStats._numPoints = points.size();
+
+    out_elevations.assign( points.size(), 0.0 );
+
+    if ( _maxDataLevel == 0 || _tileSize == 0 )
     {
-        double elevation;
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
+        // this means there are no heightfields.
+        out_valid.assign( points.size(), true );
+        return;
+    }
 
-        if ( getElevationImpl(p, elevation, desiredResolution) )
+    out_valid.assign( points.size(), false );
+
+    const Profile*          profile = _mapf.getProfile();
+    const SpatialReference* mapSRS  = profile->getSRS();
+
+    // Phase 1: transform all the points to map coordinates at once.
+    // If any point fails, redo them one at a time and leave only the ones
+    // that fail invalid.
+    std::vector<osg::Vec3d> mapPoints( points );
+    std::vector<bool>       transformed( points.size(), true );
+    if ( pointsSRS && !pointsSRS->isEquivalentTo(mapSRS) )
+    {
+        if ( !pointsSRS->transform(mapPoints, mapSRS) )
         {
-            out_elevations.push_back( elevation );
+            unsigned numFailed = 0;
+            for( unsigned i = 0; i < points.size(); ++i )
+            {
+                if ( !pointsSRS->transform(points[i], mapSRS, mapPoints[i]) )
+                {
+                    transformed[i] = false;
+                    ++numFailed;
+                }
+            }
+            OE_WARN << LC << "Coord transform failed for " << numFailed << " of "
+                << points.size() << " points" << std::endl;
+        }
+    }
+
+    osg::Timer_t t_transform = timer->tick();
+
+    // Phase 2: bucket the points by the tile that will cover them. The best
+    // available level only varies from point to point if a layer reports
+    // data extents; otherwise compute it just once.
+    unsigned int desiredLevel = UINT_MAX;
+    if ( desiredResolution > 0.0 )
+        desiredLevel = profile->getLevelOfDetailForHorizResolution( desiredResolution, _tileSize );
+
+    bool levelVariesByPoint = false;
+    for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end() && !levelVariesByPoint; ++i )
+    {
+        TileSource* ts = i->get()->getTileSource();
+        levelVariesByPoint = ts && ts->getDataExtents().size() > 0;
+    }
+    for( ImageLayerVector::const_iterator i = _mapf.imageLayers().begin(); i != _mapf.imageLayers().end() && !levelVariesByPoint; ++i )
+    {
+        TileSource* ts = i->get()->getTileSource();
+        levelVariesByPoint = ts && ts->getDataExtents().size() > 0;
+    }
+
+    unsigned int bestAvailLevel = 0;
+    bool         haveLevel      = false;
+
+    Buckets buckets;
+    for( unsigned i = 0; i < mapPoints.size(); ++i )
+    {
+        if ( !transformed[i] )
+            continue;
+
+        if ( levelVariesByPoint || !haveLevel )
+        {
+            bestAvailLevel = std::min( desiredLevel, getMaxLevel(mapPoints[i].x(), mapPoints[i].y(), mapSRS, profile) );
+            haveLevel      = true;
+        }
+
+        TileKey key = profile->createTileKey( mapPoints[i].x(), mapPoints[i].y(), bestAvailLevel );
+        if ( key.valid() )
+            buckets[key].push_back( i );
+    }
+
+    _batchStats._numTiles = buckets.size();
+
+    osg::Timer_t t_bucket = timer->tick();
+
+    // Phase 3: fetch the tiles we don't already have, in parallel.
+    std::vector<TileKey>                          keys;
+    std::vector< osg::ref_ptr<osg::HeightField> > tiles;
+    keys.reserve( buckets.size() );
+    tiles.reserve( buckets.size() );
+
+    std::vector<TileKey> missingKeys;
+    std::vector<unsigned> missingSlots;
+
+    for( Buckets::const_iterator b = buckets.begin(); b != buckets.end(); ++b )
+    {
+        osg::ref_ptr<osg::HeightField> tile;
+        if ( !_tileCache.get(b->first, tile) )
+        {
+            missingKeys.push_back( b->first );
+            missingSlots.push_back( keys.size() );
+        }
+        keys.push_back( b->first );
+        tiles.push_back( tile.get() );
+    }
+
+    if ( missingKeys.size() > 0 )
+    {
+        std::vector< osg::ref_ptr<osg::HeightField> > fetched( missingKeys.size() );
+
+        if ( missingKeys.size() == 1 || _numFetchThreads <= 1 )
+        {
+            for( unsigned m = 0; m < missingKeys.size(); ++m )
+                _mapf.getHeightField( missingKeys[m], true, fetched[m], 0L );
         }
         else
         {
-            out_elevations.push_back( 0.0 );
+            if ( !_fetchService.valid() )
+                _fetchService = new TaskService( "ElevationQuery", _numFetchThreads );
+
+            Threading::MultiEvent semaphore( missingKeys.size() );
+            for( unsigned m = 0; m < missingKeys.size(); ++m )
+            {
+                ParallelTask<FetchTile>* task = new ParallelTask<FetchTile>( &semaphore );
+                task->init( &_mapf, missingKeys[m], &fetched[m] );
+                _fetchService->add( task );
+            }
+            semaphore.wait();
+        }
+
+        for( unsigned m = 0; m < missingKeys.size(); ++m )
+        {
+            if ( fetched[m].valid() )
+            {
+                tiles[missingSlots[m]] = fetched[m].get();
+                _tileCache.insert( missingKeys[m], fetched[m].get() );
+                _batchStats._numTilesFetched++;
+            }
+            else
+            {
+                OE_WARN << LC << "Unable to create heightfield for key " << missingKeys[m].str() << std::endl;
+            }
         }
     }
-    return true;
+
+    osg::Timer_t t_fetch = timer->tick();
+
+    // Phase 4: sample each tile's points together.
+    ElevationInterpolation interp = _mapf.getMapInfo().getElevationInterpolation();
+    unsigned k = 0;
+    for( Buckets::const_iterator b = buckets.begin(); b != buckets.end(); ++b, ++k )
+    {
+        osg::HeightField* tile = tiles[k].get();
+        if ( !tile )
+            continue;
+
+        const GeoExtent& extent = b->first.getExtent();
+        double xInterval = extent.width()  / (double)(tile->getNumColumns()-1);
+        double yInterval = extent.height() / (double)(tile->getNumRows()-1);
+        double xMin      = extent.xMin();
+        double yMin      = extent.yMin();
+
+        const std::vector<unsigned>& indices = b->second;
+        for( std::vector<unsigned>::const_iterator i = indices.begin(); i != indices.end(); ++i )
+        {
+            out_elevations[*i] = (double) HeightFieldUtils::getHeightAtLocation(
+                tile, mapPoints[*i].x(), mapPoints[*i].y(), xMin, yMin, xInterval, yInterval, interp );
+            out_valid[*i] = true;
+        }
+    }
+
+    osg::Timer_t end = timer->tick();
+
+    _batchStats._transformTime = timer->delta_s( start,       t_transform );
+    _batchStats._bucketTime    = timer->delta_s( t_transform, t_bucket );
+    _batchStats._fetchTime     = timer->delta_s( t_bucket,    t_fetch );
+    _batchStats._sampleTime    = timer->delta_s( t_fetch,     end );
+
+    _queries   += (double)points.size();
+    _totalTime += timer->delta_s( start, end );
+
+    OE_DEBUG << LC << "Batch of " << points.size() << " points, " << buckets.size() << " tiles ("
+        << _batchStats._numTilesFetched << " fetched): transform " << _batchStats._transformTime
+        << "s, bucket " << _batchStats._bucketTime << "s, fetch " << _batchStats._fetchTime
+        << "s, sample " << _batchStats._sampleTime << "s" << std::endl;
 }
 
 bool
@@ -276,9 +509,7 @@ ElevationQuery::getElevationImpl(const GeoPoint& point,
     // fallback on a lower resolution, this cache will hold the final resolution heightfield
     // instead of trying to fetch the higher resolution one each item.
 
-    TileCache::Record record = _tileCache.get( key );
-    if ( record.valid() )
-        tile = record.value().get();
+    _tileCache.get( key, tile );
 
     // if we didn't find it, build it.
     if ( !tile.valid() )
@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/HTTPClient>
+#include <osgEarth/CacheBin>
+#include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Version>
 #include <osgDB/ReadFile>
@@ -29,10 +31,25 @@
 #include <iterator>
 #include <iostream>
 #include <algorithm>
+#include <list>
 #include <curl/curl.h>
 
+#ifdef _WIN32
+#  include <winsock2.h>
+#else
+#  include <sys/select.h>
+#endif
+
 #define LC "[HTTPClient] "
 
+// curl_multi_poll (7.66) can be interrupted with curl_multi_wakeup (7.68);
+// curl_multi_wait (7.28) cannot, so the engine caps its wait instead.
+#if LIBCURL_VERSION_NUM >= 0x074400
+#  define OE_CURL_HAS_MULTI_POLL
+#elif LIBCURL_VERSION_NUM >= 0x071C00
+#  define OE_CURL_HAS_MULTI_WAIT
+#endif
+
 //#define OE_TEST OE_NOTICE
 #define OE_TEST OE_NULL
 
@@ -306,6 +323,416 @@ namespace
 
     // HTTP debugging.
     static bool                        s_HTTP_DEBUG = false;
+
+    // async engine settings
+    static bool                        s_useAsyncEngine = ::getenv("OSGEARTH_HTTP_ASYNC") != 0L;
+    static unsigned                    s_maxConnectionsPerHost = 4;
+    static unsigned                    s_maxConnections = 32;
+
+    // the engine's network thread, for detecting re-entrant calls.
+    static OpenThreads::Thread*        s_engineThread = 0L;
+}
+
+//----------------------------------------------------------------------------
+
+namespace osgEarth
+{
+    /**
+     * Asynchronous HTTP engine. Runs a curl_multi event loop on its own thread,
+     * multiplexing all transfers so that no thread sits idle on a network
+     * round-trip. Finished transfers return their HTTPClient (and its easy
+     * handle) to a pool, so connections stay alive for reuse. The engine caps
+     * the number of concurrent transfers per host and in total; requests
+     * over the cap wait in a FIFO queue.
+     */
+    class HTTPEngine : public OpenThreads::Thread
+    {
+    public:
+        static HTTPEngine* instance()
+        {
+            static Threading::Mutex s_mutex;
+
+            // The engine thread uses the osgDB registry (authentication map,
+            // reader lookup) until it stops. Construct that singleton before
+            // the holder so that it is destroyed after the holder joins the
+            // engine thread at exit.
+            osgDB::Registry::instance();
+            static Holder s_holder;
+
+            Threading::ScopedMutexLock lock( s_mutex );
+            if ( !s_holder._engine )
+            {
+                s_holder._engine = new HTTPEngine();
+                s_engineThread = s_holder._engine;
+                s_holder._engine->start();
+            }
+            return s_holder._engine;
+        }
+
+        /** True if the calling thread is the engine's network thread. */
+        static bool isEngineThread()
+        {
+            return
+                s_engineThread != 0L &&
+                OpenThreads::Thread::CurrentThread() == s_engineThread;
+        }
+
+        /** Response handed back to a caller that would otherwise deadlock. */
+        static const HTTPResponse& cancelledResponse()
+        {
+            // only ever touched from the engine thread.
+            static HTTPResponse s_response( 0L );
+            s_response._cancelled = true;
+            return s_response;
+        }
+
+        osg::ref_ptr<HTTPFuture> submit(const HTTPRequest&    request,
+                                        const osgDB::Options* dbOptions,
+                                        ProgressCallback*     progress,
+                                        HTTPCallback*         callback )
+        {
+            osg::ref_ptr<HTTPFuture> future = new HTTPFuture( request );
+            Transfer* t = new Transfer( future.get() );
+            t->_dbOptions = dbOptions;
+            t->_progress  = progress;
+            t->_callback  = callback;
+            t->_host      = getHost( request.getURL() );
+            {
+                Threading::ScopedMutexLock lock( _queueMutex );
+                _queue.push_back( t );
+            }
+            wake();
+            return future;
+        }
+
+        void run()
+        {
+            while( !_done )
+            {
+                schedule();
+
+                if ( _active.empty() )
+                {
+                    // nothing in flight; sleep until a request arrives.
+                    if ( isQueueEmpty() )
+                        _wake.waitAndReset();
+                    continue;
+                }
+
+                int running = 0;
+                while( curl_multi_perform(_multi, &running) == CURLM_CALL_MULTI_PERFORM );
+
+                int left = 0;
+                while( CURLMsg* msg = curl_multi_info_read(_multi, &left) )
+                {
+                    if ( msg->msg == CURLMSG_DONE )
+                    {
+                        finish( msg->easy_handle, msg->data.result );
+                    }
+                }
+
+                if ( running > 0 )
+                {
+                    waitForActivity();
+                }
+            }
+
+            cancelAll();
+        }
+
+        int cancel()
+        {
+            _done = true;
+            wake();
+            return 0;
+        }
+
+    private:
+        // interrupts the idle wait and, where libcurl allows it, a socket wait.
+        void wake()
+        {
+            _wake.set();
+#ifdef OE_CURL_HAS_MULTI_POLL
+            curl_multi_wakeup( _multi );
+#endif
+        }
+
+        /** State of a single request */
+        struct Transfer
+        {
+            Transfer( HTTPFuture* future ) :
+                _future( future ),
+                _part  ( new HTTPResponse::Part() ),
+                _stream( &_part->_stream ),
+                _client( 0L ) { _errorBuf[0] = 0; }
+
+            osg::ref_ptr<HTTPFuture>              _future;
+            osg::ref_ptr<const osgDB::Options>    _dbOptions;
+            osg::ref_ptr<ProgressCallback>        _progress;
+            osg::ref_ptr<HTTPCallback>            _callback;
+            osg::ref_ptr<HTTPResponse::Part>      _part;
+            StreamObject                          _stream;
+            std::string                           _host;
+            std::string                           _proxyAddr;
+            HTTPClient*                           _client;
+            char                                  _errorBuf[CURL_ERROR_SIZE];
+        };
+
+        struct Holder
+        {
+            Holder() : _engine(0L) { }
+            ~Holder() { 
+                if ( _engine ) {
+                    _engine->cancel();
+                    _engine->join();
+                    s_engineThread = 0L;
+                    delete _engine;
+                }
+            }
+            HTTPEngine* _engine;
+        };
+
+        HTTPEngine() : _done(false)
+        {
+            _multi = curl_multi_init();
+            curl_multi_setopt( _multi, CURLMOPT_MAXCONNECTS, (long)s_maxConnections );
+        }
+
+        virtual ~HTTPEngine()
+        {
+            for( std::vector<HTTPClient*>::iterator i = _clients.begin(); i != _clients.end(); ++i )
+                delete *i;
+            curl_multi_cleanup( _multi );
+        }
+
+        static std::string getHost( const std::string& url )
+        {
+            std::string::size_type start = url.find( "://" );
+            start = start == std::string::npos ? 0 : start + 3;
+            std::string::size_type end = url.find_first_of( "/?", start );
+            return url.substr( start, end == std::string::npos ? std::string::npos : end-start );
+        }
+
+        bool isQueueEmpty()
+        {
+            Threading::ScopedMutexLock lock( _queueMutex );
+            return _queue.empty();
+        }
+
+        // Moves queued requests into the multi handle, honoring the connection limits.
+        void schedule()
+        {
+            std::vector<Transfer*> ready;
+            {
+                Threading::ScopedMutexLock lock( _queueMutex );
+
+                std::list<Transfer*>::iterator i = _queue.begin();
+                while( i != _queue.end() && _active.size() + ready.size() < s_maxConnections )
+                {
+                    unsigned& hostCount = _hostCounts[(*i)->_host];
+                    if ( hostCount < s_maxConnectionsPerHost )
+                    {
+                        ++hostCount;
+                        ready.push_back( *i );
+                        i = _queue.erase( i );
+                    }
+                    else
+                    {
+                        ++i;
+                    }
+                }
+            }
+
+            // start outside the lock, since a simulated response completes (and
+            // invokes its callback) immediately.
+            for( std::vector<Transfer*>::iterator i = ready.begin(); i != ready.end(); ++i )
+            {
+                start( *i );
+            }
+        }
+
+        void start( Transfer* t )
+        {
+            // grab a pooled client; its easy handle keeps its connection alive.
+            if ( _clients.empty() )
+                _clients.push_back( new HTTPClient() );
+            t->_client = _clients.back();
+            _clients.pop_back();
+
+            HTTPClient* client = t->_client;
+            t->_proxyAddr = client->setupGet( t->_future->getRequest(), t->_dbOptions.get(), t->_progress.get() );
+
+            if ( client->_simResponseCode >= 0 )
+            {
+                // simulated failure; complete immediately.
+                complete( t, client->_simResponseCode == 408 ? CURLE_OPERATION_TIMEDOUT : CURLE_COULDNT_CONNECT );
+                return;
+            }
+
+            CURL* handle = (CURL*)client->_curl_handle;
+            curl_easy_setopt( handle, CURLOPT_ERRORBUFFER, (void*)t->_errorBuf );
+            curl_easy_setopt( handle, CURLOPT_WRITEDATA, (void*)&t->_stream );
+            _active[handle] = t;
+            curl_multi_add_handle( _multi, handle );
+        }
+
+        void finish( CURL* handle, CURLcode result )
+        {
+            std::map<void*, Transfer*>::iterator i = _active.find( handle );
+            if ( i == _active.end() )
+                return;
+
+            Transfer* t = i->second;
+            _active.erase( i );
+            curl_multi_remove_handle( _multi, handle );
+            curl_easy_setopt( handle, CURLOPT_ERRORBUFFER, (void*)0 );
+            complete( t, result );
+        }
+
+        void complete( Transfer* t, int result )
+        {
+            t->_future->_response = t->_client->finishGet( t->_future->getRequest(), result, t->_part.get(), t->_proxyAddr );
+            _clients.push_back( t->_client );
+            _hostCounts[t->_host]--;
+
+            if ( t->_callback.valid() )
+                t->_callback->onComplete( t->_future->getRequest(), t->_future->_response );
+
+            t->_future->_done.set();
+            delete t;
+        }
+
+        // sleeps until a socket is ready or libcurl's next timeout expires.
+        void waitForActivity()
+        {
+#if defined(OE_CURL_HAS_MULTI_POLL)
+            // submit() and cancel() interrupt this with curl_multi_wakeup.
+            curl_multi_poll( _multi, 0L, 0, 1000, 0L );
+#elif defined(OE_CURL_HAS_MULTI_WAIT)
+            // no wakeup call in this libcurl; cap the wait so that newly
+            // queued requests still start promptly.
+            curl_multi_wait( _multi, 0L, 0, 10, 0L );
+#else
+            long timeout = -1;
+            curl_multi_timeout( _multi, &timeout );
+            if ( timeout < 0 || timeout > 10 )
+                timeout = 10;
+            if ( timeout == 0 )
+                return;
+
+            fd_set fdread, fdwrite, fdexcep;
+            FD_ZERO( &fdread );
+            FD_ZERO( &fdwrite );
+            FD_ZERO( &fdexcep );
+            int maxfd = -1;
+            curl_multi_fdset( _multi, &fdread, &fdwrite, &fdexcep, &maxfd );
+
+            if ( maxfd >= 0 )
+            {
+                struct timeval tv;
+                tv.tv_sec  = 0;
+                tv.tv_usec = timeout * 1000;
+                ::select( maxfd+1, &fdread, &fdwrite, &fdexcep, &tv );
+            }
+            else
+            {
+                OpenThreads::Thread::microSleep( timeout * 1000 );
+            }
+#endif
+        }
+
+        // fails all outstanding requests at shutdown.
+        void cancelAll()
+        {
+            while( !_active.empty() )
+            {
+                finish( (CURL*)_active.begin()->first, CURLE_ABORTED_BY_CALLBACK );
+            }
+
+            Threading::ScopedMutexLock lock( _queueMutex );
+            for( std::list<Transfer*>::iterator i = _queue.begin(); i != _queue.end(); ++i )
+            {
+                Transfer* t = *i;
+                t->_future->_response = HTTPResponse( 0L );
+                t->_future->_response._cancelled = true;
+                t->_future->_done.set();
+                delete t;
+            }
+            _queue.clear();
+        }
+
+    private:
+        CURLM*                          _multi;
+        volatile bool                   _done;
+        Threading::Event                _wake;
+        Threading::Mutex                _queueMutex;
+        std::list<Transfer*>            _queue;
+        std::map<std::string, unsigned> _hostCounts;
+        std::map<void*, Transfer*>      _active;
+        std::vector<HTTPClient*>        _clients;
+    };
+}
+
+const HTTPResponse&
+HTTPFuture::get()
+{
+    // Waiting from an HTTPCallback would block the only thread that can
+    // finish the request.
+    if ( !_done.isSet() && HTTPEngine::isEngineThread() )
+    {
+        OE_WARN << LC << "HTTPFuture::get() called on the HTTP engine thread for "
+            << _request.getURL() << "; returning a cancelled response" << std::endl;
+        return HTTPEngine::cancelledResponse();
+    }
+
+    while( !_done.isSet() )
+        _done.wait();
+    return _response;
+}
+
+osg::ref_ptr<HTTPFuture>
+HTTPClient::getAsync(const HTTPRequest&    request,
+                     const osgDB::Options* dbOptions,
+                     ProgressCallback*     progress,
+                     HTTPCallback*         callback )
+{
+    return HTTPEngine::instance()->submit( request, dbOptions, progress, callback );
+}
+
+void
+HTTPClient::setUseAsyncEngine( bool value )
+{
+    s_useAsyncEngine = value;
+}
+
+bool
+HTTPClient::getUseAsyncEngine()
+{
+    return s_useAsyncEngine;
+}
+
+void
+HTTPClient::setMaxConnectionsPerHost( unsigned value )
+{
+    s_maxConnectionsPerHost = std::max( value, 1u );
+}
+
+unsigned
+HTTPClient::getMaxConnectionsPerHost()
+{
+    return s_maxConnectionsPerHost;
+}
+
+void
+HTTPClient::setMaxConnections( unsigned value )
+{
+    s_maxConnections = std::max( value, 1u );
+}
+
+unsigned
+HTTPClient::getMaxConnections()
+{
+    return s_maxConnections;
 }
 
 HTTPClient&
@@ -607,6 +1034,47 @@ HTTPClient::download(const std::string& uri,
 
 HTTPResponse
 HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* callback) const
+{
+    // route the request through the multiplexed engine if it's enabled. A
+    // synchronous call made from an HTTPCallback runs on the engine thread
+    // itself, so it must not wait on the engine; it takes the blocking path.
+    if ( s_useAsyncEngine && !HTTPEngine::isEngineThread() )
+    {
+        osg::ref_ptr<HTTPFuture> future = getAsync( request, options, callback );
+        return future->get();
+    }
+
+    std::string proxy_addr = setupGet( request, options, callback );
+
+    osg::ref_ptr<HTTPResponse::Part> part = new HTTPResponse::Part();
+    StreamObject sp( &part->_stream );
+
+    //Take a temporary ref to the callback
+    osg::ref_ptr<ProgressCallback> progressCallback = callback;
+
+    int res;
+
+    if ( _simResponseCode < 0 )
+    {
+        char errorBuf[CURL_ERROR_SIZE];
+        errorBuf[0] = 0;
+        curl_easy_setopt( _curl_handle, CURLOPT_ERRORBUFFER, (void*)errorBuf );
+
+        curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)&sp);
+        res = curl_easy_perform( _curl_handle );
+        curl_easy_setopt( _curl_handle, CURLOPT_ERRORBUFFER, (void*)0 );
+    }
+    else
+    {
+        // simulate failure with a custom response code
+        res = _simResponseCode == 408 ? CURLE_OPERATION_TIMEDOUT : CURLE_COULDNT_CONNECT;
+    }
+
+    return finishGet( request, res, part.get(), proxy_addr );
+}
+
+std::string
+HTTPClient::setupGet( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* callback) const
 {
     initialize();
 
@@ -741,28 +1209,20 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
 #endif
     }
 
-    osg::ref_ptr<HTTPResponse::Part> part = new HTTPResponse::Part();
-    StreamObject sp( &part->_stream );
-
-    //Take a temporary ref to the callback
-    osg::ref_ptr<ProgressCallback> progressCallback = callback;
     curl_easy_setopt( _curl_handle, CURLOPT_URL, request.getURL().c_str() );
-    if (callback)
-    {
-        curl_easy_setopt(_curl_handle, CURLOPT_PROGRESSDATA, progressCallback.get());
-    }
+    curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)callback );
+
+    return proxy_addr;
+}
 
-    CURLcode res;
+HTTPResponse
+HTTPClient::finishGet( const HTTPRequest& request, int curlResult, HTTPResponse::Part* part, const std::string& proxy_addr ) const
+{
+    CURLcode res = (CURLcode)curlResult;
     long response_code = 0L;
 
     if ( _simResponseCode < 0 )
     {
-        char errorBuf[CURL_ERROR_SIZE];
-        errorBuf[0] = 0;
-        curl_easy_setopt( _curl_handle, CURLOPT_ERRORBUFFER, (void*)errorBuf );
-
-        curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)&sp);
-        res = curl_easy_perform( _curl_handle );
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
         curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
 
@@ -784,9 +1244,7 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
     }
     else
     {
-        // simulate failure with a custom response code
         response_code = _simResponseCode;
-        res = response_code == 408 ? CURLE_OPERATION_TIMEDOUT : CURLE_COULDNT_CONNECT;
     }
 
     if ( s_HTTP_DEBUG )
@@ -823,14 +1281,14 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
             OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
 
             //TODO: parse out the "wcs" -- this is WCS-specific
-            decodeMultipartStream( "wcs", part.get(), response._parts );
+            decodeMultipartStream( "wcs", part, response._parts );
         }
         else
         {
             // store headers that we care about
             part->_headers[IOMetadata::CONTENT_TYPE] = content_type;
 
-            response._parts.push_back( part.get() );
+            response._parts.push_back( part );
         }
     }
     else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
@@ -945,7 +1403,11 @@ HTTPClient::doReadImage(const std::string&    location,
             osgDB::ReaderWriter::ReadResult rr = reader->readImage(response.getPartStream(0), options);
             if ( rr.validImage() )
             {
-                result = ReadResult(rr.takeImage(), response.getHeadersAsConfig() );
+                // keep the encoded bytes around if a cache is waiting to store them as-is:
+                osg::Image* image = rr.takeImage();
+                if ( EncodedRecord::isWanted(options) )
+                    ImageUtils::setEncodedData( image, response.getPartAsString(0) );
+                result = ReadResult(image, response.getHeadersAsConfig() );
             }
             else 
             {
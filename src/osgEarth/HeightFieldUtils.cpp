@@ -22,6 +22,8 @@
 #include <osgEarth/Geoid>
 #include <osgEarth/CullingUtils>
 #include <osg/Notify>
+#include <cstring>
+#include <vector>
 
 using namespace osgEarth;
 
@@ -476,6 +478,323 @@ HeightFieldUtils::createClusterCullingCallback( osg::HeightField* grid, osg::Ell
     return ccc;
 }
 
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Packed heightfield layout (all values little-endian):
+    //   "OEHF" version:u8 mode:u8 flags:u8 reserved:u8
+    //   cols:u32 rows:u32 origin:3xf64 xInterval:f64 yInterval:f64
+    //   skirtHeight:f32 borderWidth:u32
+    //   MODE_RAW:       cols*rows x f32
+    //   MODE_QUANTIZED: [mask] if FLAG_NODATA, one bit per sample, set = NO_DATA_VALUE;
+    //                   step:f64; then one zigzag varint per valid sample holding
+    //                   the difference from a MED (LOCO-I) prediction.
+
+    const char          HF_MAGIC[4]    = { 'O', 'E', 'H', 'F' };
+    const unsigned char HF_VERSION     = 1;
+    const unsigned char MODE_RAW       = 0;
+    const unsigned char MODE_QUANTIZED = 1;
+    const unsigned char FLAG_NODATA    = 0x01;
+    const unsigned      HF_HEADER_SIZE = 4 + 4 + 4 + 4 + 5*8 + 4 + 4;
+
+    // quantization steps to try, coarsest first:
+    const double   QUANTA[]   = { 1.0, 0.5, 0.25, 0.125, 0.1, 0.0625, 0.05, 0.01, 0.001 };
+    const unsigned NUM_QUANTA = sizeof(QUANTA)/sizeof(QUANTA[0]);
+
+    typedef long long          Quantum;
+    typedef unsigned long long UQuantum;
+
+    // largest quantized magnitude we allow, so residuals stay well inside 64 bits.
+    const Quantum MAX_QUANTUM = 1LL << 40;
+
+    struct Writer
+    {
+        std::string& _buf;
+        Writer( std::string& buf ) : _buf(buf) { }
+
+        void u8( unsigned char v ) { _buf.push_back( (char)v ); }
+
+        void u32( unsigned v ) {
+            for( unsigned i=0; i<4; ++i ) u8( (unsigned char)(v >> (8*i)) );
+        }
+        void u64( UQuantum v ) {
+            for( unsigned i=0; i<8; ++i ) u8( (unsigned char)(v >> (8*i)) );
+        }
+        void f32( float v ) {
+            unsigned u; ::memcpy( &u, &v, 4 ); u32( u );
+        }
+        void f64( double v ) {
+            UQuantum u; ::memcpy( &u, &v, 8 ); u64( u );
+        }
+        void varint( Quantum v ) {
+            UQuantum z = ((UQuantum)v << 1) ^ (UQuantum)(v >> 63); // zigzag
+            while( z >= 0x80 ) {
+                u8( (unsigned char)(z | 0x80) );
+                z >>= 7;
+            }
+            u8( (unsigned char)z );
+        }
+    };
+
+    struct Reader
+    {
+        const unsigned char* _p;
+        const unsigned char* _end;
+        bool                 _ok;
+
+        Reader( const char* p, unsigned len ) :
+            _p((const unsigned char*)p), _end((const unsigned char*)p + len), _ok(true) { }
+
+        bool has( unsigned n ) { if ( (unsigned)(_end-_p) < n ) _ok = false; return _ok; }
+
+        unsigned char u8() { return has(1) ? *_p++ : 0; }
+
+        unsigned u32() {
+            if ( !has(4) ) return 0;
+            unsigned v = 0;
+            for( unsigned i=0; i<4; ++i ) v |= (unsigned)(*_p++) << (8*i);
+            return v;
+        }
+        UQuantum u64() {
+            if ( !has(8) ) return 0;
+            UQuantum v = 0;
+            for( unsigned i=0; i<8; ++i ) v |= (UQuantum)(*_p++) << (8*i);
+            return v;
+        }
+        float f32() {
+            unsigned u = u32(); float v; ::memcpy( &v, &u, 4 ); return v;
+        }
+        double f64() {
+            UQuantum u = u64(); double v; ::memcpy( &v, &u, 8 ); return v;
+        }
+        Quantum varint() {
+            UQuantum z = 0;
+            for( unsigned shift=0; shift<64; shift += 7 ) {
+                if ( !has(1) ) return 0;
+                unsigned char b = *_p++;
+                z |= (UQuantum)(b & 0x7F) << shift;
+                if ( (b & 0x80) == 0 )
+                    return (Quantum)(z >> 1) ^ -(Quantum)(z & 1);
+            }
+            _ok = false;
+            return 0;
+        }
+    };
+
+    inline float dequantize( Quantum q, double step ) {
+        return (float)((double)q * step);
+    }
+
+    // bitwise comparison, so that e.g. -0.0 does not quietly become 0.0
+    inline bool sameBits( float a, float b ) {
+        return ::memcmp( &a, &b, sizeof(float) ) == 0;
+    }
+
+    // MED predictor from LOCO-I: picks the left or upper neighbor at an edge in
+    // the terrain, and the planar estimate elsewhere.
+    inline Quantum predict( const std::vector<Quantum>& q, unsigned c, unsigned r, unsigned cols ) {
+        unsigned i = r*cols + c;
+        if ( r == 0 ) return c == 0 ? 0 : q[i-1];
+        if ( c == 0 ) return q[i-cols];
+        Quantum a = q[i-1], b = q[i-cols], d = q[i-cols-1];
+        Quantum lo = osg::minimum(a, b), hi = osg::maximum(a, b);
+        return d >= hi ? lo : d <= lo ? hi : a + b - d;
+    }
+
+    // finds the coarsest step that reproduces every valid height exactly.
+    bool findQuantum( const osg::FloatArray& heights, unsigned n, double& out_step ) {
+        for( unsigned s=0; s<NUM_QUANTA; ++s ) {
+            double step = QUANTA[s];
+            bool ok = true;
+            for( unsigned i=0; i<n && ok; ++i ) {
+                float h = heights[i];
+                if ( h == NO_DATA_VALUE ) continue;
+                double qd = osg::round( (double)h / step );
+                ok =
+                    qd >= -(double)MAX_QUANTUM &&
+                    qd <=  (double)MAX_QUANTUM &&
+                    sameBits( dequantize((Quantum)qd, step), h );
+            }
+            if ( ok ) {
+                out_step = step;
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+void
+HeightFieldUtils::encodeHeightField(const osg::HeightField* hf,
+                                    std::string&            out_bytes)
+{
+    out_bytes.clear();
+    if ( !hf || !hf->getFloatArray() )
+        return;
+
+    const osg::FloatArray& heights = *hf->getFloatArray();
+    unsigned cols = hf->getNumColumns();
+    unsigned rows = hf->getNumRows();
+    unsigned n    = cols*rows;
+    if ( heights.size() < n )
+        return;
+
+    bool hasNoData = false;
+    for( unsigned i=0; i<n && !hasNoData; ++i )
+        hasNoData = heights[i] == NO_DATA_VALUE;
+
+    double step = 0.0;
+    bool quantized = findQuantum( heights, n, step );
+
+    Writer w( out_bytes );
+    out_bytes.reserve( HF_HEADER_SIZE + (quantized ? 2*n : 4*n) );
+
+    for( unsigned i=0; i<4; ++i ) w.u8( HF_MAGIC[i] );
+    w.u8 ( HF_VERSION );
+    w.u8 ( quantized ? MODE_QUANTIZED : MODE_RAW );
+    w.u8 ( quantized && hasNoData ? FLAG_NODATA : 0 );
+    w.u8 ( 0 );
+    w.u32( cols );
+    w.u32( rows );
+    w.f64( hf->getOrigin().x() );
+    w.f64( hf->getOrigin().y() );
+    w.f64( hf->getOrigin().z() );
+    w.f64( hf->getXInterval() );
+    w.f64( hf->getYInterval() );
+    w.f32( hf->getSkirtHeight() );
+    w.u32( hf->getBorderWidth() );
+
+    if ( quantized )
+    {
+        if ( hasNoData )
+        {
+            for( unsigned i=0; i<n; i += 8 )
+            {
+                unsigned char bits = 0;
+                for( unsigned b=0; b<8 && i+b<n; ++b )
+                    if ( heights[i+b] == NO_DATA_VALUE ) bits |= (1 << b);
+                w.u8( bits );
+            }
+        }
+
+        w.f64( step );
+
+        // no-data samples take on their predicted value so that their neighbors
+        // still predict well; they are not written.
+        std::vector<Quantum> q( n );
+        for( unsigned r=0; r<rows; ++r )
+        {
+            for( unsigned c=0; c<cols; ++c )
+            {
+                unsigned i = r*cols + c;
+                Quantum p = predict( q, c, r, cols );
+                if ( heights[i] == NO_DATA_VALUE )
+                {
+                    q[i] = p;
+                }
+                else
+                {
+                    q[i] = (Quantum)osg::round( (double)heights[i] / step );
+                    w.varint( q[i] - p );
+                }
+            }
+        }
+    }
+    else
+    {
+        for( unsigned i=0; i<n; ++i )
+            w.f32( heights[i] );
+    }
+}
+
+osg::HeightField*
+HeightFieldUtils::decodeHeightField(const char* bytes,
+                                    unsigned    length)
+{
+    Reader in( bytes, length );
+    if ( !bytes || !in.has(HF_HEADER_SIZE) || ::memcmp(bytes, HF_MAGIC, 4) != 0 )
+        return 0L;
+
+    in._p += 4;
+    unsigned char version = in.u8();
+    unsigned char mode    = in.u8();
+    unsigned char flags   = in.u8();
+    in.u8();
+    if ( version != HF_VERSION || (mode != MODE_RAW && mode != MODE_QUANTIZED) )
+        return 0L;
+
+    unsigned cols   = in.u32();
+    unsigned rows   = in.u32();
+    double   ox     = in.f64();
+    double   oy     = in.f64();
+    double   oz     = in.f64();
+    double   dx     = in.f64();
+    double   dy     = in.f64();
+    float    skirt  = in.f32();
+    unsigned border = in.u32();
+
+    // guard against garbage dimensions before allocating anything.
+    if ( cols == 0 || rows == 0 || cols > 16384 || rows > 16384 )
+        return 0L;
+    unsigned n = cols*rows;
+
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+    hf->allocate( cols, rows );
+    hf->setOrigin( osg::Vec3d(ox, oy, oz) );
+    hf->setXInterval( dx );
+    hf->setYInterval( dy );
+    hf->setSkirtHeight( skirt );
+    hf->setBorderWidth( border );
+    osg::FloatArray& heights = *hf->getFloatArray();
+
+    if ( mode == MODE_RAW )
+    {
+        if ( !in.has(4*n) )
+            return 0L;
+        for( unsigned i=0; i<n; ++i )
+            heights[i] = in.f32();
+    }
+    else
+    {
+        const unsigned char* mask = 0L;
+        if ( flags & FLAG_NODATA )
+        {
+            unsigned maskBytes = (n+7)/8;
+            if ( !in.has(maskBytes) )
+                return 0L;
+            mask = in._p;
+            in._p += maskBytes;
+        }
+
+        double step = in.f64();
+        if ( !in._ok || !(step > 0.0) )
+            return 0L;
+
+        std::vector<Quantum> q( n );
+        for( unsigned r=0; r<rows && in._ok; ++r )
+        {
+            for( unsigned c=0; c<cols; ++c )
+            {
+                unsigned i = r*cols + c;
+                Quantum p = predict( q, c, r, cols );
+                if ( mask && (mask[i >> 3] & (1 << (i & 7))) )
+                {
+                    q[i] = p;
+                    heights[i] = NO_DATA_VALUE;
+                }
+                else
+                {
+                    q[i] = p + in.varint();
+                    heights[i] = dequantize( q[i], step );
+                }
+            }
+        }
+    }
+
+    return in._ok ? hf.release() : 0L;
+}
+
 /******************************************************************************************/
 
 ReplaceInvalidDataOperator::ReplaceInvalidDataOperator():
@@ -210,10 +210,19 @@ ImageLayerTileProcessor::process( osg::ref_ptr<osg::Image>& image ) const
             // a format that does before continuing.
             image = ImageUtils::convertToRGBA8( image.get() );
         }           
+        else if ( image->referenceCount() > 1 )
+        {
+            // the image may be shared (e.g. by a shared L2 cache), so copy it
+            // before modifying it in place.
+            image = ImageUtils::cloneImage( image.get() );
+        }
 
         ImageUtils::PixelVisitor<ApplyChromaKey> applyChroma;
         applyChroma._chromaKey = _chromaKey;
         applyChroma.accept( image.get() );
+
+        // the pixels no longer match any encoded bytes the image came with.
+        image->dirty();
     }    
 }
 
@@ -580,10 +589,19 @@ ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progr
             OE_INFO << LC << "WARNING! mismatched extents." << std::endl;
         }
 
-        cacheBin->write( key.str(), result.getImage() );
+        // writeImage stores the bytes the image was fetched as, if they are still
+        // valid, instead of re-encoding it.
+        cacheBin->writeImage( key.str(), result.getImage() );
         //OE_INFO << LC << "WRITING " << key.str() << " to the cache." << std::endl;
     }
 
+    // Done with the encoded bytes, so release them even if the image is shared
+    // (e.g. by the tile source's memory cache).
+    if ( result.valid() )
+    {
+        ImageUtils::clearEncodedData( result.getImage() );
+    }
+
     if ( result.valid() )
     {
         OE_DEBUG << LC << key.str() << " result OK" << std::endl;
@@ -649,7 +667,6 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
     }
 
     // Good to go, ask the tile source for an image:
-    osg::ref_ptr<TileSource::ImageOperation> op = _preCacheOp;
 
     osg::ref_ptr<osg::Image> result;
     TileKey finalKey = key;
@@ -661,7 +678,7 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
         {
             if ( !source->getBlacklist()->contains( finalKey.getTileId() ) )
             {
-                result = source->createImage( finalKey, op.get(), progress );
+                result = readImageFromTileSource( finalKey, progress );
                 if ( result.valid() )
                 {
                     if ( finalKey.getLevelOfDetail() != key.getLevelOfDetail() )
@@ -693,7 +710,7 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 
     else
     {
-        result = source->createImage( key, op.get(), progress );
+        result = readImageFromTileSource( key, progress );
     }
     
     // If image creation failed (but was not intentionally canceled),
@@ -709,6 +726,46 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 }
 
 
+osg::Image*
+ImageLayer::readImageFromTileSource(const TileKey&    key,
+                                    ProgressCallback* progress)
+{
+    TileSource* source = getTileSource();
+    osg::ref_ptr<TileSource::ImageOperation> op = _preCacheOp;
+    osg::ref_ptr<const osg::Image> image;
+
+    osg::ref_ptr<osg::Object> shared;
+    if ( _tileFlights.join(key, shared) )
+    {
+        image = source->createSharedImage( key, op.get(), progress );
+
+        // the waiters only read the image (each takes a copy below).
+        _tileFlights.land( key, const_cast<osg::Image*>(image.get()) );
+    }
+    else
+    {
+        image = dynamic_cast<osg::Image*>( shared.get() );
+        shared = 0L;
+
+        // the shared read failed. If it was blacklisted, so be it; otherwise it was
+        // probably canceled, so try it ourselves.
+        if ( !image.valid() && !source->getBlacklist()->contains(key.getTileId()) )
+        {
+            image = source->createSharedImage( key, op.get(), progress );
+        }
+    }
+
+    if ( !image.valid() )
+        return 0L;
+
+    // everything downstream may modify the image, so take a copy of our own if
+    // anyone else (the L2 cache, or other readers of this tile) refers to it.
+    if ( image->referenceCount() > 1 )
+        return ImageUtils::cloneImage( image.get() );
+
+    return const_cast<osg::Image*>( image.release() );
+}
+
 GeoImage
 ImageLayer::assembleImageFromTileSource(const TileKey&    key,
                                         ProgressCallback* progress,
@@ -783,16 +840,33 @@ ImageLayer::assembleImageFromTileSource(const TileKey&    key,
             return GeoImage::INVALID;
         }
 
-        // all set. Mosaic all the images together.
-        double rxmin, rymin, rxmax, rymax;
-        mosaic.getExtents( rxmin, rymin, rxmax, rymax );
-
-        mosaicedImage = GeoImage(
-            mosaic.createImage(),
-            GeoExtent( getProfile()->getSRS(), rxmin, rymin, rxmax, rymax ) );
-
         if ( !foundAtLeastOneRealTile )
             out_isFallback = true;
+
+        // all set. Sample the tiles straight into the requesting key's extent; if the
+        // SRS's are the same (even though extents are different), then this operation
+        // is technically not a reprojection but merely a resampling.
+        osg::Image* image = mosaic.createImage(
+            getProfile()->getSRS(),
+            key.getExtent(),
+            *_runtimeOptions.reprojectedTileSize(),
+            *_runtimeOptions.reprojectedTileSize(),
+            *_runtimeOptions.driver()->bilinearReprojection() );
+
+        if ( image )
+        {
+            result = GeoImage( image, key.getExtent() );
+        }
+        else
+        {
+            // tiles don't share a layout; mosaic them first and then reproject.
+            double rxmin, rymin, rxmax, rymax;
+            mosaic.getExtents( rxmin, rymin, rxmax, rymax );
+
+            mosaicedImage = GeoImage(
+                mosaic.createImage(),
+                GeoExtent( getProfile()->getSRS(), rxmin, rymin, rxmax, rymax ) );
+        }
     }
     else
     {
@@ -803,10 +877,7 @@ ImageLayer::assembleImageFromTileSource(const TileKey&    key,
     if ( mosaicedImage.valid() )
     {
         // GeoImage::reproject() will automatically crop the image to the correct extents.
-        // so there is no need to crop after reprojection. Also note that if the SRS's are the 
-        // same (even though extents are different), then this operation is technically not a
-        // reprojection but merely a resampling.
-
+        // so there is no need to crop after reprojection.
         result = mosaicedImage.reproject( 
             key.getProfile()->getSRS(),
             &key.getExtent(), 
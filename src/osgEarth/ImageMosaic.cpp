@@ -19,6 +19,7 @@
 
 #include <osgEarth/ImageMosaic>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/ImageReprojector>
 #include <osgEarth/HeightFieldUtils>
 #include <osg/Notify>
 #include <osg/Timer>
@@ -28,6 +29,27 @@
 
 using namespace osgEarth;
 
+namespace
+{
+    /**
+     * Locates pixels of a virtual mosaic in the tiles that make it up, without
+     * ever allocating the mosaic itself. Cells are indexed from the bottom-left
+     * like the pixels of an osg::Image.
+     */
+    struct TileIndex
+    {
+        std::vector<const osg::Image*> _cells;
+        unsigned _tilesWide, _tileWidth, _tileHeight;
+
+        const unsigned char* pixel( unsigned x, unsigned y ) const
+        {
+            static const unsigned char s_empty[4] = { 0, 0, 0, 0 };
+            const osg::Image* cell = _cells[(y/_tileHeight)*_tilesWide + (x/_tileWidth)];
+            return cell ? cell->data( x % _tileWidth, y % _tileHeight ) : s_empty;
+        }
+    };
+}
+
 
 /***************************************************************************/
 
@@ -121,4 +143,122 @@ ImageMosaic::createImage()
     return image.release();
 }
 
+osg::Image*
+ImageMosaic::createImage(const SpatialReference* srs,
+                         const GeoExtent&        destExtent,
+                         unsigned int            width,
+                         unsigned int            height,
+                         bool                    bilinear )
+{
+    if ( _images.size() == 0 || !srs || !destExtent.isValid() )
+        return 0L;
+
+    unsigned int tileWidth  = _images[0]._image->s();
+    unsigned int tileHeight = _images[0]._image->t();
+
+    unsigned int minTileX = _images[0]._tileX, maxTileX = minTileX;
+    unsigned int minTileY = _images[0]._tileY, maxTileY = minTileY;
+
+    for (TileImageList::iterator i = _images.begin(); i != _images.end(); ++i)
+    {
+        const osg::Image* image = i->getImage();
+        if ( image->getPixelFormat() != GL_RGBA || image->getDataType() != GL_UNSIGNED_BYTE ||
+             (unsigned)image->s() != tileWidth  || (unsigned)image->t() != tileHeight )
+        {
+            return 0L;
+        }
+
+        minTileX = osg::minimum(i->_tileX, minTileX);
+        minTileY = osg::minimum(i->_tileY, minTileY);
+        maxTileX = osg::maximum(i->_tileX, maxTileX);
+        maxTileY = osg::maximum(i->_tileY, maxTileY);
+    }
+
+    TileIndex index;
+    index._tilesWide  = maxTileX - minTileX + 1;
+    index._tileWidth  = tileWidth;
+    index._tileHeight = tileHeight;
+    unsigned int tilesHigh = maxTileY - minTileY + 1;
+    index._cells.assign( index._tilesWide * tilesHigh, (const osg::Image*)0L );
+
+    for (TileImageList::iterator i = _images.begin(); i != _images.end(); ++i)
+    {
+        unsigned col = i->_tileX - minTileX;
+        unsigned row = maxTileY - i->_tileY;
+        index._cells[row * index._tilesWide + col] = i->getImage();
+    }
+
+    unsigned int pixelsWide = index._tilesWide * tileWidth;
+    unsigned int pixelsHigh = tilesHigh * tileHeight;
+
+    if ( width == 0 || height == 0 )
+    {
+        width  = tileWidth;
+        height = tileHeight;
+    }
+
+    osg::ref_ptr<osg::Image> result = new osg::Image();
+    result->allocateImage( width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+    result->setInternalTextureFormat( GL_RGBA8 );
+    memset( result->data(), 0, result->getImageSizeInBytes() );
+
+    double xMin, yMin, xMax, yMax;
+    getExtents( xMin, yMin, xMax, yMax );
+    GeoExtent srcExtent( srs, xMin, yMin, xMax, yMax );
+
+    osg::ref_ptr<TransformGrid> grid = ImageReprojector::getGrid( srcExtent, pixelsWide, pixelsHigh, destExtent, width, height );
+    if ( !grid.valid() )
+    {
+        OE_WARN << LC << "Unable to map " << destExtent.toString() << " into the mosaic" << std::endl;
+        return result.release();
+    }
+
+    double xScale = (double)pixelsWide / srcExtent.width();
+    double yScale = (double)pixelsHigh / srcExtent.height();
+    double maxPX  = (double)(pixelsWide-1);
+    double maxPY  = (double)(pixelsHigh-1);
+
+    std::vector<double> xs( width ), ys( width );
+
+    for( unsigned int r = 0; r < height; ++r )
+    {
+        grid->getRow( r, &xs[0], &ys[0] );
+        unsigned char* out = result->data( 0, r );
+
+        for( unsigned int c = 0; c < width; ++c, out += 4 )
+        {
+            double x = xs[c], y = ys[c];
+            if ( x < xMin || x > xMax || y < yMin || y > yMax )
+                continue;
+
+            double px = osg::clampBetween( (x - xMin) * xScale - 0.5, 0.0, maxPX );
+            double py = osg::clampBetween( (y - yMin) * yScale - 0.5, 0.0, maxPY );
+
+            if ( !bilinear )
+            {
+                const unsigned char* p = index.pixel(
+                    osg::minimum( (unsigned)(px + 0.5), pixelsWide-1 ),
+                    osg::minimum( (unsigned)(py + 0.5), pixelsHigh-1 ) );
+                out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = p[3];
+            }
+            else
+            {
+                unsigned x0 = (unsigned)px, y0 = (unsigned)py;
+                unsigned x1 = osg::minimum( x0+1, pixelsWide-1 ), y1 = osg::minimum( y0+1, pixelsHigh-1 );
+                float    fx = (float)(px - (double)x0), fy = (float)(py - (double)y0);
+
+                const unsigned char* p00 = index.pixel( x0, y0 );
+                const unsigned char* p10 = index.pixel( x1, y0 );
+                const unsigned char* p01 = index.pixel( x0, y1 );
+                const unsigned char* p11 = index.pixel( x1, y1 );
+
+                for( unsigned k = 0; k < 4; ++k )
+                    out[k] = ImageUtils::lerpByte( p00[k], p10[k], p01[k], p11[k], fx, fy );
+            }
+        }
+    }
+
+    return result.release();
+}
+
 /***************************************************************************/
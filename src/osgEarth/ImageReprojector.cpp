@@ -0,0 +1,505 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/ImageReprojector>
+#include <osgEarth/Containers>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/SpatialReference>
+#include <algorithm>
+#include <string.h>
+#include <float.h>
+
+#define LC "[ImageReprojector] "
+
+using namespace osgEarth;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Whether the mapping between two SRS's is separable, i.e. source X depends
+    // only on destination X and source Y only on destination Y.
+    bool isSeparable( const SpatialReference* dest, const SpatialReference* src )
+    {
+        if ( dest->isEquivalentTo(src) )
+            return true;
+
+        bool destOK = dest->isGeographic() || dest->isSphericalMercator();
+        bool srcOK  = src->isGeographic()  || src->isSphericalMercator();
+
+        return destOK && srcOK && (dest->isSphericalMercator() || src->isSphericalMercator());
+    }
+}
+
+TransformGrid*
+TransformGrid::create(const GeoExtent&        destExtent,
+                      unsigned                width,
+                      unsigned                height,
+                      const SpatialReference* srcSRS,
+                      double                  tolerance )
+{
+    if ( !destExtent.isValid() || !srcSRS || width == 0 || height == 0 )
+        return 0L;
+
+    osg::ref_ptr<TransformGrid> grid = new TransformGrid();
+    grid->_width  = width;
+    grid->_height = height;
+
+    if ( isSeparable(destExtent.getSRS(), srcSRS) && grid->buildSeparable(destExtent, srcSRS) )
+    {
+        return grid.release();
+    }
+
+    // start with a coarse mesh and refine it until it's accurate enough.
+    unsigned step = 32;
+    while( step > 1 && step >= std::max(width, height) )
+        step /= 2;
+
+    for(;;)
+    {
+        if ( !grid->buildMesh(destExtent, srcSRS, step) )
+        {
+            OE_DEBUG << LC << "Failed to transform the control point mesh" << std::endl;
+            return 0L;
+        }
+
+        if ( step == 1 || grid->measureError(destExtent, srcSRS) <= tolerance )
+            break;
+
+        step /= 2;
+    }
+
+    OE_DEBUG << LC << "Built " << width << "x" << height << " grid with mesh step " << step << std::endl;
+    return grid.release();
+}
+
+bool
+TransformGrid::buildSeparable( const GeoExtent& destExtent, const SpatialReference* srcSRS )
+{
+    double dx = destExtent.width()  / (double)_width;
+    double dy = destExtent.height() / (double)_height;
+    double xMid = 0.5 * (destExtent.xMin() + destExtent.xMax());
+    double yMid = 0.5 * (destExtent.yMin() + destExtent.yMax());
+
+    std::vector<osg::Vec3d> cols( _width ), rows( _height );
+    for( unsigned c = 0; c < _width; ++c )
+        cols[c].set( destExtent.xMin() + dx * ((double)c + 0.5), yMid, 0.0 );
+    for( unsigned r = 0; r < _height; ++r )
+        rows[r].set( xMid, destExtent.yMin() + dy * ((double)r + 0.5), 0.0 );
+
+    const SpatialReference* destSRS = destExtent.getSRS();
+    if ( !destSRS->transform(cols, srcSRS) || !destSRS->transform(rows, srcSRS) )
+        return false;
+
+    _colX.resize( _width );
+    _rowY.resize( _height );
+    for( unsigned c = 0; c < _width; ++c )
+        _colX[c] = cols[c].x();
+    for( unsigned r = 0; r < _height; ++r )
+        _rowY[r] = rows[r].y();
+
+    _step = 0;
+    return true;
+}
+
+bool
+TransformGrid::buildMesh( const GeoExtent& destExtent, const SpatialReference* srcSRS, unsigned step )
+{
+    _nodeCols.clear();
+    _nodeRows.clear();
+    for( unsigned c = 0; c + 1 < _width; c += step )
+        _nodeCols.push_back( c );
+    _nodeCols.push_back( _width-1 );
+    for( unsigned r = 0; r + 1 < _height; r += step )
+        _nodeRows.push_back( r );
+    _nodeRows.push_back( _height-1 );
+
+    double dx = destExtent.width()  / (double)_width;
+    double dy = destExtent.height() / (double)_height;
+
+    unsigned nc = _nodeCols.size(), nr = _nodeRows.size();
+    std::vector<osg::Vec3d> points( nc * nr );
+    for( unsigned j = 0; j < nr; ++j )
+    {
+        double y = destExtent.yMin() + dy * ((double)_nodeRows[j] + 0.5);
+        for( unsigned i = 0; i < nc; ++i )
+        {
+            points[j*nc + i].set( destExtent.xMin() + dx * ((double)_nodeCols[i] + 0.5), y, 0.0 );
+        }
+    }
+
+    if ( !destExtent.getSRS()->transform(points, srcSRS) )
+        return false;
+
+    _meshX.resize( points.size() );
+    _meshY.resize( points.size() );
+    for( unsigned k = 0; k < points.size(); ++k )
+    {
+        _meshX[k] = points[k].x();
+        _meshY[k] = points[k].y();
+    }
+
+    _step = step;
+    return true;
+}
+
+double
+TransformGrid::measureError( const GeoExtent& destExtent, const SpatialReference* srcSRS ) const
+{
+    // compare the exact transform at the center of each mesh cell against the
+    // value interpolated from the cell's corners.
+    unsigned nc = _nodeCols.size(), nr = _nodeRows.size();
+    if ( nc < 2 || nr < 2 )
+        return 0.0;
+
+    double dx = destExtent.width()  / (double)_width;
+    double dy = destExtent.height() / (double)_height;
+
+    std::vector<osg::Vec3d> centers;
+    std::vector<osg::Vec2d> interpolated;
+    centers.reserve( (nc-1) * (nr-1) );
+    interpolated.reserve( (nc-1) * (nr-1) );
+
+    for( unsigned j = 0; j+1 < nr; ++j )
+    {
+        for( unsigned i = 0; i+1 < nc; ++i )
+        {
+            double c = 0.5 * (double)(_nodeCols[i] + _nodeCols[i+1]);
+            double r = 0.5 * (double)(_nodeRows[j] + _nodeRows[j+1]);
+            centers.push_back( osg::Vec3d(
+                destExtent.xMin() + dx * (c + 0.5),
+                destExtent.yMin() + dy * (r + 0.5),
+                0.0) );
+
+            unsigned k00 = j*nc + i, k01 = k00 + 1, k10 = k00 + nc, k11 = k10 + 1;
+            interpolated.push_back( osg::Vec2d(
+                0.25 * (_meshX[k00] + _meshX[k01] + _meshX[k10] + _meshX[k11]),
+                0.25 * (_meshY[k00] + _meshY[k01] + _meshY[k10] + _meshY[k11])) );
+        }
+    }
+
+    if ( !destExtent.getSRS()->transform(centers, srcSRS) )
+        return DBL_MAX;
+
+    double maxError = 0.0;
+    for( unsigned k = 0; k < centers.size(); ++k )
+    {
+        maxError = std::max( maxError, fabs(centers[k].x() - interpolated[k].x()) );
+        maxError = std::max( maxError, fabs(centers[k].y() - interpolated[k].y()) );
+    }
+    return maxError;
+}
+
+void
+TransformGrid::getRow( unsigned row, double* out_x, double* out_y ) const
+{
+    if ( _step == 0 )
+    {
+        memcpy( out_x, &_colX[0], _width * sizeof(double) );
+        std::fill( out_y, out_y + _width, _rowY[row] );
+        return;
+    }
+
+    unsigned nc = _nodeCols.size(), nr = _nodeRows.size();
+
+    // find the mesh rows that bracket this row, and interpolate the node 
+    // coordinates along them.
+    unsigned j = 0;
+    double   ty = 0.0;
+    if ( nr > 1 )
+    {
+        j = std::min( (unsigned)(std::upper_bound(_nodeRows.begin(), _nodeRows.end(), row) - _nodeRows.begin()) - 1, nr-2 );
+        ty = (double)(row - _nodeRows[j]) / (double)(_nodeRows[j+1] - _nodeRows[j]);
+    }
+
+    const double* x0 = &_meshX[j*nc];
+    const double* y0 = &_meshY[j*nc];
+    const double* x1 = nr > 1 ? x0 + nc : x0;
+    const double* y1 = nr > 1 ? y0 + nc : y0;
+
+    if ( nc == 1 )
+    {
+        out_x[0] = x0[0] + (x1[0]-x0[0])*ty;
+        out_y[0] = y0[0] + (y1[0]-y0[0])*ty;
+        return;
+    }
+
+    // then interpolate between the nodes along the row.
+    for( unsigned i = 0; i+1 < nc; ++i )
+    {
+        double ax = x0[i]   + (x1[i]  -x0[i]  )*ty, ay = y0[i]   + (y1[i]  -y0[i]  )*ty;
+        double bx = x0[i+1] + (x1[i+1]-x0[i+1])*ty, by = y0[i+1] + (y1[i+1]-y0[i+1])*ty;
+
+        unsigned c0 = _nodeCols[i], c1 = _nodeCols[i+1];
+        double   inv = 1.0 / (double)(c1 - c0);
+        for( unsigned c = c0; c < c1; ++c )
+        {
+            double tx = (double)(c - c0) * inv;
+            out_x[c] = ax + (bx-ax)*tx;
+            out_y[c] = ay + (by-ay)*tx;
+        }
+
+        if ( i+2 == nc )
+        {
+            out_x[c1] = bx;
+            out_y[c1] = by;
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /** Identifies a transform grid in the cache */
+    struct GridKey
+    {
+        osg::ref_ptr<const SpatialReference> _srcSRS, _destSRS;
+        double   _src[4], _dest[4];
+        unsigned _srcWidth, _srcHeight, _width, _height;
+
+        GridKey( const GeoExtent& srcEx, unsigned srcWidth, unsigned srcHeight, const GeoExtent& destEx, unsigned width, unsigned height ) :
+            _srcSRS( srcEx.getSRS() ), _destSRS( destEx.getSRS() ),
+            _srcWidth( srcWidth ), _srcHeight( srcHeight ), _width( width ), _height( height )
+        {
+            srcEx.getBounds( _src[0], _src[1], _src[2], _src[3] );
+            destEx.getBounds( _dest[0], _dest[1], _dest[2], _dest[3] );
+        }
+
+        bool operator < (const GridKey& rhs) const
+        {
+            if ( _srcSRS.get()  != rhs._srcSRS.get() )  return _srcSRS.get()  < rhs._srcSRS.get();
+            if ( _destSRS.get() != rhs._destSRS.get() ) return _destSRS.get() < rhs._destSRS.get();
+            for( unsigned i = 0; i < 4; ++i ) {
+                if ( _src[i]  != rhs._src[i] )  return _src[i]  < rhs._src[i];
+                if ( _dest[i] != rhs._dest[i] ) return _dest[i] < rhs._dest[i];
+            }
+            if ( _srcWidth  != rhs._srcWidth )  return _srcWidth  < rhs._srcWidth;
+            if ( _srcHeight != rhs._srcHeight ) return _srcHeight < rhs._srcHeight;
+            if ( _width     != rhs._width )     return _width     < rhs._width;
+            return _height < rhs._height;
+        }
+
+        unsigned hash() const
+        {
+            // FNV-1a over the raw key values
+            unsigned h = 2166136261u;
+            const unsigned char* p;
+            p = (const unsigned char*)_src;
+            for( unsigned i = 0; i < sizeof(_src); ++i ) { h ^= p[i]; h *= 16777619u; }
+            p = (const unsigned char*)_dest;
+            for( unsigned i = 0; i < sizeof(_dest); ++i ) { h ^= p[i]; h *= 16777619u; }
+            h ^= _width;  h *= 16777619u;
+            h ^= _height; h *= 16777619u;
+            return h;
+        }
+    };
+
+    typedef ShardedLRUCache< GridKey, osg::ref_ptr<TransformGrid> > GridCache;
+
+    GridCache s_gridCache( 64, GridCache::numShardsFor(64, 32) );
+
+    /**
+     * Samples one destination row from an 8-bit RGB or RGBA source into 8-bit
+     * RGBA. "px" and "py" are the source pixel coordinates of each destination
+     * pixel, or negative for pixels outside the source.
+     */
+    void sampleRowRGBA8(const osg::Image*   image,
+                        unsigned            srcComps,
+                        const double*       px,
+                        const double*       py,
+                        unsigned            width,
+                        bool                bilinear,
+                        unsigned char*      out )
+    {
+        int s = image->s(), t = image->t();
+
+        for( unsigned c = 0; c < width; ++c, out += 4 )
+        {
+            if ( px[c] < 0.0 )
+            {
+                out[0] = out[1] = out[2] = out[3] = 0;
+                continue;
+            }
+
+            if ( !bilinear )
+            {
+                int x = std::min( (int)(px[c] + 0.5), s-1 );
+                int y = std::min( (int)(py[c] + 0.5), t-1 );
+                const unsigned char* p = image->data( x, y );
+                out[0] = p[0]; out[1] = p[1]; out[2] = p[2];
+                out[3] = srcComps == 4 ? p[3] : 255;
+            }
+            else
+            {
+                int   x0 = (int)px[c], y0 = (int)py[c];
+                int   x1 = std::min( x0+1, s-1 ), y1 = std::min( y0+1, t-1 );
+                float fx = (float)(px[c] - (double)x0), fy = (float)(py[c] - (double)y0);
+
+                const unsigned char* p00 = image->data( x0, y0 );
+                const unsigned char* p10 = image->data( x1, y0 );
+                const unsigned char* p01 = image->data( x0, y1 );
+                const unsigned char* p11 = image->data( x1, y1 );
+
+                out[0] = ImageUtils::lerpByte( p00[0], p10[0], p01[0], p11[0], fx, fy );
+                out[1] = ImageUtils::lerpByte( p00[1], p10[1], p01[1], p11[1], fx, fy );
+                out[2] = ImageUtils::lerpByte( p00[2], p10[2], p01[2], p11[2], fx, fy );
+                out[3] = srcComps == 4 ? ImageUtils::lerpByte( p00[3], p10[3], p01[3], p11[3], fx, fy ) : 255;
+            }
+        }
+    }
+
+    /** Same as sampleRowRGBA8, for any format PixelReader/PixelWriter support. */
+    void sampleRowGeneric(ImageUtils::PixelReader& read,
+                          ImageUtils::PixelWriter& write,
+                          const osg::Image*        image,
+                          const double*            px,
+                          const double*            py,
+                          unsigned                 width,
+                          unsigned                 row,
+                          bool                     bilinear )
+    {
+        int s = image->s(), t = image->t();
+
+        for( unsigned c = 0; c < width; ++c )
+        {
+            if ( px[c] < 0.0 )
+            {
+                write( osg::Vec4(0,0,0,0), c, row );
+            }
+            else if ( !bilinear )
+            {
+                write( read( std::min((int)(px[c] + 0.5), s-1), std::min((int)(py[c] + 0.5), t-1) ), c, row );
+            }
+            else
+            {
+                int   x0 = (int)px[c], y0 = (int)py[c];
+                int   x1 = std::min( x0+1, s-1 ), y1 = std::min( y0+1, t-1 );
+                float fx = (float)(px[c] - (double)x0), fy = (float)(py[c] - (double)y0);
+
+                osg::Vec4 top    = read(x0, y0) * (1.0f-fx) + read(x1, y0) * fx;
+                osg::Vec4 bottom = read(x0, y1) * (1.0f-fx) + read(x1, y1) * fx;
+                write( top * (1.0f-fy) + bottom * fy, c, row );
+            }
+        }
+    }
+}
+
+osg::ref_ptr<TransformGrid>
+ImageReprojector::getGrid(const GeoExtent& srcExtent,
+                          unsigned         srcWidth,
+                          unsigned         srcHeight,
+                          const GeoExtent& destExtent,
+                          unsigned         width,
+                          unsigned         height )
+{
+    GridKey key( srcExtent, srcWidth, srcHeight, destExtent, width, height );
+
+    osg::ref_ptr<TransformGrid> grid;
+    if ( s_gridCache.get(key, grid) )
+        return grid;
+
+    // an eighth of a source pixel is well below anything visible.
+    double tolerance = 0.125 * std::min(
+        srcExtent.width()  / (double)srcWidth,
+        srcExtent.height() / (double)srcHeight );
+
+    grid = TransformGrid::create( destExtent, width, height, srcExtent.getSRS(), tolerance );
+    if ( grid.valid() )
+        s_gridCache.insert( key, grid );
+
+    return grid;
+}
+
+osg::Image*
+ImageReprojector::reproject(const osg::Image* image,
+                            const GeoExtent&  srcExtent,
+                            const GeoExtent&  destExtent,
+                            unsigned          width,
+                            unsigned          height,
+                            bool              bilinear )
+{
+    if ( !image || !srcExtent.isValid() || !destExtent.isValid() )
+        return 0L;
+
+    if ( width == 0 || height == 0 )
+    {
+        width  = image->s();
+        height = image->t();
+    }
+
+    bool fast =
+        image->getDataType() == GL_UNSIGNED_BYTE &&
+        (image->getPixelFormat() == GL_RGBA || image->getPixelFormat() == GL_RGB);
+
+    osg::Image* result = new osg::Image();
+    if ( fast )
+        result->allocateImage( width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+    else
+        result->allocateImage( width, height, 1, image->getPixelFormat(), image->getDataType() );
+    result->setInternalTextureFormat( fast ? GL_RGBA8 : image->getInternalTextureFormat() );
+
+    //Initialize the image to be completely transparent/black
+    memset( result->data(), 0, result->getImageSizeInBytes() );
+
+    osg::ref_ptr<TransformGrid> grid = getGrid( srcExtent, image->s(), image->t(), destExtent, width, height );
+    if ( !grid.valid() )
+    {
+        OE_WARN << LC << "Unable to map " << destExtent.toString() << " into " << srcExtent.getSRS()->getName() << std::endl;
+        return result;
+    }
+
+    // scale from source coordinates to source pixels (sampling pixel centers).
+    double xMin = srcExtent.xMin(), yMin = srcExtent.yMin(), xMax = srcExtent.xMax(), yMax = srcExtent.yMax();
+    double xScale = (double)image->s() / srcExtent.width();
+    double yScale = (double)image->t() / srcExtent.height();
+    double maxPX  = (double)(image->s()-1);
+    double maxPY  = (double)(image->t()-1);
+
+    std::vector<double> px( width ), py( width );
+
+    ImageUtils::PixelReader read( image );
+    ImageUtils::PixelWriter write( result );
+    unsigned srcComps = image->getPixelFormat() == GL_RGBA ? 4 : 3;
+
+    for( unsigned r = 0; r < height; ++r )
+    {
+        grid->getRow( r, &px[0], &py[0] );
+
+        for( unsigned c = 0; c < width; ++c )
+        {
+            double x = px[c], y = py[c];
+            if ( x < xMin || x > xMax || y < yMin || y > yMax )
+            {
+                px[c] = -1.0;
+            }
+            else
+            {
+                px[c] = osg::clampBetween( (x - xMin) * xScale - 0.5, 0.0, maxPX );
+                py[c] = osg::clampBetween( (y - yMin) * yScale - 0.5, 0.0, maxPY );
+            }
+        }
+
+        if ( fast )
+            sampleRowRGBA8( image, srcComps, &px[0], &py[0], width, bilinear, result->data(0, r) );
+        else
+            sampleRowGeneric( read, write, image, &px[0], &py[0], width, r, bilinear );
+    }
+
+    return result;
+}
@@ -18,6 +18,7 @@
  */
 
 #include <osgEarth/ImageUtils>
+#include <osgEarth/ThreadingUtils>
 #include <osg/Notify>
 #include <osg/Texture>
 #include <osg/ImageSequence>
@@ -70,6 +71,99 @@ ImageUtils::normalizeImage( osg::Image* image )
     }
 }
 
+namespace
+{
+    // guards an image's EncodedData user data, which the thread that writes
+    // it to a cache may clear while another thread that shares the image reads it.
+    Threading::Mutex s_encodedDataMutex;
+}
+
+void
+ImageUtils::setEncodedData( osg::Image* image, const std::string& bytes )
+{
+    if ( !image || !image->data() )
+        return;
+
+    std::string format = getEncodedFormat( bytes );
+    if ( format.empty() )
+        return;
+
+    Threading::ScopedMutexLock lock( s_encodedDataMutex );
+
+    // don't clobber someone else's user data.
+    if ( image->getUserData() && !dynamic_cast<EncodedData*>(image->getUserData()) )
+        return;
+
+    EncodedData* enc = new EncodedData();
+    enc->format         = format;
+    enc->bytes          = bytes;
+    enc->_data          = image->data();
+    enc->_modifiedCount = image->getModifiedCount();
+    enc->_s             = image->s();
+    enc->_t             = image->t();
+    enc->_r             = image->r();
+    enc->_pixelFormat   = image->getPixelFormat();
+    image->setUserData( enc );
+}
+
+osg::ref_ptr<const ImageUtils::EncodedData>
+ImageUtils::getEncodedData( const osg::Image* image )
+{
+    if ( !image )
+        return 0L;
+
+    Threading::ScopedMutexLock lock( s_encodedDataMutex );
+
+    const EncodedData* enc = dynamic_cast<const EncodedData*>( image->getUserData() );
+    if ( !enc )
+        return 0L;
+
+    // a clone or a conversion will have new data; an in-place edit should bump the
+    // modified count (via dirty()).
+    if ( enc->_data          != image->data()             ||
+         enc->_modifiedCount != image->getModifiedCount() ||
+         enc->_s             != image->s()                ||
+         enc->_t             != image->t()                ||
+         enc->_r             != image->r()                ||
+         enc->_pixelFormat   != image->getPixelFormat() )
+    {
+        return 0L;
+    }
+
+    return enc;
+}
+
+void
+ImageUtils::clearEncodedData( osg::Image* image )
+{
+    if ( !image )
+        return;
+
+    Threading::ScopedMutexLock lock( s_encodedDataMutex );
+    if ( dynamic_cast<EncodedData*>(image->getUserData()) )
+        image->setUserData( 0L );
+}
+
+std::string
+ImageUtils::getEncodedFormat( const std::string& bytes )
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>( bytes.data() );
+    unsigned len = bytes.length();
+
+    if ( len >= 8 && b[0] == 0x89 && b[1] == 'P' && b[2] == 'N' && b[3] == 'G' )
+        return "png";
+    if ( len >= 3 && b[0] == 0xFF && b[1] == 0xD8 && b[2] == 0xFF )
+        return "jpg";
+    if ( len >= 6 && b[0] == 'G' && b[1] == 'I' && b[2] == 'F' && b[3] == '8' )
+        return "gif";
+    if ( len >= 4 && ((b[0] == 'I' && b[1] == 'I' && b[2] == 42 && b[3] == 0) || (b[0] == 'M' && b[1] == 'M' && b[2] == 0 && b[3] == 42)) )
+        return "tif";
+    if ( len >= 4 && b[0] == 'D' && b[1] == 'D' && b[2] == 'S' && b[3] == ' ' )
+        return "dds";
+
+    return "";
+}
+
 bool
 ImageUtils::copyAsSubImage(const osg::Image* src, osg::Image* dst, int dst_start_col, int dst_start_row, int dst_img )
 {
@@ -17,9 +17,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/MemCache>
+#include <osgEarth/Containers>
+#include <osgEarth/IOTypes>
 #include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
-#include <osgEarth/Containers>
+#include <osg/Image>
+#include <osg/Shape>
 
 using namespace osgEarth;
 
@@ -27,14 +30,47 @@ using namespace osgEarth;
 
 namespace
 {
-    typedef std::pair<osg::ref_ptr<const osg::Object>, Config> MemCacheEntry;
-    typedef LRUCache<std::string, MemCacheEntry> MemCacheLRU;
+    struct MemCacheEntry
+    {
+        osg::ref_ptr<const osg::Object> _object;
+        Config                          _meta;
+    };
+
+    /** Cost of an entry: its size in bytes, or one unit when capping by entry count. */
+    struct MemCacheCost
+    {
+        MemCacheCost( bool bytes =false ) : _bytes(bytes) { }
+        unsigned operator()( const MemCacheEntry& entry ) const {
+            return _bytes ? MemCache::getSizeInBytes( entry._object.get() ) : 1u;
+        }
+        bool _bytes;
+    };
 
+    typedef ShardedLRUCache<std::string, MemCacheEntry, ShardHash<std::string>, MemCacheCost> MemCacheLRU;
+
+    /**
+     * Number of shards for a byte budget. Each shard gets its own slice of the
+     * budget, so a small budget uses fewer shards; otherwise a few large tiles
+     * would fill a shard and evict each other long before the cache is full.
+     */
+    unsigned numShardsFor( unsigned maxBytes )
+    {
+        const unsigned minShardBytes = 8u * 1024u * 1024u;
+        return osg::clampBetween( maxBytes / minShardBytes, 1u, 8u );
+    }
+
+    /**
+     * Cache bin that holds objects in memory, capped by entry count or by
+     * total size in bytes, evicting the least-recently-used entries first.
+     */
     struct MemCacheBin : public CacheBin
     {
-        MemCacheBin( const std::string& id, unsigned maxSize )
-            : CacheBin( id ),
-              _lru    ( true, maxSize )
+        MemCacheBin( const std::string& id, unsigned maxEntries, unsigned maxBytes, bool shareObjects )
+            : CacheBin     ( id ),
+              _lru         ( maxBytes > 0 ? maxBytes : maxEntries,
+                             maxBytes > 0 ? numShardsFor(maxBytes) : 1,
+                             MemCacheCost(maxBytes > 0) ),
+              _shareObjects( shareObjects )
         {
             //nop
         }
@@ -42,18 +78,16 @@ namespace
         ReadResult readObject(const std::string& key,
                               double             maxAge )
         {
-            MemCacheLRU::Record rec = _lru.get(key);
-
-            // clone required since the cache is in memory
+            MemCacheEntry entry;
+            if ( !_lru.get(key, entry) )
+                return ReadResult();
 
-            if ( rec.valid() )
-            {
-                return ReadResult( 
-                   osg::clone(rec.value().first.get(), osg::CopyOp::DEEP_COPY_ALL),
-                   rec.value().second );
-            }
+            // in shared mode, hand out the cached object itself; it is immutable.
+            // Otherwise a clone is required since the caller might modify it.
+            if ( _shareObjects )
+                return ReadResult( const_cast<osg::Object*>(entry._object.get()), entry._meta );
             else
-                return ReadResult();
+                return ReadResult( osg::clone(entry._object.get(), osg::CopyOp::DEEP_COPY_ALL), entry._meta );
         }
 
         ReadResult readImage(const std::string& key,
@@ -76,18 +110,19 @@ namespace
 
         bool write( const std::string& key, const osg::Object* object, const Config& meta )
         {
-            if ( object ) 
-            {
-                _lru.insert( key, std::make_pair(object, meta) );
-                return true;
-            }
-            else
+            if ( !object )
                 return false;
+
+            MemCacheEntry entry;
+            entry._object = object;
+            entry._meta   = meta;
+            _lru.insert( key, entry );
+            return true;
         }
 
         bool isCached( const std::string& key, double maxAge ) 
         {
-            return _lru.has(key);
+            return _lru.has( key );
         }
 
         bool purge()
@@ -98,6 +133,7 @@ namespace
 
     private:
         MemCacheLRU _lru;
+        bool        _shareObjects;
     };
     
 
@@ -107,15 +143,47 @@ namespace
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( std::max(maxBinSize, 1u) )
+_maxBinSize  ( std::max(maxBinSize, 1u) ),
+_maxBinBytes ( 0 ),
+_shareObjects( false )
+{
+    //nop
+}
+
+MemCache::MemCache( unsigned maxBinBytes, bool shareObjects ) :
+_maxBinSize  ( 0 ),
+_maxBinBytes ( std::max(maxBinBytes, 1u) ),
+_shareObjects( shareObjects )
 {
     //nop
 }
 
+unsigned
+MemCache::getSizeInBytes( const osg::Object* object )
+{
+    if ( !object )
+        return 0;
+
+    const osg::Image* image = dynamic_cast<const osg::Image*>( object );
+    if ( image )
+        return sizeof(osg::Image) + image->getTotalSizeInBytesIncludingMipmaps();
+
+    const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>( object );
+    if ( hf )
+        return sizeof(osg::HeightField) + hf->getNumColumns() * hf->getNumRows() * sizeof(float);
+
+    const StringObject* str = dynamic_cast<const StringObject*>( object );
+    if ( str )
+        return sizeof(StringObject) + str->getString().size();
+
+    // unknown; count the object itself.
+    return sizeof(osg::Object);
+}
+
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize, _maxBinBytes, _shareObjects) );
 }
 
 CacheBin*
@@ -127,7 +195,7 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = new MemCacheBin("__default", _maxBinSize, _maxBinBytes, _shareObjects);
         }
     }
 
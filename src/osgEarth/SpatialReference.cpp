@@ -24,6 +24,7 @@
 #include <osgEarth/ECEF>
 #include <osgEarth/ThreadingUtils>
 #include <osg/Notify>
+#include <gdal.h>
 #include <ogr_api.h>
 #include <ogr_spatialref.h>
 #include <algorithm>
@@ -32,6 +33,12 @@
 
 using namespace osgEarth;
 
+// Since GDAL 1.10, every coordinate transformation has a private PROJ.4 context,
+// so two threads may transform through different handles at the same time.
+#if GDAL_VERSION_NUM >= 1100000
+#   define THREADSAFE_OCT_TRANSFORM 1
+#endif
+
 // took this out, see issue #79
 //#define USE_CUSTOM_MERCATOR_TRANSFORM 1
 //#undef USE_CUSTOM_MERCATOR_TRANSFORM
@@ -392,7 +399,8 @@ SpatialReference::~SpatialReference()
 
         for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
         {
-            OCTDestroyCoordinateTransformation(itr->second);
+            for (unsigned i = 0; i < itr->second.size(); ++i)
+                OCTDestroyCoordinateTransformation(itr->second[i]);
         }
 
         if ( _owns_handle )
@@ -1032,21 +1040,27 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
-
+    const std::string& key = out_srs->getWKT();
     void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
+
+    // lease an idle transformation handle from the pool.
     {
-        OE_DEBUG << "using cached transform handle" << std::endl;
-        xform_handle = itr->second;
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _transformMutex );
+        TransformHandleCache::iterator itr = const_cast<SpatialReference*>(this)->_transformHandleCache.find( key );
+        if ( itr != _transformHandleCache.end() && !itr->second.empty() )
+        {
+            xform_handle = itr->second.back();
+            itr->second.pop_back();
+        }
     }
-    else
+
+    if ( !xform_handle )
     {
+        // all the handles are busy (or there are none yet), so make a new one.
+        // Creating a handle touches OSR global state, so it requires the global lock.
         OE_DEBUG << "allocating new OCT Transform" << std::endl;
+        GDAL_SCOPED_LOCK;
         xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
     }
 
     if ( !xform_handle )
@@ -1058,7 +1072,22 @@ SpatialReference::transformXYPointArrays(double*  x,
         return false;
     }
 
-    return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+    bool ok;
+    {
+#ifndef THREADSAFE_OCT_TRANSFORM
+        // older GDALs share one PROJ.4 context across all transformations.
+        GDAL_SCOPED_LOCK;
+#endif
+        ok = OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+    }
+
+    // and return it to the pool.
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _transformMutex );
+        const_cast<SpatialReference*>(this)->_transformHandleCache[key].push_back( xform_handle );
+    }
+
+    return ok;
 }
 
 
@@ -244,6 +244,8 @@ TerrainLayer::setCachePolicy( const CachePolicy& cp )
 {
     _runtimeOptions->cachePolicy() = cp;
     _runtimeOptions->cachePolicy()->apply( _dbOptions.get() );
+    if ( !cp.isCacheWriteable() )
+        EncodedRecord::setWanted( _dbOptions.get(), false );
 }
 
 const CachePolicy&
@@ -548,6 +550,12 @@ TerrainLayer::initTileSource()
                 << _tileSource->getProfile()->toString() << std::endl;
         }
 
+        // tell the tile source's readers whether a cache is waiting for the
+        // encoded image bytes they decode.
+        EncodedRecord::setWanted(
+            _dbOptions.get(),
+            _cache.valid() && _cache->acceptsEncoded() && getCachePolicy().isCacheWriteable() );
+
         // Start up the tile source (if it hasn't already been started)
         TileSource::Status status = _tileSource->getStatus();
         if ( status != TileSource::STATUS_OK )
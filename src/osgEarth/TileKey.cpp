@@ -19,6 +19,7 @@
 
 #include <osgEarth/TileKey>
 #include <osgEarth/StringUtils>
+#include <stdio.h>
 
 using namespace osgEarth;
 
@@ -28,17 +29,18 @@ TileKey TileKey::INVALID( 0, 0, 0, 0L );
 
 //------------------------------------------------------------------------
 
-TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile)
+TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile) :
+_lod     ( lod ),
+_x       ( tile_x ),
+_y       ( tile_y ),
+_profile ( profile )
 {
-    _x = tile_x;
-    _y = tile_y;
-    _lod = lod;
-    _profile = profile;
-
-    double width, height;
+    // Computed up front (it's a few arithmetic operations, with no allocation)
+    // so that the key is immutable and safe to share among threads.
     if ( _profile.valid() )
     {
-        _profile->getTileDimensions(lod, width, height);
+        double width, height;
+        _profile->getTileDimensions(_lod, width, height);
 
         double xmin = _profile->getExtent().xMin() + (width * (double)_x);
         double ymax = _profile->getExtent().yMax() - (height * (double)_y);
@@ -46,25 +48,22 @@ TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, co
         double ymin = ymax - height;
 
         _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
-
-        _key = Stringify() << _lod << "/" << _x << "/" << _y;
     }
     else
     {
         _extent = GeoExtent::INVALID;
-        _key = "invalid";
     }
 }
 
-TileKey::TileKey( const TileKey& rhs ) :
-_key( rhs._key ),
-_lod(rhs._lod),
-_x(rhs._x),
-_y(rhs._y),
-_profile( rhs._profile.get() ),
-_extent( rhs._extent )
+std::string
+TileKey::str() const
 {
-    //NOP
+    if ( !_profile.valid() )
+        return "invalid";
+
+    char buf[64];
+    sprintf( buf, "%u/%u/%u", _lod, _x, _y );
+    return buf;
 }
 
 const Profile*
@@ -150,6 +150,8 @@ _noDataValue          ( (float)SHRT_MIN ),
 _noDataMinValue       ( -32000.0f ),
 _noDataMaxValue       (  32000.0f ),
 _L2CacheSize          ( 16 ),
+_L2CacheBytes         ( 0 ),
+_L2CacheShared        ( false ),
 _bilinearReprojection ( true )
 { 
     fromConfig( _conf );
@@ -166,6 +168,8 @@ TileSourceOptions::getConfig() const
     conf.updateIfSet( "nodata_max", _noDataMaxValue );
     conf.updateIfSet( "blacklist_filename", _blacklistFilename);
     conf.updateIfSet( "l2_cache_size", _L2CacheSize );
+    conf.updateIfSet( "l2_cache_bytes", _L2CacheBytes );
+    conf.updateIfSet( "l2_cache_shared", _L2CacheShared );
     conf.updateIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.updateObjIfSet( "profile", _profileOptions );
     return conf;
@@ -189,6 +193,8 @@ TileSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "nodata_max", _noDataMaxValue );
     conf.getIfSet( "blacklist_filename", _blacklistFilename);
     conf.getIfSet( "l2_cache_size", _L2CacheSize );
+    conf.getIfSet( "l2_cache_bytes", _L2CacheBytes );
+    conf.getIfSet( "l2_cache_shared", _L2CacheShared );
     conf.getIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.getObjIfSet( "profile", _profileOptions );
 
@@ -219,7 +225,11 @@ _status ( Status::Error("Not initialized") )
 {
     this->setThreadSafeRefUnref( true );
 
-    if ( *options.L2CacheSize() > 0 )
+    if ( *options.L2CacheBytes() > 0 )
+    {
+        _memCache = new MemCache( *options.L2CacheBytes(), *options.L2CacheShared() );
+    }
+    else if ( *options.L2CacheSize() > 0 )
     {
         _memCache = new MemCache( *options.L2CacheSize() );
     }
@@ -307,6 +317,23 @@ osg::Image*
 TileSource::createImage(const TileKey&        key,
                         ImageOperation*       prepOp, 
                         ProgressCallback*     progress )
+{
+    osg::ref_ptr<const osg::Image> image = createSharedImage( key, prepOp, progress );
+    if ( !image.valid() )
+        return 0L;
+
+    // the caller may modify the result, so never hand out an image that the
+    // memcache still refers to.
+    if ( image->referenceCount() > 1 )
+        return ImageUtils::cloneImage( image.get() );
+
+    return const_cast<osg::Image*>( image.release() );
+}
+
+osg::ref_ptr<const osg::Image>
+TileSource::createSharedImage(const TileKey&        key,
+                              ImageOperation*       prepOp, 
+                              ProgressCallback*     progress )
 {
     if ( _status != STATUS_OK )
         return 0L;
@@ -316,13 +343,19 @@ TileSource::createImage(const TileKey&        key,
     {
         ReadResult r = _memCache->getOrCreateDefaultBin()->readImage( key.str() );
         if ( r.succeeded() )
-            return r.releaseImage();
+            return r.getImage();
     }
 
     osg::ref_ptr<osg::Image> newImage = createImage(key, progress);
 
     if ( prepOp )
+    {
+        // a driver's image may be shared (e.g. by a coalesced URI read), so
+        // never run the operation on someone else's copy.
+        if ( newImage.valid() && newImage->referenceCount() > 1 )
+            newImage = ImageUtils::cloneImage( newImage.get() );
         (*prepOp)( newImage );
+    }
 
     if ( newImage.valid() && _memCache.valid() )
     {
@@ -330,7 +363,7 @@ TileSource::createImage(const TileKey&        key,
         _memCache->getOrCreateDefaultBin()->write( key.str(), newImage.get() );
     }
 
-    return newImage.release();
+    return newImage.get();
 }
 
 osg::HeightField*
@@ -346,7 +379,16 @@ TileSource::createHeightField(const TileKey&        key,
     {
         ReadResult r = _memCache->getOrCreateDefaultBin()->readObject( key.str() );
         if ( r.succeeded() )
+        {
+            // heightfield consumers modify the data in place, so never hand out
+            // a shared object.
+            if ( _memCache->getShareObjects() )
+            {
+                osg::HeightField* hf = r.get<osg::HeightField>();
+                return hf ? new osg::HeightField( *hf ) : 0L;
+            }
             return r.release<osg::HeightField>();
+        }
     }
 
     osg::ref_ptr<osg::HeightField> newHF = createHeightField( key, progress );
@@ -328,6 +328,38 @@ namespace
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return readStringFile(uri, opt); }
     };
 
+    //--------------------------------------------------------------------
+    // Single-flight read coalescing. There's one set of flights per read
+    // functor, since reading a URI as (say) an image or as a string yields
+    // different results.
+
+    template<typename READ_FUNCTOR>
+    struct ReadFlights
+    {
+        static Threading::SingleFlight<std::string, ReadResult> s_flights;
+    };
+
+    template<typename READ_FUNCTOR>
+    Threading::SingleFlight<std::string, ReadResult> ReadFlights<READ_FUNCTOR>::s_flights;
+
+    // Reads only share a flight if they would resolve the same way: the same
+    // URI, read with the same options (which can change what a plugin decodes)
+    // through the same cache policy and cache bin.
+    std::string makeFlightKey(
+        const URI&                   uri,
+        const osgDB::Options*        options,
+        const optional<CachePolicy>& cp,
+        const CacheBin*              bin )
+    {
+        std::stringstream buf;
+        buf << uri.full() << "|" << (const void*)options;
+        if ( cp.isSet() )
+            buf << "|" << cp->usageString() << "|" << *cp->maxAge() << "|" << (const void*)bin;
+        std::string str;
+        str = buf.str();
+        return str;
+    }
+
     //--------------------------------------------------------------------
     // MASTER read template function. I templatized this so we wouldn't
     // have 4 95%-identical code paths to maintain...
@@ -362,11 +394,7 @@ namespace
             URIResultCache* memCache = URIResultCache::from( localOptions );
             if ( memCache )
             {
-                URIResultCache::Record r = memCache->get( uri );
-                if ( r.valid() )
-                {
-                    result = r.value();
-                }
+                memCache->get( uri, result );
             }
 
             if ( result.empty() )
@@ -374,101 +402,143 @@ namespace
                 // see if there's a read callback installed.
                 URIReadCallback* cb = Registry::instance()->getURIReadCallback();
 
-                // for a local URI, bypass all the caching logic
-                if ( !uri.isRemote() )
-                {
-                    // try to use the callback if it's set. Callback ignores the caching policy.
-                    if ( cb )
-                    {
-                        // if this returns "not implemented" we fill fall back
-                        result = reader.fromCallback( cb, uri.full(), localOptions );
-
-                        if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
-                        {
-                            // "not implemented" is the only excuse to fall back.
-                            gotResultFromCallback = true;
-                        }
-                    }
-
-                    if ( !gotResultFromCallback )
-                    {
-                        // no callback, just read from a local file.
-                        result = reader.fromFile( uri.full(), localOptions );
-                    }
-                }
-
-                // remote URI, consider caching:
-                else
+                // for a remote URI, establish the caching policy and get a cache bin
+                // if we need it:
+                optional<CachePolicy> cp;
+                CacheBin* bin = 0L;
+                if ( uri.isRemote() )
                 {
                     bool callbackCachingOK = !cb || reader.callbackRequestsCaching(cb);
 
-                    // establish the caching policy.
-                    optional<CachePolicy> cp;
                     if ( !Registry::instance()->getCachePolicy( cp, localOptions ) )
                         cp = CachePolicy::DEFAULT;
 
-                    // get a cache bin if we need it:
-                    CacheBin* bin = 0L;
                     if ( (cp->usage() != CachePolicy::USAGE_NO_CACHE) && callbackCachingOK )
                     {
                         bin = s_getCacheBin( dbOptions );
                     }
+                }
 
-                    // first try to go to the cache if there is one:
-                    if ( bin && cp->isCacheReadable() )
-                    {
-                        result = reader.fromCache( bin, uri.cacheKey(), *cp->maxAge() );
-                        if ( result.succeeded() )
-                            result.setIsFromCache(true);
-                    }
+                // if another thread is already reading this URI the same way, wait
+                // for it and share its result instead of reading it again. (A failed
+                // or canceled read is no good to us; in that case, read it ourselves.)
+                // The result object is shared as-is; see URI::getNumCoalescedReads.
+                Threading::SingleFlight<std::string, ReadResult>& flights = ReadFlights<READ_FUNCTOR>::s_flights;
+                std::string flightKey = makeFlightKey( uri, localOptions, cp, bin );
+                ReadResult shared;
+                bool leader = flights.join( flightKey, shared );
 
-                    // not in the cache, so proceed to read it from the network.
-                    if ( result.empty() )
+                if ( !leader && shared.succeeded() )
+                {
+                    result = shared;
+                }
+                else
+                {
+                    // for a local URI, bypass all the caching logic
+                    if ( !uri.isRemote() )
                     {
                         // try to use the callback if it's set. Callback ignores the caching policy.
                         if ( cb )
-                        {                
+                        {
+                            // if this returns "not implemented" we fill fall back
                             result = reader.fromCallback( cb, uri.full(), localOptions );
 
                             if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
                             {
-                                // "not implemented" is the only excuse for falling back
+                                // "not implemented" is the only excuse to fall back.
                                 gotResultFromCallback = true;
                             }
                         }
 
                         if ( !gotResultFromCallback )
                         {
-                            // still no data, go to the source:
-                            if ( result.empty() && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
-                            {
-                                result = reader.fromHTTP( uri.full(), localOptions, progress );
+                            // no callback, just read from a local file.
+                            result = reader.fromFile( uri.full(), localOptions );
+                        }
+                    }
+
+                    // remote URI, consider caching:
+                    else
+                    {
+                        // first try to go to the cache if there is one:
+                        if ( bin && cp->isCacheReadable() )
+                        {
+                            result = reader.fromCache( bin, uri.cacheKey(), *cp->maxAge() );
+                            if ( result.succeeded() )
+                                result.setIsFromCache(true);
+                        }
+
+                        // not in the cache, so proceed to read it from the network.
+                        if ( result.empty() )
+                        {
+                            // try to use the callback if it's set. Callback ignores the caching policy.
+                            if ( cb )
+                            {                
+                                result = reader.fromCallback( cb, uri.full(), localOptions );
+
+                                if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
+                                {
+                                    // "not implemented" is the only excuse for falling back
+                                    gotResultFromCallback = true;
+                                }
                             }
 
-                            // write the result to the cache if possible:
-                            if ( result.succeeded() && bin && cp->isCacheWriteable() )
+                            if ( !gotResultFromCallback )
                             {
-                                bin->write( uri.cacheKey(), result.getObject(), result.metadata() );
+                                // keep the encoded bytes of an image for our own cache bin,
+                                // unless someone downstream already asked for them.
+                                bool wantedDownstream = EncodedRecord::isWanted( localOptions );
+                                osg::ref_ptr<osgDB::Options> httpOptions;
+                                if ( !wantedDownstream && bin && cp->isCacheWriteable() && bin->acceptsEncoded() )
+                                {
+                                    httpOptions = Registry::instance()->cloneOrCreateOptions( localOptions );
+                                    EncodedRecord::setWanted( httpOptions.get(), true );
+                                }
+
+                                // still no data, go to the source:
+                                if ( result.empty() && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                                {
+                                    result = reader.fromHTTP( uri.full(), httpOptions.valid() ? httpOptions.get() : localOptions, progress );
+                                }
+
+                                // write the result to the cache if possible:
+                                if ( result.succeeded() && bin && cp->isCacheWriteable() )
+                                {
+                                    if ( result.getImage() )
+                                        bin->writeImage( uri.cacheKey(), result.getImage(), result.metadata() );
+                                    else
+                                        bin->write( uri.cacheKey(), result.getObject(), result.metadata() );
+                                }
+
+                                if ( !wantedDownstream && result.getImage() )
+                                {
+                                    ImageUtils::clearEncodedData( result.getImage() );
+                                }
                             }
                         }
-                    }
 
-                    OE_TEST << LC 
-                        << uri.base() << ": " 
-                        << (result.succeeded() ? "OK" : "FAILED") 
-                        << "; policy=" << cp->usageString()
-                        << (result.isFromCache() && result.succeeded() ? "; (from cache)" : "")
-                        << std::endl;
-                }
+                        OE_TEST << LC 
+                            << uri.base() << ": " 
+                            << (result.succeeded() ? "OK" : "FAILED") 
+                            << "; policy=" << cp->usageString()
+                            << (result.isFromCache() && result.succeeded() ? "; (from cache)" : "")
+                            << std::endl;
+                    }
 
                     
-                if ( result.getObject() && !gotResultFromCallback )
-                {
-                    result.getObject()->setName( uri.base() );
+                    if ( result.getObject() && !gotResultFromCallback )
+                    {
+                        result.getObject()->setName( uri.base() );
 
-                    if ( memCache )
+                        if ( memCache )
+                        {
+                            memCache->insert( uri, result );
+                        }
+                    }
+
+                    if ( leader )
                     {
-                        memCache->insert( uri, result );
+                        flights.land( flightKey, result );
                     }
                 }
             }
@@ -513,6 +583,16 @@ URI::readString(const osgDB::Options* dbOptions,
     return doRead<ReadString>( *this, dbOptions, progress );
 }
 
+unsigned
+URI::getNumCoalescedReads()
+{
+    return
+        ReadFlights<ReadObject>::s_flights.getNumCoalesced() +
+        ReadFlights<ReadNode  >::s_flights.getNumCoalesced() +
+        ReadFlights<ReadImage >::s_flights.getNumCoalesced() +
+        ReadFlights<ReadString>::s_flights.getNumCoalesced();
+}
+
 
 //------------------------------------------------------------------------
 
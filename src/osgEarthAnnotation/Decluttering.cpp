@@ -19,6 +19,7 @@
 #include <osgEarthAnnotation/Decluttering>
 #include <osgEarthAnnotation/AnnotationUtils>
 #include <osgEarthAnnotation/AnnotationData>
+#include <osgEarthAnnotation/ScreenSpaceGrid>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Utils>
 #include <osgEarth/VirtualProgram>
@@ -86,8 +87,6 @@ namespace
 
     typedef std::map<const osg::Drawable*, DrawableInfo> DrawableMemory;
     
-    typedef std::pair<const osg::Node*, osg::BoundingBox> RenderLeafBox;
-
     // Data structure stored one-per-View.
     struct PerViewInfo
     {
@@ -100,6 +99,7 @@ namespace
         osgUtil::RenderBin::RenderLeafList _passed;
         osgUtil::RenderBin::RenderLeafList _failed;
         std::vector<RenderLeafBox>         _used;
+        ScreenSpaceGrid                    _grid;
 
         // time stamp of the previous pass, for calculating animation speed
         double _lastTimeStamp;
@@ -222,6 +222,9 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         const osg::Viewport* vp = cam->getViewport();
         osg::Matrix windowMatrix = vp->computeWindowMatrix();
 
+        // index of occupied screen space, for fast overlap tests:
+        local._grid.reset( vp );
+
         // Track the parent nodes of drawables that are obscured (and culled). Drawables
         // with the same parent node (typically a Geode) are considered to be grouped and
         // will be culled as a group.
@@ -263,25 +266,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 else
                 {
                     // weed out any drawables that are obscured by closer drawables.
-                    // TODO: think about a more efficient algorithm - right now we are just using
-                    // brute force to compare all bbox's
-                    for( std::vector<RenderLeafBox>::const_iterator j = local._used.begin(); j != local._used.end(); ++j )
-                    {
-                        // only need a 2D test since we're in clip space
-                        bool isClear =
-                            box.xMin() > j->second.xMax() ||
-                            box.xMax() < j->second.xMin() ||
-                            box.yMin() > j->second.yMax() ||
-                            box.yMax() < j->second.yMin();
-
-                        // if there's an overlap (and the conflict isn't from the same drawable
-                        // parent, which is acceptable), then the leaf is culled.
-                        if ( !isClear && drawableParent != j->first )
-                        {
-                            visible = false;
-                            break;
-                        }
-                    }
+                    visible = !local._grid.overlaps( box, drawableParent, local._used );
                 }
             }
 
@@ -289,6 +274,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
             {
                 // passed the test, so add the leaf's bbox to the "used" list, and add the leaf
                 // to the final draw list.
+                local._grid.insert( local._used.size(), box );
                 local._used.push_back( std::make_pair(drawableParent, box) );
                 local._passed.push_back( leaf );
             }
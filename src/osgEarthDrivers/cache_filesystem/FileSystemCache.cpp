@@ -26,6 +26,7 @@
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <fstream>
+#include <sstream>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
@@ -60,6 +61,8 @@ namespace
 
         CacheBin* getOrCreateDefaultBin();
 
+        bool acceptsEncoded() const { return true; }
+
     protected:
 
         void init();
@@ -88,6 +91,10 @@ namespace
 
         bool write( const std::string& key, const osg::Object* object, const Config& meta );
 
+        bool writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta );
+
+        bool acceptsEncoded() const { return true; }
+
         bool isCached( const std::string& key, double maxAge =DBL_MAX );
 
         bool purge();
@@ -99,6 +106,8 @@ namespace
     protected:
         bool purgeDirectory( const std::string& dir );
 
+        osg::Object* readRecord( const std::string& filename, bool asImage );
+
         bool                              _ok;
         std::string                       _metaPath;
         osg::ref_ptr<osgDB::ReaderWriter> _rw;
@@ -211,6 +220,30 @@ namespace
         }
     }
 
+    osg::Object*
+    FileSystemCacheBin::readRecord( const std::string& filename, bool asImage )
+    {
+        // read the whole record first, since it may hold either a serialized
+        // object or encoded data (see EncodedRecord).
+        std::ifstream in( filename.c_str(), std::ios::in | std::ios::binary );
+        if ( !in.is_open() )
+            return 0L;
+
+        std::stringstream buf;
+        buf << in.rdbuf();
+        std::string record = buf.str();
+
+        if ( EncodedRecord::isEncoded(record) )
+            return EncodedRecord::decode( record, _rwOptions.get() );
+
+        std::istringstream stream( record );
+        osgDB::ReaderWriter::ReadResult r = asImage ?
+            _rw->readImage( stream, _rwOptions.get() ) :
+            _rw->readObject( stream, _rwOptions.get() );
+
+        return r.success() ? r.takeObject() : 0L;
+    }
+
     ReadResult
     FileSystemCacheBin::readImage(const std::string& key, double maxAge)
     {
@@ -221,11 +254,11 @@ namespace
         // mangle "key" into a legal path name
         URI fileURI( toLegalFileName(key), _metaPath );
 
-        osgDB::ReaderWriter::ReadResult r;
         {
             ScopedReadLock sharedLock( _rwmutex );
-            r = _rw->readImage( fileURI.full() + ".osgb", _rwOptions.get() );
-            if ( r.success() )
+            osg::ref_ptr<osg::Object> obj = readRecord( fileURI.full() + ".osgb", true );
+            osg::Image* image = dynamic_cast<osg::Image*>( obj.get() );
+            if ( image )
             {
                 // read metadata
                 Config meta;
@@ -233,7 +266,7 @@ namespace
                 if ( osgDB::fileExists(metafile) )
                     readMeta( metafile, meta );
 
-                return ReadResult( r.getImage(), meta );
+                return ReadResult( image, meta );
             }
         }
 
@@ -250,11 +283,10 @@ namespace
         // mangle "key" into a legal path name
         URI fileURI( toLegalFileName(key), _metaPath );
 
-        osgDB::ReaderWriter::ReadResult r;
         {
             ScopedReadLock sharedLock( _rwmutex );
-            r = _rw->readObject( fileURI.full() + ".osgb", _rwOptions.get() );
-            if ( r.success() )
+            osg::ref_ptr<osg::Object> obj = readRecord( fileURI.full() + ".osgb", false );
+            if ( obj.valid() )
             {
                 // read metadata
                 Config meta;
@@ -262,8 +294,7 @@ namespace
                 if ( osgDB::fileExists(metafile) )
                     readMeta( metafile, meta );
 
-                // TODO: read metadata
-                return ReadResult( r.getObject(), meta );
+                return ReadResult( obj.get(), meta );
             }
         }
 
@@ -365,6 +396,55 @@ namespace
         return objWriteOK;
     }
 
+    bool
+    FileSystemCacheBin::writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta )
+    {
+        if ( !_ok ) return false;
+
+        // convert the key into a legal filename:
+        URI fileURI( toLegalFileName(key), _metaPath );
+
+        bool objWriteOK = false;
+        {
+            // prevent cache contention:
+            ScopedWriteLock exclusiveLock( _rwmutex );
+
+            // make a home for it..
+            if ( !osgDB::fileExists( osgDB::getFilePath(fileURI.full()) ) )
+                osgDB::makeDirectoryForFile( fileURI.full() );
+
+            // Encoded records share the ".osgb" name with serialized ones; readRecord()
+            // tells them apart by the record tag.
+            std::string filename = fileURI.full() + ".osgb";
+            std::ofstream out( filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+            if ( out.is_open() )
+            {
+                std::string record = EncodedRecord::wrap( format, bytes );
+                out.write( record.data(), record.length() );
+                out.close();
+                objWriteOK = !out.fail();
+            }
+
+            // write metadata
+            if ( !meta.empty() && objWriteOK )
+            {
+                std::string metaname = fileURI.full() + ".meta";
+                writeMeta( metaname, meta );
+            }
+        }
+
+        if ( objWriteOK )
+        {
+            OE_DEBUG << LC << "Wrote \"" << key << "\" (" << format << ") to cache bin " << getID() << std::endl;
+        }
+        else
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
+        }
+
+        return objWriteOK;
+    }
+
     bool
     FileSystemCacheBin::isCached( const std::string& key, double maxAge )
     {
@@ -0,0 +1,1169 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackedCacheOptions"
+#include <osgEarth/Cache>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/URI>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef _WIN32
+#  include <io.h>
+#  include <fcntl.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+using namespace osgEarth::Threading;
+
+#define LC "[PackedCache] "
+
+// identifies a record header in a segment file
+#define RECORD_MAGIC   0x5250454Fu // "OEPR"
+#define RECORD_HEADER  24u
+
+// identifies an index snapshot
+#define INDEX_MAGIC    0x58504B4Fu // "OKPX"
+#define INDEX_VERSION  1u
+
+// journal operations
+#define JOURNAL_PUT    'P'
+#define JOURNAL_DELETE 'D'
+
+// number of journaled operations that triggers an index snapshot
+#define JOURNAL_CHECKPOINT_OPS 50000
+
+/**
+ * Layout on disk:
+ *
+ *   segment_NNNNNN.pack  Append-only record files. Each record is a 24-byte header
+ *                        (magic, key length, metadata length, data length, created
+ *                        time, checksum) followed by the key, metadata and data.
+ *   index.dat            Snapshot of the key index.
+ *   index.journal        Index changes since the last snapshot.
+ *
+ * A write appends the record to the active segment and then journals the index
+ * change, so a crash at any point leaves either a consistent index or some
+ * unreferenced bytes in a segment. If the snapshot is lost, the index is
+ * rebuilt by scanning the segments and then applying the journal.
+ */
+namespace
+{
+    /** Location of a record in the segment files. */
+    struct IndexEntry
+    {
+        IndexEntry() : _segment(0), _offset(0), _size(0), _created(0), _accessed(0) { }
+        unsigned          _segment;
+        unsigned          _offset;
+        unsigned          _size;
+        unsigned          _created;
+        volatile unsigned _accessed;
+    };
+
+    /** One append-only segment file. */
+    struct Segment : public osg::Referenced
+    {
+        Segment( unsigned id, const std::string& path ) : _id(id), _path(path), _size(0), _liveBytes(0) { }
+        unsigned         _id;
+        std::string      _path;
+        std::fstream     _file;
+        Threading::Mutex _mutex;     // guards the file position
+        unsigned         _size;
+        unsigned         _liveBytes; // bytes still referenced by the index
+    };
+
+    inline void writeU32( std::ostream& out, unsigned v ) {
+        out.write( (const char*)&v, 4 );
+    }
+
+    inline bool readU32( std::istream& in, unsigned& v ) {
+        in.read( (char*)&v, 4 );
+        return in.gcount() == 4;
+    }
+
+    inline void writeString( std::ostream& out, const std::string& s ) {
+        writeU32( out, s.length() );
+        out.write( s.c_str(), s.length() );
+    }
+
+    inline bool readString( std::istream& in, std::string& s ) {
+        unsigned len;
+        if ( !readU32(in, len) || len > (1u<<20) ) return false;
+        s.resize( len );
+        if ( len > 0 ) in.read( &s[0], len );
+        return (unsigned)in.gcount() == len;
+    }
+
+    /**
+     * Commits a file that was written and flushed through a stream to disk.
+     * Applied to a directory, commits a rename within it (POSIX only).
+     */
+    inline void syncFile( const std::string& path )
+    {
+#ifdef _WIN32
+        int fd = ::_open( path.c_str(), _O_RDWR | _O_BINARY );
+        if ( fd >= 0 ) { ::_commit( fd ); ::_close( fd ); }
+#else
+        int fd = ::open( path.c_str(), O_RDONLY );
+        if ( fd >= 0 ) { ::fsync( fd ); ::close( fd ); }
+#endif
+    }
+
+    inline unsigned checksum( const std::string& a, const std::string& b, const std::string& c )
+    {
+        // FNV-1a
+        unsigned h = 2166136261u;
+        for( std::string::const_iterator i = a.begin(); i != a.end(); ++i ) { h ^= (unsigned char)*i; h *= 16777619u; }
+        for( std::string::const_iterator i = b.begin(); i != b.end(); ++i ) { h ^= (unsigned char)*i; h *= 16777619u; }
+        for( std::string::const_iterator i = c.begin(); i != c.end(); ++i ) { h ^= (unsigned char)*i; h *= 16777619u; }
+        return h;
+    }
+
+
+    /**
+     * Key/value store behind a PackedCache. All the bins of a cache share one
+     * store, so they share a single byte budget and LRU order.
+     */
+    class PackedStore : public osg::Referenced
+    {
+    public:
+        PackedStore( const std::string& rootPath, unsigned maxSizeMB, unsigned segmentSizeMB );
+
+        bool valid() const { return _ok; }
+
+        bool read( const std::string& key, double maxAge, std::string& out_data, std::string& out_meta );
+
+        bool write( const std::string& key, const std::string& data, const std::string& meta );
+
+        bool exists( const std::string& key, double maxAge );
+
+        /** Removes every record whose key begins with the prefix. */
+        void removePrefix( const std::string& prefix );
+
+    protected:
+        virtual ~PackedStore();
+
+        typedef std::map<std::string, IndexEntry>          Index;
+        typedef std::map<unsigned, osg::ref_ptr<Segment> > SegmentMap;
+
+        bool loadIndex( const std::string& path );
+        bool replayJournal();
+        void scanSegments();
+        void recountBytes();
+        void checkpoint();
+        void journal( char op, const std::string& key, const IndexEntry* entry );
+
+        Segment* openSegment( unsigned id, bool create );
+        Segment* getSegment( unsigned id ) const;
+
+        bool readRecord( const IndexEntry& entry, const std::string& key, std::string& out_data, std::string& out_meta );
+        bool appendRecord( const std::string& key, const std::string& data, const std::string& meta, unsigned created, IndexEntry& out_entry );
+        void addLive( const IndexEntry& entry );
+        void releaseLive( const IndexEntry& entry );
+
+        void enforceBudget();
+        void compact( unsigned id );
+
+        bool                      _ok;
+        std::string               _rootPath;
+        std::string               _indexPath;
+        std::string               _journalPath;
+        unsigned long long        _maxBytes;
+        unsigned                  _segmentBytes;
+
+        Threading::ReadWriteMutex _indexMutex;
+        Index                     _index;
+        SegmentMap                _segments;
+        unsigned                  _activeSegment;
+        std::ofstream             _journal;
+        unsigned                  _journalOps;
+        unsigned long long        _diskBytes;
+        unsigned long long        _liveBytes;
+        unsigned long long        _nextBudgetCheck; // disk size that allows another enforceBudget pass
+    };
+
+    /** Orders index entries from least to most recently used. */
+    struct LessRecentlyUsed
+    {
+        typedef std::map<std::string, IndexEntry>::iterator Iter;
+        bool operator()( const Iter& lhs, const Iter& rhs ) const {
+            return lhs->second._accessed < rhs->second._accessed;
+        }
+    };
+
+    /**
+     * Cache that packs its records into a small number of segment files.
+     */
+    class PackedCache : public Cache
+    {
+    public:
+        PackedCache() { } // unused
+        PackedCache( const PackedCache& rhs, const osg::CopyOp& op ) { } // unused
+        META_Object( osgEarth, PackedCache );
+
+        PackedCache( const CacheOptions& options );
+
+    public: // Cache interface
+
+        CacheBin* addBin( const std::string& binID );
+
+        CacheBin* getOrCreateDefaultBin();
+
+        bool acceptsEncoded() const { return true; }
+
+    protected:
+        osg::ref_ptr<PackedStore> _store;
+    };
+
+    /**
+     * Cache bin implementation for a PackedCache. Records are stored under
+     * "binID/key" and the bin metadata under "binID".
+     */
+    class PackedCacheBin : public CacheBin
+    {
+    public:
+        PackedCacheBin( const std::string& binID, PackedStore* store );
+
+    public: // CacheBin interface
+
+        ReadResult readObject( const std::string& key, double maxAge =DBL_MAX );
+
+        ReadResult readImage( const std::string& key, double maxAge =DBL_MAX );
+
+        ReadResult readString( const std::string& key, double maxAge =DBL_MAX );
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta );
+
+        bool writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta );
+
+        bool acceptsEncoded() const { return true; }
+
+        bool isCached( const std::string& key, double maxAge =DBL_MAX );
+
+        bool purge();
+
+        Config readMetadata();
+
+        bool writeMetadata( const Config& meta );
+
+    protected:
+        bool                              _ok;
+        osg::ref_ptr<PackedStore>         _store;
+        std::string                       _prefix;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        osg::ref_ptr<osgDB::Options>      _rwOptions;
+    };
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    PackedStore::PackedStore(const std::string& rootPath,
+                             unsigned           maxSizeMB,
+                             unsigned           segmentSizeMB) :
+    _ok           ( false ),
+    _rootPath     ( rootPath ),
+    _activeSegment( 0 ),
+    _journalOps   ( 0 ),
+    _diskBytes    ( 0 ),
+    _liveBytes    ( 0 ),
+    _nextBudgetCheck( 0 )
+    {
+        _maxBytes     = (unsigned long long)maxSizeMB * 1024 * 1024;
+        _segmentBytes = osg::clampBetween( segmentSizeMB, 1u, 1024u ) * 1024u * 1024u;
+        _indexPath    = osgDB::concatPaths( _rootPath, "index.dat" );
+        _journalPath  = osgDB::concatPaths( _rootPath, "index.journal" );
+
+        osgDB::makeDirectory( _rootPath );
+        if ( !osgDB::fileExists( _rootPath ) )
+        {
+            OE_WARN << LC << "FAILED to create root folder for cache at \"" << _rootPath << "\"" << std::endl;
+            return;
+        }
+
+        // find the existing segments:
+        osgDB::DirectoryContents dc = osgDB::getDirectoryContents( _rootPath );
+        for( osgDB::DirectoryContents::iterator i = dc.begin(); i != dc.end(); ++i )
+        {
+            if ( startsWith(*i, "segment_") && endsWith(*i, ".pack") && i->length() > 13 )
+            {
+                unsigned id = as<unsigned>( i->substr(8, i->length()-13), 0u );
+                openSegment( id, false );
+            }
+        }
+
+        // load the last snapshot (or an interrupted one). Without one, the journal
+        // only covers changes since the lost snapshot, so rebuild the rest of the
+        // index from the segments themselves before applying it.
+        bool haveIndex = loadIndex( _indexPath ) || loadIndex( _indexPath + ".tmp" );
+        if ( !haveIndex && !_segments.empty() )
+        {
+            OE_INFO << LC << "Rebuilding index for \"" << _rootPath << "\"" << std::endl;
+            scanSegments();
+        }
+        replayJournal();
+
+        recountBytes();
+
+        if ( !_segments.empty() )
+            _activeSegment = _segments.rbegin()->first;
+
+        // start over with a fresh snapshot and an empty journal.
+        checkpoint();
+        _ok = _journal.is_open();
+
+        OE_INFO << LC << "Opened \"" << _rootPath << "\": " << _index.size() << " records, "
+            << (_liveBytes/(1024*1024)) << " MB live / " << (_diskBytes/(1024*1024)) << " MB on disk"
+            << std::endl;
+    }
+
+    PackedStore::~PackedStore()
+    {
+        ScopedWriteLock exclusive( _indexMutex );
+        if ( _ok )
+            checkpoint();
+        _journal.close();
+    }
+
+    Segment*
+    PackedStore::getSegment( unsigned id ) const
+    {
+        SegmentMap::const_iterator i = _segments.find( id );
+        return i != _segments.end() ? i->second.get() : 0L;
+    }
+
+    Segment*
+    PackedStore::openSegment( unsigned id, bool create )
+    {
+        std::string path = osgDB::concatPaths( _rootPath, Stringify() << "segment_" << std::setfill('0') << std::setw(6) << id << ".pack" );
+
+        if ( create )
+        {
+            std::ofstream touch( path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::app );
+        }
+
+        osg::ref_ptr<Segment> seg = new Segment( id, path );
+        seg->_file.open( path.c_str(), std::ios_base::in | std::ios_base::out | std::ios_base::binary );
+        if ( !seg->_file.is_open() )
+        {
+            OE_WARN << LC << "FAILED to open segment \"" << path << "\"" << std::endl;
+            return 0L;
+        }
+
+        seg->_file.seekg( 0, std::ios_base::end );
+        seg->_size = (unsigned)seg->_file.tellg();
+
+        _segments[id] = seg.get();
+        _diskBytes += seg->_size;
+        return seg.get();
+    }
+
+    bool
+    PackedStore::loadIndex( const std::string& path )
+    {
+        std::ifstream in( path.c_str(), std::ios_base::in | std::ios_base::binary );
+        if ( !in.is_open() )
+            return false;
+
+        unsigned magic, version, count;
+        if ( !readU32(in, magic) || !readU32(in, version) || !readU32(in, count) ||
+             magic != INDEX_MAGIC || version != INDEX_VERSION )
+        {
+            OE_WARN << LC << "Ignoring unrecognized index file \"" << path << "\"" << std::endl;
+            return false;
+        }
+
+        for( unsigned i = 0; i < count; ++i )
+        {
+            std::string key;
+            IndexEntry  e;
+            unsigned    accessed;
+            if ( !readString(in, key) ||
+                 !readU32(in, e._segment) || !readU32(in, e._offset) || !readU32(in, e._size) ||
+                 !readU32(in, e._created) || !readU32(in, accessed) )
+            {
+                OE_WARN << LC << "Index file \"" << path << "\" is truncated" << std::endl;
+                _index.clear();
+                return false;
+            }
+
+            e._accessed = accessed;
+            Segment* seg = getSegment( e._segment );
+            if ( seg && e._offset + e._size <= seg->_size )
+                _index[key] = e;
+        }
+
+        return true;
+    }
+
+    bool
+    PackedStore::replayJournal()
+    {
+        std::ifstream in( _journalPath.c_str(), std::ios_base::in | std::ios_base::binary );
+        if ( !in.is_open() )
+            return false;
+
+        // replaying is idempotent, so it does not matter whether these changes
+        // already made it into the snapshot. Stop at the first torn entry.
+        bool any = false;
+        char op;
+        while( in.get(op) )
+        {
+            std::string key;
+            if ( !readString(in, key) )
+                break;
+
+            if ( op == JOURNAL_PUT )
+            {
+                IndexEntry e;
+                if ( !readU32(in, e._segment) || !readU32(in, e._offset) || !readU32(in, e._size) || !readU32(in, e._created) )
+                    break;
+
+                e._accessed = e._created;
+                Segment* seg = getSegment( e._segment );
+                if ( seg && e._offset + e._size <= seg->_size )
+                    _index[key] = e;
+            }
+            else if ( op == JOURNAL_DELETE )
+            {
+                _index.erase( key );
+            }
+            else
+            {
+                break;
+            }
+            any = true;
+        }
+
+        return any;
+    }
+
+    void
+    PackedStore::scanSegments()
+    {
+        for( SegmentMap::iterator s = _segments.begin(); s != _segments.end(); ++s )
+        {
+            Segment* seg = s->second.get();
+            seg->_file.clear();
+            seg->_file.seekg( 0 );
+
+            unsigned offset = 0;
+            while( offset + RECORD_HEADER <= seg->_size )
+            {
+                unsigned magic, keyLen, metaLen, dataLen, created, sum;
+                if ( !readU32(seg->_file, magic) || magic != RECORD_MAGIC ||
+                     !readU32(seg->_file, keyLen) || !readU32(seg->_file, metaLen) || !readU32(seg->_file, dataLen) ||
+                     !readU32(seg->_file, created) || !readU32(seg->_file, sum) )
+                {
+                    break;
+                }
+
+                unsigned size = RECORD_HEADER + keyLen + metaLen + dataLen;
+                if ( offset + size > seg->_size )
+                    break;
+
+                std::string key( keyLen, '\0' ), meta( metaLen, '\0' ), data( dataLen, '\0' );
+                if ( keyLen  ) seg->_file.read( &key[0],  keyLen );
+                if ( metaLen ) seg->_file.read( &meta[0], metaLen );
+                if ( dataLen ) seg->_file.read( &data[0], dataLen );
+                if ( !seg->_file || checksum(key, meta, data) != sum )
+                    break;
+
+                IndexEntry& e = _index[key];
+                e._segment  = seg->_id;
+                e._offset   = offset;
+                e._size     = size;
+                e._created  = created;
+                e._accessed = created;
+
+                offset += size;
+            }
+        }
+    }
+
+    void
+    PackedStore::recountBytes()
+    {
+        _diskBytes = 0;
+        _liveBytes = 0;
+        for( SegmentMap::iterator s = _segments.begin(); s != _segments.end(); ++s )
+        {
+            s->second->_liveBytes = 0;
+            _diskBytes += s->second->_size;
+        }
+
+        for( Index::iterator i = _index.begin(); i != _index.end(); ++i )
+            addLive( i->second );
+    }
+
+    void
+    PackedStore::addLive( const IndexEntry& entry )
+    {
+        Segment* seg = getSegment( entry._segment );
+        if ( seg ) seg->_liveBytes += entry._size;
+        _liveBytes += entry._size;
+    }
+
+    void
+    PackedStore::releaseLive( const IndexEntry& entry )
+    {
+        Segment* seg = getSegment( entry._segment );
+        if ( seg ) seg->_liveBytes -= osg::minimum( seg->_liveBytes, entry._size );
+        _liveBytes -= osg::minimum( _liveBytes, (unsigned long long)entry._size );
+    }
+
+    void
+    PackedStore::checkpoint()
+    {
+        // the snapshot must not reference records that are not yet on disk.
+        Segment* active = getSegment( _activeSegment );
+        if ( active )
+            syncFile( active->_path );
+
+        std::string tmp = _indexPath + ".tmp";
+        {
+            std::ofstream out( tmp.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+            if ( !out.is_open() )
+            {
+                OE_WARN << LC << "FAILED to write index snapshot \"" << tmp << "\"" << std::endl;
+                return;
+            }
+
+            writeU32( out, INDEX_MAGIC );
+            writeU32( out, INDEX_VERSION );
+            writeU32( out, _index.size() );
+            for( Index::const_iterator i = _index.begin(); i != _index.end(); ++i )
+            {
+                writeString( out, i->first );
+                writeU32( out, i->second._segment );
+                writeU32( out, i->second._offset );
+                writeU32( out, i->second._size );
+                writeU32( out, i->second._created );
+                writeU32( out, i->second._accessed );
+            }
+
+            out.flush();
+            if ( !out )
+            {
+                OE_WARN << LC << "FAILED to write index snapshot \"" << tmp << "\"" << std::endl;
+                return;
+            }
+        }
+
+        syncFile( tmp );
+        ::remove( _indexPath.c_str() );
+        ::rename( tmp.c_str(), _indexPath.c_str() );
+        syncFile( _rootPath );
+
+        if ( _journal.is_open() )
+            _journal.close();
+        _journal.clear();
+        _journal.open( _journalPath.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+        syncFile( _journalPath );
+        _journalOps = 0;
+    }
+
+    void
+    PackedStore::journal( char op, const std::string& key, const IndexEntry* entry )
+    {
+        _journal.put( op );
+        writeString( _journal, key );
+        if ( entry )
+        {
+            writeU32( _journal, entry->_segment );
+            writeU32( _journal, entry->_offset );
+            writeU32( _journal, entry->_size );
+            writeU32( _journal, entry->_created );
+        }
+        _journal.flush();
+        ++_journalOps;
+    }
+
+    bool
+    PackedStore::readRecord(const IndexEntry&   entry,
+                            const std::string&  key,
+                            std::string&        out_data,
+                            std::string&        out_meta )
+    {
+        Segment* seg = getSegment( entry._segment );
+        if ( !seg )
+            return false;
+
+        ScopedMutexLock lock( seg->_mutex );
+
+        seg->_file.clear();
+        seg->_file.seekg( entry._offset );
+
+        unsigned magic, keyLen, metaLen, dataLen, created, sum;
+        if ( !readU32(seg->_file, magic) || !readU32(seg->_file, keyLen) || !readU32(seg->_file, metaLen) ||
+             !readU32(seg->_file, dataLen) || !readU32(seg->_file, created) || !readU32(seg->_file, sum) ||
+             magic != RECORD_MAGIC || keyLen != key.length() ||
+             RECORD_HEADER + keyLen + metaLen + dataLen != entry._size )
+        {
+            OE_WARN << LC << "Bad record header for \"" << key << "\" in " << seg->_path << std::endl;
+            return false;
+        }
+
+        std::string storedKey( keyLen, '\0' );
+        if ( keyLen ) seg->_file.read( &storedKey[0], keyLen );
+
+        out_meta.resize( metaLen );
+        if ( metaLen ) seg->_file.read( &out_meta[0], metaLen );
+
+        out_data.resize( dataLen );
+        if ( dataLen ) seg->_file.read( &out_data[0], dataLen );
+
+        if ( !seg->_file || storedKey != key || checksum(storedKey, out_meta, out_data) != sum )
+        {
+            OE_WARN << LC << "Corrupt record for \"" << key << "\" in " << seg->_path << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    PackedStore::appendRecord(const std::string& key,
+                              const std::string& data,
+                              const std::string& meta,
+                              unsigned           created,
+                              IndexEntry&        out_entry )
+    {
+        unsigned size = RECORD_HEADER + key.length() + meta.length() + data.length();
+
+        // roll over to a new segment when the active one is full.
+        Segment* seg = getSegment( _activeSegment );
+        if ( !seg || (seg->_size > 0 && seg->_size + size > _segmentBytes) )
+        {
+            // commit the full segment and the index changes that point into it.
+            if ( seg )
+            {
+                syncFile( seg->_path );
+                syncFile( _journalPath );
+                ++_activeSegment;
+            }
+            seg = openSegment( _activeSegment, true );
+            if ( !seg )
+                return false;
+        }
+
+        ScopedMutexLock lock( seg->_mutex );
+
+        seg->_file.clear();
+        seg->_file.seekp( seg->_size );
+
+        writeU32( seg->_file, RECORD_MAGIC );
+        writeU32( seg->_file, key.length() );
+        writeU32( seg->_file, meta.length() );
+        writeU32( seg->_file, data.length() );
+        writeU32( seg->_file, created );
+        writeU32( seg->_file, checksum(key, meta, data) );
+        seg->_file.write( key.c_str(), key.length() );
+        seg->_file.write( meta.c_str(), meta.length() );
+        seg->_file.write( data.c_str(), data.length() );
+        seg->_file.flush();
+
+        if ( !seg->_file )
+        {
+            OE_WARN << LC << "FAILED to append to " << seg->_path << std::endl;
+            return false;
+        }
+
+        out_entry._segment  = seg->_id;
+        out_entry._offset   = seg->_size;
+        out_entry._size     = size;
+        out_entry._created  = created;
+        out_entry._accessed = created;
+
+        seg->_size += size;
+        _diskBytes += size;
+        return true;
+    }
+
+    bool
+    PackedStore::read(const std::string& key,
+                      double             maxAge,
+                      std::string&       out_data,
+                      std::string&       out_meta )
+    {
+        if ( !_ok ) return false;
+
+        ScopedReadLock shared( _indexMutex );
+
+        Index::iterator i = _index.find( key );
+        if ( i == _index.end() )
+            return false;
+
+        unsigned now = (unsigned)::time(0L);
+        if ( maxAge < DBL_MAX && (double)(now - i->second._created) > maxAge )
+            return false;
+
+        i->second._accessed = now;
+
+        IndexEntry entry = i->second;
+        return readRecord( entry, key, out_data, out_meta );
+    }
+
+    bool
+    PackedStore::exists( const std::string& key, double maxAge )
+    {
+        if ( !_ok ) return false;
+
+        ScopedReadLock shared( _indexMutex );
+
+        Index::const_iterator i = _index.find( key );
+        if ( i == _index.end() )
+            return false;
+
+        return maxAge >= DBL_MAX || (double)((unsigned)::time(0L) - i->second._created) <= maxAge;
+    }
+
+    bool
+    PackedStore::write(const std::string& key,
+                       const std::string& data,
+                       const std::string& meta )
+    {
+        if ( !_ok ) return false;
+
+        ScopedWriteLock exclusive( _indexMutex );
+
+        IndexEntry entry;
+        if ( !appendRecord(key, data, meta, (unsigned)::time(0L), entry) )
+            return false;
+
+        Index::iterator i = _index.find( key );
+        if ( i != _index.end() )
+        {
+            releaseLive( i->second );
+            i->second = entry;
+        }
+        else
+        {
+            _index[key] = entry;
+        }
+
+        addLive( entry );
+        journal( JOURNAL_PUT, key, &entry );
+
+        // over budget, or mostly dead space? When the last pass could not get
+        // under either limit, wait for the disk to grow before trying again.
+        if ( _diskBytes > _nextBudgetCheck &&
+             ((_maxBytes > 0 && _diskBytes > _maxBytes) ||
+              (_diskBytes > 2 * _liveBytes + 2 * (unsigned long long)_segmentBytes)) )
+        {
+            enforceBudget();
+        }
+
+        if ( _journalOps >= JOURNAL_CHECKPOINT_OPS )
+        {
+            checkpoint();
+        }
+
+        return true;
+    }
+
+    void
+    PackedStore::removePrefix( const std::string& prefix )
+    {
+        if ( !_ok ) return;
+
+        ScopedWriteLock exclusive( _indexMutex );
+
+        Index::iterator i = _index.lower_bound( prefix );
+        while( i != _index.end() && i->first.compare(0, prefix.length(), prefix) == 0 )
+        {
+            releaseLive( i->second );
+            journal( JOURNAL_DELETE, i->first, 0L );
+            _index.erase( i++ );
+        }
+    }
+
+    /** Orders segments from least to most live. */
+    struct LessLive
+    {
+        bool operator()( const Segment* lhs, const Segment* rhs ) const {
+            return (unsigned long long)lhs->_liveBytes * rhs->_size < (unsigned long long)rhs->_liveBytes * lhs->_size;
+        }
+    };
+
+    void
+    PackedStore::enforceBudget()
+    {
+        // first evict the least recently used records, leaving some headroom:
+        unsigned long long target = _maxBytes - _maxBytes/5;
+        if ( _maxBytes > 0 )
+        {
+            if ( _liveBytes > target )
+            {
+                std::vector<Index::iterator> lru;
+                lru.reserve( _index.size() );
+                for( Index::iterator i = _index.begin(); i != _index.end(); ++i )
+                    lru.push_back( i );
+
+                std::sort( lru.begin(), lru.end(), LessRecentlyUsed() );
+
+                unsigned evicted = 0;
+                for( std::vector<Index::iterator>::iterator i = lru.begin(); i != lru.end() && _liveBytes > target; ++i )
+                {
+                    releaseLive( (*i)->second );
+                    journal( JOURNAL_DELETE, (*i)->first, 0L );
+                    _index.erase( *i );
+                    ++evicted;
+                }
+
+                OE_DEBUG << LC << "Evicted " << evicted << " records" << std::endl;
+            }
+        }
+
+        // then reclaim the space, starting with the sparsest segments. Those that
+        // are mostly dead are always worth compacting; over budget, keep going
+        // through fuller segments until the disk is back under the target.
+        std::vector<Segment*> candidates;
+        for( SegmentMap::iterator s = _segments.begin(); s != _segments.end(); ++s )
+        {
+            if ( s->first != _activeSegment && s->second->_liveBytes < s->second->_size )
+                candidates.push_back( s->second.get() );
+        }
+
+        std::sort( candidates.begin(), candidates.end(), LessLive() );
+
+        std::vector<unsigned> victims;
+        unsigned long long    projected = _diskBytes;
+        for( std::vector<Segment*>::iterator s = candidates.begin(); s != candidates.end(); ++s )
+        {
+            bool sparse     = (*s)->_liveBytes < (*s)->_size/2;
+            bool overBudget = _maxBytes > 0 && projected > target;
+            if ( !sparse && !overBudget )
+                break;
+
+            victims.push_back( (*s)->_id );
+            projected -= osg::minimum( projected, (unsigned long long)((*s)->_size - (*s)->_liveBytes) );
+        }
+
+        for( std::vector<unsigned>::iterator s = victims.begin(); s != victims.end(); ++s )
+            compact( *s );
+
+        checkpoint();
+
+        // hysteresis: if this pass left the disk over a limit, let it grow by a
+        // segment (or a tenth of the budget) before paying for another one.
+        _nextBudgetCheck = _diskBytes + osg::maximum( (unsigned long long)_segmentBytes, _maxBytes/10 );
+    }
+
+    void
+    PackedStore::compact( unsigned id )
+    {
+        osg::ref_ptr<Segment> seg = getSegment( id );
+        if ( !seg.valid() )
+            return;
+
+        // move the live records into the active segment:
+        std::vector<Index::iterator> live;
+        for( Index::iterator i = _index.begin(); i != _index.end(); ++i )
+        {
+            if ( i->second._segment == id )
+                live.push_back( i );
+        }
+
+        for( std::vector<Index::iterator>::iterator i = live.begin(); i != live.end(); ++i )
+        {
+            std::string data, meta;
+            IndexEntry  moved;
+            if ( readRecord((*i)->second, (*i)->first, data, meta) &&
+                 appendRecord((*i)->first, data, meta, (*i)->second._created, moved) )
+            {
+                moved._accessed = (*i)->second._accessed;
+                releaseLive( (*i)->second );
+                (*i)->second = moved;
+                addLive( moved );
+                journal( JOURNAL_PUT, (*i)->first, &moved );
+            }
+            else
+            {
+                releaseLive( (*i)->second );
+                journal( JOURNAL_DELETE, (*i)->first, 0L );
+                _index.erase( *i );
+            }
+        }
+
+        // and drop the segment.
+        seg->_file.close();
+        ::remove( seg->_path.c_str() );
+        _diskBytes -= osg::minimum( _diskBytes, (unsigned long long)seg->_size );
+        _segments.erase( id );
+
+        OE_DEBUG << LC << "Compacted " << seg->_path << std::endl;
+    }
+
+    //------------------------------------------------------------------------
+
+    PackedCache::PackedCache( const CacheOptions& options ) :
+    Cache( options )
+    {
+        PackedCacheOptions pco( options );
+        std::string rootPath = URI( *pco.rootPath(), options.referrer() ).full();
+
+        _store = new PackedStore( rootPath, *pco.maxSize(), *pco.segmentSize() );
+        if ( !_store->valid() )
+        {
+            OE_WARN << LC << "FAILED to open cache at \"" << rootPath << "\"" << std::endl;
+            _ok = false;
+        }
+    }
+
+    CacheBin*
+    PackedCache::addBin( const std::string& name )
+    {
+        return _bins.getOrCreate( name, new PackedCacheBin( name, _store.get() ) );
+    }
+
+    CacheBin*
+    PackedCache::getOrCreateDefaultBin()
+    {
+        static Threading::Mutex s_defaultBinMutex;
+        if ( !_defaultBin.valid() )
+        {
+            Threading::ScopedMutexLock lock( s_defaultBinMutex );
+            if ( !_defaultBin.valid() ) // double-check
+            {
+                _defaultBin = new PackedCacheBin( "__default", _store.get() );
+            }
+        }
+        return _defaultBin.get();
+    }
+
+    //------------------------------------------------------------------------
+
+    PackedCacheBin::PackedCacheBin(const std::string& binID,
+                                   PackedStore*       store) :
+    CacheBin( binID ),
+    _ok     ( store && store->valid() ),
+    _store  ( store ),
+    _prefix ( binID + "/" )
+    {
+        if ( _ok )
+        {
+            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+#ifdef OSGEARTH_HAVE_ZLIB
+            _rwOptions = Registry::instance()->cloneOrCreateOptions();
+            _rwOptions->setOptionString( "Compressor=zlib" );
+#endif
+            CachePolicy::NO_CACHE.apply(_rwOptions.get());
+            _ok = _rw.valid();
+        }
+    }
+
+    ReadResult
+    PackedCacheBin::readImage(const std::string& key, double maxAge)
+    {
+        if ( !_ok ) return 0L;
+
+        std::string data, meta;
+        if ( !_store->read(_prefix + key, maxAge, data, meta) )
+            return ReadResult();
+
+        osg::ref_ptr<osg::Image> result;
+        if ( EncodedRecord::isEncoded(data) )
+        {
+            osg::ref_ptr<osg::Object> obj = EncodedRecord::decode( data, _rwOptions.get() );
+            result = dynamic_cast<osg::Image*>( obj.get() );
+        }
+        else
+        {
+            std::istringstream buf( data );
+            osgDB::ReaderWriter::ReadResult r = _rw->readImage( buf, _rwOptions.get() );
+            if ( r.success() )
+                result = r.getImage();
+        }
+
+        if ( !result.valid() )
+            return ReadResult();
+
+        Config conf;
+        if ( !meta.empty() )
+            conf.fromJSON( meta );
+
+        return ReadResult( result.get(), conf );
+    }
+
+    ReadResult
+    PackedCacheBin::readObject(const std::string& key, double maxAge)
+    {
+        if ( !_ok ) return 0L;
+
+        std::string data, meta;
+        if ( !_store->read(_prefix + key, maxAge, data, meta) )
+            return ReadResult();
+
+        osg::ref_ptr<osg::Object> result;
+        if ( EncodedRecord::isEncoded(data) )
+        {
+            osg::ref_ptr<osg::Object> obj = EncodedRecord::decode( data, _rwOptions.get() );
+            result = obj.get();
+        }
+        else
+        {
+            std::istringstream buf( data );
+            osgDB::ReaderWriter::ReadResult r = _rw->readObject( buf, _rwOptions.get() );
+            if ( r.success() )
+                result = r.getObject();
+        }
+
+        if ( !result.valid() )
+            return ReadResult();
+
+        Config conf;
+        if ( !meta.empty() )
+            conf.fromJSON( meta );
+
+        return ReadResult( result.get(), conf );
+    }
+
+    ReadResult
+    PackedCacheBin::readString(const std::string& key, double maxAge)
+    {
+        ReadResult r = readObject(key, maxAge);
+        return r.succeeded() && r.get<StringObject>() ? r : ReadResult();
+    }
+
+    bool
+    PackedCacheBin::write( const std::string& key, const osg::Object* object, const Config& meta )
+    {
+        if ( !_ok || !object ) return false;
+
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult r;
+
+        if ( dynamic_cast<const osg::Image*>(object) )
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, _rwOptions.get() );
+        else if ( dynamic_cast<const osg::Node*>(object) )
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, _rwOptions.get() );
+        else
+            r = _rw->writeObject( *object, buf, _rwOptions.get() );
+
+        bool ok = r.success() && _store->write( _prefix + key, buf.str(), meta.empty() ? std::string() : meta.toJSON() );
+
+        if ( ok )
+        {
+            OE_DEBUG << LC << "Wrote \"" << key << "\" to cache bin " << getID() << std::endl;
+        }
+        else
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
+        }
+
+        return ok;
+    }
+
+    bool
+    PackedCacheBin::writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta )
+    {
+        if ( !_ok ) return false;
+
+        bool ok = _store->write( _prefix + key, EncodedRecord::wrap(format, bytes), meta.empty() ? std::string() : meta.toJSON() );
+
+        if ( ok )
+        {
+            OE_DEBUG << LC << "Wrote \"" << key << "\" (" << format << ") to cache bin " << getID() << std::endl;
+        }
+        else
+        {
+            OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID() << std::endl;
+        }
+
+        return ok;
+    }
+
+    bool
+    PackedCacheBin::isCached( const std::string& key, double maxAge )
+    {
+        if ( !_ok ) return false;
+        return _store->exists( _prefix + key, maxAge );
+    }
+
+    bool
+    PackedCacheBin::purge()
+    {
+        if ( !_ok ) return false;
+        _store->removePrefix( _prefix );
+        return true;
+    }
+
+    Config
+    PackedCacheBin::readMetadata()
+    {
+        if ( !_ok ) return Config();
+
+        std::string data, meta;
+        Config conf;
+        if ( _store->read(getID(), DBL_MAX, data, meta) )
+            conf.fromJSON( data );
+
+        return conf;
+    }
+
+    bool
+    PackedCacheBin::writeMetadata( const Config& conf )
+    {
+        if ( !_ok ) return false;
+        return _store->write( getID(), conf.toJSON(true), std::string() );
+    }
+}
+
+//------------------------------------------------------------------------
+
+/**
+ * Cache driver that packs records into append-only segment files rather
+ * than writing one file per record.
+ */
+class PackedCacheDriver : public CacheDriver
+{
+public:
+    PackedCacheDriver()
+    {
+        supportsExtension( "osgearth_cache_packed", "Packed file cache for osgEarth" );
+    }
+
+    virtual const char* className()
+    {
+        return "Packed file cache for osgEarth";
+    }
+
+    virtual ReadResult readObject(const std::string& file_name, const Options* options) const
+    {
+        if ( !acceptsExtension(osgDB::getLowerCaseFileExtension( file_name )))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        return ReadResult( new PackedCache( getCacheOptions(options) ) );
+    }
+};
+
+REGISTER_OSGPLUGIN(osgearth_cache_packed, PackedCacheDriver)
@@ -17,1748 +17,1128 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "Sqlite3CacheOptions"
-
-#include <osgEarth/FileUtils>
-#include <osgEarth/TaskService>
+#include <osgEarth/Cache>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/URI>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
-#include <osgDB/ReaderWriter>
-#if OSG_MIN_VERSION_REQUIRED(2,9,5)
-#  include <osgDB/Options>
-#endif
-#include <OpenThreads/Mutex>
-#include <OpenThreads/ScopedLock>
-#include <cstring>
-#include <fstream>
-
-// for the compressor stuff
-#if OSG_MIN_VERSION_REQUIRED(2,9,8)
-#  define USE_SERIALIZERS
-#  include <osgDB/Serializer>
-#endif
+#include <osgDB/Registry>
+#include <OpenThreads/Condition>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <set>
+#include <vector>
+#include <time.h>
 
 #include <sqlite3.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
-using namespace OpenThreads;
+using namespace osgEarth::Threading;
 
 #define LC "[Sqlite3Cache] "
 
-#define USE_TRANSACTIONS
-#define USE_L2_CACHE
+// number of rows to evict per transaction
+#define EVICTION_BATCH_SIZE 64
+
+// max seconds between access-time updates, regardless of batch size
+#define ACCESS_TIME_FLUSH_INTERVAL 10
 
-//#define SPLIT_DB_FILE
-//#define SPLIT_LAYER_DB
-#define UPDATE_ACCESS_TIMES
-#define UPDATE_ACCESS_TIMES_POOL
-#define MAX_REQUEST_TO_RUN_PURGE 100
+namespace
+{
+    /** Quotes an SQL identifier. */
+    std::string quote( const std::string& name )
+    {
+        std::string out = "\"";
+        for( std::string::const_iterator i = name.begin(); i != name.end(); ++i )
+        {
+            if ( *i == '"' ) out += '"';
+            out += *i;
+        }
+        return out + "\"";
+    }
 
-#define PURGE_GENERAL
-//#define INSERT_POOL
+    /**
+     * A pooled database connection, along with its prepared statements. It is
+     * leased to one thread at a time. Statements are compiled once and reused
+     * for the life of the connection.
+     */
+    class Connection : public osg::Referenced
+    {
+    public:
+        Connection( const std::string& path, bool serialized, bool wal );
 
-//#define MONITOR_THREAD_HEALTH
+        bool valid() const { return _db != 0L; }
 
-// --------------------------------------------------------------------------
+        sqlite3* db() const { return _db; }
 
-// opens a database connection with default settings.
-static
-sqlite3* openDatabase( const std::string& path, bool serialized )
-{
-    //Try to create the path if it doesn't exist
-    std::string dirPath = osgDB::getFilePath(path);    
+        /** Gets the prepared statement for some SQL, compiling it on first use. */
+        sqlite3_stmt* prepare( const std::string& sql );
 
-    //If the path doesn't currently exist or we can't create the path, don't cache the file
-    if (!osgDB::fileExists(dirPath) && !osgDB::makeDirectory(dirPath))
-    {
-        OE_WARN << LC << "Couldn't create path " << dirPath << std::endl;
-    }
+        /** Runs a statement that takes no parameters. */
+        bool exec( const std::string& sql );
 
-    sqlite3* db = 0L;
+    protected:
+        virtual ~Connection();
 
-    // not sure if SHAREDCACHE is necessary or wise 
-    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
-    flags |= serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX;
+        typedef std::map<std::string, sqlite3_stmt*> StatementCache;
 
-    int rc = sqlite3_open_v2( path.c_str(), &db, flags, 0L );
+        sqlite3*       _db;
+        StatementCache _statements;
+    };
 
-    if ( rc != 0 )
+    /**
+     * Resets a cached statement when it goes out of scope, so that it is ready
+     * for reuse and does not hold a read transaction open.
+     */
+    struct ScopedStatement
     {
-        OE_WARN << LC << "Failed to open cache \"" << path << "\": " << sqlite3_errmsg(db) << std::endl;
-        return 0L;
-    }
+        ScopedStatement( sqlite3_stmt* stmt ) : _stmt(stmt) { }
+        ~ScopedStatement() {
+            if ( _stmt ) {
+                sqlite3_reset( _stmt );
+                sqlite3_clear_bindings( _stmt );
+            }
+        }
+        bool valid() const { return _stmt != 0L; }
+        operator sqlite3_stmt* () const { return _stmt; }
 
-    // make sure that writes actually finish
-    sqlite3_busy_timeout( db, 60000 );
+        sqlite3_stmt* _stmt;
+    };
 
-    return db;
-}
+    /**
+     * Write transaction that rolls back unless it is committed.
+     */
+    struct Transaction
+    {
+        Transaction( Connection* conn ) : _conn(conn) {
+            _active = conn->exec( "BEGIN IMMEDIATE" );
+        }
+        ~Transaction() {
+            if ( _active ) _conn->exec( "ROLLBACK" );
+        }
+        bool active() const { return _active; }
+        bool commit() {
+            if ( !_active ) return false;
+            if ( _conn->exec("COMMIT") ) { _active = false; return true; }
+            return false;
+        }
 
-// --------------------------------------------------------------------------
+        Connection* _conn;
+        bool        _active;
+    };
 
-// a slightly customized Cache class that will support asynchronous writes
-struct AsyncCache : public Cache
-{
-public:
-    AsyncCache(const CacheOptions& options =CacheOptions()): Cache(options) { }
-    virtual void setImageSync(
-        const TileKey& key,
-        const CacheSpec& spec,
-        const osg::Image* image ) =0;
-};
+    class Sqlite3CacheBin;
 
+    /**
+     * The database shared by all the bins of a cache. Leases connections from
+     * a fixed-size pool and keeps a running count of bytes stored in each bin
+     * table, which drives size-based eviction without having to scan the tables.
+     */
+    class Database : public osg::Referenced
+    {
+    public:
+        Database( const std::string& path, const Sqlite3CacheOptions& options );
 
-// --------------------------------------------------------------------------
+        bool valid() const { return _ok; }
 
-struct MetadataRecord
-{
-    std::string   _layerName;
-    std::string   _format;
-    int           _tileSize;
-    osg::ref_ptr<const Profile> _profile;
-    std::string   _compressor;
-};
+        const Sqlite3CacheOptions& getOptions() const { return _options; }
 
-/**
- * This database table holds one record for each cached layer in the database.
- */
-struct MetadataTable
-{
-    MetadataTable() { }
+        /**
+         * Leases a connection: an idle one if there is one, a new one if the pool
+         * is not full, or else the next one returned. Never call this while the
+         * calling thread already holds a lease.
+         */
+        Connection* acquire();
 
-    bool initialize( sqlite3* db )
-    {
-        std::string sql =
-            "CREATE TABLE IF NOT EXISTS metadata ("
-            "layer varchar(255) PRIMARY KEY UNIQUE, "
-            "format varchar(255), "
-            "compressor varchar(64), "
-            "tilesize int, "
-            "srs varchar(1024), "
-            "xmin double, "
-            "ymin double, "
-            "xmax double, "
-            "ymax double, "
-            "tw int, "
-            "th int )";
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
-
-        char* errMsg = 0L;
-        int err = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( err != SQLITE_OK )
-        {
-            OE_WARN << LC << "[Sqlite3Cache] Creating metadata: " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            return false;
-        }
+        /** Returns a leased connection to the pool. */
+        void release( Connection* conn );
 
-        // prep the insert/select statement SQL strings:
-        _insertSQL = 
-            "INSERT OR REPLACE INTO metadata "
-            "(layer,format,compressor,tilesize,srs,xmin,ymin,xmax,ymax,tw,th) "
-            "VALUES (?,?,?,?,?,?,?,?,?,?,?)";
+        /** Registers a bin table in the bins registry. */
+        bool openTable( Connection* conn, const std::string& table );
 
-        _selectSQL =
-            "SELECT layer,format,compressor,tilesize,srs,xmin,ymin,xmax,ymax,tw,th "
-            "FROM metadata WHERE layer = ?";
+        /** Tracks the bin that owns a table, so eviction can flush its access times. */
+        void addBin( const std::string& table, Sqlite3CacheBin* bin );
+        void removeBin( const std::string& table );
 
-        return true;
-    }
+        /** Records a change in the number of bytes stored in a table. */
+        void addBytes( const std::string& table, sqlite3_int64 delta );
 
-    bool store( const MetadataRecord& rec, sqlite3* db )
-    {
-        sqlite3_stmt* insert = 0;
-        int rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+        /** Evicts least recently used records if the cache exceeds its maximum size. */
+        void evictIfNeeded();
 
-        sqlite3_bind_text( insert, 1, rec._layerName.c_str(), -1, 0L );
-        sqlite3_bind_text( insert, 2, rec._format.c_str(), -1, 0L );
-        sqlite3_bind_text( insert, 3, rec._compressor.c_str(), -1, 0L );
-        sqlite3_bind_int ( insert, 4, rec._tileSize );
-        sqlite3_bind_text( insert, 5, rec._profile->getSRS()->getInitString().c_str(), -1, 0L );
-        sqlite3_bind_double( insert, 6, rec._profile->getExtent().xMin() );
-        sqlite3_bind_double( insert, 7, rec._profile->getExtent().yMin() );
-        sqlite3_bind_double( insert, 8, rec._profile->getExtent().xMax() );
-        sqlite3_bind_double( insert, 9, rec._profile->getExtent().yMax() );
-        unsigned int tw, th;
-        rec._profile->getNumTiles( 0, tw, th );
-        sqlite3_bind_int( insert, 10, tw );
-        sqlite3_bind_int( insert, 11, th );
-
-        bool success;
-
-        rc = sqlite3_step(insert);
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "SQL INSERT failed: " << sqlite3_errmsg( db )
-                << "; SQL = " << _insertSQL
-                << std::endl;
-            success = false;
-        }
-        else
-        {
-            OE_DEBUG << LC << "Stored metadata record for \"" << rec._layerName << "\"" << std::endl;
-            success = true;
-        }
+    protected:
+        sqlite3_int64 evict( Connection* conn, const std::string& table, sqlite3_int64 bytesToFree );
 
-        sqlite3_finalize( insert );
-        return success;
-    }
+        std::string                             _path;
+        Sqlite3CacheOptions                     _options;
+        bool                                    _ok;
+
+        OpenThreads::Mutex                      _poolMutex;
+        OpenThreads::Condition                  _poolCond;
+        std::vector< osg::ref_ptr<Connection> > _pool;
+        std::vector<Connection*>                _idle;
+        unsigned                                _maxConnections;
+
+        Threading::Mutex                        _binsMutex;
+        std::map<std::string, Sqlite3CacheBin*> _bins;
+
+        Threading::Mutex                      _sizeMutex;
+        std::map<std::string, sqlite3_int64>  _tableBytes;
+        sqlite3_int64                         _totalBytes;
+        sqlite3_int64                         _maxBytes;
+        bool                                  _evicting;
+    };
+
+    /**
+     * A connection leased from the pool for the life of this object.
+     */
+    struct ConnectionLease
+    {
+        ConnectionLease( Database* db ) : _db(db), _conn(db->acquire()) { }
+        ~ConnectionLease() { if ( _conn ) _db->release( _conn ); }
+        bool valid() const { return _conn != 0L; }
+        Connection* get() const { return _conn; }
+        Connection* operator -> () const { return _conn; }
+        operator Connection* () const { return _conn; }
+
+        Database*   _db;
+        Connection* _conn;
+    };
 
-    bool load( const std::string& key, sqlite3* db, MetadataRecord& output )
+    /**
+     * Cache that stores data in an SQLite database.
+     */
+    class Sqlite3Cache : public Cache
     {
-        bool success = true;
+    public:
+        Sqlite3Cache() { } // unused
+        Sqlite3Cache( const Sqlite3Cache& rhs, const osg::CopyOp& op ) { } // unused
+        META_Object( osgEarth, Sqlite3Cache );
 
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, _selectSQL.c_str(), _selectSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+        Sqlite3Cache( const CacheOptions& options );
 
-        sqlite3_bind_text( select, 1, key.c_str(), -1, 0L );
+    public: // Cache interface
 
-        rc = sqlite3_step( select );
-        if ( rc == SQLITE_ROW ) 
-        {
-            // got a result            
-            output._layerName = (char*)sqlite3_column_text( select, 0 );
-            output._format = (char*)sqlite3_column_text( select, 1 );
-            output._compressor = (char*)sqlite3_column_text( select, 2 );
-            output._tileSize = sqlite3_column_int( select, 3 );
-            ProfileOptions pconf;
-            pconf.srsString() = (char*)sqlite3_column_text( select, 4 );
-            pconf.bounds() = Bounds(
-                sqlite3_column_double( select, 5 ),
-                sqlite3_column_double( select, 6 ),
-                sqlite3_column_double( select, 7 ),
-                sqlite3_column_double( select, 8 ) );
-            pconf.numTilesWideAtLod0() = sqlite3_column_int( select, 9 );
-            pconf.numTilesHighAtLod0() = sqlite3_column_int( select, 10 );
-            output._profile = Profile::create( pconf );
-            success = true;
-        }
-        else
-        {
-            // no result
-            OE_DEBUG << "NO metadata record found for \"" << key << "\"" << std::endl;
-            success = false;
-        }
+        CacheBin* addBin( const std::string& binID );
 
-        sqlite3_finalize( select );
-        return success;
-    }
+        CacheBin* getOrCreateDefaultBin();
 
+        bool acceptsEncoded() const { return true; }
+
+    protected:
+        osg::ref_ptr<Database> _db;
+    };
 
-    bool loadAllLayers( sqlite3* db, std::vector<std::string>& output )
+    /**
+     * Cache bin implementation for a Sqlite3Cache. Each bin is one table.
+     */
+    class Sqlite3CacheBin : public CacheBin
     {
-        bool success = true;
+    public:
+        Sqlite3CacheBin( const std::string& binID, Database* db );
 
-        sqlite3_stmt* select = 0L;
-        std::string selectLayersSQL = "select layer from \"metadata\"";
-        int rc = sqlite3_prepare_v2( db, selectLayersSQL.c_str(), selectLayersSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+    public: // CacheBin interface
 
-        success = true;
-        rc = sqlite3_step( select );
-        while (rc == SQLITE_ROW) {
-            output.push_back((char*)sqlite3_column_text( select, 0 ));
-            rc = sqlite3_step( select );
-        }
+        ReadResult readObject( const std::string& key, double maxAge =DBL_MAX );
 
-        if (rc != SQLITE_DONE)
-        {
-            // no result
-            OE_WARN << "NO layers found in metadata" << std::endl;
-            success = false;
-        }
+        ReadResult readImage( const std::string& key, double maxAge =DBL_MAX );
 
-        sqlite3_finalize( select );
-        return success;
-    }
+        ReadResult readString( const std::string& key, double maxAge =DBL_MAX );
 
-    std::string _insertSQL;
-    std::string _selectSQL;
- };
+        bool write( const std::string& key, const osg::Object* object, const Config& meta );
 
-// --------------------------------------------------------------------------
+        bool writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta );
 
-struct ImageRecord
-{
-    ImageRecord( const TileKey& key ) : _key(key) { }
-    TileKey _key;
-    int _created;
-    int _accessed;
-    osg::ref_ptr<const osg::Image> _image;
-};
+        bool acceptsEncoded() const { return true; }
 
-#ifdef INSERT_POOL
-class Sqlite3Cache;
-struct AsyncInsertPool : public TaskRequest {
-    struct Entry {
-        TileKey _key;
-        osg::ref_ptr<osg::Image> _image;
-        std::string _format;
-        Entry() {}
-        Entry(const TileKey& key, const std::string& format, osg::Image* img) : _key(key), _format(format), _image(img) {}
-    };
+        bool isCached( const std::string& key, double maxAge =DBL_MAX );
 
-    typedef std::map<std::string, Entry> PoolContainer;
+        bool purge();
 
-    AsyncInsertPool(const std::string& layerName, Sqlite3Cache* cache );
+        Config readMetadata();
 
-    void addEntry( const TileKey& key, const std::string& format, osg::Image* image)
-    {
-        const std::string& keyStr = key.str();
-        if (_pool.find(keyStr) != _pool.end())
-            return;
-        _pool[keyStr] = Entry(key, format, image);
-    }
+        bool writeMetadata( const Config& meta );
 
-    osg::Image* findImage(const std::string& key)
-    {
-        PoolContainer::iterator it = _pool.find(key);
-        if (it != _pool.end()) {
-            return it->second._image.get();
-        }
-        return 0;
-    }
+    public:
+        /** Writes the access times of the hits collected so far. */
+        void flushAccessTimes( Connection* conn );
 
-    void operator()( ProgressCallback* progress );
-    
-    PoolContainer _pool;
-    std::string _layerName;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-#endif
+    protected:
+        virtual ~Sqlite3CacheBin();
 
-/**
- * Database table that holds one record per cached imagery tile in a layer. The layer name
- * is the table name.
- */
-struct LayerTable : public osg::Referenced
-{
-    LayerTable( const MetadataRecord& meta, sqlite3* db )
-        : _meta(meta)
-    {        
-        _tableName = "layer_" + _meta._layerName;
-        // create the table and load the processors.
-        if ( ! initialize( db ) )
-        {
-            return;
-        }
+        bool readRecord( const std::string& key, double maxAge, std::string& out_data, Config& out_meta );
 
-        // initialize the SELECT statement for fetching records
-        std::stringstream buf;
-#ifdef SPLIT_DB_FILE
-        buf << "SELECT created,accessed,size FROM \"" << tableName << "\" WHERE key = ?";
-#else
-        buf << "SELECT created,accessed,data FROM \"" << _tableName << "\" WHERE key = ?";
-#endif
-        _selectSQL = buf.str();
-
-        // initialize the UPDATE statement for updating the timestamp of an accessed record
-        buf.str("");
-        buf << "UPDATE \"" << _tableName << "\" SET accessed = ? "
-            << "WHERE key = ?";
-        _updateTimeSQL = buf.str();
-
-        buf.str("");
-        buf << "UPDATE \"" << _tableName << "\" SET accessed = ? "
-            << "WHERE key in ( ? )";
-        _updateTimePoolSQL = buf.str();
-        
-        // initialize the INSERT statement for writing records.
-        buf.str("");
-        buf << "INSERT OR REPLACE INTO \"" << _tableName << "\" "
-#ifdef SPLIT_DB_FILE
-            << "(key,created,accessed,size) VALUES (?,?,?,?)";
-#else
-            << "(key,created,accessed,data) VALUES (?,?,?,?)";
-#endif
-        _insertSQL = buf.str();
-
-        // initialize the DELETE statements for purging old records.
-        buf.str("");
-        buf << "DELETE FROM \"" << _tableName << "\" "
-            << "INDEXED BY \"" << _tableName << "_lruindex\" "
-            << "WHERE accessed < ?";
-        _purgeSQL = buf.str();
-        
-        buf.str("");
-        buf << "DELETE FROM \""  << _tableName << "\" WHERE key in (SELECT key FROM \"" << _tableName << "\" WHERE \"accessed\" < ? limit ?)";
-        _purgeLimitSQL = buf.str();          
-
-        buf.str("");
-        buf << "SELECT key FROM \"" << _tableName << "\" WHERE \"accessed\" < ? limit ?";
-        _purgeSelect = buf.str();
-
-        _statsLoaded = 0;
-        _statsStored = 0;
-        _statsDeleted = 0;
-    }
+        bool writeRecord( const std::string& key, const std::string& data, const Config& meta );
+
+        void touch( const std::string& key );
+
+        void writeAccessTimes( Connection* conn, const std::set<std::string>& keys );
 
+        bool                              _ok;
+        osg::ref_ptr<Database>            _db;
+        std::string                       _table;
+        std::string                       _selectSQL, _existsSQL, _sizeSQL, _insertSQL;
+        std::string                       _touchSQL, _purgeSQL, _binUpdateSQL;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        osg::ref_ptr<osgDB::Options>      _rwOptions;
 
-    sqlite3_int64 getTableSize(sqlite3* db)
+        Threading::Mutex                  _accessMutex;
+        std::set<std::string>             _accessed;
+        ::time_t                          _lastAccessWrite;
+    };
+}
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    Connection::Connection( const std::string& path, bool serialized, bool wal ) :
+    _db( 0L )
     {
-#ifdef SPLIT_DB_FILE
-        std::string query = "select sum(size) from \"" + _tableName + "\";";
-#else
-        std::string query = "select sum(length(data)) from \"" + _tableName + "\";";
-#endif
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, query.c_str(), query.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(db) << std::endl;
-            return -1;
-        }
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+        flags |= serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX;
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW)
+        if ( sqlite3_open_v2( path.c_str(), &_db, flags, 0L ) != SQLITE_OK )
         {
-            OE_WARN << LC << "SQL QUERY failed for " << query << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( select );
-            return -1;
+            OE_WARN << LC << "Failed to open cache \"" << path << "\": " << sqlite3_errmsg(_db) << std::endl;
+            sqlite3_close( _db );
+            _db = 0L;
+            return;
         }
-        sqlite3_int64 size = sqlite3_column_int(select, 0);
-        sqlite3_finalize( select );
-        return size;
-    }
 
-    int getNbEntry(sqlite3* db) {
-        std::string query = "select count(*) from \"" + _tableName + "\";";
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, query.c_str(), query.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(db) << std::endl;
-            return -1;
-        }
+        // make sure that writes actually finish
+        sqlite3_busy_timeout( _db, 60000 );
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW)
+        if ( wal )
         {
-            OE_WARN << LC << "SQL QUERY failed for " << query << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( select );
-            return -1;
+            // readers never block writers (or vice versa) in WAL mode, and with
+            // synchronous=NORMAL a commit does not wait on an fsync.
+            sqlite3_exec( _db, "PRAGMA journal_mode=WAL", 0L, 0L, 0L );
+            sqlite3_exec( _db, "PRAGMA synchronous=NORMAL", 0L, 0L, 0L );
         }
-        int nbItems = sqlite3_column_int(select, 0);
-        sqlite3_finalize( select );
-        return nbItems;
     }
 
-    void checkAndPurgeIfNeeded(sqlite3* db, unsigned int maxSize )
+    Connection::~Connection()
     {
-        int size = getTableSize(db);
-        OE_DEBUG << _meta._layerName <<  std::dec << " : "  << size/1024/1024 << " MB" << std::endl;
-        if (size < 0 || size < 1.2 * maxSize)
-            return;
-            
-        ::time_t t = ::time(0L);
-        int nbElements = getNbEntry(db);
-        float averageSize = size * 1.0 / nbElements;
-        float diffSize = size - maxSize;
-        int maxElementToRemove = static_cast<int>(ceil(diffSize/averageSize));
-        OE_DEBUG << _meta._layerName <<  " try to remove " << std::dec << maxElementToRemove << " / " <<  nbElements << " to save place" << std::endl;
-        purge(t, maxElementToRemove, db);
+        for( StatementCache::iterator i = _statements.begin(); i != _statements.end(); ++i )
+            sqlite3_finalize( i->second );
+        _statements.clear();
+
+        if ( _db )
+            sqlite3_close( _db );
     }
 
-    bool store( const ImageRecord& rec, sqlite3* db )
+    sqlite3_stmt*
+    Connection::prepare( const std::string& sql )
     {
-        displayStats();
+        StatementCache::iterator i = _statements.find( sql );
+        if ( i != _statements.end() )
+            return i->second;
 
-        sqlite3_stmt* insert = 0L;
-        int rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+        sqlite3_stmt* stmt = 0L;
+        if ( sqlite3_prepare_v2( _db, sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
-
-        // bind the key string:
-        std::string keyStr = rec._key.str();
-        sqlite3_bind_text( insert, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        sqlite3_bind_int(  insert, 2, rec._created );
-        sqlite3_bind_int(  insert, 3, rec._accessed );
-
-        // serialize the image:
-#ifdef SPLIT_DB_FILE
-        std::stringstream outStream;
-        _rw->writeImage( *rec._image.get(), outStream, _rwOptions.get() );
-        std::string outBuf = outStream.str();
-        std::string fname = _meta._layerName + "_" + keyStr+".osgb";
-        {
-            std::ofstream file(fname.c_str(), std::ios::out | std::ios::binary);
-            if (file.is_open()) {
-                file.write(outBuf.c_str(), outBuf.length());
-            }
+            OE_WARN << LC << "Error preparing SQL: " << sqlite3_errmsg(_db) << " (SQL: " << sql << ")" << std::endl;
+            return 0L;
         }
-        sqlite3_bind_int( insert, 4, outBuf.length() );
-#else
-        std::stringstream outStream;
-        _rw->writeImage( *rec._image.get(), outStream, _rwOptions.get() );
-        std::string outBuf = outStream.str();
-        sqlite3_bind_blob( insert, 4, outBuf.c_str(), outBuf.length(), SQLITE_STATIC );
-#endif
-
-        // write to the database:
-        rc = sqlite3_step( insert );
 
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "SQL INSERT failed for key " << rec._key.str() << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( insert );
-            return false;
-        }
-        else
-        {
-            OE_DEBUG << LC << "cache INSERT tile " << rec._key.str() << std::endl;
-            sqlite3_finalize( insert );
-            _statsStored++;
-            return true;
-        }
+        _statements[sql] = stmt;
+        return stmt;
     }
 
-#ifdef INSERT_POOL
-    bool beginStore(sqlite3* db, sqlite3_stmt*& insert) 
+    bool
+    Connection::exec( const std::string& sql )
     {
-        int rc;
-        rc = sqlite3_exec( db, "BEGIN TRANSACTION", NULL, NULL, NULL);
-        if (rc != 0) {
-            OE_WARN << LC << "Failed to begin transaction batch of insert for " << _meta._layerName << " "  << sqlite3_errmsg(db) << std::endl;
+        ScopedStatement stmt( prepare(sql) );
+        if ( !stmt.valid() )
             return false;
-        }
 
-        // prepare for multiple inserts
-        rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+        int rc = sqlite3_step( stmt );
+        if ( rc != SQLITE_DONE && rc != SQLITE_ROW )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
+            OE_WARN << LC << "SQL failed: " << sqlite3_errmsg(_db) << " (SQL: " << sql << ")" << std::endl;
             return false;
         }
         return true;
     }
 
-    bool storePool(sqlite3* db, const AsyncInsertPool::PoolContainer& entries, sqlite3_stmt* insert)
-    {
-        ::time_t t = ::time(0L);
-        sqlite3_bind_int(  insert, 2, t );
-        sqlite3_bind_int(  insert, 3, t );
-        int rc;
-        for (AsyncInsertPool::PoolContainer::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-            
-            // bind the key string:
-            std::string keyStr = it->first;
-            sqlite3_bind_text( insert, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-
-            // serialize the image:
-#ifdef SPLIT_DB_FILE
-            std::stringstream outStream;
-            _rw->writeImage( * (it)->second._image.get(), outStream, _rwOptions.get() );
-            std::string outBuf = outStream.str();
-            std::string fname = _meta._layerName + "_" + keyStr+".osgb";
-            {
-                std::ofstream file(fname.c_str(), std::ios::out | std::ios::binary);
-                if (file.is_open()) {
-                    file.write(outBuf.c_str(), outBuf.length());
-                }
-            }
-            sqlite3_bind_int( insert, 4, outBuf.length() );
-#else
-            std::stringstream outStream;
-            _rw->writeImage( * (it)->second._image.get(), outStream, _rwOptions.get() );
-            std::string outBuf = outStream.str();
-            sqlite3_bind_blob( insert, 4, outBuf.c_str(), outBuf.length(), SQLITE_STATIC );
-#endif
-            rc = sqlite3_step(insert);   // executes the INSERT
-            if ( rc != SQLITE_DONE )
-            {
-                OE_WARN << LC << "SQL INSERT failed for key " << keyStr << ": " 
-                        << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                        << ", rc = " << rc << std::endl;
-                sqlite3_finalize(insert); // clean up prepared statement
-                return false;
-            }
-            sqlite3_reset(insert);  // reset the statement 
-        }
-
-        _statsStored += entries.size();
-        return true;
-    }
+    //------------------------------------------------------------------------
 
-    bool endStore(sqlite3* db, sqlite3_stmt* insert)
+    Database::Database( const std::string& path, const Sqlite3CacheOptions& options ) :
+    _path      ( path ),
+    _options   ( options ),
+    _ok        ( false ),
+    _totalBytes( 0 ),
+    _evicting  ( false )
     {
-        int rc = 0;
-        rc = sqlite3_finalize(insert); // clean up prepared statement
-        rc = sqlite3_exec( db, "COMMIT", NULL, NULL, NULL);  // COMMIT all dirty pages at once
-        if (rc != 0) {
-            OE_WARN << LC << "Failed to commit batch of insert for " << _meta._layerName << " "  << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
-        
-        return true;
-    }
-#endif
+        _maxBytes       = (sqlite3_int64)options.maxSize().value() * 1024 * 1024;
+        _maxConnections = std::max( 1u, options.maxConnections().value() );
 
-    bool updateAccessTime( const TileKey& key, int newTimestamp, sqlite3* db )
-    { 
-        sqlite3_stmt* update = 0L;
-        int rc = sqlite3_prepare_v2( db, _updateTimeSQL.c_str(), _updateTimeSQL.length(), &update, 0L );
-        if ( rc != SQLITE_OK )
+        if ( sqlite3_threadsafe() == 0 )
         {
-            OE_WARN << LC << "Failed to prepare SQL " << _updateTimeSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
+            OE_WARN << LC << "SQLite is not compiled in thread-safe mode" << std::endl;
         }
 
-        bool success = true;
-        sqlite3_bind_int( update, 1, newTimestamp );
-        std::string keyStr = key.str();
-        sqlite3_bind_text( update, 2, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        rc = sqlite3_step( update );
-        if ( rc != SQLITE_DONE )
+        std::string dirPath = osgDB::getFilePath( _path );
+        if ( !dirPath.empty() && !osgDB::fileExists(dirPath) && !osgDB::makeDirectory(dirPath) )
         {
-            OE_WARN << LC << "Failed to update timestamp for " << key.str() << " on layer " << _meta._layerName << " rc = " << rc << std::endl;
-            success = false;
+            OE_WARN << LC << "Couldn't create path " << dirPath << std::endl;
         }
 
-        sqlite3_finalize( update );
-        return success;
-    }
+        ConnectionLease conn( this );
+        if ( !conn.valid() )
+            return;
 
-    bool updateAccessTimePool( const std::string&  keyStr, int newTimestamp, sqlite3* db )
-    {
-        //OE_WARN << LC << "update access times " << _meta._layerName << " " << keyStr << std::endl;
-        sqlite3_stmt* update = 0L;
-        int rc = sqlite3_prepare_v2( db, _updateTimePoolSQL.c_str(), _updateTimePoolSQL.length(), &update, 0L );
-        if ( rc != SQLITE_OK )
+        if ( !conn->exec(
+            "CREATE TABLE IF NOT EXISTS bins ("
+            "name TEXT PRIMARY KEY, "
+            "bytes INTEGER, "
+            "count INTEGER, "
+            "meta TEXT )") )
         {
-            OE_WARN << LC << "Failed to prepare SQL " << _updateTimePoolSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
+            return;
         }
 
-        bool success = true;
-        sqlite3_bind_int( update, 1, newTimestamp );
-        sqlite3_bind_text( update, 2, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        rc = sqlite3_step( update );
-        if ( rc != SQLITE_DONE )
+        // the registry keeps the running size of each bin, so we never need to
+        // scan the bins themselves.
         {
-            OE_WARN << LC << "Failed to update timestamp for " << keyStr << " on layer " << _meta._layerName << " rc = " << rc << std::endl;
-            success = false;
+            ScopedStatement select( conn->prepare("SELECT name, bytes FROM bins") );
+            if ( !select.valid() )
+                return;
+
+            while( sqlite3_step(select) == SQLITE_ROW )
+            {
+                std::string   name  = (const char*)sqlite3_column_text( select, 0 );
+                sqlite3_int64 bytes = sqlite3_column_int64( select, 1 );
+                _tableBytes[name] = bytes;
+                _totalBytes += bytes;
+            }
         }
 
-        sqlite3_finalize( update );
-        return success;
+        OE_INFO << LC << "Opened \"" << _path << "\" (" << (_totalBytes/(1024*1024)) << " MB)" << std::endl;
+        _ok = true;
     }
 
-    bool load( const TileKey& key, ImageRecord& output, sqlite3* db )
+    Connection*
+    Database::acquire()
     {
-        displayStats();
-        int imageBufLen = 0;
-        
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, _selectSQL.c_str(), _selectSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _poolMutex );
+        for(;;)
         {
-            OE_WARN << LC << "Failed to prepare SQL: " << _selectSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
+            if ( !_idle.empty() )
+            {
+                Connection* conn = _idle.back();
+                _idle.pop_back();
+                return conn;
+            }
 
-        std::string keyStr = key.str();
-        sqlite3_bind_text( select, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
+            if ( _pool.size() < _maxConnections )
+            {
+                osg::ref_ptr<Connection> conn = new Connection( _path, _options.serialized().value(), _options.writeAheadLog().value() );
+                if ( !conn->valid() )
+                    return 0L;
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW ) // == SQLITE_DONE ) // SQLITE_DONE means "no more rows"
-        {
-            // cache miss
-            OE_DEBUG << LC << "Cache MISS on tile " << key.str() << std::endl;
-            sqlite3_finalize(select);
-            return false;
-        }
+                _pool.push_back( conn.get() );
+                OE_DEBUG << LC << "Opened connection " << _pool.size() << " of " << _maxConnections << std::endl;
+                return conn.get();
+            }
 
-        // copy the timestamps:
-        output._created  = sqlite3_column_int( select, 0 );
-        output._accessed = sqlite3_column_int( select, 1 );
-
-#ifdef SPLIT_DB_FILE
-        std::string fname(keyStr);
-        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( _meta._layerName + "_" +fname+".osgb" );
-#else
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 2 );
-        imageBufLen = sqlite3_column_bytes( select, 2 );
-
-        // deserialize the image from the buffer:
-        std::string imageString( data, imageBufLen );
-        std::stringstream imageBufStream( imageString );
-        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( imageBufStream );
-#endif
-        if ( rr.error() )
-        {
-            OE_WARN << LC << "Failed to read image from database: " << rr.message() << std::endl;
-        }
-        else
-        {
-            output._image = rr.takeImage();
-            output._key = key;
-            OE_DEBUG << LC << "Cache HIT on tile " << key.str() << std::endl;
+            _poolCond.wait( &_poolMutex );
         }
+    }
 
-        sqlite3_finalize(select);
+    void
+    Database::release( Connection* conn )
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _poolMutex );
+        _idle.push_back( conn );
+        _poolCond.signal();
+    }
 
-        _statsLoaded++;
-        return output._image.valid();
+    void
+    Database::addBin( const std::string& table, Sqlite3CacheBin* bin )
+    {
+        ScopedMutexLock lock( _binsMutex );
+        _bins[table] = bin;
     }
 
-    void displayStats()
+    void
+    Database::removeBin( const std::string& table )
     {
-        osg::Timer_t t = osg::Timer::instance()->tick();
-        if (osg::Timer::instance()->delta_s( _statsLastCheck, t) > 10.0) {
-            double d = osg::Timer::instance()->delta_s(_statsStartTimer, t);
-            OE_DEBUG << _meta._layerName << " time " << d << " stored " << std::dec << _statsStored << " rate " << _statsStored * 1.0 / d << std::endl;
-            OE_DEBUG << _meta._layerName << " time " << d << " loaded " << std::dec  << _statsLoaded << " rate " << _statsLoaded * 1.0 / d << std::endl;
-            OE_DEBUG << _meta._layerName << " time " << d << " deleted " << std::dec  << _statsDeleted << " rate " << _statsDeleted * 1.0 / d << std::endl;
-            _statsLastCheck = t;
-        }
+        ScopedMutexLock lock( _binsMutex );
+        _bins.erase( table );
     }
 
-    bool purge( int utcTimeStamp, int maxToRemove, sqlite3* db )
+    bool
+    Database::openTable( Connection* conn, const std::string& table )
     {
-        if ( maxToRemove < 0 )
+        ScopedStatement insert( conn->prepare("INSERT OR IGNORE INTO bins (name, bytes, count) VALUES (?, 0, 0)") );
+        if ( !insert.valid() )
             return false;
 
-        sqlite3_stmt* purge = 0L;
-        
-        int rc;
-        {
-#ifdef SPLIT_DB_FILE
-            {
-                std::vector<std::string> deleteFiles;
-                sqlite3_stmt* selectPurge = 0L;
-                rc = sqlite3_prepare_v2( db, _purgeSelect.c_str(), _purgeSelect.length(), &selectPurge, 0L);
-                if ( rc != SQLITE_OK )
-                {
-                    OE_WARN << LC << "Failed to prepare SQL: " << _purgeSelect << "; " << sqlite3_errmsg(db) << std::endl;
-                    return false;
-                }
-                sqlite3_bind_int( selectPurge, 2, maxToRemove );
-                sqlite3_bind_int( selectPurge, 1, utcTimeStamp );
-
-                rc = sqlite3_step( selectPurge );
-                if ( rc != SQLITE_ROW && rc != SQLITE_DONE)
-                {
-                    OE_WARN << LC << "SQL QUERY failed for " << _purgeSelect << ": " 
-                            << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                            << ", rc = " << rc << std::endl;
-                    sqlite3_finalize( selectPurge );
-                    return false;
-                }
-                while (rc == SQLITE_ROW) {
-                    std::string f((const char*)sqlite3_column_text( selectPurge, 0 ));
-                    deleteFiles.push_back(f);
-                    rc = sqlite3_step( selectPurge );
-                }
-                if (rc != SQLITE_DONE) {
-                    OE_WARN << LC << "SQL QUERY failed for " << _purgeSelect << ": " 
-                            << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                            << ", rc = " << rc << std::endl;
-                    sqlite3_finalize( selectPurge );
-                    return false;
-                }
-                sqlite3_finalize( selectPurge );
-                while (!deleteFiles.empty()) {
-                    std::string fname = _meta._layerName + "_" + deleteFiles.back() +".osgb";
-                    int run = unlink(fname.c_str());
-                    if (run) {
-                        OE_WARN << "Error while removing file " << fname << std::endl;
-                    }
-                    deleteFiles.pop_back();
-                }
-            }
-#endif
-            rc = sqlite3_prepare_v2( db, _purgeLimitSQL.c_str(), _purgeLimitSQL.length(), &purge, 0L );
-            if ( rc != SQLITE_OK )
-            {
-                OE_WARN << LC << "Failed to prepare SQL: " << _purgeLimitSQL << "; " << sqlite3_errmsg(db) << std::endl;
-                return false;
-            }
-            sqlite3_bind_int( purge, 2, maxToRemove );
-        }
-
-        sqlite3_bind_int( purge, 1, utcTimeStamp );
-
-        rc = sqlite3_step( purge );
-        if ( rc != SQLITE_DONE )
+        sqlite3_bind_text( insert, 1, table.c_str(), table.length(), SQLITE_STATIC );
+        if ( sqlite3_step(insert) != SQLITE_DONE )
         {
-            // cache miss
-            OE_DEBUG << LC << "Error purging records from \"" << _meta._layerName << "\"; " << sqlite3_errmsg(db) << std::endl;
-            sqlite3_finalize(purge);
+            OE_WARN << LC << "Failed to register table " << table << ": " << sqlite3_errmsg(conn->db()) << std::endl;
             return false;
         }
 
-        sqlite3_finalize(purge);
-        _statsDeleted += maxToRemove;
+        ScopedMutexLock lock( _sizeMutex );
+        if ( _tableBytes.find(table) == _tableBytes.end() )
+            _tableBytes[table] = 0;
+
         return true;
     }
 
-    /** Initializes the layer by creating the layer's table (if necessary), loading the
-        appropriate reader-writer for the image data, and initializing the compressor
-        if necessary. */
-    bool initialize( sqlite3* db )
+    void
+    Database::addBytes( const std::string& table, sqlite3_int64 delta )
     {
-        // first create the table if it does not already exist:
-        std::stringstream buf;
-        buf << "CREATE TABLE IF NOT EXISTS \"" << _tableName << "\" ("
-            << "key char(64) PRIMARY KEY UNIQUE, "
-            << "created int, "
-            << "accessed int, "
-#ifdef SPLIT_DB_FILE
-            << "size int )";
-#else
-            << "data blob )";
-#endif
-        std::string sql = buf.str();
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
+        ScopedMutexLock lock( _sizeMutex );
+        _tableBytes[table] += delta;
+        _totalBytes += delta;
+    }
 
-        char* errMsg = 0L;
-        int rc = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( rc != SQLITE_OK )
+    void
+    Database::evictIfNeeded()
+    {
+        std::map<std::string, sqlite3_int64> tables;
+        sqlite3_int64 total, toFree;
         {
-            OE_WARN << LC << "Creating layer \"" << _meta._layerName << "\": " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            return false;
-        }
-
-        // create an index on the time-last-accessed column
-        buf.str("");
-        buf << "CREATE INDEX IF NOT EXISTS \"" 
-            << _tableName << "_lruindex\" "
-            << "ON \"" << _tableName << "\" (accessed)";
-        sql = buf.str();
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
+            ScopedMutexLock lock( _sizeMutex );
+            if ( _maxBytes == 0 || _totalBytes <= _maxBytes || _evicting )
+                return;
 
-        rc = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Creating index for layer \"" << _meta._layerName << "\": " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            //return false;
+            // free a little extra so we don't come right back here on the next write.
+            _evicting = true;
+            tables    = _tableBytes;
+            total     = _totalBytes;
+            toFree    = _totalBytes - (_maxBytes - _maxBytes/10);
         }
 
-        // next load the appropriate ReaderWriter:
-
-#if OSG_MIN_VERSION_REQUIRED(2,9,5)
-        _rw = osgDB::Registry::instance()->getReaderWriterForMimeType( _meta._format );
-        if ( !_rw.valid() )
-#endif
-            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( _meta._format );
-        if ( !_rw.valid() )
+        ConnectionLease conn( this );
+        if ( conn.valid() )
         {
-            OE_WARN << LC << "Creating layer: Cannot initialize ReaderWriter for format \"" 
-                << _meta._format << "\"" << std::endl;
-            return false;
-        }
+            // take from each bin in proportion to its size.
+            sqlite3_int64 freed = 0;
+            for( std::map<std::string, sqlite3_int64>::const_iterator i = tables.begin(); i != tables.end(); ++i )
+            {
+                if ( i->second > 0 )
+                {
+                    sqlite3_int64 share = (sqlite3_int64)ceil( (double)toFree * (double)i->second / (double)total );
+                    freed += evict( conn, i->first, share );
+                }
+            }
 
-        if ( !_meta._compressor.empty() )
-            _rwOptions = new osgDB::ReaderWriter::Options( "Compressor=" + _meta._compressor );
+            OE_DEBUG << LC << "Evicted " << (freed/1024) << " KB" << std::endl;
+        }
 
-        _statsLastCheck = _statsStartTimer = osg::Timer::instance()->tick();
-        return true;
+        ScopedMutexLock lock( _sizeMutex );
+        _evicting = false;
     }
 
-    std::string _selectSQL;
-    std::string _insertSQL;
-    std::string _updateTimeSQL;
-    std::string _updateTimePoolSQL;
- 
-    std::string _purgeSelect;
-    std::string _purgeSQL;
-    std::string _purgeLimitSQL;
-    MetadataRecord _meta;
-    std::string _tableName;
+    sqlite3_int64
+    Database::evict( Connection* conn, const std::string& table, sqlite3_int64 bytesToFree )
+    {
+        std::string selectSQL = Stringify()
+            << "SELECT key, size FROM " << quote(table) << " ORDER BY accessed LIMIT " << EVICTION_BATCH_SIZE;
+        std::string deleteSQL = "DELETE FROM " + quote(table) + " WHERE key = ?";
+        std::string updateSQL = "UPDATE bins SET bytes = bytes - ?, count = count - ? WHERE name = ?";
 
-    osg::ref_ptr<osgDB::ReaderWriter> _rw;
-    osg::ref_ptr<osgDB::ReaderWriter::Options> _rwOptions;
+        // hits the bin hasn't written yet would leave their records looking
+        // older than they are, so write them before choosing victims.
+        {
+            ScopedMutexLock lock( _binsMutex );
+            std::map<std::string, Sqlite3CacheBin*>::iterator bin = _bins.find( table );
+            if ( bin != _bins.end() )
+                bin->second->flushAccessTimes( conn );
+        }
 
-    osg::Timer_t _statsStartTimer;
-    osg::Timer_t _statsLastCheck;
+        sqlite3_int64 freed = 0;
 
-    int _statsLoaded;
-    int _statsStored;
-    int _statsDeleted;
+        while( freed < bytesToFree )
+        {
+            Transaction tx( conn );
+            if ( !tx.active() )
+                break;
 
-};
+            // find the least recently used records:
+            std::vector< std::pair<std::string, sqlite3_int64> > victims;
+            {
+                ScopedStatement select( conn->prepare(selectSQL) );
+                if ( !select.valid() )
+                    break;
 
-// --------------------------------------------------------------------------
+                while( sqlite3_step(select) == SQLITE_ROW )
+                {
+                    victims.push_back( std::make_pair(
+                        std::string((const char*)sqlite3_column_text(select, 0)),
+                        sqlite3_column_int64(select, 1)) );
+                }
+            }
 
-typedef std::map<std::string,osg::ref_ptr<LayerTable> > LayerTablesByName;
+            if ( victims.empty() )
+                break;
 
-// --------------------------------------------------------------------------
+            sqlite3_int64 bytes = 0;
+            int           count = 0;
+            for( unsigned i = 0; i < victims.size(); ++i )
+            {
+                ScopedStatement del( conn->prepare(deleteSQL) );
+                if ( !del.valid() )
+                    break;
 
-//TODO: might want to move this up out of this plugin at some point.
+                sqlite3_bind_text( del, 1, victims[i].first.c_str(), victims[i].first.length(), SQLITE_STATIC );
+                if ( sqlite3_step(del) == SQLITE_DONE && sqlite3_changes(conn->db()) > 0 )
+                {
+                    bytes += victims[i].second;
+                    ++count;
+                }
+            }
 
-struct AsyncPurge : public TaskRequest {
-    AsyncPurge( const std::string& layerName, int olderThanUTC, Cache* cache )
-        : _layerName(layerName), _olderThanUTC(olderThanUTC), _cache(cache) { }
+            {
+                ScopedStatement update( conn->prepare(updateSQL) );
+                if ( !update.valid() )
+                    break;
+
+                sqlite3_bind_int64( update, 1, bytes );
+                sqlite3_bind_int  ( update, 2, count );
+                sqlite3_bind_text ( update, 3, table.c_str(), table.length(), SQLITE_STATIC );
+                if ( sqlite3_step(update) != SQLITE_DONE )
+                    break;
+            }
 
-    void operator()( ProgressCallback* progress ) { 
-        osg::ref_ptr<Cache> cache = _cache.get();
-        if ( cache.valid() )
-            cache->purge( _layerName, _olderThanUTC, false );
-    }
+            if ( !tx.commit() )
+                break;
 
-    std::string _layerName;
-    int _olderThanUTC;
-    osg::observer_ptr<Cache> _cache;
-};
+            addBytes( table, -bytes );
+            freed += bytes;
 
-struct AsyncInsert : public TaskRequest {
-    AsyncInsert( const TileKey& key, const CacheSpec& spec, const osg::Image* image, AsyncCache* cache )
-        : _cacheSpec(spec), _key(key), _image(image), _cache(cache) { }
+            if ( victims.size() < (unsigned)EVICTION_BATCH_SIZE )
+                break;
+        }
 
-    void operator()( ProgressCallback* progress ) {
-        osg::ref_ptr<AsyncCache> cache = _cache.get();
-        if ( cache.valid() )
-            cache->setImageSync( _key, _cacheSpec, _image.get() );
+        return freed;
     }
+}
 
-    CacheSpec _cacheSpec;
-    TileKey _key;
-    osg::ref_ptr<const osg::Image> _image;
-    osg::observer_ptr<AsyncCache> _cache;
-};
-
-class Sqlite3Cache;
-struct AsyncUpdateAccessTime : public TaskRequest
-{
-    AsyncUpdateAccessTime( const TileKey& key, const std::string& cacheId, int timeStamp, Sqlite3Cache* cache );
-    void operator()( ProgressCallback* progress );
-
-    TileKey _key;
-    std::string _cacheId;
-    int _timeStamp;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-
-
-
-struct AsyncUpdateAccessTimePool : public TaskRequest
-{
-    AsyncUpdateAccessTimePool( const std::string& cacheId, Sqlite3Cache* cache );
-    void addEntry(const TileKey& key, int timeStamp);
-    void addEntryInternal(const TileKey& key);
-
-    void operator()( ProgressCallback* progress );
-    const std::string& getCacheId() { return _cacheId; }
-    int getNbEntry() const { return _keys.size(); }
-    std::map<std::string, int> _keys;
-    std::string _cacheId;
-    std::string _keyStr;
-    int _timeStamp;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-
-
-
-// --------------------------------------------------------------------------
-
-struct ThreadTable {
-    ThreadTable(LayerTable* table, sqlite3* db) : _table(table), _db(db) { }
-    LayerTable* _table;
-    sqlite3* _db;
-};
+//------------------------------------------------------------------------
 
-class Sqlite3Cache : public AsyncCache
+namespace
 {
-public:
-    Sqlite3Cache( const CacheOptions& options ) 
-      : AsyncCache(options), _options(options),  _db(0L)
-    {                
-        if ( _options.path().get().empty() || options.getReferenceURI().empty() )
-            _databasePath = _options.path().get();
-        else
+    Sqlite3Cache::Sqlite3Cache( const CacheOptions& options ) :
+    Cache( options )
+    {
+        Sqlite3CacheOptions sco( options );
+        if ( !sco.path().isSet() || sco.path()->empty() )
         {
-           _databasePath = osgEarth::getFullPath( options.getReferenceURI(), _options.path().get() );
+            OE_WARN << LC << "ILLEGAL: no path set for sqlite3 cache" << std::endl;
+            _ok = false;
+            return;
         }
 
-        
-        setName( "sqlite3" );
-
-        _nbRequest = 0;
-
-        //_settings = dynamic_cast<const Sqlite3CacheOptions*>( options );
-        //if ( !_settings.valid() )
-        //    _settings = new Sqlite3CacheOptions( options );
-
-        OE_INFO << LC << "options: " << _options.getConfig().toString() << std::endl;
-
-        if ( sqlite3_threadsafe() == 0 )
+        std::string path = URI( *sco.path(), options.referrer() ).full();
+        _db = new Database( path, sco );
+        if ( !_db->valid() )
         {
-            OE_WARN << LC << "SQLITE3 IS NOT COMPILED IN THREAD-SAFE MODE" << std::endl;
-            // TODO: something in this unlikely condition
+            OE_WARN << LC << "FAILED to open cache database at \"" << path << "\"" << std::endl;
+            _ok = false;
         }
+    }
 
-        // enabled shared cache mode.
-        //sqlite3_enable_shared_cache( 1 );
-
-#ifdef USE_L2_CACHE
-        _L2cache = new MemCache();
-        _L2cache->setMaxNumTilesInCache( 64 );
-        OE_INFO << LC << "Using L2 memory cache" << std::endl;
-#endif
-        
-        _db = openDatabase( _databasePath, _options.serialized().value() );
+    CacheBin*
+    Sqlite3Cache::addBin( const std::string& name )
+    {
+        if ( !_ok ) return 0L;
+        return _bins.getOrCreate( name, new Sqlite3CacheBin( name, _db.get() ) );
+    }
 
-        if ( _db )
-        {
-            if ( ! _metadata.initialize( _db ) )
-                _db = 0L;
-        }
+    CacheBin*
+    Sqlite3Cache::getOrCreateDefaultBin()
+    {
+        if ( !_ok ) return 0L;
 
-        if ( _db && _options.asyncWrites() == true )
+        static Threading::Mutex s_defaultBinMutex;
+        if ( !_defaultBin.valid() )
         {
-            _writeService = new osgEarth::TaskService( "Sqlite3Cache Write Service", 1 );
-        }
-
-        
-        if (!_metadata.loadAllLayers( _db, _layersList )) {
-            OE_WARN << "can't read layers in meta data" << std::endl;
+            Threading::ScopedMutexLock lock( s_defaultBinMutex );
+            if ( !_defaultBin.valid() ) // double-check
+            {
+                _defaultBin = new Sqlite3CacheBin( "__default", _db.get() );
+            }
         }
-
+        return _defaultBin.get();
     }
 
-    // just here to satisfy the osg::Object requirements
-    Sqlite3Cache() { }
-    Sqlite3Cache( const Sqlite3Cache& rhs, const osg::CopyOp& op ) { }
-    META_Object(osgEarth,Sqlite3Cache);
+    //------------------------------------------------------------------------
 
-public: // Cache interface
-    
-    /**
-     * Gets whether the given TileKey is cached or not
-     */
-    bool isCached( const TileKey& key, const CacheSpec& spec ) const
+    Sqlite3CacheBin::Sqlite3CacheBin( const std::string& binID, Database* db ) :
+    CacheBin        ( binID ),
+    _ok             ( false ),
+    _db             ( db ),
+    _lastAccessWrite( ::time(0L) )
     {
-        // this looks ineffecient, but usually when isCached() is called, getImage() will be
-        // called soon thereafter. And this call will load it into the L2 cache so the subsequent
-        // getImage call will not hit the DB again.
-        osg::ref_ptr<const osg::Image> temp;
-        return const_cast<Sqlite3Cache*>(this)->getImage( key, spec, temp );
-    }
+        _table = "bin_" + binID;
+        std::string table = quote( _table );
 
-    /**
-     * Store the cache profile for the given profile.
-     */
-    virtual void storeProperties( const CacheSpec& spec, const Profile* profile, unsigned int tileSize ) 
-    {
-        if ( !_db ) return;
+        ConnectionLease conn( _db.get() );
+        if ( !conn.valid() )
+            return;
 
-        if ( spec.cacheId().empty() || profile == 0L || spec.format().empty() )
+        bool created =
+            conn->exec(
+                "CREATE TABLE IF NOT EXISTS " + table + " ("
+                "key TEXT PRIMARY KEY, "
+                "created INTEGER, "
+                "accessed INTEGER, "
+                "size INTEGER, "
+                "data BLOB, "
+                "meta TEXT )" ) &&
+            conn->exec(
+                "CREATE INDEX IF NOT EXISTS " + quote(_table + "_lru") + " ON " + table + " (accessed)" );
+
+        if ( !created || !_db->openTable(conn, _table) )
         {
-            OE_WARN << "ILLEGAL: cannot cache a layer without a layer id" << std::endl;
+            OE_WARN << LC << "FAILED to create table for cache bin " << binID << std::endl;
             return;
         }
 
-        ScopedLock<Mutex> lock( _tableListMutex ); // b/c we're using the base db handle
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateMetaDbForThread();
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return;
+        _selectSQL    = "SELECT created, data, meta FROM " + table + " WHERE key = ?";
+        _existsSQL    = "SELECT created FROM " + table + " WHERE key = ?";
+        _sizeSQL      = "SELECT size FROM " + table + " WHERE key = ?";
+        _insertSQL    = "INSERT OR REPLACE INTO " + table + " (key, created, accessed, size, data, meta) VALUES (?, ?, ?, ?, ?, ?)";
+        _touchSQL     = "UPDATE " + table + " SET accessed = ? WHERE key = ?";
+        _purgeSQL     = "DELETE FROM " + table;
+        _binUpdateSQL = "UPDATE bins SET bytes = bytes + ?, count = count + ? WHERE name = ?";
 
-        //OE_INFO << "Storing metadata for layer \"" << layerName << "\"" << std::endl;
-
-        MetadataRecord rec;
-        rec._layerName = spec.cacheId();
-        rec._profile = profile;
-        rec._tileSize = tileSize;
+        _rw = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+        if ( !_rw.valid() )
+        {
+            OE_WARN << LC << "FAILED to load the osgb plugin for cache bin " << binID << std::endl;
+            return;
+        }
 
-#ifdef USE_SERIALIZERS
-        rec._format = "osgb";
-        rec._compressor = "zlib";
-#else
-        rec._format = spec.format();
+        _rwOptions = Registry::instance()->cloneOrCreateOptions();
+#ifdef OSGEARTH_HAVE_ZLIB
+        _rwOptions->setOptionString( "Compressor=zlib" );
 #endif
+        CachePolicy::NO_CACHE.apply(_rwOptions.get());
 
-        _metadata.store( rec, db );
+        OE_INFO << LC << "Initialized cache bin " << binID << std::endl;
+        _db->addBin( _table, this );
+        _ok = true;
     }
 
-    /**
-     * Loads the cache profile for the given layer.
-     */
-    virtual bool loadProperties( 
-        const std::string&           cacheId, 
-        CacheSpec&                   out_spec, 
-        osg::ref_ptr<const Profile>& out_profile,
-        unsigned int&                out_tileSize ) 
+    Sqlite3CacheBin::~Sqlite3CacheBin()
     {
-        if ( !_db ) return 0L;
-
-        ScopedLock<Mutex> lock( _tableListMutex ); // b/c we're using the base db handle
-
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateMetaDbForThread();
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return 0L;
+        if ( !_ok ) return;
 
-        OE_DEBUG << LC << "Loading metadata for layer \"" << cacheId << "\"" << std::endl;
+        _db->removeBin( _table );
 
-        MetadataRecord rec;
-        if ( _metadata.load( cacheId, db, rec ) )
-        {
-            out_spec = CacheSpec( rec._layerName, rec._format );
-            out_tileSize = rec._tileSize;
-            out_profile = rec._profile;
-        }
-        return 0L;
+        ConnectionLease conn( _db.get() );
+        if ( conn.valid() )
+            flushAccessTimes( conn );
     }
 
-    /**
-     * Gets the cached image for the given TileKey
-     */
-    bool getImage( const TileKey& key, const CacheSpec& spec, osg::ref_ptr<const osg::Image>& out_image )
+    bool
+    Sqlite3CacheBin::readRecord(const std::string& key,
+                                double             maxAge,
+                                std::string&       out_data,
+                                Config&            out_meta )
     {
-        if ( !_db ) return false;
-
-        // wait if we are purging the db
-        ScopedLock<Mutex> lock2( _pendingPurgeMutex );
-
-        // first try the L2 cache.
-        if ( _L2cache.valid() )
-        {
-            if ( _L2cache->getImage( key, spec, out_image ) )
-                return true;
-        }
+        if ( !_ok ) return false;
 
-        // next check the deferred-write queue.
-        if ( _options.asyncWrites() == true )
         {
-#ifdef INSERT_POOL
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = layerName;
-            std::map<std::string, osg::ref_ptr<AsyncInsertPool> >::iterator it = _pendingWrites.find(name);
-            if (it != _pendingWrites.end()) {
-                AsyncInsertPool* p = it->second.get();
-                if (p) {
-                    osg::Image* img = p->findImage(key.str());
-                    if (img) {
-                        // todo: update the access time, or let it slide?
-                        OE_DEBUG << LC << "Got key that is write-queued: " << key.str() << std::endl;
-                        return img;
-                    }
-                }
-            }
-#else
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = key.str() + spec.cacheId(); //layerName;
-            std::map<std::string,osg::ref_ptr<AsyncInsert> >::iterator i = _pendingWrites.find(name);
-            if ( i != _pendingWrites.end() )
-            {
-                // todo: update the access time, or let it slide?
-                OE_DEBUG << LC << "Got key that is write-queued: " << key.str() << std::endl;
-                out_image = i->second->_image.get();
-                return out_image.valid();
-                //return i->second->_image.get();
-            }
-#endif
-        }
+            ConnectionLease conn( _db.get() );
+            if ( !conn.valid() ) return false;
 
-        // finally, try to query the database.
-        ThreadTable tt = getTable( spec.cacheId() ); //layerName);
-        if ( tt._table )
-        {
-            ImageRecord rec( key );
-            if (!tt._table->load( key, rec, tt._db ))
+            ScopedStatement select( conn->prepare(_selectSQL) );
+            if ( !select.valid() )
                 return false;
 
-            // load it into the L2 cache
-            out_image = rec._image.release();
-
-            if ( out_image.valid() && _L2cache.valid() )
-                _L2cache->setImage( key, spec, out_image.get() );
-
-#ifdef UPDATE_ACCESS_TIMES
+            sqlite3_bind_text( select, 1, key.c_str(), key.length(), SQLITE_STATIC );
+            if ( sqlite3_step(select) != SQLITE_ROW )
+                return false;
 
-#ifdef UPDATE_ACCESS_TIMES_POOL
-            // update the last-access time
-            int t = (int)::time(0L);
-            {
-                ScopedLock<Mutex> lock( _pendingUpdateMutex );
-                osg::ref_ptr<AsyncUpdateAccessTimePool> pool;
-                std::map<std::string,osg::ref_ptr<AsyncUpdateAccessTimePool> >::iterator i = _pendingUpdates.find( spec.cacheId() ); //layerName);
-                if ( i != _pendingUpdates.end() )
-                {
-                    i->second->addEntry(key, t);
-                    pool = i->second;
-                    OE_DEBUG << LC << "Add key " << key.str() << " to existing layer batch " << spec.name() << std::endl;
-                } else {
-                    pool = new AsyncUpdateAccessTimePool(spec.cacheId(), this);
-                    pool->addEntry(key, t);
-                    _pendingUpdates[spec.cacheId()] = pool.get();
-                    _writeService->add(pool.get());
-                }
-            }
-#else
-            // update the last-access time
-            int t = (int)::time(0L);
-            _writeService->add( new AsyncUpdateAccessTime(  key, layerName, t, this ) );
-#endif
+            if ( maxAge < DBL_MAX && (double)(::time(0L) - sqlite3_column_int64(select, 0)) > maxAge )
+                return false;
 
-#endif // UPDATE_ACCESS_TIMES
+            const char* data = (const char*)sqlite3_column_blob( select, 1 );
+            out_data.assign( data, sqlite3_column_bytes(select, 1) );
 
-            return out_image.valid();
-        }
-        else
-        {
-            OE_DEBUG << LC << "What, no layer table?" << std::endl;
+            const char* meta = (const char*)sqlite3_column_text( select, 2 );
+            if ( meta && *meta )
+                out_meta.fromJSON( meta );
         }
-        return false;
+
+        touch( key );
+        return true;
     }
 
-    /**
-     * Sets the cached image for the given TileKey
-     */
-    void setImage( const TileKey& key, const CacheSpec& spec, const osg::Image* image )
-    {        
-        if ( !_db ) return;
+    ReadResult
+    Sqlite3CacheBin::readImage(const std::string& key, double maxAge)
+    {
+        std::string data;
+        Config      meta;
+        if ( !readRecord(key, maxAge, data, meta) )
+            return ReadResult();
 
-        if ( _options.asyncWrites() == true )
+        osg::ref_ptr<osg::Image> result;
+        if ( EncodedRecord::isEncoded(data) )
         {
-            // the "pending writes" table is here so that we don't try to write data to
-            // the cache more than once when using an asynchronous write service.
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-#ifdef INSERT_POOL
-            std::string name = layerName;
-            std::map<std::string, osg::ref_ptr<AsyncInsertPool> >::iterator it = _pendingWrites.find(name);
-            if ( it == _pendingWrites.end() )
-            {
-                AsyncInsertPool* req = new AsyncInsertPool(layerName, this);
-                req->addEntry(key, format, image);
-                _pendingWrites[name] = req;
-                _writeService->add( req );
-            }
-            else
-            {
-                it->second->addEntry(key, format, image);
-            }
-#else
-            std::string name = key.str() + spec.cacheId();
-            if ( _pendingWrites.find(name) == _pendingWrites.end() )
-            {
-                AsyncInsert* req = new AsyncInsert(key, spec, image, this);
-                _pendingWrites[name] = req;
-                _writeService->add( req );
-            }
-            else
-            {
-                //NOTE: this should probably never happen.
-                OE_WARN << LC << "Tried to setImage; already in queue: " << key.str() << std::endl;
-            }
-#endif
+            osg::ref_ptr<osg::Object> obj = EncodedRecord::decode( data, _rwOptions.get() );
+            result = dynamic_cast<osg::Image*>( obj.get() );
         }
         else
         {
-
-            setImageSync( key, spec, image );
+            std::istringstream buf( data );
+            osgDB::ReaderWriter::ReadResult r = _rw->readImage( buf, _rwOptions.get() );
+            if ( r.success() )
+                result = r.getImage();
         }
+
+        if ( !result.valid() )
+            return ReadResult( ReadResult::RESULT_READER_ERROR );
+
+        return ReadResult( result.get(), meta );
     }
 
-    /**
-     * Purges records from the database.
-     */
-    bool purge( const std::string& layerName, int olderThanUTC, bool async )
+    ReadResult
+    Sqlite3CacheBin::readObject(const std::string& key, double maxAge)
     {
-        if ( !_db ) return false;
+        std::string data;
+        Config      meta;
+        if ( !readRecord(key, maxAge, data, meta) )
+            return ReadResult();
 
-        // purge the L2 cache first:
-        if ( async == true && _options.asyncWrites() == true )
+        osg::ref_ptr<osg::Object> result;
+        if ( EncodedRecord::isEncoded(data) )
         {
-#ifdef PURGE_GENERAL
-            if (!_pendingPurges.empty())
-                return false;
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-            AsyncPurge* req = new AsyncPurge(layerName, olderThanUTC, this);
-            _writeService->add( req);
-            _pendingPurges[layerName] = req;
-#else
-            if (_pendingPurges.find(layerName) != _pendingPurges.end()) {
-                return false;
-            } else {
-                ScopedLock<Mutex> lock( _pendingPurgeMutex );
-                AsyncPurge* req = new AsyncPurge(layerName, olderThanUTC, this);
-                _writeService->add( req);
-                _pendingPurges[layerName] = req;
-            }
-#endif
+            osg::ref_ptr<osg::Object> obj = EncodedRecord::decode( data, _rwOptions.get() );
+            result = obj.get();
         }
         else
         {
-#ifdef PURGE_GENERAL
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-
-            sqlite3_int64 limit = _options.maxSize().value() * 1024 * 1024;
-            std::map<std::string, std::pair<sqlite3_int64,int> > layers;
-            sqlite3_int64 totalSize = 0;
-            for (unsigned int i = 0; i < _layersList.size(); ++i) {
-                ThreadTable tt = getTable( _layersList[i] );
-                if ( tt._table ) {
-                    sqlite3_int64 size = tt._table->getTableSize(tt._db);
-                    layers[_layersList[i] ].first = size;
-                    layers[_layersList[i] ].second = tt._table->getNbEntry(tt._db);
-                    totalSize += size;
-                }
-            }
-            OE_INFO << LC << "SQlite cache size " << totalSize/(1024*1024) << " MB" << std::endl;
-            if (totalSize > 1.2 * limit) {
-                sqlite3_int64 diff = totalSize - limit;
-                for (unsigned int i = 0; i < _layersList.size(); ++i) {
-                    float ratio = layers[_layersList[i] ].first * 1.0 / (float)(totalSize);
-                    int sizeToRemove = (int)floor(ratio * diff);
-                    if (sizeToRemove > 0) {
-                        if (sizeToRemove / 1024 > 1024) {
-                            OE_DEBUG << "Try to remove " << sizeToRemove/(1024*1024) << " MB in " << _layersList[i] << std::endl;
-                        } else {
-                            OE_DEBUG << "Try to remove " << sizeToRemove/1024 << " KB in " << _layersList[i] << std::endl;
-                        }
-
-                        if ( _L2cache.valid() )
-                            _L2cache->purge( _layersList[i], olderThanUTC, async );
-                        ThreadTable tt = getTable(_layersList[i]);
-                        if ( tt._table ) {
-                            float averageSizePerElement = layers[_layersList[i] ].first * 1.0 /layers[_layersList[i] ].second;
-                            int nb = (int)floor(sizeToRemove / averageSizePerElement);
-                            if (nb ) {
-                                OE_DEBUG << "remove " << nb << " / " << layers[_layersList[i] ].second << " elements in " << _layersList[i] << std::endl;
-                                tt._table->purge(olderThanUTC, nb, tt._db);
-                            }
-                        }
-                    }
-                }
-            }
-            _pendingPurges.clear();
-            displayPendingOperations();
-
-#else
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-            if ( _L2cache.valid() )
-                _L2cache->purge( layerName, olderThanUTC, async );
+            std::istringstream buf( data );
+            osgDB::ReaderWriter::ReadResult r = _rw->readObject( buf, _rwOptions.get() );
+            if ( r.success() )
+                result = r.getObject();
+        }
 
-            ThreadTable tt = getTable( layerName );
-            if ( tt._table )
-            {
-                _pendingPurges.erase( layerName );
+        if ( !result.valid() )
+            return ReadResult( ReadResult::RESULT_READER_ERROR );
 
-                unsigned int maxsize = _options.getSize(layerName);
-                tt._table->checkAndPurgeIfNeeded(tt._db, maxsize * 1024 * 1024);
-                displayPendingOperations();
-            }
-#endif
-        }
-        return true;
+        return ReadResult( result.get(), meta );
     }
 
-    /**
-     * updateAccessTime records on the database.
-     */
-    bool updateAccessTimeSync( const std::string& layerName, const TileKey& key, int newTimestamp )
+    ReadResult
+    Sqlite3CacheBin::readString(const std::string& key, double maxAge)
     {
-        if ( !_db ) return false;
-
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
-        {
-            tt._table->updateAccessTime( key, newTimestamp, tt._db );
-        }
-        return true;
+        ReadResult r = readObject(key, maxAge);
+        return r.succeeded() && r.get<StringObject>() ? r : ReadResult();
     }
 
-    /**
-     * updateAccessTime records on the database.
-     */
-    bool updateAccessTimeSyncPool( const std::string& layerName, const std::string& keys, int newTimestamp )
+    bool
+    Sqlite3CacheBin::write( const std::string& key, const osg::Object* object, const Config& meta )
     {
-        if ( !_db ) return false;
+        if ( !_ok || !object ) return false;
 
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
-        {
-            tt._table->updateAccessTimePool( keys, newTimestamp, tt._db );
-        }
+        // serialize outside of the transaction:
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult r;
+        if ( dynamic_cast<const osg::Image*>(object) )
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, _rwOptions.get() );
+        else if ( dynamic_cast<const osg::Node*>(object) )
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, _rwOptions.get() );
+        else
+            r = _rw->writeObject( *object, buf, _rwOptions.get() );
 
+        if ( !r.success() )
         {
-            ScopedLock<Mutex> lock( _pendingUpdateMutex );
-            _pendingUpdates.erase( layerName );
-            displayPendingOperations();
+            OE_WARN << LC << "FAILED to serialize \"" << key << "\" for cache bin " << getID() << std::endl;
+            return false;
         }
-        return true;
-    }
 
-#ifdef INSERT_POOL
-    void setImageSyncPool( AsyncInsertPool* pool, const std::string& layerName)
-    {
-        ScopedLock<Mutex> lock( _pendingWritesMutex );
-        const AsyncInsertPool::PoolContainer& entries = pool->_pool;
-        OE_WARN << "write " << entries.size() << std::endl;
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
-        {
-            sqlite3_stmt* insert;
-            if (!tt._table->beginStore( tt._db, insert )) {
-                return;
-            }
-            if (!tt._table->storePool( tt._db, entries, insert )) {
-                return;
-            }
-            if (!tt._table->endStore( tt._db, insert )) {
-                return;
-            }
-        }
-        _pendingWrites.erase( layerName );
-        displayPendingOperations();
+        return writeRecord( key, buf.str(), meta );
     }
-#endif
-
-private:
 
-    void displayPendingOperations() {
-        if (_pendingWrites.size())
-            OE_DEBUG<< LC << "pending insert " << _pendingWrites.size() << std::endl;
-        if (_pendingUpdates.size())
-            OE_DEBUG << LC << "pending update " << _pendingUpdates.size() << std::endl;
-        if (_pendingPurges.size())
-            OE_DEBUG << LC << "pending purge " << _pendingPurges.size() << std::endl;
-        //OE_INFO << LC << "Pending writes: " << std::dec << _writeService->getNumRequests() << std::endl;
+    bool
+    Sqlite3CacheBin::writeEncoded( const std::string& key, const std::string& format, const std::string& bytes, const Config& meta )
+    {
+        if ( !_ok ) return false;
+        return writeRecord( key, EncodedRecord::wrap(format, bytes), meta );
     }
 
-    void setImageSync( const TileKey& key, const CacheSpec& spec, const osg::Image* image )
+    bool
+    Sqlite3CacheBin::writeRecord( const std::string& key, const std::string& data, const Config& meta )
     {
-        if (_options.maxSize().value() > 0 && _nbRequest > MAX_REQUEST_TO_RUN_PURGE) {
-            int t = (int)::time(0L);
-            purge(spec.cacheId(), t, _options.asyncWrites().value() );
-            _nbRequest = 0;
-        }
-        _nbRequest++;
-
-        ThreadTable tt = getTable( spec.cacheId() );
-        if ( tt._table )
-        {
-            ::time_t t = ::time(0L);
-            ImageRecord rec( key );
-            rec._created = (int)t;
-            rec._accessed = (int)t;
-            rec._image = image;
+        std::string metaStr = meta.empty() ? std::string() : meta.toJSON();
+        int         now     = (int)::time(0L);
 
-            tt._table->store( rec, tt._db );
-        }
-
-        if ( _options.asyncWrites() == true )
+        sqlite3_int64 delta = 0;
+        int           countDelta = 1;
         {
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = key.str() + spec.cacheId();
-            _pendingWrites.erase( name );
-            displayPendingOperations();
-        }
-    }
+            // give the connection back before eviction leases one.
+            ConnectionLease conn( _db.get() );
+            if ( !conn.valid() ) return false;
 
+            Transaction tx( conn );
+            if ( !tx.active() )
+                return false;
 
-#ifdef SPLIT_LAYER_DB
-    sqlite3* getOrCreateDbForThread(const std::string& layer)
-    {
-        sqlite3* db = 0L;
+            // account for the record we're replacing, if any:
+            {
+                ScopedStatement select( conn->prepare(_sizeSQL) );
+                if ( !select.valid() )
+                    return false;
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+                sqlite3_bind_text( select, 1, key.c_str(), key.length(), SQLITE_STATIC );
+                if ( sqlite3_step(select) == SQLITE_ROW )
+                {
+                    delta      = -sqlite3_column_int64( select, 0 );
+                    countDelta = 0;
+                }
+            }
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThreadLayers[layer].find(thread);
-        if ( k == _dbPerThreadLayers[layer].end() )
-        {
-            db = openDatabase( layer + _options.path().value(), _options.serialized().value() );
-            if ( db )
             {
-                _dbPerThreadLayers[layer][thread] = db;
-                OE_INFO << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
+                ScopedStatement insert( conn->prepare(_insertSQL) );
+                if ( !insert.valid() )
+                    return false;
+
+                sqlite3_bind_text ( insert, 1, key.c_str(), key.length(), SQLITE_STATIC );
+                sqlite3_bind_int  ( insert, 2, now );
+                sqlite3_bind_int  ( insert, 3, now );
+                sqlite3_bind_int64( insert, 4, (sqlite3_int64)data.length() );
+                sqlite3_bind_blob ( insert, 5, data.c_str(), data.length(), SQLITE_STATIC );
+                if ( metaStr.empty() )
+                    sqlite3_bind_null( insert, 6 );
+                else
+                    sqlite3_bind_text( insert, 6, metaStr.c_str(), metaStr.length(), SQLITE_STATIC );
+
+                if ( sqlite3_step(insert) != SQLITE_DONE )
+                {
+                    OE_WARN << LC << "FAILED to write \"" << key << "\" to cache bin " << getID()
+                        << ": " << sqlite3_errmsg(conn->db()) << std::endl;
+                    return false;
+                }
             }
-            else
+
+            delta += (sqlite3_int64)data.length();
+
             {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
+                ScopedStatement update( conn->prepare(_binUpdateSQL) );
+                if ( !update.valid() )
+                    return false;
+
+                sqlite3_bind_int64( update, 1, delta );
+                sqlite3_bind_int  ( update, 2, countDelta );
+                sqlite3_bind_text ( update, 3, _table.c_str(), _table.length(), SQLITE_STATIC );
+                if ( sqlite3_step(update) != SQLITE_DONE )
+                    return false;
             }
-        }
-        else
-        {
-            db = k->second;
+
+            if ( !tx.commit() )
+                return false;
         }
 
-        return db;
-    }
+        OE_DEBUG << LC << "Wrote \"" << key << "\" to cache bin " << getID() << std::endl;
 
+        _db->addBytes( _table, delta );
+        _db->evictIfNeeded();
+        return true;
+    }
 
-    sqlite3* getOrCreateMetaDbForThread()
+    bool
+    Sqlite3CacheBin::isCached( const std::string& key, double maxAge )
     {
-        sqlite3* db = 0L;
+        if ( !_ok ) return false;
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+        ConnectionLease conn( _db.get() );
+        if ( !conn.valid() ) return false;
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThreadMeta.find(thread);
-        if ( k == _dbPerThreadMeta.end() )
-        {
-            db = openDatabase( _options.path().value(), _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThreadMeta[thread] = db;
-                OE_INFO << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
-            }
-        }
-        else
-        {
-            db = k->second;
-        }
+        ScopedStatement select( conn->prepare(_existsSQL) );
+        if ( !select.valid() )
+            return false;
 
-        return db;
+        sqlite3_bind_text( select, 1, key.c_str(), key.length(), SQLITE_STATIC );
+        if ( sqlite3_step(select) != SQLITE_ROW )
+            return false;
+
+        return maxAge >= DBL_MAX || (double)(::time(0L) - sqlite3_column_int64(select, 0)) <= maxAge;
     }
 
-#else
-    sqlite3* getOrCreateDbForThread()
+    void
+    Sqlite3CacheBin::touch( const std::string& key )
     {
-        sqlite3* db = 0L;
-
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
-
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThread.find(thread);
-        if ( k == _dbPerThread.end() )
+        // collect hits and write their access times in batches, rather than
+        // issuing a write for every read.
+        std::set<std::string> keys;
         {
-            db = openDatabase( _databasePath, _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThread[thread] = db;
-                OE_DEBUG << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
+            ScopedMutexLock lock( _accessMutex );
+            _accessed.insert( key );
+
+            ::time_t now = ::time(0L);
+            if ( _accessed.size() < _db->getOptions().accessTimeBatchSize().value() &&
+                 now - _lastAccessWrite < ACCESS_TIME_FLUSH_INTERVAL )
             {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
+                return;
             }
+
+            keys.swap( _accessed );
+            _lastAccessWrite = now;
         }
-        else
+
+        ConnectionLease conn( _db.get() );
+        if ( conn.valid() )
+            writeAccessTimes( conn, keys );
+    }
+
+    void
+    Sqlite3CacheBin::flushAccessTimes( Connection* conn )
+    {
+        std::set<std::string> keys;
         {
-            db = k->second;
+            ScopedMutexLock lock( _accessMutex );
+            keys.swap( _accessed );
+            _lastAccessWrite = ::time(0L);
         }
-
-        return db;
+        writeAccessTimes( conn, keys );
     }
-#endif
 
-    // gets the layer table for the specified layer name, creating it if it does
-    // not already exist...
-    ThreadTable getTable( const std::string& tableName )
+    void
+    Sqlite3CacheBin::writeAccessTimes( Connection* conn, const std::set<std::string>& keys )
     {
-        ScopedLock<Mutex> lock( _tableListMutex );
+        if ( !_ok || keys.empty() ) return;
 
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateDbForThread(tableName);
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return ThreadTable( 0L, 0L );
+        Transaction tx( conn );
+        if ( !tx.active() )
+            return;
 
-        LayerTablesByName::iterator i = _tables.find(tableName);
-        if ( i == _tables.end() )
+        int now = (int)::time(0L);
+        for( std::set<std::string>::const_iterator i = keys.begin(); i != keys.end(); ++i )
         {
-            MetadataRecord meta;
-#ifdef SPLIT_LAYER_DB
-            sqlite3* metadb = getOrCreateMetaDbForThread();
-            if ( !_metadata.load( tableName, metadb, meta ) )
-#else
-            if ( !_metadata.load( tableName, db, meta ) )
-#endif
-            {
-                OE_WARN << LC << "Cannot operate on \"" << tableName << "\" because metadata does not exist."
-                    << std::endl;
-                return ThreadTable( 0L, 0L );
-            }
+            ScopedStatement update( conn->prepare(_touchSQL) );
+            if ( !update.valid() )
+                return;
 
-            _tables[tableName] = new LayerTable( meta, db );
-            OE_DEBUG << LC << "New LayerTable for " << tableName << std::endl;
+            sqlite3_bind_int ( update, 1, now );
+            sqlite3_bind_text( update, 2, i->c_str(), i->length(), SQLITE_STATIC );
+            sqlite3_step( update );
         }
-        return ThreadTable( _tables[tableName].get(), db );
-    }
-
-private:
 
-    const Sqlite3CacheOptions _options;
-    //osg::ref_ptr<const Sqlite3CacheOptions> _settings;
-    osg::ref_ptr<osgDB::ReaderWriter> _defaultRW;
-    Mutex             _tableListMutex;
-    MetadataTable     _metadata;
-    LayerTablesByName _tables;
-
-    bool _useAsyncWrites;
-    osg::ref_ptr<TaskService> _writeService;
-    Mutex _pendingWritesMutex;
+        tx.commit();
+    }
 
-#ifdef INSERT_POOL
-    std::map<std::string, osg::ref_ptr<AsyncInsertPool> > _pendingWrites;
-#else
-    std::map<std::string, osg::ref_ptr<AsyncInsert> > _pendingWrites;
-#endif
-    Mutex _pendingUpdateMutex;
-    std::map<std::string, osg::ref_ptr<AsyncUpdateAccessTimePool> > _pendingUpdates;
+    bool
+    Sqlite3CacheBin::purge()
+    {
+        if ( !_ok ) return false;
 
-    Mutex _pendingPurgeMutex;
-    std::map<std::string, osg::ref_ptr<AsyncPurge> > _pendingPurges;
+        ConnectionLease conn( _db.get() );
+        if ( !conn.valid() ) return false;
 
-    sqlite3* _db;
-    std::map<Thread*,sqlite3*> _dbPerThread;
+        {
+            ScopedMutexLock lock( _accessMutex );
+            _accessed.clear();
+        }
 
-    std::map<std::string, std::map<Thread*,sqlite3*> > _dbPerThreadLayers;
-    std::map<Thread*,sqlite3*> _dbPerThreadMeta;
+        sqlite3_int64 bytes = 0;
+        int           count = 0;
+        {
+            Transaction tx( conn );
+            if ( !tx.active() )
+                return false;
 
-    osg::ref_ptr<MemCache> _L2cache;
+            {
+                ScopedStatement select( conn->prepare("SELECT bytes, count FROM bins WHERE name = ?") );
+                if ( !select.valid() )
+                    return false;
 
-    int _count;
-    int _nbRequest;
+                sqlite3_bind_text( select, 1, _table.c_str(), _table.length(), SQLITE_STATIC );
+                if ( sqlite3_step(select) == SQLITE_ROW )
+                {
+                    bytes = sqlite3_column_int64( select, 0 );
+                    count = sqlite3_column_int( select, 1 );
+                }
+            }
 
-    std::vector<std::string> _layersList;
-    std::string _databasePath;
-};
+            if ( !conn->exec(_purgeSQL) )
+                return false;
 
+            {
+                ScopedStatement update( conn->prepare(_binUpdateSQL) );
+                if ( !update.valid() )
+                    return false;
 
+                sqlite3_bind_int64( update, 1, -bytes );
+                sqlite3_bind_int  ( update, 2, -count );
+                sqlite3_bind_text ( update, 3, _table.c_str(), _table.length(), SQLITE_STATIC );
+                if ( sqlite3_step(update) != SQLITE_DONE )
+                    return false;
+            }
 
-AsyncUpdateAccessTime::AsyncUpdateAccessTime( const TileKey& key, const std::string& cacheId, int timeStamp, Sqlite3Cache* cache ) : 
-_key(key), _cacheId(cacheId), _timeStamp(timeStamp), _cache(cache)
-{
-    //nop
-}
+            if ( !tx.commit() )
+                return false;
+        }
 
-void AsyncUpdateAccessTime::operator()( ProgressCallback* progress ) 
-{ 
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        //OE_WARN << "AsyncUpdateAccessTime will process " << _key << std::endl;
-        cache->updateAccessTimeSync( _cacheId, _key , _timeStamp );
+        _db->addBytes( _table, -bytes );
+        return true;
     }
-}
 
+    Config
+    Sqlite3CacheBin::readMetadata()
+    {
+        if ( !_ok ) return Config();
 
-AsyncUpdateAccessTimePool::AsyncUpdateAccessTimePool(const std::string& cacheId, Sqlite3Cache* cache) :
-_cacheId(cacheId), _cache(cache)
-{
-    //nop
-}
+        ConnectionLease conn( _db.get() );
+        if ( !conn.valid() ) return Config();
 
-void AsyncUpdateAccessTimePool::addEntry(const TileKey& key, int timeStamp)
-{
-    unsigned int lod = key.getLevelOfDetail();
-    addEntryInternal(key);
-    if (lod > 0) {
-        TileKey previous = key;
-        for (int i = (int)lod-1; i >= 0; --i) {
-            TileKey ancestor = previous.createAncestorKey(i);
-            if (ancestor.valid())
-                addEntryInternal(ancestor);
-            previous = ancestor;
+        ScopedStatement select( conn->prepare("SELECT meta FROM bins WHERE name = ?") );
+        if ( !select.valid() )
+            return Config();
+
+        Config conf;
+        sqlite3_bind_text( select, 1, _table.c_str(), _table.length(), SQLITE_STATIC );
+        if ( sqlite3_step(select) == SQLITE_ROW )
+        {
+            const char* meta = (const char*)sqlite3_column_text( select, 0 );
+            if ( meta && *meta )
+                conf.fromJSON( meta );
         }
+        return conf;
     }
-    _timeStamp = timeStamp;
-}
 
-void AsyncUpdateAccessTimePool::addEntryInternal(const TileKey& key)
-{
-    const std::string& keyStr = key.str();
-    if (_keys.find(keyStr) == _keys.end()) {
-        _keys[keyStr] = 1;
-        if (_keyStr.empty())
-            _keyStr = keyStr;
-        else
-            _keyStr += ", " + keyStr;
-    }
-}
+    bool
+    Sqlite3CacheBin::writeMetadata( const Config& conf )
+    {
+        if ( !_ok ) return false;
 
-void AsyncUpdateAccessTimePool::operator()( ProgressCallback* progress ) 
-{ 
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        //OE_INFO << "AsyncUpdateAccessTimePool will process " << _keys.size() << std::endl;
-        cache->updateAccessTimeSyncPool( _cacheId, _keyStr , _timeStamp );
-    }
-}
+        ConnectionLease conn( _db.get() );
+        if ( !conn.valid() ) return false;
 
+        ScopedStatement update( conn->prepare("UPDATE bins SET meta = ? WHERE name = ?") );
+        if ( !update.valid() )
+            return false;
 
-#ifdef INSERT_POOL
-AsyncInsertPool::AsyncInsertPool(const std::string& layerName, Sqlite3Cache* cache ) : _layerName(layerName), _cache(cache) { }
-void AsyncInsertPool::operator()( ProgressCallback* progress )
-{
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        cache->setImageSyncPool( this, _layerName );
+        std::string meta = conf.toJSON(true);
+        sqlite3_bind_text( update, 1, meta.c_str(), meta.length(), SQLITE_STATIC );
+        sqlite3_bind_text( update, 2, _table.c_str(), _table.length(), SQLITE_STATIC );
+        return sqlite3_step(update) == SQLITE_DONE;
     }
 }
-#endif
 
 //------------------------------------------------------------------------
 
 /**
- * This driver defers loading of the source data to the appropriate OSG plugin. You
- * must explicity set an override profile when using this driver.
- *
- * For example, use this driver to load a simple jpeg file; then set the profile to
- * tell osgEarth its projection.
+ * Cache driver that stores tiles in an SQLite database.
  */
-class Sqlite3CacheFactory : public CacheDriver
+class Sqlite3CacheDriver : public CacheDriver
 {
 public:
-    Sqlite3CacheFactory()
+    Sqlite3CacheDriver()
     {
         supportsExtension( "osgearth_cache_sqlite3", "Sqlite3 Cache for osgEarth" );
     }
@@ -1777,5 +1157,4 @@ public:
     }
 };
 
-REGISTER_OSGPLUGIN(osgearth_cache_sqlite3, Sqlite3CacheFactory)
-
+REGISTER_OSGPLUGIN(osgearth_cache_sqlite3, Sqlite3CacheDriver)
@@ -0,0 +1,108 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "ParallelKeyNodeFactory"
+
+using namespace osgEarth_engine_quadtree;
+using namespace osgEarth;
+using namespace OpenThreads;
+
+#define LC "[ParallelKeyNodeFactory] "
+
+//--------------------------------------------------------------------------
+
+ParallelKeyNodeFactory::ParallelKeyNodeFactory(TileModelFactory*        modelFactory,
+                                               TileModelCompiler*       modelCompiler,
+                                               TileNodeRegistry*        liveTiles,
+                                               TileNodeRegistry*        deadTiles,
+                                               const QuadTreeTerrainEngineOptions& options,
+                                               const MapInfo&           mapInfo,
+                                               TerrainNode*             terrain,
+                                               UID                      engineUID,
+                                               TaskService*             service ) :
+
+SerialKeyNodeFactory( modelFactory, modelCompiler, liveTiles, deadTiles, options, mapInfo, terrain, engineUID ),
+_service            ( service )
+{
+    //nop
+}
+
+osg::Node*
+ParallelKeyNodeFactory::createNode( const TileKey& parentKey )
+{
+    // without a task service, fall back on serial creation.
+    if ( !_service.valid() )
+        return SerialKeyNodeFactory::createNode( parentKey );
+
+    // An event for synchronizing the completion of all requests:
+    Threading::MultiEvent semaphore;
+
+    // Collect all the tasks that can run in parallel (from all 4 subtiles)
+    osg::ref_ptr<TileModelFactory::Job> jobs[4];
+    unsigned numTasks = 0;
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        jobs[i] = _modelFactory->createJob( parentKey.createChildKey(i), semaphore );
+        numTasks += jobs[i]->_tasks.size();
+    }
+
+    // Set up the sempahore to block for the correct number of tasks:
+    semaphore.reset( numTasks );
+
+    // Run all the tasks in parallel:
+    for( unsigned i = 0; i < 4; ++i )
+        _modelFactory->runJob( jobs[i].get(), _service.get() );
+
+    // Wait for them to complete:
+    semaphore.wait();
+
+    // Now postprocess them.
+    osg::ref_ptr<TileModel> models[4];
+    bool                    realData[4];
+    bool                    lodBlending[4];
+    bool                    tileHasAnyRealData = false;
+
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        _modelFactory->finalizeJob( jobs[i].get(), models[i], realData[i], lodBlending[i] );
+
+        if ( models[i].valid() && realData[i] )
+        {
+            tileHasAnyRealData = true;
+        }
+    }
+
+    osg::Group* root = 0L;
+
+    // assemble the tile.
+    if ( tileHasAnyRealData || _options.minLOD().isSet() || parentKey.getLevelOfDetail() == 0 )
+    {
+        // Now create TileNodes for them and assemble into a tile group.
+        root = new TileNodeGroup();
+
+        for( unsigned i = 0; i < 4; ++i )
+        {
+            if ( models[i].valid() )
+            {
+                addTile( models[i].get(), realData[i], lodBlending[i], root );
+            }
+        }
+    }
+
+    return root;
+}
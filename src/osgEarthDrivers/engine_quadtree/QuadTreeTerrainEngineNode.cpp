@@ -18,6 +18,7 @@
 */
 #include "QuadTreeTerrainEngineNode"
 #include "SerialKeyNodeFactory"
+#include "ParallelKeyNodeFactory"
 #include "TerrainNode"
 #include "TileModelFactory"
 #include "TileModelCompiler"
@@ -181,6 +182,23 @@ QuadTreeTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions&
     // initialize the model factory:
     _tileModelFactory = new TileModelFactory(getMap(), _liveTiles.get(), _terrainOptions );
 
+    // set up a thread pool for parallel tile building, if requested:
+    int numBuildThreads = 0;
+    if ( _terrainOptions.numTileBuildThreads().isSet() )
+    {
+        numBuildThreads = *_terrainOptions.numTileBuildThreads();
+    }
+    else if ( _terrainOptions.loadingPolicy().isSet() &&
+              _terrainOptions.loadingPolicy()->mode() == LoadingPolicy::MODE_PARALLEL )
+    {
+        numBuildThreads = computeLoadingThreads( *_terrainOptions.loadingPolicy() );
+    }
+
+    if ( numBuildThreads > 0 )
+    {
+        _tileService = new TaskService( "QuadTree Tile Builder", numBuildThreads );
+        OE_INFO << LC << "Building tiles in parallel with " << numBuildThreads << " threads" << std::endl;
+    }
 
     // handle an already-established map profile:
     if ( _update_mapf->getProfile() )
@@ -337,15 +355,31 @@ QuadTreeTerrainEngineNode::getKeyNodeFactory()
             _terrainOptions );
 
         // initialize a key node factory.
-        knf = new SerialKeyNodeFactory( 
-            _tileModelFactory.get(),
-            compiler,
-            _liveTiles.get(),
-            _deadTiles.get(),
-            _terrainOptions, 
-            MapInfo( getMap() ),
-            _terrain, 
-            _uid );
+        if ( _tileService.valid() )
+        {
+            knf = new ParallelKeyNodeFactory(
+                _tileModelFactory.get(),
+                compiler,
+                _liveTiles.get(),
+                _deadTiles.get(),
+                _terrainOptions,
+                MapInfo( getMap() ),
+                _terrain,
+                _uid,
+                _tileService.get() );
+        }
+        else
+        {
+            knf = new SerialKeyNodeFactory( 
+                _tileModelFactory.get(),
+                compiler,
+                _liveTiles.get(),
+                _deadTiles.get(),
+                _terrainOptions, 
+                MapInfo( getMap() ),
+                _terrain, 
+                _uid );
+        }
     }
 
     return knf.get();
@@ -39,13 +39,15 @@ namespace
                    ImageLayer*                         layer, 
                    const MapInfo&                      mapInfo,
                    const QuadTreeTerrainEngineOptions& opt, 
-                   TileModel*                          model )
+                   TileModel*                          model,
+                   Threading::Mutex*                   modelMutex =0L )
         {
-            _key      = key;
-            _layer    = layer;
-            _mapInfo  = &mapInfo;
-            _opt      = &opt;
-            _model    = model;
+            _key        = key;
+            _layer      = layer;
+            _mapInfo    = &mapInfo;
+            _opt        = &opt;
+            _model      = model;
+            _modelMutex = modelMutex;
             //_repo     = &repo;
         }
 
@@ -124,20 +126,32 @@ namespace
                     locator = GeoLocator::createForExtent(geoImage.getExtent(), *_mapInfo);
             }
 
-            // add the color layer to the repo.
-            _model->_colorData[_layer->getUID()] = TileModel::ColorData(
+            TileModel::ColorData colorData(
                 _layer,
                 geoImage.getImage(),
                 locator,
                 _key.getLevelOfDetail(),
                 _key,
                 isFallbackData );
+
+            // add the color layer to the repo. Other color tasks may be writing to
+            // the same model in parallel, so lock if necessary.
+            if ( _modelMutex )
+            {
+                Threading::ScopedMutexLock lock( *_modelMutex );
+                _model->_colorData[_layer->getUID()] = colorData;
+            }
+            else
+            {
+                _model->_colorData[_layer->getUID()] = colorData;
+            }
         }
 
-        TileKey        _key;
-        const MapInfo* _mapInfo;
-        ImageLayer*    _layer;
-        TileModel*     _model;
+        TileKey           _key;
+        const MapInfo*    _mapInfo;
+        ImageLayer*       _layer;
+        TileModel*        _model;
+        Threading::Mutex* _modelMutex;
         const QuadTreeTerrainEngineOptions* _opt;
     };
 }
@@ -219,6 +233,18 @@ namespace
 
 //------------------------------------------------------------------------
 
+TileModelFactory::Job::Job(const TileKey& key, const Map* map) :
+_key                ( key ),
+_mapf               ( map, Map::MASKED_TERRAIN_LAYERS ),
+_hasLodBlendedLayers( false )
+{
+    _model = new TileModel();
+    _model->_tileKey = key;
+    _model->_tileLocator = GeoLocator::createForKey( key, _mapf.getMapInfo() );
+}
+
+//------------------------------------------------------------------------
+
 TileModelFactory::TileModelFactory(const Map*                          map, 
                                    TileNodeRegistry*                   liveTiles,
                                    const QuadTreeTerrainEngineOptions& terrainOptions ) :
@@ -279,6 +305,80 @@ TileModelFactory::createTileModel(const TileKey&           key,
     build.init( key, mapf, _terrainOptions, model.get(), _hfCache );
     build.execute();
 
+    finalizeModel( mapf, model, out_model, out_hasRealData, out_hasLodBlendedLayers );
+}
+
+
+TileModelFactory::Job*
+TileModelFactory::createJob( const TileKey& key, Threading::MultiEvent& semaphore )
+{
+    Job* job = new Job( key, _map );
+
+    const MapInfo& mapInfo = job->_mapf.getMapInfo();
+
+    // one task per enabled image layer:
+    for( ImageLayerVector::const_iterator i = job->_mapf.imageLayers().begin(); i != job->_mapf.imageLayers().end(); ++i )
+    {
+        ImageLayer* layer = i->get();
+
+        if ( layer->getEnabled() )
+        {
+            ParallelTask<BuildColorData>* task = new ParallelTask<BuildColorData>( &semaphore );
+            task->init( key, layer, mapInfo, _terrainOptions, job->_model.get(), &job->_modelMutex );
+            task->setPriority( -(float)key.getLevelOfDetail() );
+            job->_tasks.push_back( task );
+
+            if ( layer->getImageLayerOptions().lodBlending() == true )
+            {
+                job->_hasLodBlendedLayers = true;
+            }
+        }
+    }
+
+    // and one for the elevation data. It is the only task that touches the 
+    // model's elevation data, so it requires no lock.
+    ParallelTask<BuildElevationData>* task = new ParallelTask<BuildElevationData>( &semaphore );
+    task->init( key, job->_mapf, _terrainOptions, job->_model.get(), _hfCache.get() );
+    task->setPriority( -(float)key.getLevelOfDetail() );
+    job->_tasks.push_back( task );
+
+    return job;
+}
+
+
+void
+TileModelFactory::runJob( TileModelFactory::Job* job, TaskService* service )
+{
+    for( TaskRequestVector::iterator i = job->_tasks.begin(); i != job->_tasks.end(); ++i )
+        service->add( i->get() );
+}
+
+
+void
+TileModelFactory::finalizeJob(TileModelFactory::Job*   job,
+                              osg::ref_ptr<TileModel>& out_model,
+                              bool&                    out_hasRealData,
+                              bool&                    out_hasLodBlendedLayers )
+{
+    out_hasRealData = false;
+    out_hasLodBlendedLayers = job->_hasLodBlendedLayers;
+
+    finalizeModel( job->_mapf, job->_model, out_model, out_hasRealData, out_hasLodBlendedLayers );
+
+    // the tasks hold pointers into the job; release them.
+    job->_tasks.clear();
+}
+
+
+void
+TileModelFactory::finalizeModel(MapFrame&                mapf,
+                                osg::ref_ptr<TileModel>& model,
+                                osg::ref_ptr<TileModel>& out_model,
+                                bool&                    out_hasRealData,
+                                bool&                    out_hasLodBlendedLayers )
+{
+    const MapInfo& mapInfo = mapf.getMapInfo();
+    const TileKey& key     = model->_tileKey;
 
     // Bail out now if there's no data to be had.
     if ( model->_colorData.size() == 0 && !model->_elevationData.getHFLayer() )
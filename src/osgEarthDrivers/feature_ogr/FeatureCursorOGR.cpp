@@ -20,6 +20,8 @@
 #include <osgEarthFeatures/OgrUtils>
 #include <osgEarthFeatures/Feature>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <gdal.h>
 #include <algorithm>
 
 #define LC "[FeatureCursorOGR] "
@@ -29,13 +31,29 @@
 using namespace osgEarth;
 using namespace osgEarth::Features;
 
+/**
+ * Reads the next chunk of features into the prefetch queue.
+ */
+struct FeatureCursorOGR::ChunkReader
+{
+    ChunkReader() : _cursor(0L) { }
+
+    void execute()
+    {
+        _cursor->readChunk( _cursor->_prefetchQueue );
+    }
+
+    FeatureCursorOGR* _cursor;
+};
+
 
 FeatureCursorOGR::FeatureCursorOGR(OGRDataSourceH           dsHandle,
                                    OGRLayerH                layerHandle,
                                    const FeatureSource*     source,
                                    const FeatureProfile*    profile,
                                    const Symbology::Query&  query,
-                                   const FeatureFilterList& filters ) :
+                                   const FeatureFilterList& filters,
+                                   TaskService*             prefetchService ) :
 _source           ( source ),
 _dsHandle         ( dsHandle ),
 _layerHandle      ( layerHandle ),
@@ -45,8 +63,14 @@ _query            ( query ),
 _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _profile          ( profile ),
-_filters          ( filters )
+_filters          ( filters ),
+_prefetchService  ( prefetchService ),
+_firstFeatureTime ( 0 ),
+_lastFeatureTime  ( 0 ),
+_featuresRead     ( 0 )
 {
+    _startTime = osg::Timer::instance()->tick();
+
     {
         OGR_SCOPED_LOCK;
 
@@ -130,14 +154,64 @@ _filters          ( filters )
         if ( _resultSetHandle )
         {
             OGR_L_ResetReading( _resultSetHandle );
+
+            // all features from the result set share one attribute schema:
+            _schema = OgrUtils::createAttributeSchema( OGR_L_GetLayerDefn( _resultSetHandle ) );
+
+#if GDAL_VERSION_NUM >= 1800
+            // if the query projects the attributes, tell OGR not to read the others.
+            // The schema still lists every field so slot numbers match field indices.
+            if ( query.attributes().size() > 0 )
+            {
+                OGRFeatureDefnH defn = OGR_L_GetLayerDefn( _resultSetHandle );
+
+                std::vector<const char*> ignored;
+                for( int i = 0; i < OGR_FD_GetFieldCount(defn); ++i )
+                {
+                    const char* name = OGR_Fld_GetNameRef( OGR_FD_GetFieldDefn(defn, i) );
+                    bool keep = false;
+                    for( StringVector::const_iterator a = query.attributes().begin(); a != query.attributes().end() && !keep; ++a )
+                        keep = ciEquals( *a, name );
+                    if ( !keep )
+                        ignored.push_back( name );
+                }
+
+                if ( ignored.size() > 0 )
+                {
+                    ignored.push_back( 0L );
+                    if ( OGR_L_SetIgnoredFields( _resultSetHandle, &ignored[0] ) != OGRERR_NONE )
+                    {
+                        OE_DEBUG << LC << "Driver cannot ignore fields; reading all attributes" << std::endl;
+                    }
+                }
+            }
+#endif
         }
     }
 
-    readChunk();
+    // read the first chunk now, and the one after it in the background:
+    readChunk( _queue );
+    startPrefetch();
+    fillQueue();
 }
 
 FeatureCursorOGR::~FeatureCursorOGR()
 {
+    // the prefetch task refers to this cursor; let it finish.
+    if ( _prefetchRequest.valid() )
+        _prefetchDone.wait();
+
+    if ( _featuresRead > 0 )
+    {
+        osg::Timer* t = osg::Timer::instance();
+        double total = t->delta_s( _startTime, _lastFeatureTime );
+        OE_DEBUG << LC
+            << "Read " << _featuresRead << " features; first in "
+            << t->delta_m( _startTime, _firstFeatureTime ) << " ms, "
+            << (total > 0.0 ? (double)_featuresRead / total : 0.0) << " features/s"
+            << std::endl;
+    }
+
     OGR_SCOPED_LOCK;
 
     if ( _nextHandleToQueue )
@@ -150,13 +224,14 @@ FeatureCursorOGR::~FeatureCursorOGR()
         OGR_G_DestroyGeometry( _spatialFilter );
 
     if ( _dsHandle )
-        OGRReleaseDataSource( _dsHandle );
+        OGR_DS_Destroy( _dsHandle );
 }
 
 bool
 FeatureCursorOGR::hasMore() const
 {
-    return _resultSetHandle && ( _queue.size() > 0 || _nextHandleToQueue != 0L );
+    // fillQueue() keeps the queue from running dry while there are features left.
+    return _resultSetHandle && _queue.size() > 0;
 }
 
 Feature*
@@ -165,37 +240,81 @@ FeatureCursorOGR::nextFeature()
     if ( !hasMore() )
         return 0L;
 
-    if ( _queue.size() == 0 && _nextHandleToQueue )
-        readChunk();
-
     // do this in order to hold a reference to the feature we return, so the caller
     // doesn't have to. This lets us avoid requiring the caller to use a ref_ptr when 
     // simply iterating over the cursor, making the cursor move conventient to use.
     _lastFeatureReturned = _queue.front();
     _queue.pop();
 
+    _lastFeatureTime = osg::Timer::instance()->tick();
+    if ( _featuresRead++ == 0 )
+        _firstFeatureTime = _lastFeatureTime;
+
+    if ( _queue.size() == 0 )
+        fillQueue();
+
     return _lastFeatureReturned.get();
 }
 
 
-// reads a chunk of features into a memory cache; do this for performance
-// and to avoid needing the OGR Mutex every time
+// starts reading the next chunk in the background, if there is one.
 void
-FeatureCursorOGR::readChunk()
+FeatureCursorOGR::startPrefetch()
+{
+    if ( _prefetchService.valid() && _nextHandleToQueue )
+    {
+        _prefetchDone.reset();
+
+        ParallelTask<ChunkReader>* request = new ParallelTask<ChunkReader>( &_prefetchDone );
+        request->_cursor = this;
+        _prefetchRequest = request;
+
+        _prefetchService->add( request );
+    }
+}
+
+
+// refills the empty queue from the prefetched chunk (or, without a prefetch 
+// service, by reading one) and starts prefetching the chunk after that. Loops
+// in case a whole chunk was blacklisted.
+void
+FeatureCursorOGR::fillQueue()
+{
+    while( _queue.size() == 0 && (_prefetchRequest.valid() || _nextHandleToQueue) )
+    {
+        if ( _prefetchRequest.valid() )
+        {
+            _prefetchDone.wait();
+            _prefetchRequest = 0L;
+            std::swap( _queue, _prefetchQueue );
+        }
+        else
+        {
+            readChunk( _queue );
+        }
+
+        startPrefetch();
+    }
+}
+
+
+// reads a chunk of features into a memory cache; do this for performance.
+// The cursor owns a private data source handle, so reading from it does
+// not require the global OGR lock.
+void
+FeatureCursorOGR::readChunk( std::queue< osg::ref_ptr<Feature> >& queue )
 {
     if ( !_resultSetHandle )
         return;
     
     FeatureList preProcessList;
-    
-    OGR_SCOPED_LOCK;
 
     if ( _nextHandleToQueue )
     {
-        osg::ref_ptr<Feature> f = OgrUtils::createFeature( _nextHandleToQueue, _profile->getSRS() );
+        osg::ref_ptr<Feature> f = OgrUtils::createFeature( _nextHandleToQueue, _profile->getSRS(), _schema.get() );
         if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
         {
-            _queue.push( f );
+            queue.push( f );
             
             if ( _filters.size() > 0 )
                 preProcessList.push_back( f.release() );
@@ -204,7 +323,7 @@ FeatureCursorOGR::readChunk()
         _nextHandleToQueue = 0L;
     }
 
-    unsigned handlesToQueue = _chunkSize - _queue.size();
+    unsigned handlesToQueue = _chunkSize - queue.size();
     bool resultSetEndReached = false;
 
     for( unsigned i=0; i<handlesToQueue; i++ )
@@ -212,10 +331,10 @@ FeatureCursorOGR::readChunk()
         OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
         if ( handle )
         {
-            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile->getSRS() );
+            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile->getSRS(), _schema.get() );
             if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
             {
-                _queue.push( f );
+                queue.push( f );
 
                 if ( _filters.size() > 0 )
                     preProcessList.push_back( f.release() );
@@ -248,6 +367,6 @@ FeatureCursorOGR::readChunk()
     else
         _nextHandleToQueue = 0L;
 
-    //OE_NOTICE << "read " << _queue.size() << " features ... " << std::endl;
+    //OE_NOTICE << "read " << queue.size() << " features ... " << std::endl;
 }
 
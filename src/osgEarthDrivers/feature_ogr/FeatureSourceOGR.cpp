@@ -19,6 +19,7 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
+#include <osgEarth/TaskService>
 #include <osgEarthFeatures/FeatureSource>
 #include <osgEarthFeatures/Filter>
 #include <osgEarthFeatures/BufferFilter>
@@ -108,6 +109,12 @@ public:
             _options.geometryConfig().isSet() ? parseGeometry( *_options.geometryConfig() ) :
             _options.geometryUrl().isSet()    ? parseGeometryUrl( *_options.geometryUrl(), dbOptions ) :
             0L;
+
+        // cursors read their next chunk of features on this service:
+        if ( *_options.prefetchThreads() > 0 )
+        {
+            _prefetchService = new TaskService( "OGR prefetch", *_options.prefetchThreads() );
+        }
     }
 
     /** Called once at startup to create the profile for this feature set. Successful profile
@@ -284,9 +291,10 @@ public:
             OGR_SCOPED_LOCK;
 
             // Each cursor requires its own DS handle so that multi-threaded access will work.
-            // The cursor impl will dispose of the new DS handle.
+            // The cursor impl will dispose of the new DS handle. Don't use a shared handle;
+            // the cursor reads from it without the global lock.
 
-	        OGRDataSourceH dsHandle = OGROpenShared( _source.c_str(), 0, &_ogrDriverHandle );
+	        OGRDataSourceH dsHandle = OGROpen( _source.c_str(), 0, &_ogrDriverHandle );
 	        if ( dsHandle )
 	        {
                 OGRLayerH layerHandle = OGR_DS_GetLayer( dsHandle, _layerIndex );
@@ -297,7 +305,8 @@ public:
                     this,
                     getFeatureProfile(),
                     query, 
-                    _options.filters() );
+                    _options.filters(),
+                    _prefetchService.get() );
             }
             else
             {
@@ -336,7 +345,7 @@ public:
             {
                 const FeatureProfile* p = getFeatureProfile();
                 const SpatialReference* srs = p ? p->getSRS() : 0L;
-                result = OgrUtils::createFeature( handle, srs );
+                result = OgrUtils::createFeature( handle, srs, _attributeSchema.get() );
                 OGR_F_Destroy( handle );
             }
         }
@@ -359,8 +368,6 @@ public:
         OGRFeatureH feature_handle = OGR_F_Create( OGR_L_GetLayerDefn( _layerHandle ) );
         if ( feature_handle )
         {
-            const AttributeTable& attrs = feature->getAttrs();
-
             // assign the attributes:
             int num_fields = OGR_F_GetFieldCount( feature_handle );
             for( int i=0; i<num_fields; i++ )
@@ -369,19 +376,19 @@ public:
                 std::string name = OGR_Fld_GetNameRef( field_handle_ref );
                 int field_index = OGR_F_GetFieldIndex( feature_handle, name.c_str() );
 
-                AttributeTable::const_iterator a = attrs.find( toLower(name) );
-                if ( a != attrs.end() )
+                const AttributeValue* a = feature->getAttr( name );
+                if ( a )
                 {
                     switch( OGR_Fld_GetType(field_handle_ref) )
                     {
                     case OFTInteger:
-                        OGR_F_SetFieldInteger( feature_handle, field_index, a->second.getInt(0) );
+                        OGR_F_SetFieldInteger( feature_handle, field_index, a->getInt(0) );
                         break;
                     case OFTReal:
-                        OGR_F_SetFieldDouble( feature_handle, field_index, a->second.getDouble(0.0) );
+                        OGR_F_SetFieldDouble( feature_handle, field_index, a->getDouble(0.0) );
                         break;
                     case OFTString:
-                        OGR_F_SetFieldString( feature_handle, field_index, a->second.getString().c_str() );
+                        OGR_F_SetFieldString( feature_handle, field_index, a->getString().c_str() );
                         break;
                     default:break;
                     }
@@ -458,6 +465,9 @@ protected:
             OGRFieldType ogrType = OGR_Fld_GetType( fieldDef );
             _schema[ name ] = OgrUtils::getAttributeType( ogrType );
         }
+
+        // one slot schema for every feature read straight from the layer:
+        _attributeSchema = OgrUtils::createAttributeSchema( layerDef );
     }
 
 
@@ -476,7 +486,9 @@ private:
     bool _needsSync;
     bool _writable;
     FeatureSchema _schema;
+    osg::ref_ptr<AttributeSchema> _attributeSchema;
     Geometry::Type _geometryType;
+    osg::ref_ptr<TaskService> _prefetchService;
 };
 
 
@@ -242,13 +242,16 @@ public:
             FeatureProfile* fp = getFeatureProfile();
             const SpatialReference* srs = fp ? fp->getSRS() : 0L;
 
+            // all the features in the layer share one attribute schema:
+            osg::ref_ptr<AttributeSchema> schema = OgrUtils::createAttributeSchema( OGR_L_GetLayerDefn(layer) );
+
             OGR_L_ResetReading(layer);                                
             OGRFeatureH feat_handle;
             while ((feat_handle = OGR_L_GetNextFeature( layer )) != NULL)
             {
                 if ( feat_handle )
                 {
-                    osg::ref_ptr<Feature> f = OgrUtils::createFeature( feat_handle, srs );
+                    osg::ref_ptr<Feature> f = OgrUtils::createFeature( feat_handle, srs, schema.get() );
                     if ( f.valid() && !isBlacklisted(f->getFID()) )
                     {
                         features.push_back( f.release() );
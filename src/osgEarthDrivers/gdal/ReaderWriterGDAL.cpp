@@ -22,6 +22,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/URI>
+#include <osgEarth/ThreadingUtils>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -617,7 +618,10 @@ public:
       _srcDS(NULL),
       _warpedDS(NULL),
       _options(options),
-      _maxDataLevel(30)
+      _maxDataLevel(30),
+      _requiresWarp(false),
+      _warpPolar(false),
+      _reopenable(false)
     {    
     }
 
@@ -625,6 +629,19 @@ public:
     {                     
         GDAL_SCOPED_LOCK;
 
+        // Close the per-thread handles. The primary handle (_srcDS/_warpedDS)
+        // is never in this list.
+        for( std::vector<DatasetHandle*>::iterator i = _allHandles.begin(); i != _allHandles.end(); ++i )
+        {
+            DatasetHandle* h = *i;
+            if ( h->_warpedDS && h->_warpedDS != h->_srcDS )
+                GDALClose( h->_warpedDS );
+            if ( h->_srcDS )
+                GDALClose( h->_srcDS );
+            delete h;
+        }
+        _allHandles.clear();
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -748,6 +765,7 @@ public:
                         if (_srcDS)
                         {
                             OE_INFO << LC << "Read VRT from cache!" << std::endl;
+                            _srcDSName = result.getString();
                         }
                     }
                 }
@@ -763,6 +781,13 @@ public:
 
                     if (_srcDS)
                     {
+                        // Remember the VRT XML so we can open more handles on it later.
+                        char** vrtXML = _srcDS->GetMetadata( "xml:VRT" );
+                        if ( vrtXML && vrtXML[0] )
+                        {
+                            _srcDSName = vrtXML[0];
+                        }
+
                         //Cache the VRT so we don't have to build it next time.
                         if (_cacheBin)
                         {
@@ -803,6 +828,7 @@ public:
                 //If we couldn't build a VRT, just try opening the file directly
                 //Open the dataset
                 _srcDS = (GDALDataset*)GDALOpen( files[0].c_str(), GA_ReadOnly );
+                _srcDSName = files[0];
 
                 if (_srcDS)
                 {
@@ -820,6 +846,7 @@ public:
                         char *pszSubdatasetName = CPLStrdup( CSLFetchNameValue( subDatasets, buf.str().c_str() ) );
                         GDALClose( _srcDS );
                         _srcDS = (GDALDataset*)GDALOpen( pszSubdatasetName, GA_ReadOnly ) ;
+                        _srcDSName = pszSubdatasetName;
                         CPLFree( pszSubdatasetName );
                     }
                 }
@@ -930,28 +957,12 @@ public:
 
         if ( requiresReprojection || (profile && !profile->getSRS()->isEquivalentTo( src_srs.get() )) )
         {
-            std::string destWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
+            _requiresWarp = true;
+            _warpSrcWKT   = src_srs->getWKT();
+            _warpDestWKT  = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
+            _warpPolar    = profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar());
 
-            if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
-            {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
-            }
-            else
-            {                                
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
-            }
+            _warpedDS = createWarpedDataset( _srcDS );
 
             if ( _warpedDS )
             {
@@ -1073,17 +1084,134 @@ public:
         //Set the profile
         setProfile( profile );
 
+        // The primary handle is available to the reader pool. If we know how to open
+        // the source again, each concurrent reader will get its own handle; otherwise
+        // they share the primary one.
+        _primary._srcDS    = _srcDS;
+        _primary._warpedDS = _warpedDS;
+        _reopenable        = !useExternalDataset && !_srcDSName.empty();
+        if ( _reopenable )
+        {
+            _freeHandles.push_back( &_primary );
+        }
+
         return STATUS_OK;
     }
 
+    /**
+     * Creates the warping VRT that reprojects the source dataset into the
+     * tile source's profile.
+     */
+    GDALDataset* createWarpedDataset( GDALDataset* srcDS )
+    {
+        if ( _warpPolar )
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDestWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else
+        {                                
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                srcDS,
+                _warpSrcWKT.c_str(),
+                _warpDestWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+    }
+
+    /**
+     * Source and warped dataset handles that belong to one reader at a time.
+     * GDAL datasets are not thread-safe, but distinct handles on the same
+     * file are, so each concurrent read leases its own handle.
+     */
+    struct DatasetHandle
+    {
+        DatasetHandle() : _srcDS(NULL), _warpedDS(NULL) { }
+        GDALDataset* _srcDS;
+        GDALDataset* _warpedDS;
+    };
+
+    DatasetHandle* acquireHandle()
+    {
+        if ( !_reopenable )
+        {
+            // one shared handle; readers take turns.
+            _primaryMutex.lock();
+            return &_primary;
+        }
+
+        {
+            Threading::ScopedMutexLock lock( _poolMutex );
+            if ( !_freeHandles.empty() )
+            {
+                DatasetHandle* h = _freeHandles.back();
+                _freeHandles.pop_back();
+                return h;
+            }
+        }
+
+        // no free handles; open a new one. Opening a dataset touches GDAL's
+        // global driver state, so it requires the global lock.
+        GDAL_SCOPED_LOCK;
+
+        DatasetHandle* h = new DatasetHandle();
+        h->_srcDS = (GDALDataset*)GDALOpen( _srcDSName.c_str(), GA_ReadOnly );
+        if ( h->_srcDS )
+        {
+            h->_warpedDS = _requiresWarp ? createWarpedDataset( h->_srcDS ) : h->_srcDS;
+        }
+
+        if ( !h->_warpedDS )
+        {
+            OE_WARN << LC << "Failed to open an additional handle on " << _options.url()->full() << std::endl;
+            if ( h->_srcDS )
+                GDALClose( h->_srcDS );
+            delete h;
+            return 0L;
+        }
+
+        Threading::ScopedMutexLock lock( _poolMutex );
+        _allHandles.push_back( h );
+        OE_DEBUG << LC << "Opened dataset handle #" << (_allHandles.size()+1) << " for " << _options.url()->full() << std::endl;
+        return h;
+    }
+
+    void releaseHandle( DatasetHandle* h )
+    {
+        if ( !_reopenable )
+        {
+            _primaryMutex.unlock();
+        }
+        else
+        {
+            Threading::ScopedMutexLock lock( _poolMutex );
+            _freeHandles.push_back( h );
+        }
+    }
+
+    /** Leases a dataset handle for the lifetime of the object. */
+    struct ScopedHandle
+    {
+        ScopedHandle( GDALTileSource* ts ) : _ts(ts), _h(ts->acquireHandle()) { }
+        ~ScopedHandle() { if ( _h ) _ts->releaseHandle( _h ); }
+        GDALDataset* warped() const { return _h ? _h->_warpedDS : 0L; }
+        GDALTileSource* _ts;
+        DatasetHandle*  _h;
+    };
+
 
     /**
     * Finds a raster band based on color interpretation 
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1093,8 +1221,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1196,7 +1322,11 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // lease a dataset handle for the duration of the read.
+        ScopedHandle handle( this );
+        GDALDataset* warpedDS = handle.warped();
+        if ( !warpedDS )
+            return NULL;
 
         int tileSize = _options.tileSize().value();
 
@@ -1221,11 +1351,11 @@ public:
             int width = int(((xmax - _geotransform[0]) / _geotransform[1]) - off_x);
             int height = int(((ymin - _geotransform[3]) / _geotransform[5]) - off_y);
 
-            if (off_x + width > _warpedDS->GetRasterXSize())
+            if (off_x + width > warpedDS->GetRasterXSize())
             {
-                int oversize_right = off_x + width - _warpedDS->GetRasterXSize();
+                int oversize_right = off_x + width - warpedDS->GetRasterXSize();
                 target_width = target_width - int(float(oversize_right) / width * target_width);
-                width = _warpedDS->GetRasterXSize() - off_x;
+                width = warpedDS->GetRasterXSize() - off_x;
             }
 
             if (off_x < 0)
@@ -1237,11 +1367,11 @@ public:
                 off_x = 0;
             }
 
-            if (off_y + height > _warpedDS->GetRasterYSize())
+            if (off_y + height > warpedDS->GetRasterYSize())
             {
-                int oversize_bottom = off_y + height - _warpedDS->GetRasterYSize();
+                int oversize_bottom = off_y + height - warpedDS->GetRasterYSize();
                 target_height = target_height - (int)osg::round(float(oversize_bottom) / height * target_height);
-                height = _warpedDS->GetRasterYSize() - off_y;
+                height = warpedDS->GetRasterYSize() - off_y;
             }
 
 
@@ -1264,44 +1394,44 @@ public:
 
 
 
-            GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-            GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-            GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-            GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+            GDALRasterBand* bandRed = findBandByColorInterp(warpedDS, GCI_RedBand);
+            GDALRasterBand* bandGreen = findBandByColorInterp(warpedDS, GCI_GreenBand);
+            GDALRasterBand* bandBlue = findBandByColorInterp(warpedDS, GCI_BlueBand);
+            GDALRasterBand* bandAlpha = findBandByColorInterp(warpedDS, GCI_AlphaBand);
 
-            GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+            GDALRasterBand* bandGray = findBandByColorInterp(warpedDS, GCI_GrayIndex);
 
-            GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+            GDALRasterBand* bandPalette = findBandByColorInterp(warpedDS, GCI_PaletteIndex);
 
             if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
             {
                 OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
                 //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
                 //RGB = 3 bands
-                if (_warpedDS->GetRasterCount() == 3)
+                if (warpedDS->GetRasterCount() == 3)
                 {
-                    bandRed   = _warpedDS->GetRasterBand( 1 );
-                    bandGreen = _warpedDS->GetRasterBand( 2 );
-                    bandBlue  = _warpedDS->GetRasterBand( 3 );
+                    bandRed   = warpedDS->GetRasterBand( 1 );
+                    bandGreen = warpedDS->GetRasterBand( 2 );
+                    bandBlue  = warpedDS->GetRasterBand( 3 );
                 }
                 //RGBA = 4 bands
-                else if (_warpedDS->GetRasterCount() == 4)
+                else if (warpedDS->GetRasterCount() == 4)
                 {
-                    bandRed   = _warpedDS->GetRasterBand( 1 );
-                    bandGreen = _warpedDS->GetRasterBand( 2 );
-                    bandBlue  = _warpedDS->GetRasterBand( 3 );
-                    bandAlpha = _warpedDS->GetRasterBand( 4 );
+                    bandRed   = warpedDS->GetRasterBand( 1 );
+                    bandGreen = warpedDS->GetRasterBand( 2 );
+                    bandBlue  = warpedDS->GetRasterBand( 3 );
+                    bandAlpha = warpedDS->GetRasterBand( 4 );
                 }
                 //Gray = 1 band
-                else if (_warpedDS->GetRasterCount() == 1)
+                else if (warpedDS->GetRasterCount() == 1)
                 {
-                    bandGray = _warpedDS->GetRasterBand( 1 );
+                    bandGray = warpedDS->GetRasterBand( 1 );
                 }
                 //Gray + alpha = 2 bands
-                else if (_warpedDS->GetRasterCount() == 2)
+                else if (warpedDS->GetRasterCount() == 2)
                 {
-                    bandGray  = _warpedDS->GetRasterBand( 1 );
-                    bandAlpha = _warpedDS->GetRasterBand( 2 );
+                    bandGray  = warpedDS->GetRasterBand( 1 );
+                    bandAlpha = warpedDS->GetRasterBand( 2 );
                 }
             }
 
@@ -1530,8 +1660,6 @@ public:
 
     bool isValidValue(float v, GDALRasterBand* band)
     {
-        GDAL_SCOPED_LOCK;
-
         float bandNoData = -32767.0f;
         int success;
         float value = band->GetNoDataValue(&success);
@@ -1557,7 +1685,70 @@ public:
     }
 
 
+    /** Reads single pixels directly from a raster band. */
+    struct BandPixelReader
+    {
+        BandPixelReader(GDALRasterBand* band) : _band(band) { }
+
+        float operator()(int col, int row) const
+        {
+            float value;
+            _band->RasterIO(GF_Read, col, row, 1, 1, &value, 1, 1, GDT_Float32, 0, 0);
+            return value;
+        }
+
+        GDALRasterBand* _band;
+    };
+
+    /**
+     * Reads pixels from a window of a raster band that was read into memory
+     * with a single RasterIO call. If the buffer is smaller than the window,
+     * GDAL decimates the window into it (using overviews if there are any) and
+     * each pixel maps to the buffer cell that covers it. Pixels outside the
+     * window fall through to the band.
+     */
+    struct WindowPixelReader
+    {
+        WindowPixelReader(GDALRasterBand* band, int x0, int y0, int width, int height, int bufWidth, int bufHeight) :
+            _band(band), _x0(x0), _y0(y0), _width(width), _height(height), _bufWidth(bufWidth), _bufHeight(bufHeight), _ok(false)
+        {
+            _data.resize(bufWidth * bufHeight);
+            _ok = band->RasterIO(GF_Read, x0, y0, width, height, &_data[0], bufWidth, bufHeight, GDT_Float32, 0, 0) == CE_None;
+        }
+
+        bool valid() const { return _ok; }
+
+        float operator()(int col, int row) const
+        {
+            int c = col - _x0, r = row - _y0;
+            if ( c >= 0 && c < _width && r >= 0 && r < _height )
+            {
+                if ( _bufWidth != _width )
+                    c = osg::minimum( (int)(((double)c * (double)_bufWidth) / (double)_width), _bufWidth-1 );
+                if ( _bufHeight != _height )
+                    r = osg::minimum( (int)(((double)r * (double)_bufHeight) / (double)_height), _bufHeight-1 );
+                return _data[r * _bufWidth + c];
+            }
+
+            float value;
+            _band->RasterIO(GF_Read, col, row, 1, 1, &value, 1, 1, GDT_Float32, 0, 0);
+            return value;
+        }
+
+        GDALRasterBand*    _band;
+        int                _x0, _y0, _width, _height;
+        int                _bufWidth, _bufHeight;
+        bool               _ok;
+        std::vector<float> _data;
+    };
+
     float getInterpolatedValue(GDALRasterBand *band, double x, double y, bool applyOffset=true)
+    {
+        return interpolate(band, BandPixelReader(band), x, y, applyOffset);
+    }
+
+    template<typename PixelReader>
+    float interpolate(GDALRasterBand *band, const PixelReader& read, double x, double y, bool applyOffset)
     {
         double r, c;
         GDALApplyGeoTransform(_invtransform, x, y, &c, &r);
@@ -1566,8 +1757,8 @@ public:
         double eps = 0.0001;
         if (osg::equivalent(c, 0, eps)) c = 0;
         if (osg::equivalent(r, 0, eps)) r = 0;
-        if (osg::equivalent(c, (double)_warpedDS->GetRasterXSize(), eps)) c = _warpedDS->GetRasterXSize();
-        if (osg::equivalent(r, (double)_warpedDS->GetRasterYSize(), eps)) r = _warpedDS->GetRasterYSize();
+        if (osg::equivalent(c, (double)band->GetXSize(), eps)) c = band->GetXSize();
+        if (osg::equivalent(r, (double)band->GetYSize(), eps)) r = band->GetYSize();
 
         if (applyOffset)
         {
@@ -1582,30 +1773,30 @@ public:
             {
                 c = 0;
             }
-            else if (c > _warpedDS->GetRasterXSize()-1 && c <= _warpedDS->GetRasterXSize()-0.5)
+            else if (c > band->GetXSize()-1 && c <= band->GetXSize()-0.5)
             {
-                c = _warpedDS->GetRasterXSize()-1;
+                c = band->GetXSize()-1;
             }
 
             if (r < 0 && r >= -0.5)
             {
                 r = 0;
             }
-            else if (r > _warpedDS->GetRasterYSize()-1 && r <= _warpedDS->GetRasterYSize()-0.5)
+            else if (r > band->GetYSize()-1 && r <= band->GetYSize()-0.5)
             {
-                r = _warpedDS->GetRasterYSize()-1;
+                r = band->GetYSize()-1;
             }
         }
 
         float result = 0.0f;
 
         //If the location is outside of the pixel values of the dataset, just return 0
-        if (c < 0 || r < 0 || c > _warpedDS->GetRasterXSize()-1 || r > _warpedDS->GetRasterYSize()-1)
+        if (c < 0 || r < 0 || c > band->GetXSize()-1 || r > band->GetYSize()-1)
             return NO_DATA_VALUE;
 
         if ( _options.interpolation() == INTERP_NEAREST )
         {
-            band->RasterIO(GF_Read, (int)osg::round(c), (int)osg::round(r), 1, 1, &result, 1, 1, GDT_Float32, 0, 0);
+            result = read((int)osg::round(c), (int)osg::round(r));
             if (!isValidValue( result, band))
             {
                 return NO_DATA_VALUE;
@@ -1614,19 +1805,19 @@ public:
         else
         {
             int rowMin = osg::maximum((int)floor(r), 0);
-            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
+            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(band->GetYSize()-1)), 0);
             int colMin = osg::maximum((int)floor(c), 0);
-            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
+            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(band->GetXSize()-1)), 0);
 
             if (rowMin > rowMax) rowMin = rowMax;
             if (colMin > colMax) colMin = colMax;
 
             float urHeight, llHeight, ulHeight, lrHeight;
 
-            band->RasterIO(GF_Read, colMin, rowMin, 1, 1, &llHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMin, rowMax, 1, 1, &ulHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMin, 1, 1, &lrHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMax, 1, 1, &urHeight, 1, 1, GDT_Float32, 0, 0);
+            llHeight = read(colMin, rowMin);
+            ulHeight = read(colMin, rowMax);
+            lrHeight = read(colMax, rowMin);
+            urHeight = read(colMax, rowMax);
 
             /*
             if (!isValidValue(urHeight, band)) urHeight = 0.0f;
@@ -1697,7 +1888,11 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // lease a dataset handle for the duration of the read.
+        ScopedHandle handle( this );
+        GDALDataset* warpedDS = handle.warped();
+        if ( !warpedDS )
+            return NULL;
 
         int tileSize = _options.tileSize().value();
 
@@ -1712,24 +1907,82 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(warpedDS, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = warpedDS->GetRasterBand(1);
             }
 
             double dx = (xmax - xmin) / (tileSize-1);
             double dy = (ymax - ymin) / (tileSize-1);
 
-            for (int c = 0; c < tileSize; ++c)
+            // Find the window of source pixels covering the tile, plus a border
+            // for the interpolation kernel and the half-pixel offset.
+            int rasterX = band->GetXSize();
+            int rasterY = band->GetYSize();
+            double cornerCol[4], cornerRow[4];
+            GDALApplyGeoTransform(_invtransform, xmin, ymin, &cornerCol[0], &cornerRow[0]);
+            GDALApplyGeoTransform(_invtransform, xmax, ymin, &cornerCol[1], &cornerRow[1]);
+            GDALApplyGeoTransform(_invtransform, xmin, ymax, &cornerCol[2], &cornerRow[2]);
+            GDALApplyGeoTransform(_invtransform, xmax, ymax, &cornerCol[3], &cornerRow[3]);
+
+            double colMin = cornerCol[0], colMax = cornerCol[0], rowMin = cornerRow[0], rowMax = cornerRow[0];
+            for (int i = 1; i < 4; ++i)
+            {
+                colMin = osg::minimum(colMin, cornerCol[i]); colMax = osg::maximum(colMax, cornerCol[i]);
+                rowMin = osg::minimum(rowMin, cornerRow[i]); rowMax = osg::maximum(rowMax, cornerRow[i]);
+            }
+
+            int x0 = osg::clampBetween((int)floor(colMin) - 2, 0, rasterX-1);
+            int x1 = osg::clampBetween((int)ceil (colMax) + 1, 0, rasterX-1);
+            int y0 = osg::clampBetween((int)floor(rowMin) - 2, 0, rasterY-1);
+            int y1 = osg::clampBetween((int)ceil (rowMax) + 1, 0, rasterY-1);
+
+            // Read the window in one go. If it's much bigger than the number of samples
+            // (at low LODs a tile may cover millions of source pixels), have GDAL
+            // decimate it to the tile size instead of reading it at full resolution.
+            int width  = x1-x0+1;
+            int height = y1-y0+1;
+            bool useWindow = x1 >= x0 && y1 >= y0;
+
+            if ( useWindow )
+            {
+                double windowSize = (double)width * (double)height;
+                bool decimate = windowSize > 4.0 * (double)tileSize * (double)tileSize;
+                int bufWidth  = decimate ? osg::minimum(width,  tileSize) : width;
+                int bufHeight = decimate ? osg::minimum(height, tileSize) : height;
+
+                WindowPixelReader window(band, x0, y0, width, height, bufWidth, bufHeight);
+                if ( window.valid() )
+                {
+                    for (int c = 0; c < tileSize; ++c)
+                    {
+                        double geoX = xmin + (dx * (double)c);
+                        for (int r = 0; r < tileSize; ++r)
+                        {
+                            double geoY = ymin + (dy * (double)r);
+                            hf->setHeight(c, r, interpolate(band, window, geoX, geoY, true));
+                        }
+                    }
+                }
+                else
+                {
+                    useWindow = false;
+                }
+            }
+
+            if ( !useWindow )
             {
-                double geoX = xmin + (dx * (double)c);
-                for (int r = 0; r < tileSize; ++r)
+                for (int c = 0; c < tileSize; ++c)
                 {
-                    double geoY = ymin + (dy * (double)r);
-                    float h = getInterpolatedValue(band, geoX, geoY);
-                    hf->setHeight(c, r, h);
+                    double geoX = xmin + (dx * (double)c);
+                    for (int r = 0; r < tileSize; ++r)
+                    {
+                        double geoY = ymin + (dy * (double)r);
+                        float h = getInterpolatedValue(band, geoX, geoY);
+                        hf->setHeight(c, r, h);
+                    }
                 }
             }
         }
@@ -1750,6 +2003,20 @@ private:
 
     GDALDataset* _srcDS;
     GDALDataset* _warpedDS;
+    std::string  _srcDSName;    // name, path or VRT XML from which to reopen _srcDS
+    bool         _requiresWarp;
+    bool         _warpPolar;
+    std::string  _warpSrcWKT;
+    std::string  _warpDestWKT;
+
+    // pool of dataset handles for concurrent readers.
+    bool                        _reopenable;
+    DatasetHandle               _primary;
+    Threading::Mutex            _primaryMutex;
+    std::vector<DatasetHandle*> _freeHandles;
+    std::vector<DatasetHandle*> _allHandles;
+    Threading::Mutex            _poolMutex;
+
     double       _geotransform[6];
     double       _invtransform[6];
 
@@ -21,6 +21,7 @@
 
 #include <osgEarth/TileSource>
 #include <osgEarth/Registry>
+#include <osgEarth/CacheBin>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageUtils>
 #include <osg/Notify>
@@ -50,7 +51,8 @@ public:
       _options( options ),      
       _database( NULL ),
       _minLevel( 0 ),
-      _maxLevel( 20 )
+      _maxLevel( 20 ),
+      _keepEncoded( false )
     {
     }
 
@@ -60,6 +62,9 @@ public:
         //Set the profile
         setProfile( osgEarth::Registry::instance()->getGlobalMercatorProfile() );
 
+        // keep the tile bytes on the images only if a cache is waiting for them.
+        _keepEncoded = EncodedRecord::isWanted( dbOptions );
+
 #if 0
         //Open the database
         std::string filename = _options.filename().value();
@@ -171,7 +176,11 @@ public:
             osgDB::ReaderWriter::ReadResult rr = _rw->readImage( imageBufStream );
             if (rr.validImage())
             {
-                result = rr.takeImage();            
+                result = rr.takeImage();
+
+                // keep the encoded bytes around so a cache can store them as-is:
+                if ( _keepEncoded )
+                    ImageUtils::setEncodedData( result, imageString );
             }
         }
         else
@@ -258,6 +267,7 @@ private:
     sqlite3* _database;
     unsigned int _minLevel;
     unsigned int _maxLevel;
+    bool _keepEncoded;
 
     osg::ref_ptr<osgDB::ReaderWriter> _rw;
     std::string _tileFormat;
@@ -26,7 +26,9 @@
 #include <osgEarth/Notify>
 #include <osgEarth/StringUtils>
 
+#include <OpenThreads/Thread>
 #include <v8.h>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Features;
@@ -36,47 +38,100 @@ using namespace osgEarth::Features;
 
 //----------------------------------------------------------------------------
 
+#define MAX_COMPILED_SCRIPTS 256
+
 JavascriptEngineV8::JavascriptEngineV8(const ScriptEngineOptions& options)
-: ScriptEngine(options)
+: ScriptEngine(options),
+  _maxIsolates(std::max(1, OpenThreads::GetNumberOfProcessors()))
 {
-  _isolate = v8::Isolate::New();
+  // set up the first isolate now so that errors in the startup script are
+  // reported right away.
+  IsolateLease lease(this);
+}
 
-  v8::Locker locker(_isolate);
-  v8::Isolate::Scope isolate_scope(_isolate);
+JavascriptEngineV8::~JavascriptEngineV8()
+{
+  for (std::vector<IsolateContext*>::iterator i = _isolates.begin(); i != _isolates.end(); ++i)
+  {
+    IsolateContext* ic = *i;
+    {
+      v8::Locker locker(ic->isolate);
+      v8::Isolate::Scope isolate_scope(ic->isolate);
 
-  v8:: HandleScope handle_scope;
+      for (IsolateContext::CompiledScripts::iterator c = ic->compiled.begin(); c != ic->compiled.end(); ++c)
+        c->second.Dispose();
 
-  v8::Handle<v8::ObjectTemplate> global = createGlobalObjectTemplate();
-  _globalContext = v8::Context::New(NULL, global);
+      ic->context.Dispose();
+    }
+
+    ic->isolate->Dispose();
+    delete ic;
+  }
+}
 
-  if (options.script().isSet() && !options.script()->getCode().empty())
+JavascriptEngineV8::IsolateContext*
+JavascriptEngineV8::leaseIsolate()
+{
   {
-    // Create a nested handle scope
-    v8::HandleScope local_handle_scope;
+    osgEarth::Threading::ScopedMutexLock lock(_isolatesMutex);
+
+    while (_freeIsolates.empty() && _isolates.size() >= _maxIsolates)
+      _isolateReturned.wait(&_isolatesMutex);
 
-    // Enter the global context
-    v8::Context::Scope context_scope(_globalContext);
+    // reuse the most recently returned isolate; its compiled scripts are warm.
+    if (!_freeIsolates.empty())
+    {
+      IsolateContext* ic = _freeIsolates.back();
+      _freeIsolates.pop_back();
+      return ic;
+    }
 
-    // Compile and run the script
-    ScriptResult result = executeScript(v8::String::New(options.script()->getCode().c_str(), options.script()->getCode().length()));
-    if (!result.success())
-      OE_WARN << LC << "Error reading javascript: " << result.message() << std::endl;
+    // reserve the slot now, and create the isolate outside the lock.
+    _isolates.push_back(0L);
   }
 
-  _globalTemplate = v8::Persistent<v8::ObjectTemplate>::New(global);
+  IsolateContext* ic = createIsolate();
+
+  osgEarth::Threading::ScopedMutexLock lock(_isolatesMutex);
+  *std::find(_isolates.begin(), _isolates.end(), (IsolateContext*)0L) = ic;
+  return ic;
 }
 
-JavascriptEngineV8::~JavascriptEngineV8()
+void
+JavascriptEngineV8::releaseIsolate(IsolateContext* ic)
+{
+  osgEarth::Threading::ScopedMutexLock lock(_isolatesMutex);
+  _freeIsolates.push_back(ic);
+  _isolateReturned.signal();
+}
+
+JavascriptEngineV8::IsolateContext*
+JavascriptEngineV8::createIsolate()
 {
+  IsolateContext* ic = new IsolateContext();
+  ic->isolate = v8::Isolate::New();
   {
-    v8::Locker locker(_isolate);
-    v8::Isolate::Scope isolate_scope(_isolate);
+    v8::Locker locker(ic->isolate);
+    v8::Isolate::Scope isolate_scope(ic->isolate);
 
-    _globalTemplate.Dispose();
-    _globalContext.Dispose();
+    v8::HandleScope handle_scope;
+
+    v8::Handle<v8::ObjectTemplate> global = createGlobalObjectTemplate();
+    ic->context = v8::Context::New(NULL, global);
+
+    if (_script.isSet() && !_script->getCode().empty())
+    {
+      // Enter the global context
+      v8::Context::Scope context_scope(ic->context);
+
+      // Compile and run the script
+      ScriptResult result = executeScript(v8::String::New(_script->getCode().c_str(), _script->getCode().length()));
+      if (!result.success())
+        OE_WARN << LC << "Error reading javascript: " << result.message() << std::endl;
+    }
   }
 
-  _isolate->Dispose();
+  return ic;
 }
 
 v8::Local<v8::ObjectTemplate>
@@ -119,12 +174,23 @@ JavascriptEngineV8::executeScript(v8::Handle<v8::String> script)
   // Handle scope for temporary handles.
   v8::HandleScope handle_scope;
 
+  v8::Handle<v8::Script> compiled_script;
+  ScriptResult result = compileScript(script, compiled_script);
+  if (compiled_script.IsEmpty())
+    return result;
+
+  return runScript(compiled_script);
+}
+
+ScriptResult
+JavascriptEngineV8::compileScript(v8::Handle<v8::String> source, v8::Handle<v8::Script>& out_script)
+{
   // TryCatch for any script errors
   v8::TryCatch try_catch;
 
   // Compile the script
-  v8::Handle<v8::Script> compiled_script = v8::Script::Compile(script);
-  if (compiled_script.IsEmpty())
+  out_script = v8::Script::Compile(source);
+  if (out_script.IsEmpty())
   {
     v8::String::AsciiValue error(try_catch.Exception());
 	v8::Handle<v8::Message> message = try_catch.Message();
@@ -148,8 +214,20 @@ JavascriptEngineV8::executeScript(v8::Handle<v8::String> script)
 	}
   }
 
+  return ScriptResult(EMPTY_STRING);
+}
+
+ScriptResult
+JavascriptEngineV8::runScript(v8::Handle<v8::Script> script)
+{
+  // Handle scope for temporary handles.
+  v8::HandleScope handle_scope;
+
+  // TryCatch for any script errors
+  v8::TryCatch try_catch;
+
   // Run the script
-  v8::Handle<v8::Value> result = compiled_script->Run();
+  v8::Handle<v8::Value> result = script->Run();
   if (result.IsEmpty())
   {
     v8::String::AsciiValue error(try_catch.Exception());
@@ -160,6 +238,49 @@ JavascriptEngineV8::executeScript(v8::Handle<v8::String> script)
   return ScriptResult(std::string(*ascii));
 }
 
+v8::Handle<v8::Script>
+JavascriptEngineV8::getCompiledScript(IsolateContext& ic, const std::string& code, ScriptResult& out_error)
+{
+  IsolateContext::CompiledScripts::iterator i = ic.compiled.find(code);
+  if (i != ic.compiled.end())
+    return i->second;
+
+  v8::Handle<v8::Script> script;
+  out_error = compileScript(v8::String::New(code.c_str(), code.length()), script);
+  if (script.IsEmpty())
+    return script;
+
+  // expressions with inline code can produce lots of distinct scripts; start
+  // over rather than grow without bound.
+  if (ic.compiled.size() >= MAX_COMPILED_SCRIPTS)
+  {
+    for (i = ic.compiled.begin(); i != ic.compiled.end(); ++i)
+      i->second.Dispose();
+    ic.compiled.clear();
+  }
+
+  ic.compiled[code] = v8::Persistent<v8::Script>::New(script);
+  return script;
+}
+
+void
+JavascriptEngineV8::setGlobals(IsolateContext& ic, osgEarth::Features::Feature const* feature, osgEarth::Features::FilterContext const* context)
+{
+  if (feature)
+  {
+    v8::Handle<v8::Object> fObj = JSFeature::WrapFeature(const_cast<Feature*>(feature));
+    if (!fObj.IsEmpty())
+      ic.context->Global()->Set(v8::String::New("feature"), fObj);
+  }
+
+  if (context)
+  {
+    v8::Handle<v8::Object> cObj = JSFilterContext::WrapFilterContext(const_cast<FilterContext*>(context));
+    if (!cObj.IsEmpty())
+      ic.context->Global()->Set(v8::String::New("context"), cObj);
+  }
+}
+
 ScriptResult
 JavascriptEngineV8::run(Script* script, osgEarth::Features::Feature const* feature, osgEarth::Features::FilterContext const* context)
 {
@@ -175,36 +296,83 @@ JavascriptEngineV8::run(const std::string& code, osgEarth::Features::Feature con
   if (code.empty())
     return ScriptResult(EMPTY_STRING, false, "Script is empty.");
 
-  v8::Locker locker(_isolate);
-  v8::Isolate::Scope isolate_scope(_isolate);
+  // the lease must outlive the V8 scopes below.
+  IsolateLease lease(this);
+  IsolateContext& ic = *lease;
+
+  v8::Locker locker(ic.isolate);
+  v8::Isolate::Scope isolate_scope(ic.isolate);
 
   v8::HandleScope handle_scope;
 
-  //Create a separate context
-  //v8::Persistent<v8::Context> context = v8::Context::New(NULL, _globalTemplate);
-  //v8::Context::Scope context_scope(context);
-  v8::Context::Scope context_scope(_globalContext);
+  v8::Context::Scope context_scope(ic.context);
 
-  if (feature)
+  ScriptResult error;
+  v8::Handle<v8::Script> script = getCompiledScript(ic, code, error);
+  if (script.IsEmpty())
+    return error;
+
+  setGlobals(ic, feature, context);
+
+  return runScript(script);
+}
+
+bool
+JavascriptEngineV8::run(Script* script, const FeatureList& features, std::vector<ScriptResult>& out_results, osgEarth::Features::FilterContext const* context)
+{
+  if (!script)
   {
-    v8::Handle<v8::Object> fObj = JSFeature::WrapFeature(const_cast<Feature*>(feature));
-    if (!fObj.IsEmpty())
-      _globalContext->Global()->Set(v8::String::New("feature"), fObj);
+    out_results.assign(features.size(), ScriptResult(EMPTY_STRING, false, "Script is null."));
+    return false;
   }
 
-  if (context)
+  return run(script->getCode(), features, out_results, context);
+}
+
+bool
+JavascriptEngineV8::run(const std::string& code, const FeatureList& features, std::vector<ScriptResult>& out_results, osgEarth::Features::FilterContext const* context)
+{
+  out_results.clear();
+
+  if (code.empty())
   {
-    v8::Handle<v8::Object> cObj = JSFilterContext::WrapFilterContext(const_cast<FilterContext*>(context));
-    if (!cObj.IsEmpty())
-      _globalContext->Global()->Set(v8::String::New("context"), cObj);
+    out_results.assign(features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+    return false;
   }
 
-  // Compile and run the script
-  ScriptResult result = executeScript(v8::String::New(code.c_str(), code.length()));
+  // enter the isolate and context once for the whole batch. The lease must
+  // outlive the V8 scopes below.
+  IsolateLease lease(this);
+  IsolateContext& ic = *lease;
 
-  //context.Dispose();
+  v8::Locker locker(ic.isolate);
+  v8::Isolate::Scope isolate_scope(ic.isolate);
+
+  v8::HandleScope handle_scope;
+
+  v8::Context::Scope context_scope(ic.context);
+
+  ScriptResult error;
+  v8::Handle<v8::Script> script = getCompiledScript(ic, code, error);
+  if (script.IsEmpty())
+  {
+    out_results.assign(features.size(), error);
+    return false;
+  }
+
+  setGlobals(ic, 0L, context);
+
+  out_results.reserve(features.size());
+  for (FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+  {
+    // release each feature's wrapper handles before moving on to the next.
+    v8::HandleScope feature_scope;
+
+    setGlobals(ic, i->get(), 0L);
+    out_results.push_back(runScript(script));
+  }
 
-  return result;
+  return true;
 }
 
 ScriptResult
@@ -213,17 +381,21 @@ JavascriptEngineV8::call(const std::string& function, osgEarth::Features::Featur
   if (function.empty())
     return ScriptResult(EMPTY_STRING, false, "Empty function name parameter.");
 
+  // the lease must outlive the V8 scopes below.
+  IsolateLease lease(this);
+  IsolateContext& ic = *lease;
+
   // Lock for V8 multithreaded uses
-  v8::Locker locker(_isolate);
-  v8::Isolate::Scope isolate_scope(_isolate);
+  v8::Locker locker(ic.isolate);
+  v8::Isolate::Scope isolate_scope(ic.isolate);
 
   v8::HandleScope handle_scope;
 
-  v8::Context::Scope context_scope(_globalContext);
+  v8::Context::Scope context_scope(ic.context);
 
   // Attempt to fetch the function from the global object.
   v8::Handle<v8::String> func_name = v8::String::New(function.c_str(), function.length());
-  v8::Handle<v8::Value> func_val = _globalContext->Global()->Get(func_name);
+  v8::Handle<v8::Value> func_val = ic.context->Global()->Get(func_name);
 
   // If there is no function, or if it is not a function, bail out
   if (!func_val->IsFunction())
@@ -231,19 +403,7 @@ JavascriptEngineV8::call(const std::string& function, osgEarth::Features::Featur
 
   v8::Handle<v8::Function> func_func = v8::Handle<v8::Function>::Cast(func_val);
 
-  if (feature)
-  {
-    v8::Handle<v8::Object> fObj = JSFeature::WrapFeature(const_cast<Feature*>(feature));
-    if (!fObj.IsEmpty())
-      _globalContext->Global()->Set(v8::String::New("feature"), fObj);
-  }
-
-  if (context)
-  {
-    v8::Handle<v8::Object> cObj = JSFilterContext::WrapFilterContext(const_cast<FilterContext*>(context));
-    if (!cObj.IsEmpty())
-      _globalContext->Global()->Set(v8::String::New("context"), cObj);
-  }
+  setGlobals(ic, feature, context);
 
   // Set up an exception handler before calling the Eval function
   v8::TryCatch try_catch;
@@ -252,7 +412,7 @@ JavascriptEngineV8::call(const std::string& function, osgEarth::Features::Featur
   //const int argc = 1;
   //v8::Handle<v8::Value> argv[argc] = { fObj };
   //v8::Handle<v8::Value> result = func_func->Call(_globalContext->Global(), argc, argv);
-  v8::Handle<v8::Value> result = func_func->Call(_globalContext->Global(), 0, NULL);
+  v8::Handle<v8::Value> result = func_func->Call(ic.context->Global(), 0, NULL);
 
   if (result.IsEmpty())
   {
@@ -21,6 +21,7 @@
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgEarth/Registry>
 #include <osgEarth/XmlUtils>
+#include <osgEarth/HTTPClient>
 #include <osgEarthUtil/WMS>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -283,61 +284,107 @@ public:
         ProgressCallback*  progress, 
         ReadResult&        out_response )
     {
-        osgDB::ReaderWriter* result = 0L;
-
-        std::string uri = createURI(key);
-        if ( !extraAttrs.empty() )
-        {
-            std::string delim = uri.find("?") == std::string::npos ? "?" : "&";
-            uri = uri + delim + extraAttrs;
-        }
-
-
-        out_response = URI( uri ).readString( _dbOptions.get(), progress );
+        out_response = URI( createURI(key, extraAttrs) ).readString( _dbOptions.get(), progress );
 
         //...
         //out_response = HTTPClient::get( uri, 0L, progress ); //getOptions(), progress );
 
         if ( out_response.succeeded() )
         {
-            // get the mime type:
-            std::string mt = out_response.metadata().value( IOMetadata::CONTENT_TYPE );
+            return getReader(
+                key,
+                out_response.metadata().value( IOMetadata::CONTENT_TYPE ),
+                out_response.getString() );
+        }
+        return 0L;
+    }
 
-            if ( mt == "application/vnd.ogc.se_xml" || mt == "text/xml" )
-            {
-                std::istringstream content( out_response.getString() );
+    /** Finds a reader for a WMS response, reporting any service exception */
+    osgDB::ReaderWriter* getReader(
+        const TileKey&     key,
+        const std::string& mt,
+        const std::string& content )
+    {
+        osgDB::ReaderWriter* result = 0L;
+
+        if ( mt == "application/vnd.ogc.se_xml" || mt == "text/xml" )
+        {
+            std::istringstream in( content );
 
-                // an XML result means there was a WMS service exception:
-                Config se;
-                if ( se.fromXML(content) )
+            // an XML result means there was a WMS service exception:
+            Config se;
+            if ( se.fromXML(in) )
+            {
+                Config ex = se.child("serviceexceptionreport").child("serviceexception");
+                if ( !ex.empty() )
                 {
-                    Config ex = se.child("serviceexceptionreport").child("serviceexception");
-                    if ( !ex.empty() )
-                    {
-                        OE_NOTICE << "WMS Service Exception: " << ex.toJSON(true) << std::endl;
-                    }
-                    else
-                    {
-                        OE_NOTICE << "WMS Response: " << se.toJSON(true) << std::endl;
-                    }
+                    OE_NOTICE << "WMS Service Exception: " << ex.toJSON(true) << std::endl;
                 }
                 else
                 {
-                    OE_NOTICE << "WMS: unknown error." << std::endl;
+                    OE_NOTICE << "WMS Response: " << se.toJSON(true) << std::endl;
                 }
             }
             else
             {
-                // really ought to use mime-type support here -GW
-                std::string typeExt = mt.substr( mt.find_last_of("/")+1 );
-                result = osgDB::Registry::instance()->getReaderWriterForExtension( typeExt );
-                if ( !result )
+                OE_NOTICE << "WMS: unknown error." << std::endl;
+            }
+        }
+        else
+        {
+            // really ought to use mime-type support here -GW
+            std::string typeExt = mt.substr( mt.find_last_of("/")+1 );
+            result = osgDB::Registry::instance()->getReaderWriterForExtension( typeExt );
+            if ( !result )
+            {
+                OE_NOTICE << "WMS: no reader registered; URI=" << createURI(key) << std::endl;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Fetches one image per WMS-T time. All the requests go to the HTTP engine
+     * at once, so the frames download concurrently instead of one round-trip
+     * after another; the calling thread decodes them in order as they arrive.
+     * Frames that fail come back NULL.
+     */
+    void fetchTimeFrames(
+        const TileKey&                          key,
+        ProgressCallback*                       progress,
+        std::vector< osg::ref_ptr<osg::Image> >& out_frames )
+    {
+        std::vector< osg::ref_ptr<HTTPFuture> > futures;
+        futures.reserve( _timesVec.size() );
+        for( unsigned int r=0; r<_timesVec.size(); ++r )
+        {
+            HTTPRequest request( createURI(key, std::string("TIME=") + _timesVec[r]) );
+            futures.push_back( HTTPClient::getAsync(request, _dbOptions.get(), progress) );
+        }
+
+        out_frames.assign( _timesVec.size(), 0L );
+        for( unsigned int r=0; r<futures.size(); ++r )
+        {
+            const HTTPResponse& response = futures[r]->get();
+            if ( !response.isOK() || response.getNumParts() == 0 )
+                continue;
+
+            std::string content = response.getPartAsString( 0 );
+            osgDB::ReaderWriter* reader = getReader( key, response.getMimeType(), content );
+            if ( reader )
+            {
+                std::istringstream buf( content );
+                osgDB::ReaderWriter::ReadResult readResult = reader->readImage( buf, _dbOptions.get() );
+                if ( readResult.error() )
+                {
+                    OE_WARN << "WMS: image read failed for " << futures[r]->getRequest().getURL() << std::endl;
+                }
+                else
                 {
-                    OE_NOTICE << "WMS: no reader registered; URI=" << createURI(key) << std::endl;
+                    out_frames[r] = readResult.getImage();
                 }
             }
         }
-        return result;
     }
 
 
@@ -381,40 +428,29 @@ public:
     {
         osg::ref_ptr<osg::Image> image;
 
-        for( unsigned int r=0; r<_timesVec.size(); ++r )
+        std::vector< osg::ref_ptr<osg::Image> > frames;
+        fetchTimeFrames( key, progress, frames );
+
+        for( unsigned int r=0; r<frames.size(); ++r )
         {
-            std::string extraAttrs = std::string("TIME=") + _timesVec[r];
-            ReadResult response;
-            osgDB::ReaderWriter* reader = fetchTileAndReader( key, extraAttrs, progress, response );
-            if ( reader )
+            osg::Image* timeImage = frames[r].get();
+            if ( timeImage )
             {
-                std::istringstream buf( response.getString() );
-
-                osgDB::ReaderWriter::ReadResult readResult = reader->readImage( buf, _dbOptions.get() );
-                if ( readResult.error() )
+                if ( !image.valid() )
                 {
-                    OE_WARN << "WMS: image read failed for " << createURI(key) << std::endl;
+                    image = new osg::Image();
+                    image->allocateImage(
+                        timeImage->s(), timeImage->t(), _timesVec.size(),
+                        timeImage->getPixelFormat(),
+                        timeImage->getDataType(),
+                        timeImage->getPacking() );
+                    image->setInternalTextureFormat( timeImage->getInternalTextureFormat() );
                 }
-                else
-                {
-                    osg::ref_ptr<osg::Image> timeImage = readResult.getImage();
 
-                    if ( !image.valid() )
-                    {
-                        image = new osg::Image();
-                        image->allocateImage(
-                            timeImage->s(), timeImage->t(), _timesVec.size(),
-                            timeImage->getPixelFormat(),
-                            timeImage->getDataType(),
-                            timeImage->getPacking() );
-                        image->setInternalTextureFormat( timeImage->getInternalTextureFormat() );
-                    }
-
-                    memcpy( 
-                        image->data(0,0,r), 
-                        timeImage->data(), 
-                        osg::minimum(image->getImageSizeInBytes(), timeImage->getImageSizeInBytes()) );
-                }
+                memcpy( 
+                    image->data(0,0,r), 
+                    timeImage->data(), 
+                    osg::minimum(image->getImageSizeInBytes(), timeImage->getImageSizeInBytes()) );
             }
         }
 
@@ -430,24 +466,14 @@ public:
         seq->setLength( _options.secondsPerFrame().value() * (double)_timesVec.size() );
         seq->play();
 
-        for( unsigned int r=0; r<_timesVec.size(); ++r )
-        {
-            std::string extraAttrs = std::string("TIME=") + _timesVec[r];
+        std::vector< osg::ref_ptr<osg::Image> > frames;
+        fetchTimeFrames( key, progress, frames );
 
-            ReadResult response;
-            osgDB::ReaderWriter* reader = fetchTileAndReader( key, extraAttrs, progress, response );
-            if ( reader )
+        for( unsigned int r=0; r<frames.size(); ++r )
+        {
+            if ( frames[r].valid() )
             {
-                std::istringstream buf(response.getString());
-                osgDB::ReaderWriter::ReadResult readResult = reader->readImage( buf, _dbOptions.get() );
-                if ( !readResult.error() )
-                {
-                    seq->addImage( readResult.getImage() );
-                }
-                else
-                {
-                    OE_WARN << "WMS: image read failed for " << createURI(key) << std::endl;
-                }
+                seq->addImage( frames[r].get() );
             }
         }
 
@@ -477,6 +503,17 @@ public:
     }
 
 
+    std::string createURI( const TileKey& key, const std::string& extraAttrs ) const
+    {
+        std::string uri = createURI( key );
+        if ( !extraAttrs.empty() )
+        {
+            std::string delim = uri.find("?") == std::string::npos ? "?" : "&";
+            uri = uri + delim + extraAttrs;
+        }
+        return uri;
+    }
+
     std::string createURI( const TileKey& key ) const
     {
         double minx, miny, maxx, maxy;
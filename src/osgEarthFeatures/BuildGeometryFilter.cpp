@@ -18,6 +18,7 @@
  */
 #include <osgEarthFeatures/BuildGeometryFilter>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osgEarthFeatures/FilterStats>
 #include <osgEarthSymbology/TextSymbol>
 #include <osgEarthSymbology/PointSymbol>
 #include <osgEarthSymbology/LineSymbol>
@@ -390,7 +391,10 @@ BuildGeometryFilter::push( FeatureList& input, FilterContext& context )
     if ( !_featureNameExpr.isSet() )
     {
 #if 1
+        FilterStats* stats = context.getSession() ? context.getSession()->getFilterStats() : 0L;
+        FilterStats::Probe probe( stats, "mesh_consolidation", _geode.get(), "build_geometry" );
         MeshConsolidator::run( *_geode.get() );
+        probe.finish( _geode.get() );
 #else
         osgUtil::Optimizer opt;
         opt.optimize( _geode.get(),
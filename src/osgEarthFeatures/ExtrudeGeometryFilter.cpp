@@ -18,6 +18,7 @@
  */
 #include <osgEarthFeatures/ExtrudeGeometryFilter>
 #include <osgEarthFeatures/FeatureSourceIndexNode>
+#include <osgEarthFeatures/FilterStats>
 #include <osgEarthSymbology/MeshSubdivider>
 #include <osgEarthSymbology/MeshConsolidator>
 #include <osgEarth/ECEF>
@@ -666,7 +667,36 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
     Random wallSkinPRNG( _wallSkinSymbol.valid()? *_wallSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
     Random roofSkinPRNG( _roofSkinSymbol.valid()? *_roofSkinSymbol->randomSeed() : 0, Random::METHOD_FAST );
 
-    for( FeatureList::iterator f = features.begin(); f != features.end(); ++f )
+    // evaluate the height expressions in one pass, over only the features
+    // that have geometry to extrude. A height callback replaces the height
+    // expression, so it isn't evaluated at all in that case.
+    bool evalHeights = !_heightCallback.valid() && _heightExpr.isSet();
+    bool evalOffsets = _heightOffsetExpr.isSet();
+
+    std::vector<double> heights, offsets;
+    std::vector<int>    evalSlots;
+    if ( evalHeights || evalOffsets )
+    {
+        FeatureList extruded;
+        evalSlots.resize( features.size(), -1 );
+        unsigned i = 0;
+        for( FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++i )
+        {
+            if ( f->get()->getGeometry() )
+            {
+                evalSlots[i] = extruded.size();
+                extruded.push_back( *f );
+            }
+        }
+
+        if ( evalHeights )
+            Feature::evalAll( _heightExpr.mutable_value(), extruded, heights, &context );
+        if ( evalOffsets )
+            Feature::evalAll( _heightOffsetExpr.mutable_value(), extruded, offsets, &context );
+    }
+
+    unsigned featureIndex = 0;
+    for( FeatureList::iterator f = features.begin(); f != features.end(); ++f, ++featureIndex )
     {
         Feature* input = f->get();
 
@@ -714,7 +744,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             }
             else if ( _heightExpr.isSet() )
             {
-                height = input->eval( _heightExpr.mutable_value(), &context );
+                height = heights[evalSlots[featureIndex]];
             }
             else
             {
@@ -725,7 +755,7 @@ ExtrudeGeometryFilter::process( FeatureList& features, FilterContext& context )
             float offset = 0.0;
             if ( _heightOffsetExpr.isSet() )
             {
-                offset = input->eval( _heightOffsetExpr.mutable_value(), &context );
+                offset = offsets[evalSlots[featureIndex]];
             }
 
             osg::StateSet* wallStateSet = 0L;
@@ -929,10 +959,14 @@ ExtrudeGeometryFilter::push( FeatureList& input, FilterContext& context )
     // convert everything to triangles and combine drawables.
     if ( _mergeGeometry == true && _featureNameExpr.empty() )
     {
+        FilterStats* stats = context.getSession() ? context.getSession()->getFilterStats() : 0L;
+
         for( SortedGeodeMap::iterator i = _geodes.begin(); i != _geodes.end(); ++i )
         {
 #if 1
+            FilterStats::Probe probe( stats, "mesh_consolidation", i->second.get(), "extrude" );
             MeshConsolidator::run( *i->second.get() );
+            probe.finish( i->second.get() );
 #else
         osgUtil::Optimizer opt;
         opt.optimize( i->second.get(),
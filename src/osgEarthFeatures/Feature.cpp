@@ -143,18 +143,65 @@ AttributeValue::getBool( bool defaultValue ) const
 
 //----------------------------------------------------------------------------
 
+AttributeSchema::AttributeSchema()
+{
+    //nop
+}
+
+AttributeSchema::AttributeSchema( const std::vector<std::string>& names ) :
+_names( names )
+{
+    // slot i is always names[i]; if a name repeats, the last slot wins.
+    for( unsigned i=0; i<_names.size(); ++i )
+        _slots[_names[i]] = i;
+}
+
+AttributeSchema::AttributeSchema( const AttributeSchema* parent, const std::string& name ) :
+_names( parent->_names ),
+_slots( parent->_slots )
+{
+    _slots[name] = _names.size();
+    _names.push_back( name );
+}
+
+AttributeSchema::~AttributeSchema()
+{
+    //nop
+}
+
+int
+AttributeSchema::indexOf( const std::string& name ) const
+{
+    std::map<std::string, unsigned>::const_iterator i = _slots.find( name );
+    return i != _slots.end() ? (int)i->second : -1;
+}
+
+const AttributeSchema*
+AttributeSchema::extend( const std::string& name ) const
+{
+    Threading::ScopedMutexLock lock( _extensionsMutex );
+    osg::ref_ptr<const AttributeSchema>& ext = _extensions[name];
+    if ( !ext.valid() )
+        ext = new AttributeSchema( this, name );
+    return ext.get();
+}
+
+//----------------------------------------------------------------------------
+
 Feature::Feature( FeatureID fid ) :
-_fid( fid ),
-_srs( 0L )
+_fid       ( fid ),
+_srs       ( 0L ),
+_geomShared( false )
 //_cachedBoundingPolytopeValid( false )
 {
     //NOP
 }
 
 Feature::Feature( Geometry* geom, const SpatialReference* srs, const Style& style, FeatureID fid ) :
-_geom ( geom ),
-_srs  ( srs ),
-_fid  ( fid )
+_geom      ( geom ),
+_srs       ( srs ),
+_fid       ( fid ),
+_geomShared( false )
 {
     if ( !style.empty() )
         _style = style;
@@ -164,13 +211,27 @@ _fid  ( fid )
 
 Feature::Feature( const Feature& rhs, const osg::CopyOp& copyOp ) :
 _fid      ( rhs._fid ),
-_attrs    ( rhs._attrs ),
+_schema   ( rhs._schema.get() ),
+_values   ( rhs._values ),
+_present  ( rhs._present ),
 _style    ( rhs._style ),
 _geoInterp( rhs._geoInterp ),
-_srs      ( rhs._srs.get() )
+_srs      ( rhs._srs.get() ),
+_geomShared( false )
 {
     if ( rhs._geom.valid() )
-        _geom = rhs._geom->clone();
+    {
+        if ( copyOp.getCopyFlags() == osg::CopyOp::SHALLOW_COPY )
+        {
+            // share until someone asks for a modifiable geometry.
+            _geom       = rhs._geom.get();
+            _geomShared = true;
+        }
+        else
+        {
+            _geom = rhs._geom->clone();
+        }
+    }
 
     dirty();
 }
@@ -191,10 +252,19 @@ Feature::setSRS( const SpatialReference* srs )
 void
 Feature::setGeometry( Geometry* geom )
 {
-    _geom = geom;
+    _geom       = geom;
+    _geomShared = false;
     dirty();
 }
 
+void
+Feature::unshareGeometry()
+{
+    if ( _geom.valid() )
+        _geom = _geom->clone();
+    _geomShared = false;
+}
+
 void
 Feature::dirty()
 {
@@ -203,10 +273,93 @@ Feature::dirty()
     //_cachedBoundingPolytopeValid = false;
 }
 
+void
+Feature::setSchema( const AttributeSchema* schema )
+{
+    if ( schema == _schema.get() )
+        return;
+
+    osg::ref_ptr<const AttributeSchema> oldSchema = _schema.get();
+    std::vector<AttributeValue>         oldValues;
+    std::vector<bool>                   oldPresent;
+    oldValues.swap( _values );
+    oldPresent.swap( _present );
+
+    _schema = schema;
+    if ( _schema.valid() )
+    {
+        _values.resize( _schema->size() );
+        _present.resize( _schema->size(), false );
+    }
+
+    // carry over existing attributes.
+    for( unsigned i=0; i<oldValues.size(); ++i )
+    {
+        if ( !oldPresent[i] )
+            continue;
+
+        AttributeValue& a = slotFor( oldSchema->getName(i) );
+        a = oldValues[i];
+    }
+}
+
+int
+Feature::findSlot( const std::string& name ) const
+{
+    return _schema.valid() ? _schema->indexOf( name ) : -1;
+}
+
+AttributeValue&
+Feature::slotFor( const std::string& name )
+{
+    if ( !_schema.valid() )
+        _schema = new AttributeSchema();
+
+    int slot = _schema->indexOf( name );
+    if ( slot < 0 )
+    {
+        _schema = _schema->extend( name );
+        slot = _schema->size()-1;
+    }
+
+    return valueAt( slot );
+}
+
+AttributeValue&
+Feature::valueAt( int slot )
+{
+    if ( _values.size() < _schema->size() )
+    {
+        _values.resize( _schema->size() );
+        _present.resize( _schema->size(), false );
+    }
+
+    _present[slot] = true;
+    return _values[slot];
+}
+
+AttributeTable
+Feature::getAttrs() const
+{
+    AttributeTable table;
+    for( unsigned i=0; i<_values.size(); ++i )
+    {
+        if ( _present[i] )
+            table[_schema->getName(i)] = _values[i];
+    }
+    return table;
+}
+
+const AttributeValue*
+Feature::getAttr( const std::string& name ) const
+{
+    return getAttr( findSlot(toLower(name)) );
+}
+
 void
 Feature::set( const std::string& name, const std::string& value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = slotFor(name);
     a.first = ATTRTYPE_STRING;
     a.second.stringValue = value;
     a.second.set = true;
@@ -215,7 +368,7 @@ Feature::set( const std::string& name, const std::string& value )
 void
 Feature::set( const std::string& name, double value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = slotFor(name);
     a.first = ATTRTYPE_DOUBLE;
     a.second.doubleValue = value;
     a.second.set = true;
@@ -224,7 +377,7 @@ Feature::set( const std::string& name, double value )
 void
 Feature::set( const std::string& name, int value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = slotFor(name);
     a.first = ATTRTYPE_INT;
     a.second.intValue = value;
     a.second.set = true;
@@ -233,7 +386,7 @@ Feature::set( const std::string& name, int value )
 void
 Feature::set( const std::string& name, bool value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = slotFor(name);
     a.first = ATTRTYPE_BOOL;
     a.second.boolValue = value;
     a.second.set = true;
@@ -242,73 +395,134 @@ Feature::set( const std::string& name, bool value )
 void
 Feature::setNull( const std::string& name)
 {
-    AttributeValue& a = _attrs[name];    
+    AttributeValue& a = slotFor(name);
     a.second.set = false;
 }
 
 void
 Feature::setNull( const std::string& name, AttributeType type)
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = slotFor(name);
     a.first = type;    
     a.second.set = false;
 }
 
+void
+Feature::setAt( int slot, const std::string& value )
+{
+    AttributeValue& a = valueAt(slot);
+    a.first = ATTRTYPE_STRING;
+    a.second.stringValue = value;
+    a.second.set = true;
+}
 
+void
+Feature::setAt( int slot, double value )
+{
+    AttributeValue& a = valueAt(slot);
+    a.first = ATTRTYPE_DOUBLE;
+    a.second.doubleValue = value;
+    a.second.set = true;
+}
 
+void
+Feature::setAt( int slot, int value )
+{
+    AttributeValue& a = valueAt(slot);
+    a.first = ATTRTYPE_INT;
+    a.second.intValue = value;
+    a.second.set = true;
+}
+
+void
+Feature::setAt( int slot, bool value )
+{
+    AttributeValue& a = valueAt(slot);
+    a.first = ATTRTYPE_BOOL;
+    a.second.boolValue = value;
+    a.second.set = true;
+}
+
+void
+Feature::setNullAt( int slot, AttributeType type )
+{
+    AttributeValue& a = valueAt(slot);
+    a.first = type;
+    a.second.set = false;
+}
 
 bool
 Feature::hasAttr( const std::string& name ) const
 {
-    return _attrs.find(toLower(name)) != _attrs.end();
+    return getAttr(name) != 0L;
 }
 
 std::string
 Feature::getString( const std::string& name ) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getString() : EMPTY_STRING;
+    const AttributeValue* a = getAttr(name);
+    return a ? a->getString() : EMPTY_STRING;
 }
 
 double
 Feature::getDouble( const std::string& name, double defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getDouble(defaultValue) : defaultValue;
+    const AttributeValue* a = getAttr(name);
+    return a ? a->getDouble(defaultValue) : defaultValue;
 }
 
 int
 Feature::getInt( const std::string& name, int defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getInt(defaultValue) : defaultValue;
+    const AttributeValue* a = getAttr(name);
+    return a ? a->getInt(defaultValue) : defaultValue;
 }
 
 bool
 Feature::getBool( const std::string& name, bool defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getBool(defaultValue) : defaultValue;
+    const AttributeValue* a = getAttr(name);
+    return a ? a->getBool(defaultValue) : defaultValue;
 }
 
 bool
 Feature::isSet( const std::string& name) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.second.set : false;
+    const AttributeValue* a = getAttr(name);
+    return a ? a->second.set : false;
+}
+
+namespace
+{
+    // Resolves an expression's variables to slots in a schema, reusing the
+    // previous resolution if the schema hasn't changed.
+    template<typename VARS>
+    const std::vector<int>& bindVariables( ExpressionBinding& binding, const VARS& vars, const AttributeSchema* schema )
+    {
+        if ( binding.slots.size() != vars.size() || binding.schema.get() != schema )
+        {
+            binding.schema = const_cast<AttributeSchema*>( schema );
+            binding.slots.resize( vars.size() );
+            for( unsigned i=0; i<vars.size(); ++i )
+                binding.slots[i] = schema ? schema->indexOf( toLower(vars[i].first) ) : -1;
+        }
+        return binding.slots;
+    }
 }
 
 double
 Feature::eval( NumericExpression& expr, FilterContext const* context ) const
 {
     const NumericExpression::Variables& vars = expr.variables();
-    for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
+    const std::vector<int>& slots = bindVariables( expr.binding(), vars, _schema.get() );
+    for( unsigned v = 0; v < vars.size(); ++v )
     {
+      NumericExpression::Variables::const_iterator i = vars.begin() + v;
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      const AttributeValue* attr = getAttr( slots[v] );
+      if (attr)
       {
-        val = ai->second.getDouble(0.0);
+        val = attr->getDouble(0.0);
       }
       else if (context)
       {
@@ -334,13 +548,15 @@ const std::string&
 Feature::eval( StringExpression& expr, FilterContext const* context ) const
 {
     const StringExpression::Variables& vars = expr.variables();
-    for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
+    const std::vector<int>& slots = bindVariables( expr.binding(), vars, _schema.get() );
+    for( unsigned v = 0; v < vars.size(); ++v )
     {
+      StringExpression::Variables::const_iterator i = vars.begin() + v;
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+      const AttributeValue* attr = getAttr( slots[v] );
+      if (attr)
       {
-        val = ai->second.getString();
+        val = attr->getString();
       }
       else if (context)
       {
@@ -363,6 +579,140 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     return expr.eval();
 }
 
+namespace
+{
+    // Results of the scripts for expression variables that don't resolve to
+    // an attribute, run as one batch per variable.
+    struct ScriptedVariables
+    {
+        std::vector< std::vector<ScriptResult> > results; // per variable
+        std::vector< std::vector<int> >          index;   // per variable, per feature; -1 = not scripted
+
+        ScriptResult* get( unsigned v, unsigned k )
+        {
+            int i = index[v][k];
+            return i >= 0 && i < (int)results[v].size() ? &results[v][i] : 0L;
+        }
+    };
+
+    template<typename VARS>
+    void runScriptedVariables( ExpressionBinding& binding, const VARS& vars, const FeatureList& features,
+                               FilterContext const* context, ScriptedVariables& out )
+    {
+        out.results.resize( vars.size() );
+        out.index.assign( vars.size(), std::vector<int>(features.size(), -1) );
+
+        ScriptEngine* engine = context && context->getSession() ? context->getSession()->getScriptEngine() : 0L;
+        if ( !engine )
+            return;
+
+        for( unsigned v = 0; v < vars.size(); ++v )
+        {
+            FeatureList pending;
+            unsigned k = 0;
+            for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++k )
+            {
+                if ( !i->valid() )
+                    continue;
+
+                const std::vector<int>& slots = bindVariables( binding, vars, (*i)->getSchema() );
+                if ( !(*i)->getAttr(slots[v]) )
+                {
+                    out.index[v][k] = pending.size();
+                    pending.push_back( *i );
+                }
+            }
+
+            if ( !pending.empty() )
+                engine->run( vars[v].first, pending, out.results[v], context );
+        }
+    }
+}
+
+void
+Feature::evalAll( NumericExpression& expr, const FeatureList& features, std::vector<double>& out_values, FilterContext const* context )
+{
+    const NumericExpression::Variables& vars = expr.variables();
+
+    ScriptedVariables scripted;
+    runScriptedVariables( expr.binding(), vars, features, context, scripted );
+
+    out_values.resize( features.size() );
+    unsigned k = 0;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++k )
+    {
+        if ( !i->valid() )
+        {
+            out_values[k] = 0.0;
+            continue;
+        }
+
+        const std::vector<int>& slots = bindVariables( expr.binding(), vars, (*i)->getSchema() );
+        for( unsigned v = 0; v < vars.size(); ++v )
+        {
+            double val = 0.0;
+            const AttributeValue* attr = (*i)->getAttr( slots[v] );
+            if ( attr )
+            {
+                val = attr->getDouble(0.0);
+            }
+            else if ( ScriptResult* result = scripted.get(v, k) )
+            {
+                if ( result->success() )
+                    val = result->asDouble();
+                else
+                    OE_WARN << LC << "Script error:" << result->message() << std::endl;
+            }
+
+            expr.set( vars[v], val );
+        }
+
+        out_values[k] = expr.eval();
+    }
+}
+
+void
+Feature::evalAll( StringExpression& expr, const FeatureList& features, std::vector<std::string>& out_values, FilterContext const* context )
+{
+    const StringExpression::Variables& vars = expr.variables();
+
+    ScriptedVariables scripted;
+    runScriptedVariables( expr.binding(), vars, features, context, scripted );
+
+    out_values.resize( features.size() );
+    unsigned k = 0;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++k )
+    {
+        if ( !i->valid() )
+        {
+            out_values[k].clear();
+            continue;
+        }
+
+        const std::vector<int>& slots = bindVariables( expr.binding(), vars, (*i)->getSchema() );
+        for( unsigned v = 0; v < vars.size(); ++v )
+        {
+            std::string val;
+            const AttributeValue* attr = (*i)->getAttr( slots[v] );
+            if ( attr )
+            {
+                val = attr->getString();
+            }
+            else if ( ScriptResult* result = scripted.get(v, k) )
+            {
+                if ( result->success() )
+                    val = result->asString();
+                else
+                    OE_WARN << LC << "Script error:" << result->message() << std::endl;
+            }
+
+            if ( !val.empty() )
+                expr.set( vars[v], val );
+        }
+
+        out_values[k] = expr.eval();
+    }
+}
 
 bool
 Feature::getWorldBound(const SpatialReference* srs,
@@ -462,10 +812,11 @@ Feature::getGeoJSON()
 
     //Write out all the properties         
     Json::Value props(Json::objectValue);    
-    if (getAttrs().size() > 0)
+    AttributeTable attrs = getAttrs();
+    if (attrs.size() > 0)
     {
 
-        for (AttributeTable::const_iterator itr = getAttrs().begin(); itr != getAttrs().end(); ++itr)
+        for (AttributeTable::const_iterator itr = attrs.begin(); itr != attrs.end(); ++itr)
         {
             if (itr->second.first == ATTRTYPE_INT)
             {
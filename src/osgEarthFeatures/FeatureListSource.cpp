@@ -17,33 +17,452 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/FeatureListSource>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
 
+using namespace osgEarth;
 using namespace osgEarth::Features;
+using namespace osgEarth::Threading;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // 2D axis-aligned box; lighter than osgEarth::Bounds for use in the index.
+    struct Box
+    {
+        double xmin, ymin, xmax, ymax;
+
+        Box() : xmin(DBL_MAX), ymin(DBL_MAX), xmax(-DBL_MAX), ymax(-DBL_MAX) { }
+
+        Box( const Bounds& b ) : xmin(b.xMin()), ymin(b.yMin()), xmax(b.xMax()), ymax(b.yMax()) { }
+
+        bool valid() const { return xmin <= xmax && ymin <= ymax; }
+
+        void expandBy( const Box& rhs ) {
+            xmin = std::min(xmin, rhs.xmin); ymin = std::min(ymin, rhs.ymin);
+            xmax = std::max(xmax, rhs.xmax); ymax = std::max(ymax, rhs.ymax);
+        }
+
+        bool intersects( const Box& rhs ) const {
+            return xmin <= rhs.xmax && xmax >= rhs.xmin && ymin <= rhs.ymax && ymax >= rhs.ymin;
+        }
+
+        bool contains( const Box& rhs ) const {
+            return xmin <= rhs.xmin && xmax >= rhs.xmax && ymin <= rhs.ymin && ymax >= rhs.ymax;
+        }
+
+        double area() const { return valid() ? (xmax-xmin)*(ymax-ymin) : 0.0; }
+
+        double enlargement( const Box& rhs ) const {
+            Box u = *this; u.expandBy( rhs ); return u.area() - area();
+        }
+
+        double cx() const { return 0.5*(xmin+xmax); }
+        double cy() const { return 0.5*(ymin+ymax); }
+    };
+
+    // maximum number of entries (or children) per node.
+    const unsigned NODE_CAPACITY = 16;
+
+    struct Entry
+    {
+        Box      box;
+        Feature* feature;  // owned by the FeatureListSource
+        unsigned seq;      // position in the source list, for ordering results
+    };
+
+    struct Node
+    {
+        Node() : parent(0L), leaf(true) { }
+        ~Node() { for( unsigned i=0; i<children.size(); ++i ) delete children[i]; }
+
+        Box                box;
+        Node*              parent;
+        bool               leaf;
+        std::vector<Node*> children;  // internal nodes
+        std::vector<Entry> entries;   // leaf nodes
+
+        unsigned size() const { return leaf ? entries.size() : children.size(); }
+
+        void recomputeBox() {
+            box = Box();
+            if ( leaf ) for( unsigned i=0; i<entries.size();  ++i ) box.expandBy( entries[i].box );
+            else        for( unsigned i=0; i<children.size(); ++i ) box.expandBy( children[i]->box );
+        }
+    };
+
+    struct LessEntryX { bool operator()(const Entry& a, const Entry& b) const { return a.box.cx() < b.box.cx(); } };
+    struct LessEntryY { bool operator()(const Entry& a, const Entry& b) const { return a.box.cy() < b.box.cy(); } };
+    struct LessNodeX  { bool operator()(const Node* a, const Node* b) const { return a->box.cx() < b->box.cx(); } };
+    struct LessNodeY  { bool operator()(const Node* a, const Node* b) const { return a->box.cy() < b->box.cy(); } };
+    struct LessSeq    { bool operator()(const Entry* a, const Entry* b) const { return a->seq < b->seq; } };
+
+    // Sort-Tile-Recursive packing: sorts items by x, cuts them into vertical
+    // slices, sorts each slice by y, and packs runs of NODE_CAPACITY into nodes.
+    template<typename T, typename LESSX, typename LESSY>
+    void strSort( std::vector<T>& items )
+    {
+        unsigned n      = items.size();
+        unsigned pages  = (n + NODE_CAPACITY - 1) / NODE_CAPACITY;
+        unsigned slices = (unsigned)ceil( sqrt((double)pages) );
+        unsigned perSlice = slices * NODE_CAPACITY;
+
+        std::sort( items.begin(), items.end(), LESSX() );
+        for( unsigned i=0; i<n; i += perSlice )
+            std::sort( items.begin()+i, items.begin()+std::min(n, i+perSlice), LESSY() );
+    }
+}
+
+/**
+ * R-tree over the extents of the features in a FeatureListSource. Bulk loaded
+ * with STR when the source is (re)indexed; supports incremental inserts and
+ * removals in between.
+ */
+class FeatureListSource::Index
+{
+public:
+    Index() : _root(new Node()), _nextSeq(0) { }
+    ~Index() { delete _root; }
+
+    // rebuilds the tree from scratch.
+    void build( const FeatureList& features )
+    {
+        delete _root;
+        _root    = 0L;
+        _nextSeq = 0;
+
+        std::vector<Entry> entries;
+        for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+        {
+            Entry e;
+            e.feature = i->get();
+            e.seq     = _nextSeq++;
+            if ( getBox(e.feature, e.box) )
+                entries.push_back( e );
+        }
+
+        // pack the leaves:
+        strSort<Entry, LessEntryX, LessEntryY>( entries );
+        std::vector<Node*> level;
+        for( unsigned i=0; i<entries.size(); i += NODE_CAPACITY )
+        {
+            Node* leaf = new Node();
+            leaf->entries.assign( entries.begin()+i, entries.begin()+std::min((unsigned)entries.size(), i+NODE_CAPACITY) );
+            leaf->recomputeBox();
+            level.push_back( leaf );
+        }
+
+        // then pack each level of internal nodes until one remains:
+        while( level.size() > 1 )
+        {
+            strSort<Node*, LessNodeX, LessNodeY>( level );
+            std::vector<Node*> parents;
+            for( unsigned i=0; i<level.size(); i += NODE_CAPACITY )
+            {
+                Node* node = new Node();
+                node->leaf = false;
+                for( unsigned j=i; j<std::min((unsigned)level.size(), i+NODE_CAPACITY); ++j )
+                {
+                    level[j]->parent = node;
+                    node->children.push_back( level[j] );
+                }
+                node->recomputeBox();
+                parents.push_back( node );
+            }
+            level.swap( parents );
+        }
+
+        _root = level.empty() ? new Node() : level.front();
+        _root->parent = 0L;
+    }
+
+    // adds a feature to the tree.
+    void insert( Feature* feature )
+    {
+        Entry e;
+        e.feature = feature;
+        e.seq     = _nextSeq++;
+        if ( !getBox(feature, e.box) )
+            return;
+
+        // descend to the leaf that needs the least enlargement:
+        Node* node = _root;
+        while( !node->leaf )
+        {
+            Node*  best = node->children.front();
+            double bestGrowth = DBL_MAX;
+            for( unsigned i=0; i<node->children.size(); ++i )
+            {
+                Node* child = node->children[i];
+                double growth = child->box.enlargement( e.box );
+                if ( growth < bestGrowth || (growth == bestGrowth && child->box.area() < best->box.area()) )
+                {
+                    best = child;
+                    bestGrowth = growth;
+                }
+            }
+            node = best;
+        }
+
+        node->entries.push_back( e );
+        for( Node* n = node; n; n = n->parent )
+            n->box.expandBy( e.box );
+
+        // split overflowing nodes on the way back up:
+        while( node && node->size() > NODE_CAPACITY )
+        {
+            split( node );
+            node = node->parent;
+        }
+    }
+
+    // removes a feature from the tree; returns false if it wasn't there.
+    bool remove( Feature* feature )
+    {
+        // look where the feature's extent says it should be, or failing that (the
+        // geometry may have changed since it was indexed) everywhere.
+        Box box;
+        Node* leaf = getBox(feature, box) ? findLeaf( _root, feature, &box ) : 0L;
+        if ( !leaf )
+            leaf = findLeaf( _root, feature, 0L );
+        if ( !leaf )
+            return false;
+
+        for( std::vector<Entry>::iterator i = leaf->entries.begin(); i != leaf->entries.end(); ++i )
+        {
+            if ( i->feature == feature )
+            {
+                leaf->entries.erase( i );
+                break;
+            }
+        }
+
+        // prune empty nodes and shrink boxes back up to the root. Underfull nodes
+        // are tolerated; the next rebuild repacks them.
+        Node* node = leaf;
+        while( node->parent && node->size() == 0 )
+        {
+            Node* parent = node->parent;
+            parent->children.erase( std::find(parent->children.begin(), parent->children.end(), node) );
+            delete node;
+            node = parent;
+        }
+        for( Node* n = node; n; n = n->parent )
+            n->recomputeBox();
+
+        // collapse a root with a single child:
+        while( !_root->leaf && _root->children.size() == 1 )
+        {
+            Node* child = _root->children.front();
+            _root->children.clear();
+            delete _root;
+            _root = child;
+            _root->parent = 0L;
+        }
+        if ( !_root->leaf && _root->children.empty() )
+        {
+            _root->leaf = true;
+        }
+
+        return true;
+    }
+
+    // collects the features whose extents intersect the bounds, in list order.
+    void query( const Bounds& bounds, FeatureList& out ) const
+    {
+        Box box( bounds );
+        std::vector<const Entry*> hits;
+        std::vector<const Node*> stack;
+        stack.push_back( _root );
+        while( !stack.empty() )
+        {
+            const Node* node = stack.back();
+            stack.pop_back();
+            if ( !node->box.intersects(box) )
+                continue;
+
+            if ( node->leaf )
+            {
+                for( unsigned i=0; i<node->entries.size(); ++i )
+                    if ( node->entries[i].box.intersects(box) )
+                        hits.push_back( &node->entries[i] );
+            }
+            else
+            {
+                for( unsigned i=0; i<node->children.size(); ++i )
+                    stack.push_back( node->children[i] );
+            }
+        }
+
+        std::sort( hits.begin(), hits.end(), LessSeq() );
+        for( unsigned i=0; i<hits.size(); ++i )
+            out.push_back( hits[i]->feature );
+    }
+
+private:
+    Node*    _root;
+    unsigned _nextSeq;
+
+    static bool getBox( const Feature* feature, Box& out_box )
+    {
+        const Geometry* geom = feature ? feature->getGeometry() : 0L;
+        if ( !geom )
+            return false;
+        out_box = Box( geom->getBounds() );
+        return out_box.valid();
+    }
+
+    // finds the leaf holding a feature, optionally pruning by its extent.
+    Node* findLeaf( Node* node, const Feature* feature, const Box* box ) const
+    {
+        if ( box && !node->box.contains(*box) )
+            return 0L;
+
+        if ( node->leaf )
+        {
+            for( unsigned i=0; i<node->entries.size(); ++i )
+                if ( node->entries[i].feature == feature )
+                    return node;
+            return 0L;
+        }
+
+        for( unsigned i=0; i<node->children.size(); ++i )
+        {
+            Node* leaf = findLeaf( node->children[i], feature, box );
+            if ( leaf )
+                return leaf;
+        }
+        return 0L;
+    }
+
+    // splits a node in half along the longer axis of its box.
+    void split( Node* node )
+    {
+        bool alongX = (node->box.xmax - node->box.xmin) >= (node->box.ymax - node->box.ymin);
+
+        Node* sibling = new Node();
+        sibling->leaf = node->leaf;
+
+        if ( node->leaf )
+        {
+            if ( alongX ) std::sort( node->entries.begin(), node->entries.end(), LessEntryX() );
+            else          std::sort( node->entries.begin(), node->entries.end(), LessEntryY() );
+            unsigned half = node->entries.size()/2;
+            sibling->entries.assign( node->entries.begin()+half, node->entries.end() );
+            node->entries.resize( half );
+        }
+        else
+        {
+            if ( alongX ) std::sort( node->children.begin(), node->children.end(), LessNodeX() );
+            else          std::sort( node->children.begin(), node->children.end(), LessNodeY() );
+            unsigned half = node->children.size()/2;
+            sibling->children.assign( node->children.begin()+half, node->children.end() );
+            node->children.resize( half );
+            for( unsigned i=0; i<sibling->children.size(); ++i )
+                sibling->children[i]->parent = sibling;
+        }
+
+        node->recomputeBox();
+        sibling->recomputeBox();
+
+        if ( !node->parent )
+        {
+            // grow a new root.
+            Node* root = new Node();
+            root->leaf = false;
+            root->children.push_back( node );
+            node->parent = root;
+            _root = root;
+        }
+
+        sibling->parent = node->parent;
+        node->parent->children.push_back( sibling );
+        node->parent->recomputeBox();
+    }
+};
+
+//------------------------------------------------------------------------
 
 FeatureListSource::FeatureListSource():
-FeatureSource()
+FeatureSource(),
+_index       ( 0L )
 {
     //nop
 }
 
 FeatureListSource::FeatureListSource(const GeoExtent& defaultExtent ) :
 FeatureSource (),
-_defaultExtent( defaultExtent )
+_defaultExtent( defaultExtent ),
+_index        ( 0L )
 {
     //nop
 }
 
+FeatureListSource::~FeatureListSource()
+{
+    delete _index;
+}
+
+namespace
+{
+    // The processing filters in osgEarth can modify the features as they are operating
+    // and we don't want our original data destroyed. Shallow copies share the geometry
+    // until a filter asks to modify it, and then clone it.
+    void shallowCopy( const FeatureList& input, FeatureList& output )
+    {
+        for (FeatureList::const_iterator itr = input.begin(); itr != input.end(); ++itr)
+        {
+            Feature* feature = new osgEarth::Features::Feature(*(itr->get()), osg::CopyOp::SHALLOW_COPY);
+            output.push_back( feature );
+        }
+    }
+}
+
 FeatureCursor*
 FeatureListSource::createFeatureCursor( const Symbology::Query& query )
 {
-    //Create a copy of all of the features before returning the cursor.
-    //The processing filters in osgEarth can modify the features as they are operating and we don't want our original data destroyed.
     FeatureList cursorFeatures;
-    for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
+
+    if ( query.bounds().isSet() )
+    {
+        FeatureList hits;
+        bool found = false;
+        {
+            ScopedReadLock shared( _indexMutex );
+            if ( _index && inSyncWith(_indexRevision) )
+            {
+                _index->query( query.bounds().get(), hits );
+                found = true;
+            }
+        }
+
+        if ( !found )
+        {
+            // rebuild the index, since the source changed behind our back (i.e.,
+            // someone called dirty() after editing the features directly).
+            ScopedWriteLock exclusive( _indexMutex );
+            if ( !_index || outOfSyncWith(_indexRevision) )
+            {
+                if ( !_index )
+                    _index = new Index();
+                _index->build( _features );
+                sync( _indexRevision );
+            }
+            _index->query( query.bounds().get(), hits );
+        }
+
+        shallowCopy( hits, cursorFeatures );
+    }
+    else
     {
-        Feature* feature = new osgEarth::Features::Feature(*(itr->get()), osg::CopyOp::DEEP_COPY_ALL);        
-        cursorFeatures.push_back( feature );
-    }    
+        // a concurrent insert or delete must not change the list while we copy it.
+        ScopedReadLock shared( _indexMutex );
+        shallowCopy( _features, cursorFeatures );
+    }
+
     return new FeatureListCursor( cursorFeatures );
 }
 
@@ -53,6 +472,7 @@ FeatureListSource::createFeatureProfile()
     const SpatialReference* srs = 0L;
     osgEarth::Bounds        bounds;
 
+    ScopedReadLock shared( _indexMutex );
     if ( !_features.empty() )
     {
         // Get the SRS of the first feature
@@ -80,12 +500,22 @@ bool
 FeatureListSource::deleteFeature(FeatureID fid)
 {
     dirtyFeatureProfile();
+
+    ScopedWriteLock exclusive( _indexMutex );
     for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
     {
         if (itr->get()->getFID() == fid)
         {
+            // update the index in place, unless it's due for a rebuild anyway.
+            bool indexInSync = _index && inSyncWith(_indexRevision);
+            if ( indexInSync && !_index->remove(itr->get()) )
+                indexInSync = false;
+
             _features.erase( itr );
             dirty();
+
+            if ( indexInSync )
+                sync( _indexRevision );
             return true;
         }
     }
@@ -95,6 +525,7 @@ FeatureListSource::deleteFeature(FeatureID fid)
 Feature*
 FeatureListSource::getFeature( FeatureID fid )
 {
+    ScopedReadLock shared( _indexMutex );
     for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr) 
     {
         if (itr->get()->getFID() == fid)
@@ -108,7 +539,19 @@ FeatureListSource::getFeature( FeatureID fid )
 bool FeatureListSource::insertFeature(Feature* feature)
 {
     dirtyFeatureProfile();
+
+    ScopedWriteLock exclusive( _indexMutex );
+
+    // update the index in place, unless it's due for a rebuild anyway.
+    bool indexInSync = _index && inSyncWith(_indexRevision);
+
     _features.push_back( feature );
+    if ( indexInSync )
+        _index->insert( feature );
+
     dirty();
+
+    if ( indexInSync )
+        sync( _indexRevision );
     return true;
 }
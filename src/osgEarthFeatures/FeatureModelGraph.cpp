@@ -30,14 +30,19 @@
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarthSymbology/MeshConsolidator>
 
 #include <osg/CullFace>
+#include <osg/MatrixTransform>
 #include <osg/PagedLOD>
 #include <osg/ProxyNode>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReaderWriter>
 #include <osgDB/WriteFile>
 #include <osgUtil/Optimizer>
+#include <climits>
+#include <set>
+#include <typeinfo>
 
 #define LC "[FeatureModelGraph] "
 
@@ -191,6 +196,140 @@ namespace
             node->getOrCreateStateSet()->addUniform( u );
         }
     };
+
+
+    /**
+     * Merges the nodes compiled from the chunks of one working set, so they
+     * render like the set compiled in one piece: the drawables of plain geodes
+     * move into one geode per state set (the first one found, in chunk order),
+     * which is then consolidated. A plain geode sits under nothing but groups
+     * and translations (each chunk is localized to its own center), with no
+     * state or callbacks on the way; its vertices are shifted into the target
+     * geode's frame. Geodes with named (pickable) drawables stay where they are.
+     */
+    class ChunkMerger : public osg::NodeVisitor
+    {
+    public:
+        ChunkMerger() : osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN ) { }
+
+        /** Merges a chunk's node; returns false if nothing is left of it. */
+        bool merge( osg::Node* chunk )
+        {
+            _emptied.clear();
+            chunk->accept( *this );
+
+            // detach the emptied geodes, and any groups they leave empty.
+            for( unsigned e = 0; e < _emptied.size(); ++e )
+            {
+                osg::NodePath& path = _emptied[e];
+                for( int n = (int)path.size()-1; n > 0; --n )
+                {
+                    osg::Group* parent = path[n-1]->asGroup();
+                    parent->removeChild( path[n] );
+                    if ( parent->getNumChildren() > 0 )
+                        break;
+                }
+            }
+
+            osg::Geode* geode = chunk->asGeode();
+            osg::Group* group = chunk->asGroup();
+            return geode ? geode->getNumDrawables() > 0 : group ? group->getNumChildren() > 0 : true;
+        }
+
+        /** Consolidates the geodes that received drawables from other chunks. */
+        void consolidate()
+        {
+            for( std::set<osg::Geode*>::iterator i = _merged.begin(); i != _merged.end(); ++i )
+                MeshConsolidator::run( **i );
+            _merged.clear();
+            _targets.clear();
+        }
+
+        void apply( osg::Geode& geode )
+        {
+            osg::Vec3d offset;
+            if ( !isPlain(geode, offset) )
+                return;
+
+            Target& target = _targets[geode.getStateSet()];
+            if ( !target.geode.valid() )
+            {
+                target.geode  = &geode;
+                target.offset = offset;
+                return;
+            }
+
+            osg::Vec3 shift = offset - target.offset;
+            for( unsigned i = 0; i < geode.getNumDrawables(); ++i )
+            {
+                osg::Drawable* drawable = geode.getDrawable( i );
+                if ( shift != osg::Vec3() )
+                {
+                    osg::Vec3Array* verts = static_cast<osg::Vec3Array*>( drawable->asGeometry()->getVertexArray() );
+                    for( osg::Vec3Array::iterator v = verts->begin(); v != verts->end(); ++v )
+                        *v += shift;
+                    verts->dirty();
+                    drawable->dirtyBound();
+                    drawable->dirtyDisplayList();
+                }
+                target.geode->addDrawable( drawable );
+            }
+            geode.removeDrawables( 0, geode.getNumDrawables() );
+
+            _merged.insert( target.geode.get() );
+            _emptied.push_back( getNodePath() );
+        }
+
+    protected:
+        bool isPlain( osg::Geode& geode, osg::Vec3d& out_offset ) const
+        {
+            if ( typeid(geode) != typeid(osg::Geode) || geode.getUpdateCallback() || geode.getCullCallback() )
+                return false;
+
+            for( unsigned i = 0; i < geode.getNumDrawables(); ++i )
+            {
+                osg::Drawable* drawable = geode.getDrawable( i );
+                osg::Geometry* geom = drawable->asGeometry();
+                if ( !drawable->getName().empty() || !geom || !dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) )
+                    return false;
+            }
+
+            out_offset.set( 0, 0, 0 );
+            const osg::NodePath& path = getNodePath();
+            for( unsigned n = 0; n+1 < path.size(); ++n )
+            {
+                osg::Node* node = path[n];
+                if ( node->getStateSet() || node->getUpdateCallback() || node->getCullCallback() )
+                    return false;
+
+                if ( typeid(*node) == typeid(osg::MatrixTransform) )
+                {
+                    osg::MatrixTransform* xform = static_cast<osg::MatrixTransform*>( node );
+                    const osg::Matrixd& m = xform->getMatrix();
+                    if ( xform->getReferenceFrame() != osg::Transform::RELATIVE_RF ||
+                         osg::Matrixd::translate(m.getTrans()) != m )
+                        return false;
+                    out_offset += m.getTrans();
+                }
+                else if ( typeid(*node) != typeid(osg::Group) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        struct Target
+        {
+            osg::ref_ptr<osg::Geode> geode;
+            osg::Vec3d               offset;
+        };
+        typedef std::map<osg::StateSet*, Target> Targets;
+
+        Targets                    _targets;
+        std::set<osg::Geode*>      _merged;
+        std::vector<osg::NodePath> _emptied;
+    };
 }
 
 
@@ -304,6 +443,13 @@ _overlayChange     ( OVERLAY_NO_CHANGE )
         OE_INFO << LC << "Added fading post-merge operation" << std::endl;
     }
 
+    // a thread pool for compiling style groups in parallel, if requested.
+    if ( _options.compileThreads().isSet() && *_options.compileThreads() > 0 )
+    {
+        _compileService = new TaskService( "FeatureModelGraph compiler", *_options.compileThreads() );
+        OE_INFO << LC << "Compiling with " << *_options.compileThreads() << " threads" << std::endl;
+    }
+
     ADJUST_EVENT_TRAV_COUNT( this, 1 );
 
     redraw();
@@ -963,11 +1109,15 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
         }
     }
 
-    // next create a style group per bin.
+    // next resolve the style of each bin.
+    std::vector<Style>       styles;
+    std::vector<FeatureList> workingSets;
+    styles.reserve( styleBins.size() );
+    workingSets.reserve( styleBins.size() );
+
     for( std::map<std::string,FeatureList>::iterator i = styleBins.begin(); i != styleBins.end(); ++i )
     {
         const std::string& styleString = i->first;
-        FeatureList&       workingSet  = i->second;
 
         // resolve the style:
         Style combinedStyle;
@@ -988,11 +1138,13 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
                 combinedStyle = *selectedStyle;
         }
 
-        // create the node and add it.
-        osg::Group* styleGroup = createStyleGroup(combinedStyle, workingSet, context);
-        if ( styleGroup )
-            parent->addChild( styleGroup );
+        styles.push_back( combinedStyle );
+        workingSets.push_back( FeatureList() );
+        workingSets.back().swap( i->second );
     }
+
+    // and create a style group per bin.
+    createStyleGroups( styles, workingSets, context, parent );
 }
 
 
@@ -1003,6 +1155,36 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
 {
     osg::Group* styleGroup = 0L;
 
+    osg::ref_ptr<osg::Node> node;
+    if ( compileFeatures( style, workingSet, contextPrototype, node ) )
+    {
+        styleGroup = _factory->getOrCreateStyleGroup( style, _session.get() );
+
+        // if it returned a node, add it. (it doesn't necessarily have to)
+        if ( node.valid() )
+            styleGroup->addChild( node.get() );
+    }
+
+    // Check the style and see if we need to active GPU clamping. GPU clamping
+    // is currently all-or-nothing for a single FMG.
+    if ( workingSet.size() > 0 )
+        checkForGlobalAltitudeStyles( style );
+
+    return styleGroup;
+}
+
+
+/**
+ * Crops a working set and compiles it into a node. Returns true if the
+ * factory succeeded (though it may not produce a node). This may run on a
+ * compile thread, so it must not touch the graph's state.
+ */
+bool
+FeatureModelGraph::compileFeatures(const Style&             style,
+                                   FeatureList&             workingSet,
+                                   const FilterContext&     contextPrototype,
+                                   osg::ref_ptr<osg::Node>& output)
+{
     FilterContext context(contextPrototype);
 
     // first Crop the feature set to the working extent:
@@ -1026,25 +1208,133 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
     // finally, compile the features into a node.
     if ( workingSet.size() > 0 )
     {
-        osg::ref_ptr<osg::Node> node;
         osg::ref_ptr<FeatureCursor> newCursor = new FeatureListCursor(workingSet);
+        return _factory->createOrUpdateNode( newCursor.get(), style, context, output );
+    }
+
+    return false;
+}
+
+
+/**
+ * Compiles one chunk of a working set on the compile service.
+ */
+struct FeatureModelGraph::CompileTask
+{
+    CompileTask() : _graph(0L), _style(0L), _ok(false) { }
+
+    void execute()
+    {
+        _ok = _graph->compileFeatures( *_style, _workingSet, _context, _node );
+    }
+
+    FeatureModelGraph*      _graph;
+    const Style*            _style;
+    FeatureList             _workingSet;
+    FilterContext           _context;
+    osg::ref_ptr<osg::Node> _node;
+    bool                    _ok;
+};
 
-        if ( _factory->createOrUpdateNode( newCursor.get(), style, context, node ) )
-        {
-            if ( !styleGroup )
-                styleGroup = _factory->getOrCreateStyleGroup( style, _session.get() );
 
-            // if it returned a node, add it. (it doesn't necessarily have to)
-            if ( node.valid() )
-                styleGroup->addChild( node.get() );
+/**
+ * Creates a style group for each working set and adds it to the parent. With a
+ * compile service, the working sets are split into chunks that compile in
+ * parallel; the results are put together in working set and chunk order, so
+ * the output does not depend on the order in which the tasks finish, and the
+ * chunks of each working set are merged back into one set of geodes.
+ */
+void
+FeatureModelGraph::createStyleGroups(const std::vector<Style>& styles,
+                                     std::vector<FeatureList>& workingSets,
+                                     const FilterContext&      contextPrototype,
+                                     osg::Group*               parent)
+{
+    if ( !_compileService.valid() )
+    {
+        for( unsigned i = 0; i < workingSets.size(); ++i )
+        {
+            osg::Group* styleGroup = createStyleGroup( styles[i], workingSets[i], contextPrototype );
+            if ( styleGroup )
+                parent->addChild( styleGroup );
         }
+        return;
+    }
 
-        // Check the style and see if we need to active GPU clamping. GPU clamping
-        // is currently all-or-nothing for a single FMG.
-        checkForGlobalAltitudeStyles( style );
+    unsigned chunkSize = *_options.compileChunkSize() > 0 ? *_options.compileChunkSize() : UINT_MAX;
+
+    // count the tasks up front; the semaphore needs to know.
+    unsigned numTasks = 0;
+    for( unsigned i = 0; i < workingSets.size(); ++i )
+    {
+        unsigned size = workingSets[i].size();
+        numTasks += size / chunkSize + (size % chunkSize > 0 ? 1 : 0);
     }
 
-    return styleGroup;
+    if ( numTasks == 0 )
+        return;
+
+    typedef ParallelTask<CompileTask> Task;
+    std::vector< osg::ref_ptr<Task> > tasks;
+    std::vector<unsigned>             taskWorkingSet;
+    tasks.reserve( numTasks );
+    taskWorkingSet.reserve( numTasks );
+
+    Threading::MultiEvent semaphore( numTasks );
+
+    for( unsigned i = 0; i < workingSets.size(); ++i )
+    {
+        FeatureList::iterator f = workingSets[i].begin();
+        while( f != workingSets[i].end() )
+        {
+            Task* task = new Task( &semaphore );
+            task->_graph   = this;
+            task->_style   = &styles[i];
+            task->_context = contextPrototype;
+            for( unsigned n = 0; n < chunkSize && f != workingSets[i].end(); ++n, ++f )
+                task->_workingSet.push_back( *f );
+
+            tasks.push_back( task );
+            taskWorkingSet.push_back( i );
+        }
+    }
+
+    for( unsigned t = 0; t < tasks.size(); ++t )
+        _compileService->add( tasks[t].get() );
+
+    semaphore.wait();
+
+    // put the results together in order, one working set at a time. The chunks of
+    // a working set are merged here, on the calling thread.
+    unsigned t = 0;
+    while( t < tasks.size() )
+    {
+        unsigned i = taskWorkingSet[t];
+
+        osg::Group* styleGroup = 0L;
+        ChunkMerger merger;
+
+        for( ; t < tasks.size() && taskWorkingSet[t] == i; ++t )
+        {
+            CompileTask& task = *tasks[t].get();
+            if ( task._ok )
+            {
+                if ( !styleGroup )
+                {
+                    styleGroup = _factory->getOrCreateStyleGroup( styles[i], _session.get() );
+                    parent->addChild( styleGroup );
+                }
+
+                if ( task._node.valid() && merger.merge(task._node.get()) )
+                    styleGroup->addChild( task._node.get() );
+            }
+
+            if ( task._workingSet.size() > 0 )
+                checkForGlobalAltitudeStyles( styles[i] );
+        }
+
+        merger.consolidate();
+    }
 }
 
 
@@ -1077,7 +1367,26 @@ FeatureModelGraph::createStyleGroup(const Style&        style,
         FeatureList workingSet;
         cursor->fill( workingSet );
 
-        styleGroup = createStyleGroup(style, workingSet, context);
+        if ( _compileService.valid() )
+        {
+            // compile the working set in chunks on the compile service.
+            std::vector<Style>       styles( 1, style );
+            std::vector<FeatureList> workingSets( 1 );
+            workingSets[0].swap( workingSet );
+
+            osg::ref_ptr<osg::Group> holder = new osg::Group();
+            createStyleGroups( styles, workingSets, context, holder.get() );
+            if ( holder->getNumChildren() > 0 )
+            {
+                osg::ref_ptr<osg::Group> result = holder->getChild(0)->asGroup();
+                holder->removeChildren( 0, holder->getNumChildren() );
+                styleGroup = result.release();
+            }
+        }
+        else
+        {
+            styleGroup = createStyleGroup(style, workingSet, context);
+        }
     }
 
 
@@ -36,7 +36,9 @@ _maxGranularity_deg( 1.0 ),
 _mergeGeometry     ( false ),
 _clusterCulling    ( true ),
 _backfaceCulling   ( true ),
-_alphaBlending     ( true )
+_alphaBlending     ( true ),
+_compileThreads    ( 0 ),
+_compileChunkSize  ( 0 )
 {
     fromConfig( _conf );
 }
@@ -61,6 +63,8 @@ FeatureModelSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "cluster_culling",  _clusterCulling );
     conf.getIfSet( "backface_culling", _backfaceCulling );
     conf.getIfSet( "alpha_blending",   _alphaBlending );
+    conf.getIfSet( "compile_threads",    _compileThreads );
+    conf.getIfSet( "compile_chunk_size", _compileChunkSize );
 
 }
 
@@ -87,6 +91,8 @@ FeatureModelSourceOptions::getConfig() const
     conf.updateIfSet( "cluster_culling",  _clusterCulling );
     conf.updateIfSet( "backface_culling", _backfaceCulling );
     conf.updateIfSet( "alpha_blending",   _alphaBlending );
+    conf.updateIfSet( "compile_threads",    _compileThreads );
+    conf.updateIfSet( "compile_chunk_size", _compileChunkSize );
 
     return conf;
 }
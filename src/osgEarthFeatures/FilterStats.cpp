@@ -0,0 +1,293 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FilterStats>
+#include <osgEarth/JsonUtils>
+#include <osg/Geometry>
+#include <osg/Geode>
+#include <cstdlib>
+
+#define LC "[FilterStats] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    struct CountVertices : public osg::NodeVisitor
+    {
+        unsigned long _count;
+
+        CountVertices() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN), _count(0) { }
+
+        void apply( osg::Geode& geode )
+        {
+            for( unsigned i=0; i<geode.getNumDrawables(); ++i )
+            {
+                osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+                if ( geom && geom->getVertexArray() )
+                    _count += geom->getVertexArray()->getNumElements();
+            }
+        }
+    };
+
+    Json::Value stageToJSON( const FilterStats::Stage& stage )
+    {
+        Json::Value value( Json::objectValue );
+        value["calls"]        = (Json::UInt)stage.calls;
+        value["seconds"]      = stage.seconds;
+        value["features_in"]  = (double)stage.featuresIn;
+        value["features_out"] = (double)stage.featuresOut;
+        value["vertices_in"]  = (double)stage.verticesIn;
+        value["vertices_out"] = (double)stage.verticesOut;
+        return value;
+    }
+}
+
+//------------------------------------------------------------------------
+
+void
+FilterStats::Stage::accumulate( const Stage& rhs )
+{
+    calls       += rhs.calls;
+    seconds     += rhs.seconds;
+    featuresIn  += rhs.featuresIn;
+    featuresOut += rhs.featuresOut;
+    verticesIn  += rhs.verticesIn;
+    verticesOut += rhs.verticesOut;
+}
+
+//------------------------------------------------------------------------
+
+FilterStats::Probe::Probe( Record* record, const std::string& stage, const FeatureList& input ) :
+_record( record ),
+_stats ( 0L ),
+_name  ( stage )
+{
+    if ( _record )
+        start( input.size(), countVertices(input) );
+}
+
+FilterStats::Probe::Probe( FilterStats* stats, const std::string& stage, const FeatureList& input ) :
+_record( 0L ),
+_stats ( stats && stats->isEnabled() ? stats : 0L ),
+_name  ( stage )
+{
+    if ( _stats )
+        start( input.size(), countVertices(input) );
+}
+
+FilterStats::Probe::Probe( FilterStats* stats, const std::string& stage, osg::Node* input, const std::string& parent ) :
+_record( 0L ),
+_stats ( stats && stats->isEnabled() ? stats : 0L ),
+_name  ( stage ),
+_parent( parent )
+{
+    if ( _stats )
+        start( 0, countVertices(input) );
+}
+
+void
+FilterStats::Probe::start( unsigned long featuresIn, unsigned long verticesIn )
+{
+    _stage.calls      = 1;
+    _stage.featuresIn = featuresIn;
+    _stage.verticesIn = verticesIn;
+
+    // start the clock after counting the input.
+    _start = osg::Timer::instance()->tick();
+}
+
+void
+FilterStats::Probe::finish( const FeatureList& output, osg::Node* node )
+{
+    if ( _record || _stats )
+    {
+        double seconds = osg::Timer::instance()->delta_s( _start, osg::Timer::instance()->tick() );
+        _stage.seconds = seconds;
+        finish( output.size(), node ? countVertices(node) : countVertices(output) );
+    }
+}
+
+void
+FilterStats::Probe::finish( osg::Node* output )
+{
+    if ( _record || _stats )
+    {
+        double seconds = osg::Timer::instance()->delta_s( _start, osg::Timer::instance()->tick() );
+        _stage.seconds = seconds;
+        finish( 0, countVertices(output) );
+    }
+}
+
+void
+FilterStats::Probe::finish( unsigned long featuresOut, unsigned long verticesOut )
+{
+    _stage.featuresOut = featuresOut;
+    _stage.verticesOut = verticesOut;
+
+    if ( _record )
+        _record->stages.push_back( std::make_pair(_name, _stage) );
+    else
+        _stats->add( _name, _stage, _parent );
+
+    // only record once.
+    _record = 0L;
+    _stats  = 0L;
+}
+
+//------------------------------------------------------------------------
+
+FilterStats::FilterStats() :
+_enabled   ( ::getenv("OSGEARTH_FILTER_STATS") != 0L ),
+_maxRecords( 100 )
+{
+    //nop
+}
+
+void
+FilterStats::setMaxRecords( unsigned value )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _maxRecords = value;
+    while( _records.size() > _maxRecords )
+        _records.pop_front();
+}
+
+void
+FilterStats::add( const Record& record )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    for( Stages::const_iterator i = record.stages.begin(); i != record.stages.end(); ++i )
+        _totals[i->first].accumulate( i->second );
+
+    if ( _maxRecords > 0 )
+    {
+        _records.push_back( record );
+        if ( _records.size() > _maxRecords )
+            _records.pop_front();
+    }
+}
+
+void
+FilterStats::add( const std::string& stage, const Stage& sample, const std::string& parent )
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _totals[stage].accumulate( sample );
+    if ( !parent.empty() )
+        _includedIn[stage].insert( parent );
+}
+
+void
+FilterStats::getTotals( std::map<std::string, Stage>& out_totals ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    out_totals = _totals;
+}
+
+void
+FilterStats::getRecords( std::vector<Record>& out_records ) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    out_records.assign( _records.begin(), _records.end() );
+}
+
+void
+FilterStats::reset()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _totals.clear();
+    _includedIn.clear();
+    _records.clear();
+}
+
+std::string
+FilterStats::toJSON() const
+{
+    Json::Value root( Json::objectValue );
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    Json::Value totals( Json::objectValue );
+    for( std::map<std::string, Stage>::const_iterator i = _totals.begin(); i != _totals.end(); ++i )
+    {
+        Json::Value stage = stageToJSON( i->second );
+
+        // nested stages: their time is already counted in their parents'.
+        std::map<std::string, std::set<std::string> >::const_iterator p = _includedIn.find( i->first );
+        if ( p != _includedIn.end() )
+        {
+            Json::Value parents( Json::arrayValue );
+            for( std::set<std::string>::const_iterator j = p->second.begin(); j != p->second.end(); ++j )
+                parents.append( *j );
+            stage["included_in"] = parents;
+        }
+
+        totals[i->first] = stage;
+    }
+    root["totals"] = totals;
+
+    Json::Value records( Json::arrayValue );
+    for( std::list<Record>::const_iterator r = _records.begin(); r != _records.end(); ++r )
+    {
+        Json::Value record( Json::objectValue );
+        record["name"] = r->name;
+
+        Json::Value stages( Json::arrayValue );
+        for( Stages::const_iterator i = r->stages.begin(); i != r->stages.end(); ++i )
+        {
+            Json::Value stage = stageToJSON( i->second );
+            stage["stage"] = i->first;
+            stages.append( stage );
+        }
+        record["stages"] = stages;
+
+        records.append( record );
+    }
+    root["records"] = records;
+
+    return Json::FastWriter().write( root );
+}
+
+unsigned long
+FilterStats::countVertices( const FeatureList& features )
+{
+    unsigned long count = 0;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        // use the const accessor so shared geometry stays shared.
+        const Feature* f = i->get();
+        if ( f && f->getGeometry() )
+            count += f->getGeometry()->getTotalPointCount();
+    }
+    return count;
+}
+
+unsigned long
+FilterStats::countVertices( osg::Node* node )
+{
+    if ( !node )
+        return 0;
+
+    CountVertices visitor;
+    node->accept( visitor );
+    return visitor._count;
+}
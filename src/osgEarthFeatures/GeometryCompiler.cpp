@@ -22,6 +22,7 @@
 #include <osgEarthFeatures/AltitudeFilter>
 #include <osgEarthFeatures/CentroidFilter>
 #include <osgEarthFeatures/ExtrudeGeometryFilter>
+#include <osgEarthFeatures/FilterStats>
 #include <osgEarthFeatures/ScatterFilter>
 #include <osgEarthFeatures/SubstituteModelFilter>
 #include <osgEarthFeatures/TessellateOperator>
@@ -173,11 +174,6 @@ GeometryCompiler::compile(FeatureList&          workingSet,
                           const Style&          style,
                           const FilterContext&  context)
 {
-#ifdef PROFILING
-    osg::Timer_t p_start = osg::Timer::instance()->tick();
-    unsigned p_features = workingSet.size();
-#endif
-
     osg::ref_ptr<osg::Group> resultGroup = new osg::Group();
 
     // create a filter context that will track feature data through the process
@@ -187,6 +183,16 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         sharedCX.extent() = sharedCX.profile()->getExtent();
     }
 
+    // collect per-stage stats for this compilation if the session wants them.
+    osg::ref_ptr<FilterStats> stats = sharedCX.getSession() ? sharedCX.getSession()->getFilterStats() : 0L;
+    FilterStats::Record  statsRecord;
+    FilterStats::Record* record = stats.valid() && stats->isEnabled() ? &statsRecord : 0L;
+    if ( record && sharedCX.extent().isSet() )
+    {
+        statsRecord.name = sharedCX.extent()->toString();
+    }
+    FilterStats::Probe compileProbe( record, "compile", workingSet );
+
     // only localize coordinates if the map is geocentric AND the extent is
     // less than 180 degrees.
     bool localize = false;
@@ -213,7 +219,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     {
         TemplateFeatureFilter<TessellateOperator> filter;
         filter.setNumPartitions( *line->tessellation() );
+        FilterStats::Probe probe( record, "tessellate", workingSet );
         sharedCX = filter.push( workingSet, sharedCX );
+        probe.finish( workingSet );
     }
 
     // if the style was empty, use some defaults based on the geometry type of the
@@ -248,7 +256,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             resample.maxLength() = *_options.resampleMaxLength();
         }                   
-        sharedCX = resample.push( workingSet, sharedCX );        
+        FilterStats::Probe probe( record, "resample", workingSet );
+        sharedCX = resample.push( workingSet, sharedCX );
+        probe.finish( workingSet );
     }    
     
     // check whether we need to do elevation clamping:
@@ -272,19 +282,25 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             scatter.setDensity( *marker->density() );
             scatter.setRandom( marker->placement() == MarkerSymbol::PLACEMENT_RANDOM );
             scatter.setRandomSeed( *marker->randomSeed() );
+            FilterStats::Probe probe( record, "scatter", workingSet );
             markerCX = scatter.push( workingSet, markerCX );
+            probe.finish( workingSet );
         }
         else if ( marker->placement() == MarkerSymbol::PLACEMENT_CENTROID )
         {
             CentroidFilter centroid;
+            FilterStats::Probe probe( record, "centroid", workingSet );
             centroid.push( workingSet, markerCX );
+            probe.finish( workingSet );
         }
 
         if ( altRequired )
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
+            FilterStats::Probe probe( record, "altitude", workingSet );
             markerCX = clamp.push( workingSet, markerCX );
+            probe.finish( workingSet );
 
             // don't set this; we changed the input data.
             //altRequired = false;
@@ -299,7 +315,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.featureName().isSet() )
             sub.setFeatureNameExpr( *_options.featureName() );
 
+        FilterStats::Probe probe( record, "substitute_model", workingSet );
         osg::Node* node = sub.push( workingSet, markerCX );
+        probe.finish( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -321,19 +339,25 @@ GeometryCompiler::compile(FeatureList&          workingSet,
             scatter.setDensity( *instance->density() );
             scatter.setRandom( instance->placement() == InstanceSymbol::PLACEMENT_RANDOM );
             scatter.setRandomSeed( *instance->randomSeed() );
+            FilterStats::Probe probe( record, "scatter", workingSet );
             localCX = scatter.push( workingSet, localCX );
+            probe.finish( workingSet );
         }
         else if ( instance->placement() == InstanceSymbol::PLACEMENT_CENTROID )
         {
             CentroidFilter centroid;
+            FilterStats::Probe probe( record, "centroid", workingSet );
             centroid.push( workingSet, localCX );
+            probe.finish( workingSet );
         }
 
         if ( altRequired )
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
+            FilterStats::Probe probe( record, "altitude", workingSet );
             localCX = clamp.push( workingSet, localCX );
+            probe.finish( workingSet );
 
             // don't set this; we changed the input data.
             //altRequired = false;
@@ -351,7 +375,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.featureName().isSet() )
             sub.setFeatureNameExpr( *_options.featureName() );
 
+        FilterStats::Probe probe( record, "substitute_model", workingSet );
         osg::Node* node = sub.push( workingSet, localCX );
+        probe.finish( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -365,7 +391,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
+            FilterStats::Probe probe( record, "altitude", workingSet );
             sharedCX = clamp.push( workingSet, sharedCX );
+            probe.finish( workingSet );
             altRequired = false;
         }
 
@@ -376,7 +404,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.featureName().isSet() )
             extrude.setFeatureNameExpr( *_options.featureName() );
 
+        FilterStats::Probe probe( record, "extrude", workingSet );
         osg::Node* node = extrude.push( workingSet, sharedCX );
+        probe.finish( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -390,7 +420,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
+            FilterStats::Probe probe( record, "altitude", workingSet );
             sharedCX = clamp.push( workingSet, sharedCX );
+            probe.finish( workingSet );
             altRequired = false;
         }
 
@@ -406,7 +438,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.useVertexBufferObjects().isSet())
             filter.useVertexBufferObjects() = *_options.useVertexBufferObjects();
 
+        FilterStats::Probe probe( record, "build_geometry", workingSet );
         osg::Node* node = filter.push( workingSet, sharedCX );
+        probe.finish( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -419,12 +453,16 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         {
             AltitudeFilter clamp;
             clamp.setPropertiesFromStyle( style );
+            FilterStats::Probe probe( record, "altitude", workingSet );
             sharedCX = clamp.push( workingSet, sharedCX );
+            probe.finish( workingSet );
             altRequired = false;
         }
 
         BuildTextFilter filter( style );
+        FilterStats::Probe probe( record, "build_text", workingSet );
         osg::Node* node = filter.push( workingSet, sharedCX );
+        probe.finish( workingSet, node );
         if ( node )
         {
             resultGroup->addChild( node );
@@ -444,7 +482,9 @@ GeometryCompiler::compile(FeatureList&          workingSet,
         if ( _options.shaderPolicy() == SHADERPOLICY_GENERATE )
         {
             ShaderGenerator gen( 0L );
+            FilterStats::Probe probe( record, "shader_generation", workingSet );
             resultGroup->accept( gen );
+            probe.finish( workingSet, resultGroup.get() );
         }
         else if ( _options.shaderPolicy() == SHADERPOLICY_DISABLE )
         {
@@ -455,7 +495,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     }
 
     // Optimize stateset sharing.
-    sscache->optimize( resultGroup.get() );
+    {
+        FilterStats::Probe probe( record, "stateset_optimization", workingSet );
+        sscache->optimize( resultGroup.get() );
+        probe.finish( workingSet, resultGroup.get() );
+    }
     
     // todo: this helps a lot, but is currently broken for non-triangle
     // geometries. (gw, 12-17-2012)
@@ -471,12 +515,11 @@ GeometryCompiler::compile(FeatureList&          workingSet,
 
     //osgDB::writeNodeFile( *(resultGroup.get()), "out.osg" );
 
-#ifdef PROFILING
-    osg::Timer_t p_end = osg::Timer::instance()->tick();
-    OE_INFO << LC
-        << "features = " << p_features <<
-        << " ,time = " << osg::Timer::instance()->delta_s(p_start, p_end) << " s." << std::endl;
-#endif
+    if ( record )
+    {
+        compileProbe.finish( workingSet, resultGroup.get() );
+        stats->add( statsRecord );
+    }
 
     return resultGroup.release();
 }
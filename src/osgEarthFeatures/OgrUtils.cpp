@@ -17,6 +17,8 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarthFeatures/OgrUtils>
+#include <gdal.h>
+#include <algorithm>
 
 #define LC "[FeatureSource] "
 
@@ -263,6 +265,35 @@ OGRGeometryH
 Feature*
     OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
 {
+    osg::ref_ptr<AttributeSchema> schema = createAttributeSchema( OGR_F_GetDefnRef(handle) );
+    return createFeature( handle, srs, schema.get() );
+}
+
+AttributeSchema*
+OgrUtils::createAttributeSchema( OGRFeatureDefnH defn )
+{
+    std::vector<std::string> names;
+
+    int numFields = defn ? OGR_FD_GetFieldCount( defn ) : 0;
+    names.reserve( numFields );
+    for( int i = 0; i < numFields; ++i )
+    {
+        // field names are stored in lower case:
+        OGRFieldDefnH field_handle_ref = OGR_FD_GetFieldDefn( defn, i );
+        std::string name = std::string( OGR_Fld_GetNameRef( field_handle_ref ) );
+        std::transform( name.begin(), name.end(), name.begin(), ::tolower );
+        names.push_back( name );
+    }
+
+    return new AttributeSchema( names );
+}
+
+Feature*
+    OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, const AttributeSchema* schema )
+{
+    if ( !schema )
+        return createFeature( handle, srs );
+
     long fid = OGR_F_GetFID( handle );
 
     OGRGeometryH geomRef = OGR_F_GetGeometryRef( handle );	
@@ -275,16 +306,19 @@ Feature*
     }
 
     Feature* feature = new Feature( geom, srs, Style(), fid );
+    feature->setSchema( schema );
 
-    int numAttrs = OGR_F_GetFieldCount(handle); 
+    // slot i in the schema is field i:
+    int numAttrs = std::min( OGR_F_GetFieldCount(handle), (int)schema->size() );
     for (int i = 0; i < numAttrs; ++i) 
     { 
         OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i ); 
 
-        // get the field name and convert to lower case:
-        const char* field_name = OGR_Fld_GetNameRef( field_handle_ref ); 
-        std::string name = std::string( field_name ); 
-        std::transform( name.begin(), name.end(), name.begin(), ::tolower ); 
+#if GDAL_VERSION_NUM >= 1800
+        // skip fields that the query's attribute projection left out:
+        if ( OGR_Fld_IsIgnored( field_handle_ref ) )
+            continue;
+#endif
 
         // get the field type and set the value appropriately
         OGRFieldType field_type = OGR_Fld_GetType( field_handle_ref );        
@@ -295,11 +329,11 @@ Feature*
                 if (OGR_F_IsFieldSet( handle, i ))
                 {
                     int value = OGR_F_GetFieldAsInteger( handle, i );
-                    feature->set( name, value );                    
+                    feature->setAt( i, value );                    
                 }
                 else
                 {
-                    feature->setNull( name, ATTRTYPE_INT );
+                    feature->setNullAt( i, ATTRTYPE_INT );
                 }
             }
             break;
@@ -308,11 +342,11 @@ Feature*
                 if (OGR_F_IsFieldSet( handle, i ))
                 {
                     double value = OGR_F_GetFieldAsDouble( handle, i );
-                    feature->set( name, value );
+                    feature->setAt( i, value );
                 }
                 else
                 {
-                    feature->setNull( name, ATTRTYPE_DOUBLE );
+                    feature->setNullAt( i, ATTRTYPE_DOUBLE );
                 }
             }
             break;
@@ -321,11 +355,11 @@ Feature*
                 if (OGR_F_IsFieldSet( handle, i ))
                 {
                     const char* value = OGR_F_GetFieldAsString(handle, i);
-                    feature->set( name, std::string(value) );
+                    feature->setAt( i, std::string(value) );
                 }
                 else
                 {
-                    feature->setNull( name, ATTRTYPE_STRING );
+                    feature->setNullAt( i, ATTRTYPE_STRING );
                 }
             }
         }
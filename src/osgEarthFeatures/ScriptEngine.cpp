@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/Feature>
 #include <osgEarth/Notify>
 #include <osgEarth/Registry>
 #include <osgDB/ReadFile>
@@ -66,6 +67,34 @@ ScriptEngineOptions::getConfig() const
 
 //------------------------------------------------------------------------
 
+bool
+ScriptEngine::run(const std::string& code, const FeatureList& features, std::vector<ScriptResult>& out_results, FilterContext const* context)
+{
+    out_results.clear();
+    out_results.reserve( features.size() );
+
+    bool anySucceeded = false;
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        out_results.push_back( run(code, i->get(), context) );
+        anySucceeded = anySucceeded || out_results.back().success();
+    }
+    return anySucceeded || features.empty();
+}
+
+bool
+ScriptEngine::run(Script* script, const FeatureList& features, std::vector<ScriptResult>& out_results, FilterContext const* context)
+{
+    if ( !script )
+    {
+        out_results.assign( features.size(), ScriptResult(EMPTY_STRING, false, "Script is null.") );
+        return false;
+    }
+    return run( script->getCode(), features, out_results, context );
+}
+
+//------------------------------------------------------------------------
+
 #undef  LC
 #define LC "[ScriptEngineFactory] "
 #define SCRIPT_ENGINE_OPTIONS_TAG "__osgEarth::Features::ScriptEngineOptions"
@@ -21,6 +21,7 @@
 #include <osgEarthFeatures/Script>
 #include <osgEarthFeatures/ScriptEngine>
 #include <osgEarthFeatures/FeatureSource>
+#include <osgEarthFeatures/FilterStats>
 #include <osgEarth/FileUtils>
 #include <osgEarth/StringUtils>
 #include <osg/AutoTransform>
@@ -52,10 +53,16 @@ _dbOptions     ( dbOptions )
 
     // a new cache to optimize state changes.
     _stateSetCache = new StateSetCache();
+
+    _filterStats = new FilterStats();
 }
 
 Session::~Session()
 {
+    if ( _filterStats->isEnabled() )
+    {
+        OE_INFO << LC << "Filter stats: " << _filterStats->toJSON() << std::endl;
+    }
 }
 
 const osgDB::Options*
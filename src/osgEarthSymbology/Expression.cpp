@@ -38,7 +38,8 @@ _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
-_dirty( rhs._dirty )
+_dirty( rhs._dirty ),
+_stackDepth( rhs._stackDepth )
 {
     //nop
 }
@@ -72,12 +73,14 @@ NumericExpression::getConfig() const
 }
 
 #define IS_OPERATOR(a) ( a .first == ADD || a .first == SUB || a .first == MULT || a .first == DIV || a .first == MOD )
+#define IS_BINARY(a)   ( IS_OPERATOR(a) || a .first == MIN || a .first == MAX )
 
 void
 NumericExpression::init()
 {
     _vars.clear();
     _rpn.clear();
+    _binding = ExpressionBinding();
 
     StringTokenizer variablesTokenizer( "", "" );
     variablesTokenizer.addDelims( "[]", true );
@@ -243,6 +246,17 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    // find the deepest the stack can get, so eval() can use a fixed-size one.
+    unsigned depth = 0;
+    _stackDepth = 0;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        if ( !IS_BINARY(_rpn[i]) )
+            _stackDepth = std::max( _stackDepth, ++depth );
+        else if ( depth >= 2 )
+            --depth;
+    }
 }
 
 void 
@@ -261,82 +275,41 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
-
-        for( unsigned i=0; i<_rpn.size(); ++i )
+        // evaluate on a fixed-size stack; most expressions fit in the local buffer.
+        double              local[16];
+        std::vector<double> heap;
+        double*             s = local;
+        if ( _stackDepth > 16 )
         {
-            const Atom& a = _rpn[i];
+            heap.resize( _stackDepth );
+            s = &heap[0];
+        }
+        unsigned n = 0;
 
-            if ( a.first == ADD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
+        for( AtomVector::const_iterator a = _rpn.begin(); a != _rpn.end(); ++a )
+        {
+            if ( !IS_BINARY((*a)) )
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::min(op1, op2) );
-                }
+                s[n++] = a->second; // OPERAND or VARIABLE
             }
-            else if ( a.first == MAX )
+            else if ( n >= 2 )
             {
-                if ( s.size() >= 2 )
+                double op2 = s[--n];
+                double& op1 = s[n-1];
+                switch( a->first )
                 {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::max(op1, op2) );
+                case ADD:  op1 = op1 + op2; break;
+                case SUB:  op1 = op1 - op2; break;
+                case MULT: op1 = op1 * op2; break;
+                case DIV:  op1 = op1 / op2; break;
+                case MOD:  op1 = fmod(op1, op2); break;
+                case MIN:  op1 = std::min(op1, op2); break;
+                default:   op1 = std::max(op1, op2); break; // MAX
                 }
             }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
-            }
         }
 
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
+        const_cast<NumericExpression*>(this)->_value = n > 0 ? s[n-1] : 0.0;
         const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
@@ -413,6 +386,8 @@ StringExpression::getConfig() const
 void
 StringExpression::init()
 {
+    _binding = ExpressionBinding();
+
     bool inQuotes = false;
     int inVar = 0;
     int startPos = 0;
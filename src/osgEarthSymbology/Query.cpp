@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthSymbology/Query>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
@@ -36,6 +37,12 @@ Query::mergeConfig( const Config& conf )
 
     conf.getIfSet("orderby", _orderby);
 
+    if ( conf.hasValue("attributes") )
+    {
+        _attributes.clear();
+        StringTokenizer( conf.value("attributes"), _attributes, " ,", "'\"", false, true );
+    }
+
     Config b = conf.child( "extent" );
     if( !b.empty() )
     {
@@ -53,6 +60,14 @@ Query::getConfig() const
     Config conf( "query" );
     conf.addIfSet( "expr", _expression );
     conf.addIfSet( "orderby", _orderby);
+    if ( !_attributes.empty() ) {
+        std::stringstream buf;
+        for( StringVector::const_iterator i = _attributes.begin(); i != _attributes.end(); ++i )
+            buf << (i != _attributes.begin() ? " " : "") << *i;
+        std::string str;
+        str = buf.str();
+        conf.add( "attributes", str );
+    }
     if ( _bounds.isSet() ) {
         Config bc( "extent" );
         bc.add( "xmin", toString(_bounds->xMin()) );
@@ -91,6 +106,18 @@ Query::combineWith( const Query& rhs ) const
         merged.expression() = *_expression;
     }
 
+    // merge the attribute lists. An empty list means "all attributes", so if
+    // either query needs them all, so does the merged one:
+    if ( !_attributes.empty() && !rhs.attributes().empty() )
+    {
+        merged.attributes() = _attributes;
+        for( StringVector::const_iterator i = rhs.attributes().begin(); i != rhs.attributes().end(); ++i )
+        {
+            if ( std::find(merged.attributes().begin(), merged.attributes().end(), *i) == merged.attributes().end() )
+                merged.attributes().push_back( *i );
+        }
+    }
+
     // tilekey overrides bounds:
     if ( _tileKey.isSet() )
     {
@@ -22,278 +22,778 @@
 #include <osgEarth/ImageToHeightFieldConverter>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
 #include <osgDB/WriteFile>
+#include <OpenThreads/Condition>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Thread>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#ifdef OSGEARTH_HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
 
 #define LC "[TMSPackager] "
 
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
+//------------------------------------------------------------------------
 
-TMSPackager::TMSPackager(const Profile* outProfile, osgDB::Options* imageWriteOptions) :
-_outProfile         ( outProfile ),
-_maxLevel           ( 99 ),
-_verbose            ( false ),
-_overwrite          ( false ),
-_keepEmptyImageTiles( false ),
-_subdivideSingleColorImageTiles ( false ),
-_abortOnError       ( true ),
-_imageWriteOptions  (imageWriteOptions)
+namespace
 {
-    //nop
-}
-
+    typedef OpenThreads::ScopedLock<OpenThreads::Mutex> ScopedLock;
+
+    /**
+     * FIFO that holds at most "capacity" items. push() blocks while the queue
+     * is full and pop() blocks while it is empty, until the queue is closed.
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        BoundedQueue( unsigned capacity ) : _capacity(capacity), _closed(false) { }
 
-void
-TMSPackager::addExtent( const GeoExtent& extent )
-{
-    _extents.push_back(extent);
-}
+        // returns false if the queue was closed before the item fit.
+        bool push( const T& item )
+        {
+            ScopedLock lock( _mutex );
+            while( _queue.size() >= _capacity && !_closed )
+                _notFull.wait( &_mutex );
+            if ( _closed )
+                return false;
+            _queue.push_back( item );
+            _notEmpty.signal();
+            return true;
+        }
 
+        // returns false once the queue is closed and drained.
+        bool pop( T& out )
+        {
+            ScopedLock lock( _mutex );
+            while( _queue.empty() && !_closed )
+                _notEmpty.wait( &_mutex );
+            if ( _queue.empty() )
+                return false;
+            out = _queue.front();
+            _queue.pop_front();
+            _notFull.signal();
+            return true;
+        }
 
-bool
-TMSPackager::shouldPackageKey( const TileKey& key ) const
-{
-    // if there are no extent filters, or we're at a sufficiently low level, 
-    // always package the key.
-    if ( _extents.size() == 0 || key.getLevelOfDetail() <= 1 )
-        return true;
+        // no more pushes; optionally throws away what's left.
+        void close( bool discard =false )
+        {
+            ScopedLock lock( _mutex );
+            _closed = true;
+            if ( discard )
+                _queue.clear();
+            _notEmpty.broadcast();
+            _notFull.broadcast();
+        }
 
-    // check for intersection with one of the filter extents.
-    for( std::vector<GeoExtent>::const_iterator i = _extents.begin(); i != _extents.end(); ++i )
+    private:
+        unsigned               _capacity;
+        bool                   _closed;
+        std::deque<T>          _queue;
+        OpenThreads::Mutex     _mutex;
+        OpenThreads::Condition _notEmpty;
+        OpenThreads::Condition _notFull;
+    };
+
+    /** A tile making its way through the pipeline. */
+    struct PackagedTile
     {
-        if ( i->intersects( key.getExtent() ) )
-            return true;
+        PackagedTile() : _subdivide(false) { }
+        TileKey                  _key;
+        osg::ref_ptr<osg::Image> _image;
+        std::string              _data;
+        bool                     _subdivide; // whether to visit the children once written
+    };
+
+    /** Row of a tile in the TMS (and MBTiles) scheme, which counts from the bottom. */
+    unsigned getTMSRow( const TileKey& key )
+    {
+        unsigned w, h;
+        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+        return h - key.getTileY() - 1;
     }
 
-    return false;
-}
+    /** Writes tiles to a TMS folder structure. */
+    class FileTileSink : public TMSPackager::TileSink
+    {
+    public:
+        FileTileSink( const std::string& rootDir, const std::string& extension ) :
+          _rootDir  ( rootDir ),
+          _extension( extension ) { }
 
+        bool exists( const TileKey& key )
+        {
+            return osgDB::fileExists( getPath(key) );
+        }
 
-TMSPackager::Result
-TMSPackager::packageImageTile(ImageLayer*          layer,
-                              const TileKey&       key,
-                              const std::string&   rootDir,
-                              const std::string&   extension,
-                              unsigned&            out_maxLevel )
-{
-    unsigned minLevel = layer->getImageLayerOptions().minLevel().isSet() ?
-        *layer->getImageLayerOptions().minLevel() : 0;
-    
+        bool write( const TileKey& key, const std::string& data )
+        {
+            std::string path = getPath( key );
+            osgDB::makeDirectoryForFile( path );
+            std::ofstream out( path.c_str(), std::ios::out | std::ios::binary );
+            if ( !out.is_open() )
+                return false;
+            out.write( data.c_str(), data.size() );
+            return !out.fail();
+        }
 
-    if ( shouldPackageKey(key) && key.getLevelOfDetail() >= minLevel )
-    {
-        unsigned w, h;
-        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+    private:
+        std::string getPath( const TileKey& key ) const
+        {
+            return Stringify() 
+                << _rootDir 
+                << "/" << key.getLevelOfDetail() 
+                << "/" << key.getTileX() 
+                << "/" << getTMSRow(key)
+                << "." << _extension;
+        }
 
-        std::string path = Stringify() 
-            << rootDir 
-            << "/" << key.getLevelOfDetail() 
-            << "/" << key.getTileX() 
-            << "/" << h - key.getTileY() - 1
-            << "." << extension;
+        std::string _rootDir;
+        std::string _extension;
+    };
 
-        bool isSingleColor = false;
-        bool tileOK = osgDB::fileExists(path) && !_overwrite;
-        if ( !tileOK )
+#ifdef OSGEARTH_HAVE_SQLITE3
+
+    /**
+     * Writes tiles to an MBTiles database, committing a transaction every
+     * "batchSize" tiles and reusing one prepared insert statement.
+     */
+    class MBTilesTileSink : public TMSPackager::TileSink
+    {
+    public:
+        MBTilesTileSink( unsigned batchSize ) :
+          _database ( 0L ),
+          _insert   ( 0L ),
+          _batchSize( batchSize ),
+          _batched  ( 0 ) { }
+
+        ~MBTilesTileSink()
+        {
+            if ( _insert )
+                sqlite3_finalize( _insert );
+            if ( _database )
+                sqlite3_close( _database );
+        }
+
+        bool open( const std::string& filename, bool loadExisting )
         {
-            GeoImage image = layer->createImage( key );
-            if ( image.valid() )
+            osgDB::makeDirectoryForFile( filename );
+
+            int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+            if ( sqlite3_open_v2(filename.c_str(), &_database, flags, 0L) != SQLITE_OK )
             {
-                // Check for single color
-                if ( !_subdivideSingleColorImageTiles )
-                {
-                    isSingleColor = ImageUtils::isSingleColorImage(image.getImage());
-                    if ( _verbose )
-                    {
-                        OE_NOTICE << LC << "Not subdividing single color tile " << key.str() << std::endl;
-                    }
-                }
+                OE_WARN << LC << "Failed to open database \"" << filename << "\": " << sqlite3_errmsg(_database) << std::endl;
+                return false;
+            }
+
+            // the writes are transactional anyway, so skip the per-commit fsyncs.
+            if ( !exec("PRAGMA synchronous=OFF") ||
+                 !exec("CREATE TABLE IF NOT EXISTS metadata (name text, value text)") ||
+                 !exec("CREATE TABLE IF NOT EXISTS tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob)") ||
+                 !exec("CREATE UNIQUE INDEX IF NOT EXISTS tile_index on tiles (zoom_level, tile_column, tile_row)") )
+            {
+                return false;
+            }
 
-                // check for empty:
-                if ( !_keepEmptyImageTiles && ImageUtils::isEmptyImage(image.getImage()) )
+            if ( loadExisting )
+            {
+                sqlite3_stmt* select = 0L;
+                std::string query = "SELECT zoom_level, tile_column, tile_row FROM tiles";
+                if ( sqlite3_prepare_v2(_database, query.c_str(), -1, &select, 0L) != SQLITE_OK )
                 {
-                    if ( _verbose )
-                    {
-                        OE_NOTICE << LC << "Skipping empty tile " << key.str() << std::endl;
-                    }
+                    OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+                    return false;
                 }
-                else
+                while( sqlite3_step(select) == SQLITE_ROW )
                 {
-                    // convert to RGB if necessary
-                    osg::ref_ptr<osg::Image> final = image.getImage();
-                    if ( extension == "jpg" && final->getPixelFormat() != GL_RGB )
-                        final = ImageUtils::convertToRGB8( image.getImage() );
+                    _existing.insert( TileID(
+                        sqlite3_column_int(select, 0),
+                        sqlite3_column_int(select, 1),
+                        sqlite3_column_int(select, 2)) );
+                }
+                sqlite3_finalize( select );
+            }
 
-                    // dump it to disk
-                    osgDB::makeDirectoryForFile( path );
-                    tileOK = osgDB::writeImageFile( *final.get(), path, _imageWriteOptions);
+            std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+            if ( sqlite3_prepare_v2(_database, query.c_str(), -1, &_insert, 0L) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+                return false;
+            }
 
-                    if ( _verbose )
-                    {
-                        if ( tileOK ) {
-                            OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
-                        }
-                        else {
-                            OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
-                        }
-                    }
+            return true;
+        }
 
-                    if ( _abortOnError && !tileOK )
-                    {
-                        return Result( Stringify() << "Aborting, write failed for tile " << key.str() );
-                    }
-                }
-            }
+        bool exists( const TileKey& key )
+        {
+            return _existing.find( TileID(key.getLevelOfDetail(), key.getTileX(), getTMSRow(key)) ) != _existing.end();
         }
-        else
+
+        bool write( const TileKey& key, const std::string& data )
         {
-            if ( _verbose )
+            if ( _batched == 0 && !exec("BEGIN TRANSACTION") )
+                return false;
+
+            sqlite3_bind_int ( _insert, 1, key.getLevelOfDetail() );
+            sqlite3_bind_int ( _insert, 2, key.getTileX() );
+            sqlite3_bind_int ( _insert, 3, getTMSRow(key) );
+            sqlite3_bind_blob( _insert, 4, data.c_str(), data.size(), SQLITE_STATIC );
+
+            int rc = sqlite3_step( _insert );
+            sqlite3_reset( _insert );
+            if ( rc != SQLITE_DONE )
             {
-                OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
+                OE_WARN << LC << "Failed to insert tile " << key.str() << ": " << sqlite3_errmsg(_database) << std::endl;
+                return false;
             }
+
+            if ( ++_batched >= _batchSize )
+                return commit();
+
+            return true;
         }
 
-        // increment the maximum detected tile level:
-        if ( tileOK && key.getLevelOfDetail() > out_maxLevel )
+        bool close()
         {
-            out_maxLevel = key.getLevelOfDetail();
+            return commit();
         }
 
-        // see if subdivision should continue.
-        unsigned lod = key.getLevelOfDetail();
-        const ImageLayerOptions& options = layer->getImageLayerOptions();
+        void setMetaData( const std::string& name, const std::string& value )
+        {
+            sqlite3_stmt* stmt = 0L;
 
-        unsigned layerMaxLevel = (options.maxLevel().isSet()? *options.maxLevel() : 99);
-        unsigned maxLevel = std::min(_maxLevel, layerMaxLevel);
-        bool subdivide =
-            (options.minLevel().isSet() && lod < *options.minLevel()) ||
-            (tileOK && lod+1 < maxLevel);
+            std::string query = "DELETE FROM metadata WHERE name = ?";
+            if ( sqlite3_prepare_v2(_database, query.c_str(), -1, &stmt, 0L) == SQLITE_OK )
+            {
+                sqlite3_bind_text( stmt, 1, name.c_str(), name.length(), SQLITE_STATIC );
+                sqlite3_step( stmt );
+                sqlite3_finalize( stmt );
+            }
+
+            query = "INSERT INTO metadata (name, value) VALUES (?, ?)";
+            if ( sqlite3_prepare_v2(_database, query.c_str(), -1, &stmt, 0L) == SQLITE_OK )
+            {
+                sqlite3_bind_text( stmt, 1, name.c_str(), name.length(), SQLITE_STATIC );
+                sqlite3_bind_text( stmt, 2, value.c_str(), value.length(), SQLITE_STATIC );
+                sqlite3_step( stmt );
+                sqlite3_finalize( stmt );
+            }
+            else
+            {
+                OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+            }
+        }
 
-        // subdivide if necessary:
-        if ( (subdivide == true) && (isSingleColor == false) )
+    private:
+        bool exec( const std::string& sql )
         {
-            for( unsigned q=0; q<4; ++q )
+            char* err = 0L;
+            if ( sqlite3_exec(_database, sql.c_str(), 0L, 0L, &err) != SQLITE_OK )
             {
-                TileKey childKey = key.createChildKey(q);
-                Result r = packageImageTile( layer, childKey, rootDir, extension, out_maxLevel );
-                if ( _abortOnError && !r.ok )
-                    return r;
+                OE_WARN << LC << "SQL failed: " << sql << "; " << (err ? err : "") << std::endl;
+                sqlite3_free( err );
+                return false;
             }
+            return true;
         }
-    }
 
-    return Result();
+        bool commit()
+        {
+            if ( _batched == 0 )
+                return true;
+            _batched = 0;
+            return exec( "COMMIT TRANSACTION" );
+        }
+
+        struct TileID
+        {
+            TileID( int z, int x, int y ) : _z(z), _x(x), _y(y) { }
+            bool operator < (const TileID& rhs) const {
+                if ( _z != rhs._z ) return _z < rhs._z;
+                if ( _x != rhs._x ) return _x < rhs._x;
+                return _y < rhs._y;
+            }
+            int _z, _x, _y;
+        };
+
+        sqlite3*         _database;
+        sqlite3_stmt*    _insert;
+        unsigned         _batchSize;
+        unsigned         _batched;
+        std::set<TileID> _existing;
+    };
+
+#endif // OSGEARTH_HAVE_SQLITE3
 }
 
+//------------------------------------------------------------------------
 
-TMSPackager::Result
-TMSPackager::packageElevationTile(ElevationLayer*      layer,
-                                  const TileKey&       key,
-                                  const std::string&   rootDir,
-                                  const std::string&   extension,
-                                  unsigned&            out_maxLevel)
+/**
+ * Fetches, encodes, and writes the tiles of one layer. Each stage runs on its
+ * own threads and hands tiles to the next stage through a bounded queue.
+ */
+class TMSPackager::Pipeline
 {
-    unsigned minLevel = layer->getElevationLayerOptions().minLevel().isSet() ?
-        *layer->getElevationLayerOptions().minLevel() : 0;
+public:
+    Pipeline(const TMSPackager&  packager,
+             TerrainLayer*       layer,
+             TileSink*           sink,
+             const std::string&  extension,
+             const std::string&  scratchFolder ) :
+      _packager    ( packager ),
+      _imageLayer  ( dynamic_cast<ImageLayer*>(layer) ),
+      _elevLayer   ( dynamic_cast<ElevationLayer*>(layer) ),
+      _sink        ( sink ),
+      _extension   ( extension ),
+      _scratchFolder( scratchFolder ),
+      _encodeQueue ( packager._maxQueuedTiles ),
+      _writeQueue  ( packager._maxQueuedTiles ),
+      _pending     ( 0 ),
+      _aborted     ( false ),
+      _outMaxLevel ( 0 )
+    {
+        const TerrainLayerOptions& options = layer->getTerrainLayerRuntimeOptions();
+        _minLevel = options.minLevel().isSet() ? *options.minLevel() : 0;
+        _maxLevel = std::min( _packager._maxLevel, options.maxLevel().isSet() ? *options.maxLevel() : 99u );
+
+        _rw = osgDB::Registry::instance()->getReaderWriterForExtension( extension );
+    }
 
-    if ( shouldPackageKey(key) && key.getLevelOfDetail() >= minLevel )
+    Result run( const std::vector<TileKey>& rootKeys, unsigned& out_maxLevel )
     {
-        unsigned w, h;
-        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+        if ( !_rw )
+            return Result( Stringify() << "No image writer found for extension \"" << _extension << "\"" );
 
-        std::string path = Stringify() 
-            << rootDir 
-            << "/" << key.getLevelOfDetail() 
-            << "/" << key.getTileX() 
-            << "/" << h - key.getTileY() - 1
-            << "." << extension;
+        _keys.insert( _keys.end(), rootKeys.rbegin(), rootKeys.rend() );
+        _pending = _keys.size();
 
-        bool tileOK = osgDB::fileExists(path) && !_overwrite;
-        if ( !tileOK )
+        std::vector<Stage*> fetchers, encoders;
+        for( unsigned i = 0; i < _packager._numThreads; ++i )
         {
+            fetchers.push_back( new Stage(this, &Pipeline::fetchLoop) );
+            fetchers.back()->start();
+            encoders.push_back( new Stage(this, &Pipeline::encodeLoop) );
+            encoders.back()->start();
+        }
+        Stage writer( this, &Pipeline::writeLoop );
+        writer.start();
+
+        // shut the stages down in order, so that each drains its input queue.
+        join( fetchers );
+        _encodeQueue.close();
+        join( encoders );
+        _writeQueue.close();
+        writer.join();
 
-            GeoHeightField hf = layer->createHeightField( key );
-            if ( hf.valid() )
+        if ( !_sink->close() && !_aborted )
+            abort( "Failed to finish writing tiles" );
+
+        out_maxLevel = std::max( out_maxLevel, _outMaxLevel );
+
+        return _aborted ? Result( _abortMessage ) : Result();
+    }
+
+private:
+
+    typedef void (Pipeline::*Loop)();
+
+    struct Stage : public OpenThreads::Thread
+    {
+        Stage( Pipeline* pipeline, Loop loop ) : _pipeline(pipeline), _loop(loop) { }
+        void run() { (_pipeline->*_loop)(); }
+        Pipeline* _pipeline;
+        Loop      _loop;
+    };
+
+    void join( std::vector<Stage*>& stages )
+    {
+        for( std::vector<Stage*>::iterator i = stages.begin(); i != stages.end(); ++i )
+        {
+            (*i)->join();
+            delete *i;
+        }
+        stages.clear();
+    }
+
+    void abort( const std::string& message )
+    {
+        {
+            ScopedLock lock( _keysMutex );
+            if ( _aborted )
+                return;
+            _aborted = true;
+            _abortMessage = message;
+            _keysReady.broadcast();
+        }
+        _encodeQueue.close( true );
+        _writeQueue.close( true );
+    }
+
+    void updateMaxLevel( const TileKey& key )
+    {
+        ScopedLock lock( _maxLevelMutex );
+        if ( key.getLevelOfDetail() > _outMaxLevel )
+            _outMaxLevel = key.getLevelOfDetail();
+    }
+
+    // Stage 1: reads tiles from the layer and decides whether to subdivide.
+    // Keys come off a LIFO so the traversal stays roughly depth-first.
+    void fetchLoop()
+    {
+        for(;;)
+        {
+            TileKey key;
+            {
+                ScopedLock lock( _keysMutex );
+                while( _keys.empty() && _pending > 0 && !_aborted )
+                    _keysReady.wait( &_keysMutex );
+                if ( _keys.empty() || _aborted )
+                    return;
+                key = _keys.back();
+                _keys.pop_back();
+            }
+
+            std::vector<TileKey> children;
+            if ( fetch(key, children) )
             {
-                // convert the HF to an image
-                ImageToHeightFieldConverter conv;
-                osg::ref_ptr<osg::Image> image = conv.convert( hf.getHeightField() );
+                finish( children );
+            }
+        }
+    }
+
+    // Retires a key, queueing its children for traversal. A key handed to the
+    // encoder stays pending until its tile is written, so that traversal can't
+    // finish early and only a successful write leads to the children.
+    void finish( const std::vector<TileKey>& children )
+    {
+        ScopedLock lock( _keysMutex );
+        _keys.insert( _keys.end(), children.begin(), children.end() );
+        _pending += children.size();
+        --_pending;
+        if ( _pending == 0 || children.size() > 0 )
+            _keysReady.broadcast();
+    }
+
+    void finish( const PackagedTile& tile, bool written )
+    {
+        std::vector<TileKey> children;
+        if ( written && tile._subdivide )
+            getChildren( tile._key, children );
+        finish( children );
+    }
+
+    void getChildren( const TileKey& key, std::vector<TileKey>& out_children ) const
+    {
+        // reverse order, so the LIFO pops them in quadrant order.
+        for( int q=3; q>=0; --q )
+        {
+            out_children.push_back( key.createChildKey(q) );
+        }
+    }
+
+    // Returns false if the key went to the encoder; the write stage retires it.
+    bool fetch( const TileKey& key, std::vector<TileKey>& out_children )
+    {
+        if ( !_packager.shouldPackageKey(key) )
+            return true;
 
-                // dump it to disk
-                osgDB::makeDirectoryForFile( path );
-                tileOK = osgDB::writeImageFile( *image.get(), path );
+        unsigned lod = key.getLevelOfDetail();
+        bool tileOK = false;
+        bool isSingleColor = false;
 
-                if ( _verbose )
+        // below the layer's minimum level there's no data, but keep subdividing.
+        if ( lod >= _minLevel )
+        {
+            tileOK = !_packager._overwrite && _sink->exists(key);
+            if ( !tileOK )
+            {
+                PackagedTile tile;
+                tile._key = key;
+
+                if ( _imageLayer )
                 {
-                    if ( tileOK ) {
-                        OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
+                    GeoImage image = _imageLayer->createImage( key );
+                    if ( image.valid() )
+                    {
+                        // Check for single color
+                        if ( !_packager._subdivideSingleColorImageTiles )
+                        {
+                            isSingleColor = ImageUtils::isSingleColorImage(image.getImage());
+                            if ( isSingleColor && _packager._verbose )
+                            {
+                                OE_NOTICE << LC << "Not subdividing single color tile " << key.str() << std::endl;
+                            }
+                        }
+
+                        // check for empty:
+                        if ( !_packager._keepEmptyImageTiles && ImageUtils::isEmptyImage(image.getImage()) )
+                        {
+                            if ( _packager._verbose )
+                            {
+                                OE_NOTICE << LC << "Skipping empty tile " << key.str() << std::endl;
+                            }
+                        }
+                        else
+                        {
+                            tile._image = image.getImage();
+                        }
                     }
-                    else {
-                        OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
+                }
+                else if ( _elevLayer )
+                {
+                    GeoHeightField hf = _elevLayer->createHeightField( key );
+                    if ( hf.valid() )
+                    {
+                        // convert the HF to an image
+                        ImageToHeightFieldConverter conv;
+                        tile._image = conv.convert( hf.getHeightField() );
                     }
                 }
 
-                if ( _abortOnError && !tileOK )
+                if ( tile._image.valid() )
+                {
+                    // subdivision waits for the write to succeed.
+                    tile._subdivide = lod+1 < _maxLevel && !isSingleColor;
+                    if ( _encodeQueue.push(tile) )
+                        return false;
+                }
+            }
+            else
+            {
+                if ( _packager._verbose )
                 {
-                    return Result( Stringify() << "Aborting, write failed for tile " << key.str() );
+                    OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
                 }
+                updateMaxLevel( key );
             }
         }
-        else
+
+        // see if subdivision should continue.
+        bool subdivide =
+            (lod < _minLevel) ||
+            (tileOK && lod+1 < _maxLevel);
+
+        if ( subdivide && !isSingleColor )
+        {
+            getChildren( key, out_children );
+        }
+        return true;
+    }
+
+    // Stage 2: encodes the images into their output format.
+    void encodeLoop()
+    {
+        PackagedTile tile;
+        while( _encodeQueue.pop(tile) )
         {
-            if ( _verbose )
+            osg::ref_ptr<osg::Image> final = tile._image.get();
+
+            // convert to RGB if necessary
+            if ( _imageLayer && _extension == "jpg" && final->getPixelFormat() != GL_RGB )
+                final = ImageUtils::convertToRGB8( final.get() );
+
+            const osgDB::Options* options = _imageLayer ? _packager._imageWriteOptions.get() : 0L;
+
+            std::stringstream buf;
+            osgDB::ReaderWriter::WriteResult wr = _rw->writeImage( *final.get(), buf, options );
+
+            bool encoded = wr.success();
+            if ( encoded )
+                tile._data = buf.str();
+            else
+                encoded = encodeToFile( *final.get(), options, tile._key, tile._data );
+
+            tile._image = 0L;
+
+            if ( encoded )
             {
-                OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
+                if ( !_writeQueue.push(tile) )
+                    finish( tile, false );
+            }
+            else
+            {
+                OE_NOTICE << LC << "Error encoding tile " << tile._key.str() << std::endl;
+                if ( _packager._abortOnError )
+                    abort( Stringify() << "Aborting, encoding failed for tile " << tile._key.str() );
+                finish( tile, false );
             }
         }
+    }
 
-        // increment the maximum detected tile level:
-        if ( tileOK && key.getLevelOfDetail() > out_maxLevel )
+    // Some plugins (e.g. tiff) can't write to a stream. For those, write a
+    // scratch file and read the encoded bytes back.
+    bool encodeToFile( const osg::Image& image, const osgDB::Options* options, const TileKey& key, std::string& out_data ) const
+    {
+        std::string path = osgDB::concatPaths( _scratchFolder, Stringify()
+            << ".tmp_" << key.getLevelOfDetail() << "_" << key.getTileX() << "_" << key.getTileY() << "." << _extension );
+
+        bool ok = false;
+        if ( osgDB::writeImageFile(image, path, options) )
         {
-            out_maxLevel = key.getLevelOfDetail();
+            std::ifstream in( path.c_str(), std::ios::in | std::ios::binary );
+            if ( in.is_open() )
+            {
+                std::stringstream buf;
+                buf << in.rdbuf();
+                out_data = buf.str();
+                ok = !out_data.empty();
+            }
         }
+        ::remove( path.c_str() );
+        return ok;
+    }
 
-        // see if subdivision should continue.
-        unsigned lod = key.getLevelOfDetail();
-        const ElevationLayerOptions& options = layer->getElevationLayerOptions();
+    // Stage 3: writes the encoded tiles. There's only one of these, so the
+    // sink never sees concurrent writes.
+    void writeLoop()
+    {
+        PackagedTile tile;
+        while( _writeQueue.pop(tile) )
+        {
+            bool tileOK = _sink->write( tile._key, tile._data );
 
-        unsigned layerMaxLevel = (options.maxLevel().isSet()? *options.maxLevel() : 99);
-        unsigned maxLevel = std::min(_maxLevel, layerMaxLevel);
-        bool subdivide =
-            (options.minLevel().isSet() && lod < *options.minLevel()) ||
-            (tileOK && lod+1 < maxLevel);
+            if ( _packager._verbose )
+            {
+                if ( tileOK ) {
+                    OE_NOTICE << LC << "Wrote tile " << tile._key.str() << " (" << tile._key.getExtent().toString() << ")" << std::endl;
+                }
+                else {
+                    OE_NOTICE << LC << "Error write tile " << tile._key.str() << std::endl;
+                }
+            }
 
-        // subdivide if necessary:
-        if ( subdivide )
-        {
-            for( unsigned q=0; q<4; ++q )
+            if ( tileOK )
+            {
+                updateMaxLevel( tile._key );
+            }
+            else if ( _packager._abortOnError )
             {
-                TileKey childKey = key.createChildKey(q);
-                Result r = packageElevationTile( layer, childKey, rootDir, extension, out_maxLevel );
-                if ( _abortOnError && !r.ok )
-                    return r;
+                abort( Stringify() << "Aborting, write failed for tile " << tile._key.str() );
             }
+
+            finish( tile, tileOK );
         }
     }
 
-    return Result();
+private:
+    const TMSPackager&          _packager;
+    ImageLayer*                 _imageLayer;
+    ElevationLayer*             _elevLayer;
+    TileSink*                   _sink;
+    std::string                 _extension;
+    std::string                 _scratchFolder;
+    osgDB::ReaderWriter*        _rw;
+    unsigned                    _minLevel;
+    unsigned                    _maxLevel;
+
+    std::vector<TileKey>        _keys;
+    OpenThreads::Mutex          _keysMutex;
+    OpenThreads::Condition      _keysReady;
+    BoundedQueue<PackagedTile>  _encodeQueue;
+    BoundedQueue<PackagedTile>  _writeQueue;
+    unsigned                    _pending;
+
+    bool                        _aborted;
+    std::string                 _abortMessage;
+
+    unsigned                    _outMaxLevel;
+    OpenThreads::Mutex          _maxLevelMutex;
+};
+
+//------------------------------------------------------------------------
+
+TMSPackager::TMSPackager(const Profile* outProfile, osgDB::Options* imageWriteOptions) :
+_outProfile         ( outProfile ),
+_maxLevel           ( 99 ),
+_numThreads         ( 1 ),
+_maxQueuedTiles     ( 64 ),
+_mbtilesBatchSize   ( 256 ),
+_verbose            ( false ),
+_overwrite          ( false ),
+_keepEmptyImageTiles( false ),
+_subdivideSingleColorImageTiles ( false ),
+_abortOnError       ( true ),
+_imageWriteOptions  (imageWriteOptions)
+{
+    //nop
+}
+
+
+void
+TMSPackager::addExtent( const GeoExtent& extent )
+{
+    _extents.push_back(extent);
+}
+
+
+bool
+TMSPackager::supportsMBTiles()
+{
+#ifdef OSGEARTH_HAVE_SQLITE3
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool
+TMSPackager::shouldPackageKey( const TileKey& key ) const
+{
+    // if there are no extent filters, or we're at a sufficiently low level, 
+    // always package the key.
+    if ( _extents.size() == 0 || key.getLevelOfDetail() <= 1 )
+        return true;
+
+    // check for intersection with one of the filter extents.
+    for( std::vector<GeoExtent>::const_iterator i = _extents.begin(); i != _extents.end(); ++i )
+    {
+        if ( i->intersects( key.getExtent() ) )
+            return true;
+    }
+
+    return false;
 }
 
 
 TMSPackager::Result
-TMSPackager::package(ImageLayer*        layer,
-                     const std::string& rootFolder,
-                     const std::string& overrideExtension )
+TMSPackager::packageTiles(TerrainLayer*        layer,
+                          TileSink*            sink,
+                          const std::string&   extension,
+                          const std::string&   scratchFolder,
+                          unsigned&            out_maxLevel )
 {
-    if ( !layer || !_outProfile.valid() )
-        return Result( "Illegal null layer or profile" );
+    // collect the root tile keys in preparation for packaging:
+    std::vector<TileKey> rootKeys;
+    _outProfile->getRootKeys( rootKeys );
 
-    // attempt to create the output folder:
-    osgDB::makeDirectory( rootFolder );
-    if ( !osgDB::fileExists( rootFolder ) )
-        return Result( "Unable to create output folder" );
+    if ( rootKeys.size() == 0 )
+        return Result( "Unable to calculate root key set" );
+
+    Pipeline pipeline( *this, layer, sink, extension, scratchFolder );
+    return pipeline.run( rootKeys, out_maxLevel );
+}
 
+
+TMSPackager::Result
+TMSPackager::getImageFormat(ImageLayer*        layer,
+                            const std::string& overrideExtension,
+                            GeoImage&          out_testImage,
+                            std::string&       out_extension,
+                            std::string&       out_mimeType ) const
+{
     // collect the root tile keys in preparation for packaging:
     std::vector<TileKey> rootKeys;
     _outProfile->getRootKeys( rootKeys );
@@ -302,24 +802,22 @@ TMSPackager::package(ImageLayer*        layer,
         return Result( "Unable to calculate root key set" );
 
     // fetch one tile to see what the image size should be
-    
-    GeoImage testImage;
-    for( std::vector<TileKey>::iterator i = rootKeys.begin(); i != rootKeys.end() && !testImage.valid(); ++i )
+    for( std::vector<TileKey>::iterator i = rootKeys.begin(); i != rootKeys.end() && !out_testImage.valid(); ++i )
     {
-        testImage = layer->createImage( *i );
+        out_testImage = layer->createImage( *i );
     }
-    if ( !testImage.valid() )
+    if ( !out_testImage.valid() )
         return Result( "Unable to get a test image!" );
 
     // try to determine the image extension:
     std::string extension = overrideExtension;
 
-    if ( extension.empty() && testImage.valid() )
+    if ( extension.empty() && out_testImage.valid() )
     {
-        extension = toLower( osgDB::getFileExtension( testImage.getImage()->getFileName() ) );
+        extension = toLower( osgDB::getFileExtension( out_testImage.getImage()->getFileName() ) );
         if ( extension.empty() )
         {
-            if ( ImageUtils::hasAlphaChannel(testImage.getImage()) )
+            if ( ImageUtils::hasAlphaChannel(out_testImage.getImage()) )
             {
                 extension = "png";
             }
@@ -347,14 +845,37 @@ TMSPackager::package(ImageLayer*        layer,
         OE_NOTICE << LC << "MIME-TYPE = " << mimeType << ", Extension = " << extension << std::endl;
     }
 
+    out_extension = extension;
+    out_mimeType  = mimeType;
+    return Result();
+}
+
+
+TMSPackager::Result
+TMSPackager::package(ImageLayer*        layer,
+                     const std::string& rootFolder,
+                     const std::string& overrideExtension )
+{
+    if ( !layer || !_outProfile.valid() )
+        return Result( "Illegal null layer or profile" );
+
+    // attempt to create the output folder:
+    osgDB::makeDirectory( rootFolder );
+    if ( !osgDB::fileExists( rootFolder ) )
+        return Result( "Unable to create output folder" );
+
+    GeoImage    testImage;
+    std::string extension, mimeType;
+    Result r = getImageFormat( layer, overrideExtension, testImage, extension, mimeType );
+    if ( !r.ok )
+        return r;
+
     // package the tile hierarchy
     unsigned maxLevel = 0;
-    for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
-    {
-        Result r = packageImageTile( layer, *i, rootFolder, extension, maxLevel );
-        if ( _abortOnError && !r.ok )
-            return r;
-    }
+    osg::ref_ptr<TileSink> sink = new FileTileSink( rootFolder, extension );
+    r = packageTiles( layer, sink.get(), extension, rootFolder, maxLevel );
+    if ( _abortOnError && !r.ok )
+        return r;
 
     // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
@@ -412,12 +933,10 @@ TMSPackager::package(ElevationLayer*    layer,
         return Result( "Unable to determine heightfield size" );
 
     unsigned maxLevel = 0;
-    for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
-    {
-        Result r = packageElevationTile( layer, *i, rootFolder, extension, maxLevel );
-        if ( _abortOnError && !r.ok )
-            return r;
-    }
+    osg::ref_ptr<TileSink> sink = new FileTileSink( rootFolder, extension );
+    Result r = packageTiles( layer, sink.get(), extension, rootFolder, maxLevel );
+    if ( _abortOnError && !r.ok )
+        return r;
 
     // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
@@ -438,3 +957,70 @@ TMSPackager::package(ElevationLayer*    layer,
 
     return Result();
 }
+
+
+TMSPackager::Result
+TMSPackager::packageMBTiles(ImageLayer*        layer,
+                            const std::string& filename,
+                            const std::string& overrideExtension )
+{
+#ifdef OSGEARTH_HAVE_SQLITE3
+    if ( !layer || !_outProfile.valid() )
+        return Result( "Illegal null layer or profile" );
+
+    GeoImage    testImage;
+    std::string extension, mimeType;
+    Result r = getImageFormat( layer, overrideExtension, testImage, extension, mimeType );
+    if ( !r.ok )
+        return r;
+
+    osg::ref_ptr<MBTilesTileSink> sink = new MBTilesTileSink( _mbtilesBatchSize );
+    if ( !sink->open(filename, !_overwrite) )
+        return Result( Stringify() << "Unable to open MBTiles database \"" << filename << "\"" );
+
+    // package the tile hierarchy
+    unsigned maxLevel = 0;
+    std::string scratchFolder = osgDB::getFilePath( filename );
+    if ( scratchFolder.empty() )
+        scratchFolder = ".";
+    r = packageTiles( layer, sink.get(), extension, scratchFolder, maxLevel );
+    if ( _abortOnError && !r.ok )
+        return r;
+
+    // bounds are geographic: left,bottom,right,top.
+    GeoExtent bounds = _outProfile->getLatLongExtent();
+    if ( _extents.size() > 0 )
+    {
+        GeoExtent filter;
+        for( std::vector<GeoExtent>::const_iterator i = _extents.begin(); i != _extents.end(); ++i )
+        {
+            GeoExtent e = i->transform( bounds.getSRS() );
+            if ( !e.isValid() )
+                continue;
+            if ( !filter.isValid() )
+                filter = e;
+            else
+                filter.expandToInclude( e );
+        }
+        if ( filter.isValid() )
+            bounds = bounds.intersectionSameSRS( filter );
+    }
+
+    const TerrainLayerOptions& options = layer->getTerrainLayerRuntimeOptions();
+    unsigned minLevel = options.minLevel().isSet() ? *options.minLevel() : 0;
+
+    sink->setMetaData( "name",        layer->getName() );
+    sink->setMetaData( "type",        "baselayer" );
+    sink->setMetaData( "version",     "1.0.0" );
+    sink->setMetaData( "description", layer->getName() );
+    sink->setMetaData( "format",      extension );
+    sink->setMetaData( "bounds",      Stringify() << std::setprecision(10)
+        << bounds.xMin() << "," << bounds.yMin() << "," << bounds.xMax() << "," << bounds.yMax() );
+    sink->setMetaData( "minzoom",     Stringify() << std::min(minLevel, maxLevel) );
+    sink->setMetaData( "maxzoom",     Stringify() << maxLevel );
+
+    return Result();
+#else
+    return Result( "MBTiles output is not supported (osgEarth was built without SQLite3)" );
+#endif
+}